@@ -16,6 +16,9 @@
 
 #include "BranchListFile.h"
 
+#include <algorithm>
+#include <queue>
+
 #include "ETMDecoder.h"
 #include "system/extras/simpleperf/branch_list.pb.h"
 
@@ -44,6 +47,226 @@ std::vector<bool> ProtoStringToETMBranch(const std::string& s, size_t bit_size)
   return branch;
 }
 
+static constexpr uint64_t LONG_PATTERN_MASK = ~0ULL << FlatETMBranchMap::kMaxPackedBranches;
+static constexpr size_t MIN_TABLE_CAPACITY = 16;
+
+static inline bool IsLongPattern(uint64_t pattern) {
+  return (pattern & LONG_PATTERN_MASK) == LONG_PATTERN_MASK;
+}
+
+static inline size_t HashEntry(uint64_t addr, uint64_t pattern) {
+  uint64_t h = (addr ^ (pattern * 0x9e3779b97f4a7c15ULL)) * 0xbf58476d1ce4e5b9ULL;
+  return h ^ (h >> 31);
+}
+
+// Keep the load factor <= 3/4.
+static inline bool NeedGrow(size_t size, size_t capacity) {
+  return size * 4 > capacity * 3;
+}
+
+void FlatETMBranchMap::Reserve(size_t size) {
+  size_t capacity = std::max(table_.size(), MIN_TABLE_CAPACITY);
+  while (NeedGrow(size, capacity)) {
+    capacity *= 2;
+  }
+  if (capacity != table_.size()) {
+    Rehash(capacity);
+  }
+}
+
+void FlatETMBranchMap::Add(uint64_t addr, const std::vector<bool>& branch, uint64_t count) {
+  OverflowSafeAdd(FindOrInsert(addr, Pack(branch)).count, count);
+}
+
+void FlatETMBranchMap::Merge(const FlatETMBranchMap& other) {
+  for (const Entry& entry : other.table_) {
+    if (entry.pattern == 0) {
+      continue;
+    }
+    uint64_t pattern = entry.pattern;
+    if (IsLongPattern(pattern)) {
+      pattern = Pack(other.long_patterns_[pattern & ~LONG_PATTERN_MASK]);
+    }
+    OverflowSafeAdd(FindOrInsert(entry.addr, pattern).count, entry.count);
+  }
+}
+
+FlatETMBranchMap FlatETMBranchMap::MergeSorted(const std::vector<const FlatETMBranchMap*>& maps) {
+  std::vector<std::vector<Entry>> inputs;
+  inputs.reserve(maps.size());
+  for (const FlatETMBranchMap* map : maps) {
+    inputs.emplace_back(map->GetSortedEntries());
+  }
+  std::vector<size_t> pos(maps.size(), 0);
+  auto heap_cmp = [&](size_t i, size_t j) {
+    return CompareEntries(*maps[i], inputs[i][pos[i]], *maps[j], inputs[j][pos[j]]) > 0;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(heap_cmp)> heap(heap_cmp);
+  for (size_t i = 0; i < maps.size(); i++) {
+    if (!inputs[i].empty()) {
+      heap.push(i);
+    }
+  }
+
+  FlatETMBranchMap result;
+  std::vector<Entry> merged;
+  // The map and entry of the last merged entry, used to find equal entries from other maps.
+  const FlatETMBranchMap* last_map = nullptr;
+  const Entry* last_entry = nullptr;
+  while (!heap.empty()) {
+    size_t i = heap.top();
+    heap.pop();
+    const Entry& entry = inputs[i][pos[i]];
+    if (last_entry != nullptr && CompareEntries(*last_map, *last_entry, *maps[i], entry) == 0) {
+      OverflowSafeAdd(merged.back().count, entry.count);
+    } else {
+      merged.emplace_back(entry);
+      if (IsLongPattern(entry.pattern)) {
+        merged.back().pattern =
+            result.Pack(maps[i]->long_patterns_[entry.pattern & ~LONG_PATTERN_MASK]);
+      }
+      last_map = maps[i];
+      last_entry = &entry;
+    }
+    if (++pos[i] < inputs[i].size()) {
+      heap.push(i);
+    }
+  }
+
+  result.Reserve(merged.size());
+  for (const Entry& entry : merged) {
+    result.FindOrInsert(entry.addr, entry.pattern).count = entry.count;
+  }
+  return result;
+}
+
+void FlatETMBranchMap::ConvertAddrs(const std::function<uint64_t(uint64_t)>& convert_addr) {
+  std::vector<Entry> old_table(table_.size(), Entry{});
+  table_.swap(old_table);
+  size_ = 0;
+  for (const Entry& entry : old_table) {
+    if (entry.pattern != 0) {
+      OverflowSafeAdd(FindOrInsert(convert_addr(entry.addr), entry.pattern).count, entry.count);
+    }
+  }
+}
+
+void FlatETMBranchMap::ForEachSorted(const EntryCallback& callback) const {
+  std::vector<bool> branch;
+  for (const Entry& entry : GetSortedEntries()) {
+    Unpack(entry.pattern, branch);
+    callback(entry.addr, branch, entry.count);
+  }
+}
+
+ETMBranchMap FlatETMBranchMap::ToETMBranchMap() const {
+  ETMBranchMap result;
+  std::vector<bool> branch;
+  for (const Entry& entry : table_) {
+    if (entry.pattern != 0) {
+      Unpack(entry.pattern, branch);
+      result[entry.addr][branch] = entry.count;
+    }
+  }
+  return result;
+}
+
+uint64_t FlatETMBranchMap::Pack(const std::vector<bool>& branch) {
+  if (branch.size() <= kMaxPackedBranches) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < branch.size(); i++) {
+      if (branch[i]) {
+        bits |= 1ULL << i;
+      }
+    }
+    return (static_cast<uint64_t>(branch.size() + 1) << kMaxPackedBranches) | bits;
+  }
+  auto [it, inserted] = long_pattern_ids_.try_emplace(branch, long_patterns_.size());
+  if (inserted) {
+    long_patterns_.emplace_back(branch);
+  }
+  return LONG_PATTERN_MASK | it->second;
+}
+
+void FlatETMBranchMap::Unpack(uint64_t pattern, std::vector<bool>& branch) const {
+  if (IsLongPattern(pattern)) {
+    branch = long_patterns_[pattern & ~LONG_PATTERN_MASK];
+    return;
+  }
+  size_t size = (pattern >> kMaxPackedBranches) - 1;
+  branch.resize(size);
+  for (size_t i = 0; i < size; i++) {
+    branch[i] = (pattern >> i) & 1;
+  }
+}
+
+// Entries are ordered by addr, then by pattern. Packed patterns are compared by their packed
+// values, which are the same in all maps. Long patterns are after packed patterns, and are
+// compared by their branches.
+int FlatETMBranchMap::CompareEntries(const FlatETMBranchMap& map1, const Entry& entry1,
+                                     const FlatETMBranchMap& map2, const Entry& entry2) {
+  if (entry1.addr != entry2.addr) {
+    return entry1.addr < entry2.addr ? -1 : 1;
+  }
+  if (IsLongPattern(entry1.pattern) && IsLongPattern(entry2.pattern)) {
+    const auto& branch1 = map1.long_patterns_[entry1.pattern & ~LONG_PATTERN_MASK];
+    const auto& branch2 = map2.long_patterns_[entry2.pattern & ~LONG_PATTERN_MASK];
+    return branch1 < branch2 ? -1 : (branch2 < branch1 ? 1 : 0);
+  }
+  if (entry1.pattern != entry2.pattern) {
+    return entry1.pattern < entry2.pattern ? -1 : 1;
+  }
+  return 0;
+}
+
+std::vector<FlatETMBranchMap::Entry> FlatETMBranchMap::GetSortedEntries() const {
+  std::vector<Entry> entries;
+  entries.reserve(size_);
+  for (const Entry& entry : table_) {
+    if (entry.pattern != 0) {
+      entries.emplace_back(entry);
+    }
+  }
+  std::sort(entries.begin(), entries.end(), [this](const Entry& entry1, const Entry& entry2) {
+    return CompareEntries(*this, entry1, *this, entry2) < 0;
+  });
+  return entries;
+}
+
+FlatETMBranchMap::Entry& FlatETMBranchMap::FindOrInsert(uint64_t addr, uint64_t pattern) {
+  if (table_.empty() || NeedGrow(size_ + 1, table_.size())) {
+    Rehash(std::max(table_.size() * 2, MIN_TABLE_CAPACITY));
+  }
+  size_t mask = table_.size() - 1;
+  for (size_t i = HashEntry(addr, pattern) & mask;; i = (i + 1) & mask) {
+    Entry& entry = table_[i];
+    if (entry.pattern == 0) {
+      entry = Entry{addr, pattern, 0};
+      size_++;
+      return entry;
+    }
+    if (entry.addr == addr && entry.pattern == pattern) {
+      return entry;
+    }
+  }
+}
+
+void FlatETMBranchMap::Rehash(size_t capacity) {
+  std::vector<Entry> old_table(capacity, Entry{});
+  table_.swap(old_table);
+  size_t mask = capacity - 1;
+  for (const Entry& entry : old_table) {
+    if (entry.pattern == 0) {
+      continue;
+    }
+    size_t i = HashEntry(entry.addr, entry.pattern) & mask;
+    while (table_[i].pattern != 0) {
+      i = (i + 1) & mask;
+    }
+    table_[i] = entry;
+  }
+}
+
 static std::optional<proto::ETMBinary::BinaryType> ToProtoBinaryType(DsoType dso_type) {
   switch (dso_type) {
     case DSO_ELF_FILE:
@@ -77,19 +300,19 @@ bool ETMBinaryMapToString(const ETMBinaryMap& binary_map, std::string& s) {
     }
     binary_proto->set_type(opt_binary_type.value());
 
-    for (const auto& addr_p : binary.branch_map) {
-      auto addr_proto = binary_proto->add_addrs();
-      addr_proto->set_addr(addr_p.first);
-
-      for (const auto& branch_p : addr_p.second) {
-        const std::vector<bool>& branch = branch_p.first;
-        auto branch_proto = addr_proto->add_branches();
-
-        branch_proto->set_branch(ETMBranchToProtoString(branch));
-        branch_proto->set_branch_size(branch.size());
-        branch_proto->set_count(branch_p.second);
-      }
-    }
+    // Entries are sorted by addr, so branches of an addr are added to the same addr_proto.
+    proto::ETMBinary::Address* addr_proto = nullptr;
+    binary.branch_map.ForEachSorted(
+        [&](uint64_t addr, const std::vector<bool>& branch, uint64_t count) {
+          if (addr_proto == nullptr || addr_proto->addr() != addr) {
+            addr_proto = binary_proto->add_addrs();
+            addr_proto->set_addr(addr);
+          }
+          auto branch_proto = addr_proto->add_branches();
+          branch_proto->set_branch(ETMBranchToProtoString(branch));
+          branch_proto->set_branch_size(branch.size());
+          branch_proto->set_count(count);
+        });
 
     if (binary.dso_type == DSO_KERNEL) {
       binary_proto->mutable_kernel_info()->set_kernel_start_addr(key.kernel_start_addr);
@@ -116,16 +339,20 @@ static std::optional<DsoType> ToDsoType(proto::ETMBinary::BinaryType binary_type
   }
 }
 
-static UnorderedETMBranchMap BuildUnorderedETMBranchMap(const proto::ETMBinary& binary_proto) {
-  UnorderedETMBranchMap branch_map;
+static FlatETMBranchMap BuildETMBranchMap(const proto::ETMBinary& binary_proto) {
+  FlatETMBranchMap branch_map;
+  size_t branch_count = 0;
+  for (size_t i = 0; i < binary_proto.addrs_size(); i++) {
+    branch_count += binary_proto.addrs(i).branches_size();
+  }
+  branch_map.Reserve(branch_count);
   for (size_t i = 0; i < binary_proto.addrs_size(); i++) {
     const auto& addr_proto = binary_proto.addrs(i);
-    auto& b_map = branch_map[addr_proto.addr()];
     for (size_t j = 0; j < addr_proto.branches_size(); j++) {
       const auto& branch_proto = addr_proto.branches(j);
       std::vector<bool> branch =
           ProtoStringToETMBranch(branch_proto.branch(), branch_proto.branch_size());
-      b_map[branch] = branch_proto.count();
+      branch_map.Add(addr_proto.addr(), branch, branch_proto.count());
     }
   }
   return branch_map;
@@ -325,8 +552,7 @@ void ETMBranchListGeneratorImpl::ProcessBranchList(const ETMBranchList& branch_l
   if (!binary_filter_.Filter(branch_list.dso)) {
     return;
   }
-  auto& branch_map = branch_list_binary_map_[branch_list.dso].branch_map;
-  ++branch_map[branch_list.addr][branch_list.branch];
+  branch_list_binary_map_[branch_list.dso].branch_map.Add(branch_list.addr, branch_list.branch);
 }
 
 ETMBinaryMap ETMBranchListGeneratorImpl::GetETMBinaryMap() {
@@ -409,7 +635,7 @@ bool ParseBranchListData(const std::string& s, ETMBinaryMap& etm_data, LBRData&
       return false;
     }
     binary.dso_type = dso_type.value();
-    binary.branch_map = BuildUnorderedETMBranchMap(binary_proto);
+    binary.branch_map = BuildETMBranchMap(binary_proto);
   }
   if (branch_list_proto.has_lbr_data()) {
     const auto& lbr_data_proto = branch_list_proto.lbr_data();
@@ -94,41 +94,61 @@ class BinaryFilter {
   std::unordered_map<const Dso*, bool> dso_filter_cache_;
 };
 
-using UnorderedETMBranchMap =
-    std::unordered_map<uint64_t, std::unordered_map<std::vector<bool>, uint64_t>>;
+// Map from (addr, branch pattern) to count, for branch lists of a binary. A branch pattern is
+// packed into a uint64_t, and entries are stored in a flat open addressing hash table. So adding
+// and merging entries don't need to allocate and hash std::vector<bool>s.
+class FlatETMBranchMap {
+ public:
+  // Patterns with up to kMaxPackedBranches branches are stored in the low bits of the packed
+  // value, with (branch count + 1) in the high bits. Longer patterns are rare. They are stored
+  // in long_patterns_, and the packed value has all high bits set and the index in the low bits.
+  static constexpr size_t kMaxPackedBranches = 57;
+
+  struct Entry {
+    uint64_t addr;
+    uint64_t pattern;  // 0 for empty slots
+    uint64_t count;
+  };
+
+  using EntryCallback =
+      std::function<void(uint64_t addr, const std::vector<bool>& branch, uint64_t count)>;
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  void Reserve(size_t size);
+  void Add(uint64_t addr, const std::vector<bool>& branch, uint64_t count = 1);
+  void Merge(const FlatETMBranchMap& other);
+  // Merge multiple maps by a k-way merge of their sorted entries. The result table is allocated
+  // once, instead of growing and rehashing while adding entries of each map.
+  static FlatETMBranchMap MergeSorted(const std::vector<const FlatETMBranchMap*>& maps);
+  // Replace each addr with convert_addr(addr). Entries converted to the same key are merged.
+  void ConvertAddrs(const std::function<uint64_t(uint64_t)>& convert_addr);
+  // Call callback for each entry, sorted by addr.
+  void ForEachSorted(const EntryCallback& callback) const;
+  ETMBranchMap ToETMBranchMap() const;
+
+ private:
+  uint64_t Pack(const std::vector<bool>& branch);
+  void Unpack(uint64_t pattern, std::vector<bool>& branch) const;
+  static int CompareEntries(const FlatETMBranchMap& map1, const Entry& entry1,
+                            const FlatETMBranchMap& map2, const Entry& entry2);
+  std::vector<Entry> GetSortedEntries() const;
+  Entry& FindOrInsert(uint64_t addr, uint64_t pattern);
+  void Rehash(size_t capacity);
+
+  std::vector<Entry> table_;
+  size_t size_ = 0;
+  std::vector<std::vector<bool>> long_patterns_;
+  std::unordered_map<std::vector<bool>, uint64_t> long_pattern_ids_;
+};
 
 struct ETMBinary {
   DsoType dso_type;
-  UnorderedETMBranchMap branch_map;
-
-  void Merge(const ETMBinary& other) {
-    for (auto& other_p : other.branch_map) {
-      auto it = branch_map.find(other_p.first);
-      if (it == branch_map.end()) {
-        branch_map[other_p.first] = std::move(other_p.second);
-      } else {
-        auto& map2 = it->second;
-        for (auto& other_p2 : other_p.second) {
-          auto it2 = map2.find(other_p2.first);
-          if (it2 == map2.end()) {
-            map2[other_p2.first] = other_p2.second;
-          } else {
-            OverflowSafeAdd(it2->second, other_p2.second);
-          }
-        }
-      }
-    }
-  }
+  FlatETMBranchMap branch_map;
 
-  ETMBranchMap GetOrderedBranchMap() const {
-    ETMBranchMap result;
-    for (const auto& p : branch_map) {
-      uint64_t addr = p.first;
-      const auto& b_map = p.second;
-      result[addr] = std::map<std::vector<bool>, uint64_t>(b_map.begin(), b_map.end());
-    }
-    return result;
-  }
+  void Merge(const ETMBinary& other) { branch_map.Merge(other.branch_map); }
+
+  ETMBranchMap GetOrderedBranchMap() const { return branch_map.ToETMBranchMap(); }
 };
 
 using ETMBinaryMap = std::unordered_map<BinaryKey, ETMBinary, BinaryKeyHash>;
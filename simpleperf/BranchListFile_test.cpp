@@ -34,3 +34,93 @@ TEST(BranchListFile, etm_branch_to_proto_string) {
     ASSERT_EQ(branch, branch2);
   }
 }
+
+static std::vector<bool> CreateBranch(size_t size, uint64_t seed) {
+  std::vector<bool> branch(size);
+  for (size_t i = 0; i < size; i++) {
+    branch[i] = ((seed >> (i % 64)) ^ (i / 64)) & 1;
+  }
+  return branch;
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(BranchListFile, flat_etm_branch_map) {
+  FlatETMBranchMap map;
+  ETMBranchMap expected;
+  // Include empty, packed and long branch patterns.
+  for (size_t size : {0, 1, 2, 56, 57, 58, 64, 200}) {
+    for (uint64_t addr = 0x1000; addr < 0x1400; addr += 0x100) {
+      for (uint64_t seed : {0x0ULL, 0x5a5a5a5a5a5a5a5aULL, ~0ULL}) {
+        std::vector<bool> branch = CreateBranch(size, seed ^ addr);
+        map.Add(addr, branch, 2);
+        map.Add(addr, branch);
+        expected[addr][branch] += 3;
+      }
+    }
+  }
+  ASSERT_EQ(map.ToETMBranchMap(), expected);
+
+  size_t count = 0;
+  uint64_t prev_addr = 0;
+  map.ForEachSorted([&](uint64_t addr, const std::vector<bool>& branch, uint64_t count_value) {
+    ASSERT_GE(addr, prev_addr);
+    prev_addr = addr;
+    ASSERT_EQ(expected[addr][branch], count_value);
+    count++;
+  });
+  ASSERT_EQ(count, map.size());
+
+  map.ConvertAddrs([](uint64_t addr) { return addr & ~0x100ULL; });
+  ETMBranchMap converted;
+  for (const auto& [addr, branches] : expected) {
+    for (const auto& [branch, count_value] : branches) {
+      converted[addr & ~0x100ULL][branch] += count_value;
+    }
+  }
+  ASSERT_EQ(map.ToETMBranchMap(), converted);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(BranchListFile, flat_etm_branch_map_merge) {
+  std::vector<FlatETMBranchMap> maps(4);
+  ETMBranchMap expected;
+  for (size_t i = 0; i < maps.size(); i++) {
+    for (size_t j = 0; j < 1000; j++) {
+      uint64_t addr = 0x1000 + (i * 7 + j) % 50 * 4;
+      std::vector<bool> branch = CreateBranch(j % 3 == 0 ? 100 : j % 20, j);
+      maps[i].Add(addr, branch, j);
+      expected[addr][branch] += j;
+    }
+  }
+  FlatETMBranchMap merged;
+  for (const FlatETMBranchMap& map : maps) {
+    merged.Merge(map);
+  }
+  ASSERT_EQ(merged.ToETMBranchMap(), expected);
+
+  std::vector<const FlatETMBranchMap*> map_ptrs;
+  for (const FlatETMBranchMap& map : maps) {
+    map_ptrs.push_back(&map);
+  }
+  FlatETMBranchMap merged_sorted = FlatETMBranchMap::MergeSorted(map_ptrs);
+  ASSERT_EQ(merged_sorted.size(), merged.size());
+  ASSERT_EQ(merged_sorted.ToETMBranchMap(), expected);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(BranchListFile, etm_binary_map_to_string) {
+  ETMBinaryMap binary_map;
+  ETMBinary& binary = binary_map[BinaryKey("/data/local/tmp/a.so", BuildId())];
+  binary.dso_type = DSO_ELF_FILE;
+  binary.branch_map.Add(0x2000, {true, false}, 5);
+  binary.branch_map.Add(0x1000, CreateBranch(80, 0x1234), 3);
+  binary.branch_map.Add(0x1000, {}, 1);
+  std::string s;
+  ASSERT_TRUE(ETMBinaryMapToString(binary_map, s));
+  ETMBinaryMap binary_map2;
+  ASSERT_TRUE(StringToETMBinaryMap(s, binary_map2));
+  ASSERT_EQ(binary_map2.size(), 1);
+  const ETMBinary& binary2 = binary_map2.begin()->second;
+  ASSERT_EQ(binary2.dso_type, DSO_ELF_FILE);
+  ASSERT_EQ(binary2.GetOrderedBranchMap(), binary.GetOrderedBranchMap());
+}
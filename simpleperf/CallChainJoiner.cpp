@@ -16,6 +16,7 @@
 
 #include "CallChainJoiner.h"
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 
 #include "environment.h"
@@ -24,8 +25,10 @@
 namespace simpleperf {
 namespace call_chain_joiner_impl {
 
-LRUCache::LRUCache(size_t cache_size, size_t matched_node_count_to_extend_callchain)
-    : node_set_(1024 * 16, CacheNodeHash, CacheNodeEqual) {
+// The size of blocks read from a CallChainBuffer spilled to a file.
+static constexpr size_t kCallChainBufferBlockSize = 1024 * 1024;
+
+LRUCache::LRUCache(size_t cache_size, size_t matched_node_count_to_extend_callchain) {
   cache_stat_.cache_size = cache_size;
   cache_stat_.max_node_count = cache_size / sizeof(CacheNode);
   CHECK_GE(cache_stat_.max_node_count, 2u);
@@ -36,6 +39,13 @@ LRUCache::LRUCache(size_t cache_size, size_t matched_node_count_to_extend_callch
   nodes_[0].is_leaf = 1;
   nodes_[0].parent_index = 0;
   nodes_[0].leaf_link_prev = nodes_[0].leaf_link_next = 0;
+  // Keep the load factor of node_table_ <= 0.5, so probing sequences are short.
+  size_t table_size = 1;
+  while (table_size < (cache_stat_.max_node_count + 1) * 2) {
+    table_size <<= 1;
+  }
+  node_table_.resize(table_size, 0);
+  node_table_mask_ = table_size - 1;
 }
 
 LRUCache::~LRUCache() {
@@ -101,12 +111,50 @@ void LRUCache::AddCallChain(pid_t tid, std::vector<uint64_t>& ips, std::vector<u
   }
 }
 
-bool LRUCache::CacheNodeEqual(const CacheNode* n1, const CacheNode* n2) {
-  return n1->tid == n2->tid && n1->ip == n2->ip && n1->sp == n2->sp;
+size_t LRUCache::GetHomeSlot(uint32_t tid, uint64_t ip, uint64_t sp) const {
+  // Ips and sps are aligned. So mix the bits before masking.
+  uint64_t h = (ip ^ (sp << 1) ^ (static_cast<uint64_t>(tid) << 40)) * 0x9e3779b97f4a7c15ULL;
+  return static_cast<size_t>(h ^ (h >> 32)) & node_table_mask_;
+}
+
+size_t LRUCache::FindSlot(uint32_t tid, uint64_t ip, uint64_t sp) const {
+  size_t slot = GetHomeSlot(tid, ip, sp);
+  while (true) {
+    uint32_t index = node_table_[slot];
+    if (index == 0u) {
+      return slot;
+    }
+    const CacheNode& node = nodes_[index];
+    if (node.tid == tid && node.ip == ip && node.sp == sp) {
+      return slot;
+    }
+    slot = (slot + 1) & node_table_mask_;
+  }
+}
+
+void LRUCache::InsertNodeInTable(CacheNode* node) {
+  node_table_[FindSlot(node->tid, node->ip, node->sp)] = GetNodeIndex(node);
 }
 
-size_t LRUCache::CacheNodeHash(const CacheNode* n) {
-  return static_cast<size_t>(n->tid ^ n->ip ^ n->sp);
+void LRUCache::EraseNodeFromTable(CacheNode* node) {
+  size_t slot = FindSlot(node->tid, node->ip, node->sp);
+  // Move following nodes in the probing sequence backward, to not leave a hole in the sequence.
+  size_t next = slot;
+  while (true) {
+    next = (next + 1) & node_table_mask_;
+    uint32_t index = node_table_[next];
+    if (index == 0u) {
+      break;
+    }
+    const CacheNode& n = nodes_[index];
+    size_t home = GetHomeSlot(n.tid, n.ip, n.sp);
+    // The node can be moved if slot is in [home, next).
+    if (((next - home) & node_table_mask_) >= ((next - slot) & node_table_mask_)) {
+      node_table_[slot] = index;
+      slot = next;
+    }
+  }
+  node_table_[slot] = 0;
 }
 
 CacheNode* LRUCache::GetNode(uint32_t tid, uint64_t ip, uint64_t sp) {
@@ -126,7 +174,7 @@ CacheNode* LRUCache::GetNode(uint32_t tid, uint64_t ip, uint64_t sp) {
   node->is_leaf = 1;
   node->parent_index = 0;
   node->leaf_link_prev = node->leaf_link_next = GetNodeIndex(node);
-  node_set_.insert(node);
+  InsertNodeInTable(node);
   AppendNodeToLRUList(node);
   return node;
 }
@@ -138,7 +186,7 @@ CacheNode* LRUCache::AllocNode() {
   // Recycle the node at the front of the LRU linked list.
   CacheNode* node = &nodes_[nodes_->leaf_link_next];
   RemoveNodeFromLRUList(node);
-  node_set_.erase(node);
+  EraseNodeFromTable(node);
   CacheNode* parent = GetParent(node);
   if (parent != nullptr) {
     DecreaseChildCountOfNode(parent);
@@ -170,120 +218,186 @@ void LRUCache::UnlinkParent(CacheNode* child) {
   child->parent_index = 0;
 }
 
-}  // namespace call_chain_joiner_impl
-
-using namespace call_chain_joiner_impl;
-
-static bool WriteCallChain(FILE* fp, pid_t pid, pid_t tid, CallChainJoiner::ChainType type,
-                           const std::vector<uint64_t>& ips, const std::vector<uint64_t>& sps,
-                           size_t ip_count) {
-  // Below is the content of a call chain stored in file.
-  //   uint32_t pid;
-  //   uint32_t tid;
-  //   uint32_t chain_type;
-  //   uint32_t ip_count;
-  //   uint64_t ips[];
-  //   uint64_t sps[];
-  //   uint32_t size;
-  uint32_t size = 4 * sizeof(uint32_t) + sizeof(uint64_t) * ip_count * 2 + sizeof(uint32_t);
-  std::vector<char> data(size);
-  char* p = data.data();
-  MoveToBinaryFormat(pid, p);
-  MoveToBinaryFormat(tid, p);
-  MoveToBinaryFormat(type, p);
-  MoveToBinaryFormat(static_cast<uint32_t>(ip_count), p);
-  MoveToBinaryFormat(ips.data(), ip_count, p);
-  MoveToBinaryFormat(sps.data(), ip_count, p);
-  MoveToBinaryFormat(size, p);
-  if (fwrite(data.data(), size, 1, fp) != 1) {
+bool CallChainBuffer::Write(const std::vector<char>& data) {
+  size_ += data.size();
+  if (fp_ == nullptr) {
+    if (data.size() <= memory_budget_) {
+      data_.insert(data_.end(), data.begin(), data.end());
+      memory_budget_ -= data.size();
+      return true;
+    }
+    // Spill all data to a temporary file.
+    std::unique_ptr<TemporaryFile> tmpfile = ScopedTempFiles::CreateTempFile();
+    fp_ = fdopen(tmpfile->release(), "web+");
+    if (fp_ == nullptr) {
+      PLOG(ERROR) << "fdopen";
+      return false;
+    }
+    if (!data_.empty()) {
+      if (fwrite(data_.data(), data_.size(), 1, fp_) != 1) {
+        PLOG(ERROR) << "fwrite";
+        return false;
+      }
+      spilled_bytes_ += data_.size();
+      memory_budget_ += data_.size();
+      std::vector<char>().swap(data_);
+    }
+  }
+  if (fwrite(data.data(), data.size(), 1, fp_) != 1) {
     PLOG(ERROR) << "fwrite";
     return false;
   }
+  spilled_bytes_ += data.size();
+  need_flush_ = true;
   return true;
 }
 
-static bool ReadCallChain(FILE* fp, pid_t& pid, pid_t& tid, CallChainJoiner::ChainType& type,
-                          std::vector<uint64_t>& ips, std::vector<uint64_t>& sps) {
-  std::vector<char> data(4 * sizeof(uint32_t));
-  if (fread(data.data(), data.size(), 1, fp) != 1) {
-    PLOG(ERROR) << "fread";
-    return false;
+const char* CallChainBuffer::Read(uint64_t start, uint64_t end, bool backward) {
+  CHECK_LE(start, end);
+  CHECK_LE(end, size_);
+  if (fp_ == nullptr) {
+    return data_.data() + start;
+  }
+  if (start >= block_start_ && end <= block_start_ + block_.size()) {
+    return block_.data() + (start - block_start_);
+  }
+  if (need_flush_) {
+    if (fflush(fp_) != 0) {
+      PLOG(ERROR) << "fflush";
+      return nullptr;
+    }
+    need_flush_ = false;
+  }
+  uint64_t read_size = std::max<uint64_t>(end - start, kCallChainBufferBlockSize);
+  if (backward) {
+    block_start_ = end - std::min(end, read_size);
+    read_size = end - block_start_;
+  } else {
+    block_start_ = start;
+    read_size = std::min(read_size, size_ - start);
+  }
+  block_.resize(read_size);
+  if (!android::base::ReadFullyAtOffset(fileno(fp_), block_.data(), read_size, block_start_)) {
+    PLOG(ERROR) << "failed to read call chains";
+    block_.clear();
+    return nullptr;
+  }
+  return block_.data() + (start - block_start_);
+}
+
+void CallChainBuffer::Clear() {
+  memory_budget_ += data_.size();
+  std::vector<char>().swap(data_);
+  std::vector<char>().swap(block_);
+  block_start_ = 0;
+  if (fp_ != nullptr) {
+    fclose(fp_);
+    fp_ = nullptr;
   }
-  const char* p = data.data();
+  size_ = 0;
+}
+
+}  // namespace call_chain_joiner_impl
+
+using namespace call_chain_joiner_impl;
+
+// Below is the content of a call chain stored in a CallChainBuffer.
+//   uint32_t pid;
+//   uint32_t tid;
+//   uint32_t chain_type;
+//   uint32_t ip_count;
+//   uint64_t ips[];
+//   uint64_t sps[];
+//   uint32_t size;
+static constexpr size_t kCallChainHeaderSize = 4 * sizeof(uint32_t);
+
+static uint32_t GetCallChainSize(size_t ip_count) {
+  return kCallChainHeaderSize + sizeof(uint64_t) * ip_count * 2 + sizeof(uint32_t);
+}
+
+static void DecodeCallChain(const char* p, pid_t& pid, pid_t& tid,
+                            CallChainJoiner::ChainType& type, std::vector<uint64_t>& ips,
+                            std::vector<uint64_t>& sps) {
   MoveFromBinaryFormat(pid, p);
   MoveFromBinaryFormat(tid, p);
   MoveFromBinaryFormat(type, p);
   uint32_t ip_count;
   MoveFromBinaryFormat(ip_count, p);
-  data.resize(sizeof(uint64_t) * ip_count * 2 + sizeof(uint32_t));
-  if (fread(data.data(), data.size(), 1, fp) != 1) {
-    PLOG(ERROR) << "fread";
-    return false;
-  }
-  p = data.data();
   ips.resize(ip_count);
   MoveFromBinaryFormat(ips.data(), ip_count, p);
   sps.resize(ip_count);
   MoveFromBinaryFormat(sps.data(), ip_count, p);
-  return true;
 }
 
-static bool ReadCallChainInReverseOrder(FILE* fp, pid_t& pid, pid_t& tid,
-                                        CallChainJoiner::ChainType& type,
-                                        std::vector<uint64_t>& ips, std::vector<uint64_t>& sps) {
-  uint32_t size;
-  if (fseek(fp, -4, SEEK_CUR) != 0 || fread(&size, sizeof(size), 1, fp) != 1) {
-    PLOG(ERROR) << "fread";
+bool CallChainJoiner::WriteCallChain(CallChainBuffer& buffer, pid_t pid, pid_t tid,
+                                     ChainType type, const std::vector<uint64_t>& ips,
+                                     const std::vector<uint64_t>& sps, size_t ip_count) {
+  uint32_t size = GetCallChainSize(ip_count);
+  chain_data_.resize(size);
+  char* p = chain_data_.data();
+  MoveToBinaryFormat(pid, p);
+  MoveToBinaryFormat(tid, p);
+  MoveToBinaryFormat(type, p);
+  MoveToBinaryFormat(static_cast<uint32_t>(ip_count), p);
+  MoveToBinaryFormat(ips.data(), ip_count, p);
+  MoveToBinaryFormat(sps.data(), ip_count, p);
+  MoveToBinaryFormat(size, p);
+  stat_.stored_bytes += size;
+  return buffer.Write(chain_data_);
+}
+
+bool CallChainJoiner::ReadCallChain(CallChainBuffer& buffer, uint64_t& pos, pid_t& pid,
+                                    pid_t& tid, ChainType& type, std::vector<uint64_t>& ips,
+                                    std::vector<uint64_t>& sps) {
+  const char* p = buffer.Read(pos, pos + kCallChainHeaderSize, false);
+  if (p == nullptr) {
     return false;
   }
-  std::vector<char> data(size - 4);
-  if (fseek(fp, -static_cast<int>(size), SEEK_CUR) != 0 ||
-      fread(data.data(), data.size(), 1, fp) != 1 ||
-      fseek(fp, -static_cast<int>(data.size()), SEEK_CUR) != 0) {
-    PLOG(ERROR) << "fread";
+  uint32_t ip_count;
+  memcpy(&ip_count, p + kCallChainHeaderSize - sizeof(uint32_t), sizeof(ip_count));
+  uint32_t size = GetCallChainSize(ip_count);
+  p = buffer.Read(pos, pos + size, false);
+  if (p == nullptr) {
     return false;
   }
-  const char* p = data.data();
-  MoveFromBinaryFormat(pid, p);
-  MoveFromBinaryFormat(tid, p);
-  MoveFromBinaryFormat(type, p);
-  uint32_t ip_count;
-  MoveFromBinaryFormat(ip_count, p);
-  ips.resize(ip_count);
-  MoveFromBinaryFormat(ips.data(), ip_count, p);
-  sps.resize(ip_count);
-  MoveFromBinaryFormat(sps.data(), ip_count, p);
+  DecodeCallChain(p, pid, tid, type, ips, sps);
+  pos += size;
   return true;
 }
 
-static FILE* CreateTempFp() {
-  std::unique_ptr<TemporaryFile> tmpfile = ScopedTempFiles::CreateTempFile();
-  FILE* fp = fdopen(tmpfile->release(), "web+");
-  if (fp == nullptr) {
-    PLOG(ERROR) << "fdopen";
-    return nullptr;
+bool CallChainJoiner::ReadCallChainInReverseOrder(CallChainBuffer& buffer, uint64_t& pos,
+                                                  pid_t& pid, pid_t& tid, ChainType& type,
+                                                  std::vector<uint64_t>& ips,
+                                                  std::vector<uint64_t>& sps) {
+  const char* p = buffer.Read(pos - sizeof(uint32_t), pos, true);
+  if (p == nullptr) {
+    return false;
+  }
+  uint32_t size;
+  memcpy(&size, p, sizeof(size));
+  p = buffer.Read(pos - size, pos, true);
+  if (p == nullptr) {
+    return false;
   }
-  return fp;
+  DecodeCallChain(p, pid, tid, type, ips, sps);
+  pos -= size;
+  return true;
 }
 
 CallChainJoiner::CallChainJoiner(size_t cache_size, size_t matched_node_count_to_extend_callchain,
-                                 bool keep_original_callchains)
+                                 bool keep_original_callchains, size_t max_memory_size)
     : keep_original_callchains_(keep_original_callchains),
-      original_chains_fp_(nullptr),
-      joined_chains_fp_(nullptr),
+      memory_budget_(max_memory_size),
+      original_chains_(memory_budget_, stat_.spilled_bytes),
+      joined_chains_(memory_budget_, stat_.spilled_bytes),
+      original_read_pos_(0u),
+      joined_read_pos_(0u),
       next_chain_index_(0u) {
   cache_stat_.cache_size = cache_size;
   cache_stat_.matched_node_count_to_extend_callchain = matched_node_count_to_extend_callchain;
 }
 
-CallChainJoiner::~CallChainJoiner() {
-  if (original_chains_fp_ != nullptr) {
-    fclose(original_chains_fp_);
-  }
-  if (joined_chains_fp_ != nullptr) {
-    fclose(joined_chains_fp_);
-  }
-}
+CallChainJoiner::~CallChainJoiner() {}
 
 bool CallChainJoiner::AddCallChain(pid_t pid, pid_t tid, ChainType type,
                                    const std::vector<uint64_t>& ips,
@@ -312,14 +426,8 @@ bool CallChainJoiner::AddCallChain(pid_t pid, pid_t tid, ChainType type,
     }
   }
 
-  if (original_chains_fp_ == nullptr) {
-    original_chains_fp_ = CreateTempFp();
-    if (original_chains_fp_ == nullptr) {
-      return false;
-    }
-  }
   stat_.chain_count++;
-  return WriteCallChain(original_chains_fp_, pid, tid, type, ips, sps, ip_count);
+  return WriteCallChain(original_chains_, pid, tid, type, ips, sps, ip_count);
 }
 
 bool CallChainJoiner::JoinCallChains() {
@@ -327,30 +435,20 @@ bool CallChainJoiner::JoinCallChains() {
     return true;
   }
   LRUCache cache(cache_stat_.cache_size, cache_stat_.matched_node_count_to_extend_callchain);
-  std::unique_ptr<FILE, decltype(&fclose)> tmp_fp(CreateTempFp(), fclose);
-  if (!tmp_fp) {
-    return false;
-  }
-  joined_chains_fp_ = CreateTempFp();
-  if (joined_chains_fp_ == nullptr) {
-    return false;
-  }
+  CallChainBuffer tmp_chains(memory_budget_, stat_.spilled_bytes);
   pid_t pid;
   pid_t tid;
   ChainType type;
   std::vector<uint64_t> ips;
   std::vector<uint64_t> sps;
-  if (fseek(original_chains_fp_, 0, SEEK_END) != 0) {
-    PLOG(ERROR) << "fseek";
-    return false;
-  }
-  std::vector<std::pair<FILE*, FILE*>> file_pairs = {
-      std::make_pair(original_chains_fp_, tmp_fp.get()),
-      std::make_pair(tmp_fp.get(), joined_chains_fp_)};
+  std::vector<std::pair<CallChainBuffer*, CallChainBuffer*>> buffer_pairs = {
+      std::make_pair(&original_chains_, &tmp_chains),
+      std::make_pair(&tmp_chains, &joined_chains_)};
   for (size_t pass = 0; pass < 2u; ++pass) {
-    auto& pair = file_pairs[pass];
+    auto& pair = buffer_pairs[pass];
+    uint64_t pos = pair.first->Size();
     for (size_t i = 0; i < stat_.chain_count; ++i) {
-      if (!ReadCallChainInReverseOrder(pair.first, pid, tid, type, ips, sps)) {
+      if (!ReadCallChainInReverseOrder(*pair.first, pos, pid, tid, type, ips, sps)) {
         return false;
       }
       if (pass == 0u) {
@@ -369,11 +467,14 @@ bool CallChainJoiner::JoinCallChains() {
         stat_.after_join_max_chain_length = std::max(stat_.after_join_max_chain_length, ips.size());
       }
 
-      if (!WriteCallChain(pair.second, pid, tid, type, ips, sps, ips.size())) {
+      if (!WriteCallChain(*pair.second, pid, tid, type, ips, sps, ips.size())) {
         return false;
       }
     }
   }
+  if (!keep_original_callchains_) {
+    original_chains_.Clear();
+  }
   cache_stat_ = cache.Stat();
   return true;
 }
@@ -384,22 +485,12 @@ bool CallChainJoiner::GetNextCallChain(pid_t& pid, pid_t& tid, ChainType& type,
     // No more chains.
     return false;
   }
-  if (next_chain_index_ == 0u) {
-    if (fseek(original_chains_fp_, 0, SEEK_SET) != 0 ||
-        fseek(joined_chains_fp_, 0, SEEK_SET) != 0) {
-      PLOG(ERROR) << "fseek";
-      return false;
-    }
-  }
-  FILE* fp;
-  if (keep_original_callchains_) {
-    fp = (next_chain_index_ & 1) ? joined_chains_fp_ : original_chains_fp_;
+  if (keep_original_callchains_ && (next_chain_index_ & 1) == 0) {
     next_chain_index_++;
-  } else {
-    fp = joined_chains_fp_;
-    next_chain_index_ += 2;
+    return ReadCallChain(original_chains_, original_read_pos_, pid, tid, type, ips, sps);
   }
-  return ReadCallChain(fp, pid, tid, type, ips, sps);
+  next_chain_index_ += keep_original_callchains_ ? 1 : 2;
+  return ReadCallChain(joined_chains_, joined_read_pos_, pid, tid, type, ips, sps);
 }
 
 void CallChainJoiner::DumpStat() {
@@ -422,6 +513,8 @@ void CallChainJoiner::DumpStat() {
                << (stat_.after_join_node_count * 1.0 / stat_.chain_count);
   }
   LOG(DEBUG) << "  after_join_max_chain_length: " << stat_.after_join_max_chain_length;
+  LOG(DEBUG) << "  stored_bytes: " << stat_.stored_bytes;
+  LOG(DEBUG) << "  spilled_bytes: " << stat_.spilled_bytes;
 }
 
 }  // namespace simpleperf
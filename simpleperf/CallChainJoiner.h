@@ -21,7 +21,6 @@
 #include <stdio.h>
 #include <unistd.h>
 
-#include <unordered_set>
 #include <vector>
 
 namespace simpleperf {
@@ -75,20 +74,16 @@ class LRUCache {
   const LRUCacheStat& Stat() { return cache_stat_; }
 
   CacheNode* FindNode(uint32_t tid, uint64_t ip, uint64_t sp) {
-    CacheNode key;
-    key.tid = tid;
-    key.ip = ip;
-    key.sp = sp;
-    auto it = node_set_.find(&key);
-    return it != node_set_.end() ? *it : nullptr;
+    uint32_t index = node_table_[FindSlot(tid, ip, sp)];
+    return index == 0u ? nullptr : nodes_ + index;
   }
 
  private:
-  static bool CacheNodeEqual(const CacheNode* n1, const CacheNode* n2);
-  static size_t CacheNodeHash(const CacheNode* n);
-
-  typedef std::unordered_set<CacheNode*, decltype(&CacheNodeHash), decltype(&CacheNodeEqual)>
-      set_type;
+  size_t GetHomeSlot(uint32_t tid, uint64_t ip, uint64_t sp) const;
+  // Return the slot of the node in node_table_, or the empty slot to insert the node.
+  size_t FindSlot(uint32_t tid, uint64_t ip, uint64_t sp) const;
+  void InsertNodeInTable(CacheNode* node);
+  void EraseNodeFromTable(CacheNode* node);
 
   CacheNode* GetParent(CacheNode* node) {
     return node->parent_index == 0u ? nullptr : nodes_ + node->parent_index;
@@ -124,10 +119,41 @@ class LRUCache {
   void UnlinkParent(CacheNode* child);
 
   CacheNode* nodes_;
-  set_type node_set_;
+  // A hash table of node indexes using linear probing, which is more cache friendly than a set of
+  // node pointers. 0 means an empty slot, since nodes_[0] is the sentinel node.
+  std::vector<uint32_t> node_table_;
+  size_t node_table_mask_;
   LRUCacheStat cache_stat_;
 };
 
+// CallChainBuffer stores call chains in binary format. It keeps data in memory until the memory
+// budget shared by buffers is used up, then spills all data to a temporary file.
+class CallChainBuffer {
+ public:
+  CallChainBuffer(size_t& memory_budget, uint64_t& spilled_bytes)
+      : memory_budget_(memory_budget), spilled_bytes_(spilled_bytes) {}
+  ~CallChainBuffer() { Clear(); }
+
+  bool Write(const std::vector<char>& data);
+  uint64_t Size() const { return size_; }
+  // Return data in [start, end) of the buffer, which is valid until the next call. When reading
+  // from a file, data is read in blocks. backward decides whether the block is extended to data
+  // before start or to data after end.
+  const char* Read(uint64_t start, uint64_t end, bool backward);
+  void Clear();
+
+ private:
+  size_t& memory_budget_;
+  uint64_t& spilled_bytes_;
+  uint64_t size_ = 0;
+  std::vector<char> data_;
+  FILE* fp_ = nullptr;
+  bool need_flush_ = false;
+  // Data read from fp_, in [block_start_, block_start_ + block_.size()) of the buffer.
+  std::vector<char> block_;
+  uint64_t block_start_ = 0;
+};
+
 }  // namespace call_chain_joiner_impl
 
 // CallChainJoiner is used to join callchains of samples in the same thread, in order to get
@@ -139,9 +165,11 @@ class LRUCache {
 //   sample 2: (ip A, sp A) -> (ip B, sp B) -> (ip C, sp C) -> ...
 class CallChainJoiner {
  public:
-  // The parameters are used in LRUCache.
+  // cache_size and matched_node_count_to_extend_callchain are used in LRUCache.
+  // max_memory_size limits the memory used to store call chains. Call chains beyond the limit are
+  // spilled to temporary files.
   CallChainJoiner(size_t cache_size, size_t matched_node_count_to_extend_callchain,
-                  bool keep_original_callchains);
+                  bool keep_original_callchains, size_t max_memory_size = 64 * 1024 * 1024);
   ~CallChainJoiner();
 
   enum ChainType {
@@ -162,18 +190,37 @@ class CallChainJoiner {
     size_t before_join_node_count = 0u;
     size_t after_join_node_count = 0u;
     size_t after_join_max_chain_length = 0u;
+    // Bytes of call chains stored in buffers. They were all written to temporary files before
+    // call chains could be kept in memory.
+    uint64_t stored_bytes = 0u;
+    // Bytes of call chains written to temporary files.
+    uint64_t spilled_bytes = 0u;
   };
   void DumpStat();
   const Stat& GetStat() { return stat_; }
   const call_chain_joiner_impl::LRUCacheStat& GetCacheStat() { return cache_stat_; }
 
  private:
+  bool WriteCallChain(call_chain_joiner_impl::CallChainBuffer& buffer, pid_t pid, pid_t tid,
+                      ChainType type, const std::vector<uint64_t>& ips,
+                      const std::vector<uint64_t>& sps, size_t ip_count);
+  bool ReadCallChain(call_chain_joiner_impl::CallChainBuffer& buffer, uint64_t& pos, pid_t& pid,
+                     pid_t& tid, ChainType& type, std::vector<uint64_t>& ips,
+                     std::vector<uint64_t>& sps);
+  bool ReadCallChainInReverseOrder(call_chain_joiner_impl::CallChainBuffer& buffer, uint64_t& pos,
+                                   pid_t& pid, pid_t& tid, ChainType& type,
+                                   std::vector<uint64_t>& ips, std::vector<uint64_t>& sps);
+
   bool keep_original_callchains_;
-  FILE* original_chains_fp_;
-  FILE* joined_chains_fp_;
-  size_t next_chain_index_;
   call_chain_joiner_impl::LRUCacheStat cache_stat_;
   Stat stat_;
+  size_t memory_budget_;
+  call_chain_joiner_impl::CallChainBuffer original_chains_;
+  call_chain_joiner_impl::CallChainBuffer joined_chains_;
+  uint64_t original_read_pos_;
+  uint64_t joined_read_pos_;
+  size_t next_chain_index_;
+  std::vector<char> chain_data_;
 };
 
 }  // namespace simpleperf
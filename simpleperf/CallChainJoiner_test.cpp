@@ -269,3 +269,52 @@ TEST_F(CallChainJoinerTest, no_chains) {
   ASSERT_FALSE(joiner.GetNextCallChain(pid, tid, type, ips, sps));
   joiner.DumpStat();
 }
+
+// @CddTest = 6.1/C-0-2
+TEST_F(CallChainJoinerTest, spill_to_file) {
+  struct Chain {
+    pid_t pid;
+    CallChainJoiner::ChainType type;
+    std::vector<uint64_t> ips;
+    std::vector<uint64_t> sps;
+
+    bool operator==(const Chain& other) const {
+      return pid == other.pid && type == other.type && ips == other.ips && sps == other.sps;
+    }
+  };
+  auto join_chains = [](size_t max_memory_size, std::vector<Chain>& chains,
+                        CallChainJoiner::Stat& stat) {
+    CallChainJoiner joiner(sizeof(CacheNode) * 1024, 1, true, max_memory_size);
+    for (pid_t pid = 0; pid < 10000; ++pid) {
+      pid_t tid = pid % 10;
+      ASSERT_TRUE(
+          joiner.AddCallChain(pid, tid, CallChainJoiner::ORIGINAL_OFFLINE, {1, 2, 3}, {1, 2, 3}));
+      ASSERT_TRUE(
+          joiner.AddCallChain(pid, tid, CallChainJoiner::ORIGINAL_OFFLINE, {3, 4, 5}, {3, 4, 5}));
+    }
+    ASSERT_TRUE(joiner.JoinCallChains());
+    Chain chain;
+    pid_t tid;
+    while (joiner.GetNextCallChain(chain.pid, tid, chain.type, chain.ips, chain.sps)) {
+      chains.push_back(chain);
+    }
+    stat = joiner.GetStat();
+  };
+  std::vector<Chain> chains_in_memory;
+  CallChainJoiner::Stat stat_in_memory;
+  join_chains(64 * 1024 * 1024, chains_in_memory, stat_in_memory);
+  ASSERT_EQ(chains_in_memory.size(), 40000u);
+  ASSERT_EQ(chains_in_memory[1].ips, std::vector<uint64_t>({1, 2, 3, 4, 5}));
+  ASSERT_GT(stat_in_memory.stored_bytes, 0u);
+  ASSERT_EQ(stat_in_memory.spilled_bytes, 0u);
+
+  for (size_t max_memory_size : {0, 64 * 1024}) {
+    std::vector<Chain> chains;
+    CallChainJoiner::Stat stat;
+    join_chains(max_memory_size, chains, stat);
+    ASSERT_TRUE(chains == chains_in_memory);
+    ASSERT_EQ(stat.stored_bytes, stat_in_memory.stored_bytes);
+    ASSERT_GT(stat.spilled_bytes, 0u);
+    ASSERT_LE(stat.spilled_bytes, stat.stored_bytes);
+  }
+}
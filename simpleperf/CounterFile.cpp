@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CounterFile.h"
+
+#include <string.h>
+
+#include <map>
+#include <tuple>
+
+#include <android-base/logging.h>
+
+#include "utils.h"
+
+namespace simpleperf {
+
+namespace {
+
+constexpr char kCounterFileMagic[8] = {'S', 'P', 'C', 'O', 'U', 'N', 'T', 'S'};
+constexpr uint32_t kCounterFileVersion = 1;
+// Buffer intervals in memory, so writing at small intervals doesn't need a syscall each time.
+constexpr size_t kWriteBufferSize = 1024 * 1024;
+
+struct IntervalHeader {
+  uint64_t time_in_ns;
+  uint32_t counter_count;
+  uint32_t reserved;
+};
+
+}  // namespace
+
+std::unique_ptr<CounterFileWriter> CounterFileWriter::Create(const std::string& filename) {
+  FILE* fp = fopen(filename.c_str(), "we");
+  if (fp == nullptr) {
+    PLOG(ERROR) << "failed to open " << filename;
+    return nullptr;
+  }
+  return std::unique_ptr<CounterFileWriter>(new CounterFileWriter(filename, fp));
+}
+
+CounterFileWriter::CounterFileWriter(const std::string& filename, FILE* fp)
+    : filename_(filename), fp_(fp), buffer_(kWriteBufferSize) {
+  setvbuf(fp_, buffer_.data(), _IOFBF, buffer_.size());
+}
+
+CounterFileWriter::~CounterFileWriter() {
+  if (fp_ != nullptr) {
+    Close();
+  }
+}
+
+bool CounterFileWriter::WriteHeader(const std::vector<std::string>& event_names) {
+  uint32_t data[2] = {kCounterFileVersion, static_cast<uint32_t>(event_names.size())};
+  if (!Write(kCounterFileMagic, sizeof(kCounterFileMagic)) || !Write(data, sizeof(data))) {
+    return false;
+  }
+  for (const std::string& name : event_names) {
+    uint32_t size = name.size();
+    if (!Write(&size, sizeof(size)) || !Write(name.data(), size)) {
+      return false;
+    }
+  }
+  static const char zeros[8] = {};
+  return Write(zeros, Align(offset_, 8) - offset_);
+}
+
+bool CounterFileWriter::WriteInterval(uint64_t time_in_ns,
+                                      const std::vector<CounterFileEntry>& counters) {
+  // Counters are usually passed in the same order in each interval. Only look them up by key
+  // when the order changes.
+  std::map<std::tuple<uint32_t, int32_t, int32_t>, const CounterFileEntry*> prev_map;
+  auto find_prev = [&](size_t i) -> const CounterFileEntry* {
+    const CounterFileEntry& c = counters[i];
+    if (i < prev_counters_.size()) {
+      const CounterFileEntry& prev = prev_counters_[i];
+      if (prev.event_index == c.event_index && prev.tid == c.tid && prev.cpu == c.cpu) {
+        return &prev;
+      }
+    }
+    if (prev_map.empty()) {
+      for (const CounterFileEntry& prev : prev_counters_) {
+        prev_map[std::make_tuple(prev.event_index, prev.tid, prev.cpu)] = &prev;
+      }
+    }
+    auto it = prev_map.find(std::make_tuple(c.event_index, c.tid, c.cpu));
+    return it != prev_map.end() ? it->second : nullptr;
+  };
+  auto delta = [](uint64_t value, uint64_t prev_value) {
+    return value >= prev_value ? value - prev_value : value;
+  };
+
+  deltas_.resize(counters.size());
+  for (size_t i = 0; i < counters.size(); i++) {
+    CounterFileEntry& d = deltas_[i];
+    d = counters[i];
+    d.reserved = 0;
+    if (const CounterFileEntry* prev = find_prev(i); prev != nullptr) {
+      d.value = delta(d.value, prev->value);
+      d.time_enabled = delta(d.time_enabled, prev->time_enabled);
+      d.time_running = delta(d.time_running, prev->time_running);
+    }
+  }
+  prev_counters_ = counters;
+
+  IntervalHeader header = {time_in_ns, static_cast<uint32_t>(deltas_.size()), 0};
+  return Write(&header, sizeof(header)) &&
+         Write(deltas_.data(), deltas_.size() * sizeof(CounterFileEntry));
+}
+
+bool CounterFileWriter::Close() {
+  bool result = fclose(fp_) == 0;
+  fp_ = nullptr;
+  if (!result) {
+    PLOG(ERROR) << "failed to write " << filename_;
+  }
+  return result;
+}
+
+bool CounterFileWriter::Write(const void* data, size_t size) {
+  if (size > 0 && fwrite(data, size, 1, fp_) != 1) {
+    PLOG(ERROR) << "failed to write " << filename_;
+    return false;
+  }
+  offset_ += size;
+  return true;
+}
+
+std::unique_ptr<CounterFileReader> CounterFileReader::Open(const std::string& filename) {
+  FILE* fp = fopen(filename.c_str(), "rb");
+  if (fp == nullptr) {
+    PLOG(ERROR) << "failed to open " << filename;
+    return nullptr;
+  }
+  std::unique_ptr<CounterFileReader> reader(new CounterFileReader(filename, fp));
+  if (!reader->ReadHeader()) {
+    return nullptr;
+  }
+  return reader;
+}
+
+CounterFileReader::CounterFileReader(const std::string& filename, FILE* fp)
+    : filename_(filename), fp_(fp) {
+  file_size_ = GetFileSize(filename_);
+}
+
+CounterFileReader::~CounterFileReader() {
+  fclose(fp_);
+}
+
+bool CounterFileReader::ReadHeader() {
+  char magic[sizeof(kCounterFileMagic)];
+  uint32_t data[2];
+  if (!Read(magic, sizeof(magic)) || !Read(data, sizeof(data))) {
+    return false;
+  }
+  if (memcmp(magic, kCounterFileMagic, sizeof(magic)) != 0) {
+    LOG(ERROR) << filename_ << " is not a counter file";
+    return false;
+  }
+  if (data[0] != kCounterFileVersion) {
+    LOG(ERROR) << "unsupported counter file version " << data[0] << " in " << filename_;
+    return false;
+  }
+  if (!CheckDataSize(static_cast<uint64_t>(data[1]) * sizeof(uint32_t), "event count")) {
+    return false;
+  }
+  for (uint32_t i = 0; i < data[1]; i++) {
+    uint32_t size;
+    if (!Read(&size, sizeof(size)) || !CheckDataSize(size, "event name size")) {
+      return false;
+    }
+    std::string name(size, '\0');
+    if (!Read(name.data(), size)) {
+      return false;
+    }
+    event_names_.emplace_back(std::move(name));
+  }
+  char padding[8];
+  return Read(padding, Align(offset_, 8) - offset_);
+}
+
+bool CounterFileReader::ReadInterval(CounterInterval* interval, bool* eof) {
+  if (offset_ == file_size_) {
+    *eof = true;
+    return true;
+  }
+  *eof = false;
+  IntervalHeader header;
+  if (!Read(&header, sizeof(header)) ||
+      !CheckDataSize(static_cast<uint64_t>(header.counter_count) * sizeof(CounterFileEntry),
+                     "counter count")) {
+    return false;
+  }
+  interval->time_in_ns = header.time_in_ns;
+  interval->counters.resize(header.counter_count);
+  for (CounterFileEntry& entry : interval->counters) {
+    if (!Read(&entry, sizeof(entry))) {
+      return false;
+    }
+    if (entry.event_index >= event_names_.size()) {
+      LOG(ERROR) << "invalid event index " << entry.event_index << " in " << filename_;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CounterFileReader::CheckDataSize(uint64_t size, const char* name) {
+  if (offset_ > file_size_ || size > file_size_ - offset_) {
+    LOG(ERROR) << "invalid " << name << " at offset " << offset_ << " in " << filename_;
+    return false;
+  }
+  return true;
+}
+
+bool CounterFileReader::Read(void* data, size_t size) {
+  if (size > 0 && fread(data, size, 1, fp_) != 1) {
+    if (feof(fp_)) {
+      LOG(ERROR) << "unexpected end of " << filename_;
+    } else {
+      PLOG(ERROR) << "failed to read " << filename_;
+    }
+    return false;
+  }
+  offset_ += size;
+  return true;
+}
+
+}  // namespace simpleperf
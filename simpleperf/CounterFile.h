@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLE_PERF_COUNTER_FILE_H_
+#define SIMPLE_PERF_COUNTER_FILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace simpleperf {
+
+// A counter file stores counters read by `simpleperf stat --binary-output` in each interval, as a
+// compact time series. All values are little endian.
+//   header:
+//     char magic[8] = "SPCOUNTS"
+//     uint32_t version
+//     uint32_t event_count
+//     event names: { uint32_t size; char name[size]; } names[event_count], padded to 8 bytes
+//   intervals until the end of file:
+//     uint64_t time_in_ns        // time since stat starts
+//     uint32_t counter_count
+//     uint32_t reserved
+//     CounterFileEntry counters[counter_count]
+//
+// Values in CounterFileEntry are deltas from the previous interval, for the same event, thread and
+// cpu. So each interval only has events happened in the interval.
+struct CounterFileEntry {
+  uint32_t event_index;
+  int32_t tid;
+  int32_t cpu;
+  uint32_t reserved;
+  uint64_t value;
+  uint64_t time_enabled;
+  uint64_t time_running;
+};
+
+static_assert(sizeof(CounterFileEntry) == 40);
+
+struct CounterInterval {
+  uint64_t time_in_ns;
+  std::vector<CounterFileEntry> counters;
+};
+
+class CounterFileWriter {
+ public:
+  static std::unique_ptr<CounterFileWriter> Create(const std::string& filename);
+  ~CounterFileWriter();
+
+  bool WriteHeader(const std::vector<std::string>& event_names);
+  // counters have accumulated values since start, which are converted to deltas.
+  bool WriteInterval(uint64_t time_in_ns, const std::vector<CounterFileEntry>& counters);
+  bool Close();
+
+ private:
+  CounterFileWriter(const std::string& filename, FILE* fp);
+  bool Write(const void* data, size_t size);
+
+  const std::string filename_;
+  FILE* fp_;
+  std::vector<char> buffer_;
+  uint64_t offset_ = 0;
+  // Accumulated values in the previous interval, in the order of counters passed in.
+  std::vector<CounterFileEntry> prev_counters_;
+  std::vector<CounterFileEntry> deltas_;
+};
+
+class CounterFileReader {
+ public:
+  static std::unique_ptr<CounterFileReader> Open(const std::string& filename);
+  ~CounterFileReader();
+
+  const std::vector<std::string>& EventNames() const { return event_names_; }
+  // Read the next interval. Return false on error. Set eof to true when there are no more
+  // intervals.
+  bool ReadInterval(CounterInterval* interval, bool* eof);
+
+ private:
+  CounterFileReader(const std::string& filename, FILE* fp);
+  bool ReadHeader();
+  // Check if the file has size bytes left, before allocating memory for data of that size.
+  bool CheckDataSize(uint64_t size, const char* name);
+  bool Read(void* data, size_t size);
+
+  const std::string filename_;
+  FILE* fp_;
+  uint64_t file_size_;
+  uint64_t offset_ = 0;
+  std::vector<std::string> event_names_;
+};
+
+}  // namespace simpleperf
+
+#endif  // SIMPLE_PERF_COUNTER_FILE_H_
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CounterFile.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <android-base/file.h>
+
+using namespace simpleperf;
+
+static CounterFileEntry CreateEntry(uint32_t event_index, int32_t tid, int32_t cpu, uint64_t value,
+                                    uint64_t time) {
+  return CounterFileEntry{event_index, tid, cpu, 0, value, time, time};
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(CounterFile, write_and_read) {
+  TemporaryFile tmpfile;
+  std::unique_ptr<CounterFileWriter> writer = CounterFileWriter::Create(tmpfile.path);
+  ASSERT_TRUE(writer);
+  ASSERT_TRUE(writer->WriteHeader({"cpu-cycles", "instructions:u"}));
+  ASSERT_TRUE(writer->WriteInterval(
+      1000, {CreateEntry(0, 1, 0, 100, 10), CreateEntry(1, 1, 0, 50, 10)}));
+  ASSERT_TRUE(writer->WriteInterval(
+      2000, {CreateEntry(0, 1, 0, 250, 20), CreateEntry(1, 1, 0, 80, 20)}));
+  // Change the order of counters and add a new one.
+  ASSERT_TRUE(writer->WriteInterval(3000, {CreateEntry(1, 1, 0, 90, 30),
+                                           CreateEntry(0, 1, 1, 5, 3),
+                                           CreateEntry(0, 1, 0, 300, 30)}));
+  ASSERT_TRUE(writer->Close());
+
+  std::unique_ptr<CounterFileReader> reader = CounterFileReader::Open(tmpfile.path);
+  ASSERT_TRUE(reader);
+  ASSERT_EQ(reader->EventNames(), std::vector<std::string>({"cpu-cycles", "instructions:u"}));
+  CounterInterval interval;
+  bool eof;
+  auto check_entry = [](const CounterFileEntry& entry, uint32_t event_index, int32_t cpu,
+                        uint64_t value, uint64_t time) {
+    ASSERT_EQ(entry.event_index, event_index);
+    ASSERT_EQ(entry.tid, 1);
+    ASSERT_EQ(entry.cpu, cpu);
+    ASSERT_EQ(entry.value, value);
+    ASSERT_EQ(entry.time_enabled, time);
+    ASSERT_EQ(entry.time_running, time);
+  };
+
+  ASSERT_TRUE(reader->ReadInterval(&interval, &eof));
+  ASSERT_FALSE(eof);
+  ASSERT_EQ(interval.time_in_ns, 1000);
+  ASSERT_EQ(interval.counters.size(), 2);
+  check_entry(interval.counters[0], 0, 0, 100, 10);
+  check_entry(interval.counters[1], 1, 0, 50, 10);
+
+  ASSERT_TRUE(reader->ReadInterval(&interval, &eof));
+  ASSERT_FALSE(eof);
+  ASSERT_EQ(interval.time_in_ns, 2000);
+  ASSERT_EQ(interval.counters.size(), 2);
+  check_entry(interval.counters[0], 0, 0, 150, 10);
+  check_entry(interval.counters[1], 1, 0, 30, 10);
+
+  ASSERT_TRUE(reader->ReadInterval(&interval, &eof));
+  ASSERT_FALSE(eof);
+  ASSERT_EQ(interval.time_in_ns, 3000);
+  ASSERT_EQ(interval.counters.size(), 3);
+  check_entry(interval.counters[0], 1, 0, 10, 10);
+  check_entry(interval.counters[1], 0, 1, 5, 3);
+  check_entry(interval.counters[2], 0, 0, 50, 10);
+
+  ASSERT_TRUE(reader->ReadInterval(&interval, &eof));
+  ASSERT_TRUE(eof);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(CounterFile, read_invalid_file) {
+  TemporaryFile tmpfile;
+  ASSERT_TRUE(android::base::WriteStringToFile("not a counter file", tmpfile.path));
+  ASSERT_FALSE(CounterFileReader::Open(tmpfile.path));
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(CounterFile, read_corrupted_file) {
+  TemporaryFile tmpfile;
+  std::unique_ptr<CounterFileWriter> writer = CounterFileWriter::Create(tmpfile.path);
+  ASSERT_TRUE(writer);
+  ASSERT_TRUE(writer->WriteHeader({"cpu-cycles"}));
+  ASSERT_TRUE(writer->WriteInterval(1000, {CreateEntry(0, 1, 0, 100, 10)}));
+  ASSERT_TRUE(writer->Close());
+  std::string data;
+  ASSERT_TRUE(android::base::ReadFileToString(tmpfile.path, &data));
+  ASSERT_EQ(data.size(), 32 + 16 + sizeof(CounterFileEntry));
+  const size_t kNameSizeOffset = 16;
+  const size_t kCounterCountOffset = 40;
+
+  auto read_intervals = [&](const std::string& content) {
+    if (!android::base::WriteStringToFile(content, tmpfile.path)) {
+      return false;
+    }
+    std::unique_ptr<CounterFileReader> reader = CounterFileReader::Open(tmpfile.path);
+    if (!reader) {
+      return false;
+    }
+    CounterInterval interval;
+    bool eof = false;
+    while (!eof) {
+      if (!reader->ReadInterval(&interval, &eof)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  ASSERT_TRUE(read_intervals(data));
+
+  // A too big size isn't used to allocate memory.
+  std::string bad_data = data;
+  uint32_t value = UINT32_MAX;
+  memcpy(bad_data.data() + kNameSizeOffset, &value, sizeof(value));
+  ASSERT_FALSE(read_intervals(bad_data));
+  bad_data = data;
+  memcpy(bad_data.data() + kCounterCountOffset, &value, sizeof(value));
+  ASSERT_FALSE(read_intervals(bad_data));
+
+  // A truncated interval is an error, not the end of file.
+  ASSERT_FALSE(read_intervals(data.substr(0, data.size() - 1)));
+  ASSERT_FALSE(read_intervals(data.substr(0, 36)));
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FlightRecorder.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+
+#include "utils.h"
+
+namespace simpleperf {
+
+namespace {
+
+// Each record is stored as an entry header followed by the record binary, padded to 8 bytes.
+struct EntryHeader {
+  uint32_t type;
+  uint32_t size;
+  uint32_t attr_index;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(EntryHeader) == 16);
+
+// The time and size limits are split into this many segments. So evicting a segment drops about
+// 1/kSegmentCount of the kept records.
+constexpr uint64_t kSegmentCount = 16;
+
+size_t GetEntrySize(const char* entry) {
+  EntryHeader header;
+  memcpy(&header, entry, sizeof(header));
+  return sizeof(header) + Align(header.size, 8);
+}
+
+// Records not describing threads or maps, but needed to report any sample.
+bool IsRecordAlwaysKept(uint32_t type) {
+  switch (type) {
+    case PERF_RECORD_TRACING_DATA:
+    case PERF_RECORD_AUXTRACE_INFO:
+    case SIMPLE_PERF_RECORD_KERNEL_SYMBOL:
+    case SIMPLE_PERF_RECORD_DSO:
+    case SIMPLE_PERF_RECORD_SYMBOL:
+    case SIMPLE_PERF_RECORD_EVENT_ID:
+    case SIMPLE_PERF_RECORD_TRACING_DATA:
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+FlightRecorder::FlightRecorder(const EventAttrIds& attrs, uint64_t max_duration_in_ns,
+                               uint64_t max_size)
+    : max_duration_(max_duration_in_ns),
+      max_size_(max_size),
+      segment_duration_(std::max<uint64_t>(max_duration_in_ns / kSegmentCount, 1)),
+      segment_size_(std::max<uint64_t>(max_size / kSegmentCount, 1)) {
+  CHECK(!attrs.empty());
+  for (size_t i = 0; i < attrs.size(); i++) {
+    attrs_.push_back(attrs[i].attr);
+    for (uint64_t id : attrs[i].ids) {
+      event_id_to_attr_index_[id] = i;
+    }
+  }
+}
+
+void FlightRecorder::AddRecord(const Record& record) {
+  uint64_t time = record.Timestamp();
+  if (time == 0) {
+    // Records without timestamps are taken as at the time of the previous record.
+    time = last_time_;
+  }
+  last_time_ = std::max(last_time_, time);
+  if (segments_.empty() || segments_.back().data.size() >= segment_size_ ||
+      (time > segments_.back().start_time &&
+       time - segments_.back().start_time >= segment_duration_)) {
+    Segment& segment = segments_.emplace_back();
+    segment.data.reserve(segment_size_);
+    segment.start_time = segment.end_time = time;
+  }
+  Segment& segment = segments_.back();
+  EntryHeader header;
+  header.type = record.type();
+  header.size = record.size();
+  header.attr_index = 0;
+  if (auto it = event_id_to_attr_index_.find(record.Id()); it != event_id_to_attr_index_.end()) {
+    header.attr_index = it->second;
+  }
+  header.reserved = 0;
+  size_t entry_size = sizeof(header) + Align(header.size, 8);
+  size_t offset = segment.data.size();
+  segment.data.resize(offset + entry_size, 0);
+  memcpy(segment.data.data() + offset, &header, sizeof(header));
+  memcpy(segment.data.data() + offset + sizeof(header), record.Binary(), header.size);
+  segment.end_time = std::max(segment.end_time, time);
+  size_ += entry_size;
+
+  // The size limit covers the state, which grows when segments are evicted.
+  while (segments_.size() > 1 && (size_ + state_size_ > max_size_ ||
+                                  last_time_ - segments_.front().end_time > max_duration_)) {
+    EvictOldestSegment();
+  }
+}
+
+void FlightRecorder::EvictOldestSegment() {
+  std::vector<char>& data = segments_.front().data;
+  auto replace_state = [&](auto& seqs, const auto& key, const char* entry) {
+    if (auto it = seqs.find(key); it != seqs.end()) {
+      RemoveStateRecord(it->second);
+    }
+    seqs[key] = AddStateRecord(entry);
+  };
+  for (char* entry = data.data(); entry < data.data() + data.size();
+       entry += GetEntrySize(entry)) {
+    EntryHeader header;
+    memcpy(&header, entry, sizeof(header));
+    char* binary = entry + sizeof(header);
+    if (IsRecordAlwaysKept(header.type)) {
+      AddStateRecord(entry);
+      continue;
+    }
+    if (header.type != PERF_RECORD_COMM && header.type != PERF_RECORD_FORK &&
+        header.type != PERF_RECORD_EXIT && header.type != PERF_RECORD_MMAP &&
+        header.type != PERF_RECORD_MMAP2) {
+      dropped_record_count_++;
+      continue;
+    }
+    Record* r = record_parser_.Parse(attrs_[header.attr_index], header.type, binary,
+                                     binary + header.size);
+    if (r == nullptr) {
+      dropped_record_count_++;
+      continue;
+    }
+    if (header.type == PERF_RECORD_COMM) {
+      auto& comm = *static_cast<CommRecord*>(r);
+      replace_state(comm_seqs_, std::make_pair(comm.data->pid, comm.data->tid), entry);
+    } else if (header.type == PERF_RECORD_FORK) {
+      auto& fork = *static_cast<ForkRecord*>(r);
+      replace_state(fork_seqs_, std::make_pair(fork.data->pid, fork.data->tid), entry);
+    } else if (header.type == PERF_RECORD_EXIT) {
+      auto& exit = *static_cast<ExitRecord*>(r);
+      if (exit.data->pid == exit.data->tid) {
+        RemoveThreadState(exit.data->pid, std::nullopt);
+      } else {
+        RemoveThreadState(exit.data->pid, exit.data->tid);
+      }
+    } else if (header.type == PERF_RECORD_MMAP) {
+      auto& map = *static_cast<MmapRecord*>(r);
+      replace_state(map_seqs_, std::pair<uint32_t, uint64_t>(map.data->pid, map.data->addr), entry);
+    } else {
+      auto& map = *static_cast<Mmap2Record*>(r);
+      replace_state(map_seqs_, std::pair<uint32_t, uint64_t>(map.data->pid, map.data->addr), entry);
+    }
+  }
+  size_ -= data.size();
+  segments_.pop_front();
+}
+
+uint64_t FlightRecorder::AddStateRecord(const char* entry) {
+  uint64_t seq = next_state_seq_++;
+  size_t entry_size = GetEntrySize(entry);
+  state_records_[seq].assign(entry, entry + entry_size);
+  state_size_ += entry_size;
+  return seq;
+}
+
+void FlightRecorder::RemoveStateRecord(uint64_t seq) {
+  if (auto it = state_records_.find(seq); it != state_records_.end()) {
+    state_size_ -= it->second.size();
+    state_records_.erase(it);
+  }
+}
+
+void FlightRecorder::RemoveThreadState(uint32_t pid, std::optional<uint32_t> tid) {
+  auto remove_range = [this](auto& seqs, const auto& first, const auto& last) {
+    for (auto it = seqs.lower_bound(first); it != seqs.end() && !(last < it->first);) {
+      RemoveStateRecord(it->second);
+      it = seqs.erase(it);
+    }
+  };
+  if (tid) {
+    auto key = std::make_pair(pid, tid.value());
+    remove_range(comm_seqs_, key, key);
+    remove_range(fork_seqs_, key, key);
+  } else {
+    auto first = std::make_pair(pid, uint32_t(0));
+    auto last = std::make_pair(pid, UINT32_MAX);
+    remove_range(comm_seqs_, first, last);
+    remove_range(fork_seqs_, first, last);
+    remove_range(map_seqs_, std::pair<uint32_t, uint64_t>(pid, 0),
+                 std::pair<uint32_t, uint64_t>(pid, UINT64_MAX));
+  }
+}
+
+bool FlightRecorder::ReadRecords(const std::function<bool(const Record&)>& callback) {
+  for (auto& [seq, entry] : state_records_) {
+    if (!ReadRecordEntry(entry.data(), callback)) {
+      return false;
+    }
+  }
+  for (Segment& segment : segments_) {
+    std::vector<char>& data = segment.data;
+    for (char* entry = data.data(); entry < data.data() + data.size();
+         entry += GetEntrySize(entry)) {
+      if (!ReadRecordEntry(entry, callback)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool FlightRecorder::ReadRecordEntry(char* entry,
+                                     const std::function<bool(const Record&)>& callback) {
+  EntryHeader header;
+  memcpy(&header, entry, sizeof(header));
+  char* binary = entry + sizeof(header);
+  Record* r = record_parser_.Parse(attrs_[header.attr_index], header.type, binary,
+                                   binary + header.size);
+  return r != nullptr && callback(*r);
+}
+
+std::pair<uint64_t, uint64_t> FlightRecorder::KeptTimeRange() const {
+  if (segments_.empty()) {
+    return std::make_pair(0, 0);
+  }
+  return std::make_pair(segments_.front().start_time, segments_.back().end_time);
+}
+
+}  // namespace simpleperf
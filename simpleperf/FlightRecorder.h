@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLE_PERF_FLIGHT_RECORDER_H_
+#define SIMPLE_PERF_FLIGHT_RECORDER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "event_attr.h"
+#include "record.h"
+
+namespace simpleperf {
+
+// FlightRecorder keeps the most recent records in bounded memory, for continuous profiling where
+// only the last window before an anomaly is needed.
+//
+// Records are stored in segments, each covering a slice of the time window. When the records
+// exceed the time limit, or the records and the state below exceed the size limit, the oldest
+// segment is evicted. Samples in an evicted segment are
+// dropped. Comm, fork and mmap records in it are folded into a state of live threads and maps,
+// and exit records remove their threads from the state. So the kept samples can still be
+// symbolized. Records like kernel symbols and tracing data are always kept.
+class FlightRecorder {
+ public:
+  FlightRecorder(const EventAttrIds& attrs, uint64_t max_duration_in_ns, uint64_t max_size);
+
+  void AddRecord(const Record& record);
+  // Pass state records and then kept records to callback, in the order they were added.
+  bool ReadRecords(const std::function<bool(const Record&)>& callback);
+
+  uint64_t KeptSize() const { return size_; }
+  uint64_t StateSize() const { return state_size_; }
+  uint64_t DroppedRecordCount() const { return dropped_record_count_; }
+  // Return the time range of kept records.
+  std::pair<uint64_t, uint64_t> KeptTimeRange() const;
+
+ private:
+  struct Segment {
+    std::vector<char> data;
+    uint64_t start_time = 0;
+    uint64_t end_time = 0;
+  };
+
+  void EvictOldestSegment();
+  uint64_t AddStateRecord(const char* entry);
+  void RemoveStateRecord(uint64_t seq);
+  // Remove state records of a thread, or of all threads and maps in a process if tid isn't set.
+  void RemoveThreadState(uint32_t pid, std::optional<uint32_t> tid);
+  bool ReadRecordEntry(char* entry, const std::function<bool(const Record&)>& callback);
+
+  std::vector<perf_event_attr> attrs_;
+  std::unordered_map<uint64_t, uint32_t> event_id_to_attr_index_;
+  const uint64_t max_duration_;
+  const uint64_t max_size_;
+  const uint64_t segment_duration_;
+  const uint64_t segment_size_;
+
+  std::deque<Segment> segments_;
+  uint64_t size_ = 0;
+  uint64_t last_time_ = 0;
+  uint64_t dropped_record_count_ = 0;
+
+  // State records, stored in the same format as segment data, indexed by the order they were
+  // added.
+  std::map<uint64_t, std::vector<char>> state_records_;
+  uint64_t next_state_seq_ = 0;
+  uint64_t state_size_ = 0;
+  // Map from (pid, tid) to sequence numbers of comm and fork records.
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> comm_seqs_;
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> fork_seqs_;
+  // Map from (pid, start_addr) to sequence numbers of mmap records.
+  std::map<std::pair<uint32_t, uint64_t>, uint64_t> map_seqs_;
+
+  InPlaceRecordParser record_parser_;
+};
+
+}  // namespace simpleperf
+
+#endif  // SIMPLE_PERF_FLIGHT_RECORDER_H_
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FlightRecorder.h"
+
+#include <gtest/gtest.h>
+
+#include "event_attr.h"
+#include "event_type.h"
+
+using namespace simpleperf;
+
+// @CddTest = 6.1/C-0-2
+class FlightRecorderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::unique_ptr<EventTypeAndModifier> event_type = ParseEventType("cpu-clock");
+    ASSERT_TRUE(event_type != nullptr);
+    attr_ids_.resize(1);
+    attr_ids_[0].attr = CreateDefaultPerfEventAttr(event_type->event_type);
+    attr_ids_[0].attr.sample_id_all = 1;
+    attr_ids_[0].ids.push_back(kEventId);
+  }
+
+  SampleRecord CreateSample(uint32_t tid, uint64_t time) {
+    return SampleRecord(attr_ids_[0].attr, kEventId, 0x1000, tid, tid, time, 0, 1, {}, {}, {}, 0);
+  }
+
+  std::vector<std::unique_ptr<Record>> ReadRecords(FlightRecorder& recorder) {
+    std::vector<std::unique_ptr<Record>> records;
+    EXPECT_TRUE(recorder.ReadRecords([&](const Record& r) {
+      records.emplace_back(CopyRecord(attr_ids_[0].attr, r));
+      return true;
+    }));
+    return records;
+  }
+
+  static constexpr uint64_t kEventId = 1;
+  EventAttrIds attr_ids_;
+};
+
+// @CddTest = 6.1/C-0-2
+TEST_F(FlightRecorderTest, keep_records_in_time_limit) {
+  FlightRecorder recorder(attr_ids_, 1600, 1024 * 1024);
+  for (uint64_t time = 1; time <= 10000; time++) {
+    recorder.AddRecord(CreateSample(1, time));
+  }
+  std::vector<std::unique_ptr<Record>> records = ReadRecords(recorder);
+  ASSERT_FALSE(records.empty());
+  // Records are kept in order, and cover the last time window, with at most one more segment.
+  ASSERT_EQ(records.back()->Timestamp(), 10000u);
+  ASSERT_GE(records.front()->Timestamp(), 10000u - 1600 - 100);
+  ASSERT_LE(records.front()->Timestamp(), 10000u - 1600);
+  for (size_t i = 1; i < records.size(); i++) {
+    ASSERT_EQ(records[i]->Timestamp(), records[i - 1]->Timestamp() + 1);
+  }
+  ASSERT_EQ(recorder.DroppedRecordCount(), records.front()->Timestamp() - 1);
+  auto [start_time, end_time] = recorder.KeptTimeRange();
+  ASSERT_EQ(start_time, records.front()->Timestamp());
+  ASSERT_EQ(end_time, 10000u);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(FlightRecorderTest, keep_records_in_size_limit) {
+  const uint64_t max_size = 64 * 1024;
+  FlightRecorder recorder(attr_ids_, UINT64_MAX, max_size);
+  for (uint64_t time = 1; time <= 10000; time++) {
+    recorder.AddRecord(CreateSample(1, time));
+  }
+  ASSERT_LE(recorder.KeptSize(), max_size);
+  ASSERT_GE(recorder.KeptSize(), max_size - max_size / 8);
+  std::vector<std::unique_ptr<Record>> records = ReadRecords(recorder);
+  ASSERT_FALSE(records.empty());
+  ASSERT_EQ(records.back()->Timestamp(), 10000u);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(FlightRecorderTest, size_limit_includes_state) {
+  const perf_event_attr& attr = attr_ids_[0].attr;
+  const uint64_t max_size = 64 * 1024;
+  FlightRecorder recorder(attr_ids_, UINT64_MAX, max_size);
+  // Maps still alive are moved to the state when their segments are evicted.
+  const std::string filename(200, 'a');
+  for (uint64_t i = 0; i < 100; i++) {
+    recorder.AddRecord(
+        MmapRecord(attr, false, 1, 1, 0x1000 * (i + 1), 0x1000, 0, filename, kEventId, 1));
+  }
+  for (uint64_t time = 2; time <= 10000; time++) {
+    recorder.AddRecord(CreateSample(1, time));
+  }
+  ASSERT_GT(recorder.StateSize(), max_size / 4);
+  ASSERT_LE(recorder.KeptSize() + recorder.StateSize(), max_size);
+  ASSERT_GE(recorder.KeptSize() + recorder.StateSize(), max_size - max_size / 8);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(FlightRecorderTest, keep_thread_and_map_state) {
+  const perf_event_attr& attr = attr_ids_[0].attr;
+  FlightRecorder recorder(attr_ids_, 1600, 1024 * 1024);
+  recorder.AddRecord(CommRecord(attr, 1, 1, "first_name", kEventId, 1));
+  recorder.AddRecord(MmapRecord(attr, false, 1, 1, 0x1000, 0x1000, 0, "old_lib", kEventId, 1));
+  recorder.AddRecord(ForkRecord(attr, 2, 2, 1, 1, kEventId));
+  recorder.AddRecord(CommRecord(attr, 1, 1, "second_name", kEventId, 2));
+  recorder.AddRecord(MmapRecord(attr, false, 1, 1, 0x1000, 0x1000, 0, "new_lib", kEventId, 2));
+  for (uint64_t time = 3; time <= 10000; time++) {
+    recorder.AddRecord(CreateSample(1, time));
+  }
+  ASSERT_GT(recorder.StateSize(), 0u);
+  std::vector<std::unique_ptr<Record>> records = ReadRecords(recorder);
+  // State records are passed first, without replaced comm and mmap records.
+  ASSERT_GE(records.size(), 3u);
+  ASSERT_EQ(records[0]->type(), PERF_RECORD_FORK);
+  ASSERT_EQ(records[1]->type(), PERF_RECORD_COMM);
+  ASSERT_STREQ(static_cast<CommRecord*>(records[1].get())->comm, "second_name");
+  ASSERT_EQ(records[2]->type(), PERF_RECORD_MMAP);
+  ASSERT_STREQ(static_cast<MmapRecord*>(records[2].get())->filename, "new_lib");
+  for (size_t i = 3; i < records.size(); i++) {
+    ASSERT_EQ(records[i]->type(), PERF_RECORD_SAMPLE);
+  }
+}
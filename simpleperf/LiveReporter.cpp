@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LiveReporter.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace simpleperf {
+
+// Wake up the report thread when this many samples are pending.
+static constexpr size_t kReportBatchSize = 4096;
+// Drop samples when this many samples are pending.
+static constexpr size_t kMaxPendingSamples = 1024 * 1024;
+// Forget symbols and dsos with weights below this ratio of the total weight.
+static constexpr double kMinWeightRatio = 1e-5;
+
+LiveReporter::LiveReporter(const perf_event_attr& attr, std::chrono::milliseconds interval,
+                           FILE* fp, size_t top_count, double decay)
+    : attr_(attr),
+      interval_(interval),
+      fp_(fp),
+      top_count_(top_count),
+      decay_(decay),
+      start_time_(std::chrono::steady_clock::now()) {
+  report_thread_ = std::thread([this]() { ReportThreadMain(); });
+}
+
+LiveReporter::~LiveReporter() {
+  Stop();
+}
+
+void LiveReporter::AddRecord(const Record& record) {
+  Item item;
+  uint32_t type = record.type();
+  if (type == PERF_RECORD_SAMPLE) {
+    const SampleRecord& r = static_cast<const SampleRecord&>(record);
+    item.pid = r.tid_data.pid;
+    item.tid = r.tid_data.tid;
+    item.ip = r.ip_data.ip;
+    item.period = r.period_data.period;
+    item.in_kernel = r.InKernel();
+  } else if (type == PERF_RECORD_MMAP || type == PERF_RECORD_MMAP2 || type == PERF_RECORD_COMM ||
+             type == PERF_RECORD_FORK || type == PERF_RECORD_EXIT) {
+    item.record = CopyRecord(attr_, record);
+    if (!item.record) {
+      return;
+    }
+  } else {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!item.record) {
+    if (pending_samples_ >= kMaxPendingSamples) {
+      dropped_samples_++;
+      return;
+    }
+    if (++pending_samples_ == kReportBatchSize) {
+      cond_.notify_one();
+    }
+  }
+  pending_items_.emplace_back(std::move(item));
+}
+
+void LiveReporter::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_one();
+  if (report_thread_.joinable()) {
+    report_thread_.join();
+  }
+}
+
+void LiveReporter::ReportThreadMain() {
+  auto next_report_time = std::chrono::steady_clock::now() + interval_;
+  std::vector<Item> items;
+  while (true) {
+    bool stop;
+    size_t dropped_samples;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait_until(lock, next_report_time,
+                       [this]() { return stop_ || pending_samples_ >= kReportBatchSize; });
+      items.swap(pending_items_);
+      pending_samples_ = 0;
+      dropped_samples = dropped_samples_;
+      stop = stop_;
+    }
+    for (const Item& item : items) {
+      ProcessItem(item);
+    }
+    items.clear();
+    auto now = std::chrono::steady_clock::now();
+    if (stop || now >= next_report_time) {
+      PrintReport(dropped_samples);
+      next_report_time = std::max(next_report_time + interval_, now);
+    }
+    if (stop) {
+      break;
+    }
+  }
+}
+
+void LiveReporter::ProcessItem(const Item& item) {
+  if (item.record) {
+    thread_tree_.Update(*item.record);
+    return;
+  }
+  const ThreadEntry* thread = thread_tree_.FindThreadOrNew(item.pid, item.tid);
+  const MapEntry* map = thread_tree_.FindMap(thread, item.ip, item.in_kernel);
+  Dso* dso = nullptr;
+  const Symbol* symbol = thread_tree_.FindSymbol(map, item.ip, nullptr, &dso);
+  if (symbol == thread_tree_.UnknownSymbol()) {
+    // Merge unknown symbols in the same dso.
+    symbol = nullptr;
+  }
+  double weight = static_cast<double>(item.period);
+  symbol_weights_[std::make_pair(dso, symbol)] += weight;
+  dso_weights_[dso] += weight;
+  total_weight_ += weight;
+  sample_count_++;
+}
+
+void LiveReporter::PrintReport(size_t dropped_samples) {
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_)
+                       .count();
+  fprintf(fp_, "\nLive report at %.3f s: %zu samples, %zu dropped\n", seconds, sample_count_,
+          dropped_samples);
+  if (total_weight_ > 0) {
+    auto print_top = [&](const auto& weights, const char* title, auto get_name) {
+      std::vector<const typename std::decay_t<decltype(weights)>::value_type*> entries;
+      for (const auto& entry : weights) {
+        entries.push_back(&entry);
+      }
+      size_t count = std::min(top_count_, entries.size());
+      std::partial_sort(entries.begin(), entries.begin() + count, entries.end(),
+                        [](const auto* e1, const auto* e2) { return e1->second > e2->second; });
+      fprintf(fp_, "%8s  %s\n", "Overhead", title);
+      for (size_t i = 0; i < count; i++) {
+        fprintf(fp_, "%7.2f%%  %s\n", entries[i]->second * 100.0 / total_weight_,
+                get_name(entries[i]->first).c_str());
+      }
+    };
+    auto dso_name = [](const Dso* dso) -> std::string { return dso ? dso->Path() : "unknown"; };
+    print_top(dso_weights_, "Shared Object", dso_name);
+    print_top(symbol_weights_, "Symbol", [&](const std::pair<const Dso*, const Symbol*>& key) {
+      std::string name = key.second ? key.second->DemangledName() : "unknown";
+      return name + " [" + dso_name(key.first) + "]";
+    });
+  }
+  fflush(fp_);
+  DecayWeights(symbol_weights_);
+  DecayWeights(dso_weights_);
+  total_weight_ *= decay_;
+}
+
+template <typename Key>
+void LiveReporter::DecayWeights(std::map<Key, double>& weights) {
+  double min_weight = total_weight_ * decay_ * kMinWeightRatio;
+  for (auto it = weights.begin(); it != weights.end();) {
+    it->second *= decay_;
+    if (it->second < min_weight) {
+      it = weights.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace simpleperf
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLE_PERF_LIVE_REPORTER_H_
+#define SIMPLE_PERF_LIVE_REPORTER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "record.h"
+#include "thread_tree.h"
+
+namespace simpleperf {
+
+// LiveReporter periodically prints the top symbols and dsos of samples while recording, like
+// `top`. Sample weights decay in each interval, so the report follows recent samples.
+// Records are added in the record thread and symbolized in a report thread. So reporting doesn't
+// slow down reading records from the kernel buffers.
+class LiveReporter {
+ public:
+  // attr is used to copy non-sample records. decay is the factor multiplied to sample weights
+  // after each report.
+  LiveReporter(const perf_event_attr& attr, std::chrono::milliseconds interval, FILE* fp,
+               size_t top_count = 20, double decay = 0.5);
+  ~LiveReporter();
+
+  // Called in the record thread. Only samples and records updating threads and maps are kept.
+  // When the report thread can't keep up, samples are dropped instead of blocking the caller.
+  void AddRecord(const Record& record);
+  // Process all added records, print the last report and stop the report thread.
+  void Stop();
+
+ private:
+  struct Item {
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t ip;
+    uint64_t period;
+    bool in_kernel;
+    // Set for non-sample records.
+    std::unique_ptr<Record> record;
+  };
+
+  void ReportThreadMain();
+  void ProcessItem(const Item& item);
+  void PrintReport(size_t dropped_samples);
+  template <typename Key>
+  void DecayWeights(std::map<Key, double>& weights);
+
+  const perf_event_attr attr_;
+  const std::chrono::milliseconds interval_;
+  FILE* fp_;
+  const size_t top_count_;
+  const double decay_;
+  const std::chrono::steady_clock::time_point start_time_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // Below are protected by mutex_.
+  std::vector<Item> pending_items_;
+  size_t pending_samples_ = 0;
+  size_t dropped_samples_ = 0;
+  bool stop_ = false;
+
+  // Below are only used in the report thread.
+  ThreadTree thread_tree_;
+  std::map<std::pair<const Dso*, const Symbol*>, double> symbol_weights_;
+  std::map<const Dso*, double> dso_weights_;
+  double total_weight_ = 0;
+  size_t sample_count_ = 0;
+
+  std::thread report_thread_;
+};
+
+}  // namespace simpleperf
+
+#endif  // SIMPLE_PERF_LIVE_REPORTER_H_
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LiveReporter.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+#include <android-base/file.h>
+
+#include "event_attr.h"
+#include "event_type.h"
+#include "record.h"
+
+using namespace simpleperf;
+
+// @CddTest = 6.1/C-0-2
+TEST(LiveReporter, report_top_dsos) {
+  const EventType* event_type = FindEventTypeByName("cpu-clock");
+  ASSERT_TRUE(event_type != nullptr);
+  perf_event_attr attr = CreateDefaultPerfEventAttr(*event_type);
+  attr.sample_id_all = 1;
+  TemporaryFile tmpfile;
+  FILE* fp = fdopen(tmpfile.release(), "w");
+  ASSERT_TRUE(fp != nullptr);
+  {
+    // Use a long interval, so only the last report is printed in Stop().
+    LiveReporter reporter(attr, std::chrono::hours(1), fp);
+    reporter.AddRecord(MmapRecord(attr, false, 1, 1, 0x1000, 0x1000, 0, "/data/fake_lib1.so", 0));
+    reporter.AddRecord(MmapRecord(attr, false, 1, 1, 0x2000, 0x1000, 0, "/data/fake_lib2.so", 0));
+    for (uint64_t ip : {0x1100, 0x1200, 0x1300, 0x2100}) {
+      reporter.AddRecord(SampleRecord(attr, 0, ip, 1, 1, 0, 0, 1, {}, {}, {}, 0));
+    }
+    reporter.Stop();
+  }
+  fclose(fp);
+  std::string output;
+  ASSERT_TRUE(android::base::ReadFileToString(tmpfile.path, &output));
+  ASSERT_NE(output.find("4 samples, 0 dropped"), std::string::npos);
+  ASSERT_NE(output.find("75.00%  /data/fake_lib1.so"), std::string::npos);
+  ASSERT_NE(output.find("25.00%  /data/fake_lib2.so"), std::string::npos);
+}
@@ -20,12 +20,23 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <procinfo/process_map.h>
 
+#include "ThreadPool.h"
 #include "environment.h"
 #include "thread_tree.h"
+#include "utils.h"
 
 namespace simpleperf {
 
@@ -63,12 +74,151 @@ bool MapRecordReader::ReadProcessMaps(pid_t pid, uint64_t timestamp) {
 
 bool MapRecordReader::ReadProcessMaps(pid_t pid, const std::unordered_set<pid_t>& tids,
                                       uint64_t timestamp) {
-  // Dump mmap records.
   std::vector<ThreadMmap> thread_mmaps;
   if (!GetThreadMmapsInProcess(pid, &thread_mmaps)) {
     // The process may exit before we get its info.
     return true;
   }
+  return DumpProcess(pid, tids, thread_mmaps, timestamp);
+}
+
+namespace {
+
+// Processes forked from zygote without loading their own code (like app zygotes and unspecialized
+// app processes) have identical maps. ProcessMapsCache parses identical maps files only once.
+// Maps files are keyed by their content, so different maps never share a cache entry.
+class ProcessMapsCache {
+ public:
+  explicit ProcessMapsCache(bool keep_non_executable_maps)
+      : keep_non_executable_maps_(keep_non_executable_maps) {}
+
+  std::shared_ptr<const std::vector<ThreadMmap>> GetMaps(pid_t pid) {
+    std::string content;
+    if (!android::base::ReadFileToString(android::base::StringPrintf("/proc/%d/maps", pid),
+                                         &content)) {
+      // The process may exit before we get its info.
+      return nullptr;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (auto it = maps_.find(content); it != maps_.end()) {
+        return it->second;
+      }
+    }
+    auto thread_mmaps = std::make_shared<std::vector<ThreadMmap>>();
+    if (!android::procinfo::ReadMapFileContent(
+            content.data(), [&](const android::procinfo::MapInfo& mapinfo) {
+              if ((mapinfo.flags & PROT_EXEC) || keep_non_executable_maps_) {
+                thread_mmaps->emplace_back(mapinfo.start, mapinfo.end - mapinfo.start,
+                                           mapinfo.pgoff, mapinfo.name.c_str(), mapinfo.flags);
+              }
+            })) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Limit the memory used by maps unlikely to be shared.
+    if (cached_content_size_ + content.size() <= kMaxCachedContentSize) {
+      size_t size = content.size();
+      if (maps_.emplace(std::move(content), thread_mmaps).second) {
+        cached_content_size_ += size;
+      }
+    }
+    return thread_mmaps;
+  }
+
+ private:
+  static constexpr size_t kMaxCachedContentSize = 32 * kMegabyte;
+
+  const bool keep_non_executable_maps_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const std::vector<ThreadMmap>>> maps_;
+  size_t cached_content_size_ = 0;
+};
+
+}  // namespace
+
+bool MapRecordReader::ReadProcessMapsInParallel(
+    const std::vector<std::pair<pid_t, std::unordered_set<pid_t>>>& processes,
+    uint64_t timestamp, size_t thread_count, const std::atomic<bool>* stop) {
+  // Each task reads a process into data, which is passed to callback_ in the calling thread.
+  struct Task {
+    pid_t pid;
+    const std::unordered_set<pid_t>* tids;
+    std::vector<char> data;
+    bool finished = false;
+  };
+  ProcessMapsCache maps_cache(keep_non_executable_maps_);
+  std::deque<std::unique_ptr<Task>> tasks;
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  auto run_task = [&](Task* task) {
+    MapRecordReader reader(attr_, event_id_, keep_non_executable_maps_);
+    reader.SetCallback([task](Record* r) {
+      task->data.insert(task->data.end(), r->Binary(), r->Binary() + r->size());
+      return true;
+    });
+    if (auto thread_mmaps = maps_cache.GetMaps(task->pid); thread_mmaps) {
+      if (task->tids->empty()) {
+        std::vector<pid_t> tids = GetThreadsInProcess(task->pid);
+        reader.DumpProcess(task->pid, std::unordered_set<pid_t>(tids.begin(), tids.end()),
+                           *thread_mmaps, timestamp);
+      } else {
+        reader.DumpProcess(task->pid, *task->tids, *thread_mmaps, timestamp);
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    task->finished = true;
+    cond.notify_all();
+  };
+
+  // Pass records of finished tasks in order, until there are at most max_pending_tasks tasks left.
+  auto pass_records = [&](size_t max_pending_tasks) {
+    while (!tasks.empty()) {
+      Task& task = *tasks.front();
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!task.finished) {
+          if (tasks.size() <= max_pending_tasks) {
+            break;
+          }
+          cond.wait(lock, [&]() { return task.finished; });
+        }
+      }
+      for (auto& r : ReadRecordsFromBuffer(attr_, task.data.data(), task.data.size())) {
+        if (!callback_(r.get())) {
+          return false;
+        }
+      }
+      tasks.pop_front();
+    }
+    return true;
+  };
+
+  // Declared after everything used by its tasks (including run_task). So on an early return, it
+  // is destroyed first, and waits for pending tasks before the things they use are destroyed.
+  ThreadPool thread_pool(thread_count);
+
+  for (const auto& [pid, tids] : processes) {
+    if (stop != nullptr && *stop) {
+      return false;
+    }
+    Task* task = tasks.emplace_back(new Task).get();
+    task->pid = pid;
+    task->tids = &tids;
+    thread_pool.AddTask([&run_task, task](size_t) { run_task(task); });
+    // Limit memory used by records waiting to be passed.
+    if (!pass_records(thread_count * 2)) {
+      return false;
+    }
+  }
+  return pass_records(0);
+}
+
+bool MapRecordReader::DumpProcess(pid_t pid, const std::unordered_set<pid_t>& tids,
+                                  const std::vector<ThreadMmap>& thread_mmaps,
+                                  uint64_t timestamp) {
+  // Dump mmap records.
   for (const auto& map : thread_mmaps) {
     if (!(map.prot & PROT_EXEC) && !keep_non_executable_maps_) {
       continue;
@@ -105,6 +255,12 @@ bool MapRecordReader::ReadProcessMaps(pid_t pid, const std::unordered_set<pid_t>
   return true;
 }
 
+size_t GetMapReadThreadCount() {
+  // Use a few threads, to not take much cpu time from profiled processes.
+  constexpr size_t kMaxMapReadThreads = 4;
+  return std::clamp<size_t>(GetOnlineCpus().size(), 1, kMaxMapReadThreads);
+}
+
 MapRecordThread::MapRecordThread(const MapRecordReader& map_record_reader)
     : map_record_reader_(map_record_reader), fp_(nullptr, fclose) {
   map_record_reader_.SetCallback([this](Record* r) { return WriteRecordToFile(r); });
@@ -127,15 +283,12 @@ bool MapRecordThread::RunThread() {
   if (!map_record_reader_.ReadKernelMaps()) {
     return false;
   }
-  for (auto pid : GetAllProcesses()) {
-    if (early_stop_) {
-      return false;
-    }
-    if (!map_record_reader_.ReadProcessMaps(pid, 0)) {
-      return false;
-    }
+  std::vector<std::pair<pid_t, std::unordered_set<pid_t>>> processes;
+  for (pid_t pid : GetAllProcesses()) {
+    processes.emplace_back(pid, std::unordered_set<pid_t>());
   }
-  return true;
+  return map_record_reader_.ReadProcessMapsInParallel(processes, 0, GetMapReadThreadCount(),
+                                                      &early_stop_);
 }
 
 bool MapRecordThread::WriteRecordToFile(Record* record) {
@@ -24,6 +24,7 @@
 #include <memory>
 #include <thread>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "event_attr.h"
@@ -31,6 +32,8 @@
 
 namespace simpleperf {
 
+struct ThreadMmap;
+
 class MapRecordReader {
  public:
   MapRecordReader(const perf_event_attr& attr, uint64_t event_id, bool keep_non_executable_maps)
@@ -43,14 +46,26 @@ class MapRecordReader {
   bool ReadProcessMaps(pid_t pid, uint64_t timestamp);
   // Read process maps and selected thread names in a process.
   bool ReadProcessMaps(pid_t pid, const std::unordered_set<pid_t>& tids, uint64_t timestamp);
+  // Read maps and thread names of processes in thread_count threads. An empty tid set means all
+  // threads in a process. Records are passed to the callback in the calling thread, in the order
+  // of processes. Return false if the callback fails, or stop is set before reading all processes.
+  bool ReadProcessMapsInParallel(
+      const std::vector<std::pair<pid_t, std::unordered_set<pid_t>>>& processes,
+      uint64_t timestamp, size_t thread_count, const std::atomic<bool>* stop = nullptr);
 
  private:
+  bool DumpProcess(pid_t pid, const std::unordered_set<pid_t>& tids,
+                   const std::vector<ThreadMmap>& thread_mmaps, uint64_t timestamp);
+
   const perf_event_attr& attr_;
   const uint64_t event_id_;
   const bool keep_non_executable_maps_;
   std::function<bool(Record*)> callback_;
 };
 
+// Return the number of threads used to read process maps in parallel.
+size_t GetMapReadThreadCount();
+
 // Create a thread for reading maps while recording. The maps are stored in a temporary file, and
 // read back after recording.
 class MapRecordThread {
@@ -70,6 +70,39 @@ TEST_F(MapRecordReaderTest, ReadProcessMaps) {
   ASSERT_GT(comm_record_count_, 0);
 }
 
+// @CddTest = 6.1/C-0-2
+TEST_F(MapRecordReaderTest, ReadProcessMapsInParallel) {
+  ASSERT_TRUE(CreateMapRecordReader());
+  std::vector<std::pair<pid_t, std::unordered_set<pid_t>>> processes;
+  for (size_t i = 0; i < 8; i++) {
+    processes.emplace_back(getpid(), std::unordered_set<pid_t>());
+  }
+  size_t process_comm_count = 0;
+  reader_->SetCallback([&](Record* r) {
+    if (r->type() == PERF_RECORD_COMM) {
+      auto comm = static_cast<CommRecord*>(r);
+      if (comm->data->pid == comm->data->tid) {
+        process_comm_count++;
+      }
+    }
+    return CountRecord(r);
+  });
+  ASSERT_TRUE(reader_->ReadProcessMapsInParallel(processes, 0, 3));
+  ASSERT_GE(map_record_count_, processes.size());
+  ASSERT_EQ(process_comm_count, processes.size());
+
+  // Stop reading when the stop flag is set.
+  std::atomic<bool> stop = true;
+  ASSERT_FALSE(reader_->ReadProcessMapsInParallel(processes, 0, 3, &stop));
+
+  // Stop reading when the callback fails, with tasks still pending.
+  for (size_t i = 0; i < 64; i++) {
+    processes.emplace_back(getpid(), std::unordered_set<pid_t>());
+  }
+  reader_->SetCallback([](Record*) { return false; });
+  ASSERT_FALSE(reader_->ReadProcessMapsInParallel(processes, 0, 3));
+}
+
 // @CddTest = 6.1/C-0-2
 TEST_F(MapRecordReaderTest, MapRecordThread) {
 #ifdef __ANDROID__
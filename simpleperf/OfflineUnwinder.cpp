@@ -23,6 +23,7 @@
 
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <unwindstack/Elf.h>
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/MachineArm64.h>
 #include <unwindstack/MachineX86.h>
@@ -228,18 +229,29 @@ void UnwindMaps::UpdateMaps(const MapSet& map_set) {
     } else if (i == old_size || entry->start_addr <= entries_[i]->start_addr) {
       // Add an entry.
       entries_.push_back(entry);
-      maps_.emplace_back(CreateMapInfo(entry));
+      std::shared_ptr<unwindstack::MapInfo> map_info = CreateMapInfo(entry);
+      // Look up unwindstack's ELF cache like MapInfo::GetElf(), to know if the ELF file is
+      // shared.
+      if (unwindstack::Elf::CachingEnabled() && !map_info->name().empty()) {
+        unwindstack::Elf::CacheLock();
+        bool hit = unwindstack::Elf::CacheGet(map_info.get());
+        unwindstack::Elf::CacheUnlock();
+        maps_with_uncounted_elf_[map_info.get()] = hit;
+      }
+      maps_.emplace_back(std::move(map_info));
       ++it;
     } else {
       // Remove an entry.
       has_removed_entry = true;
       entries_[i] = nullptr;
+      maps_with_uncounted_elf_.erase(maps_[i].get());
       maps_[i++] = nullptr;
     }
   }
   while (i < old_size) {
     has_removed_entry = true;
     entries_[i] = nullptr;
+    maps_with_uncounted_elf_.erase(maps_[i].get());
     maps_[i++] = nullptr;
   }
 
@@ -257,6 +269,27 @@ void UnwindMaps::UpdateMaps(const MapSet& map_set) {
   Sort();
 }
 
+void UnwindMaps::CountElfCacheUse(const std::vector<unwindstack::FrameData>& frames,
+                                  UnwindingCacheStat* stat) {
+  if (maps_with_uncounted_elf_.empty()) {
+    return;
+  }
+  for (const auto& frame : frames) {
+    if (frame.map_info == nullptr) {
+      continue;
+    }
+    auto it = maps_with_uncounted_elf_.find(frame.map_info.get());
+    if (it != maps_with_uncounted_elf_.end() && frame.map_info->elf()) {
+      if (it->second) {
+        stat->elf_cache_hits++;
+      } else {
+        stat->elf_cache_misses++;
+      }
+      maps_with_uncounted_elf_.erase(it);
+    }
+  }
+}
+
 void OfflineUnwinder::CollectMetaInfo(std::unordered_map<std::string, std::string>* info_map
                                       __attribute__((unused))) {
 #if defined(__aarch64__)
@@ -313,6 +346,7 @@ bool OfflineUnwinderImpl::UnwindCallChain(const ThreadEntry& thread, const RegSe
                                                stack_addr + stack_size));
   unwinder.SetResolveNames(false);
   unwinder.Unwind();
+  cached_map.CountElfCacheUse(unwinder.frames(), &cache_stat_);
   size_t last_jit_method_frame = UINT_MAX;
   for (auto& frame : unwinder.frames()) {
     // Unwinding in arm architecture can return 0 pc address.
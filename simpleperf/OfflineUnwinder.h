@@ -56,6 +56,15 @@ struct UnwindingResult {
   uint64_t stack_end;
 };
 
+// Stat of unwindstack's ELF cache, which is shared by all OfflineUnwinder instances in a process.
+// Each map used in unwinding is counted once.
+struct UnwindingCacheStat {
+  // Maps getting ELF files parsed before, by this or another unwinder.
+  uint64_t elf_cache_hits = 0;
+  // Maps whose ELF files weren't in the cache when the maps were added.
+  uint64_t elf_cache_misses = 0;
+};
+
 class OfflineUnwinder {
  public:
   static constexpr const char* META_KEY_ARM64_PAC_MASK = "arm64_pac_mask";
@@ -68,6 +77,7 @@ class OfflineUnwinder {
                                std::vector<uint64_t>* sps) = 0;
 
   const UnwindingResult& GetUnwindingResult() const { return unwinding_result_; }
+  const UnwindingCacheStat& GetCacheStat() const { return cache_stat_; }
 
   bool IsCallChainBrokenForIncompleteJITDebugInfo() {
     return is_callchain_broken_for_incomplete_jit_debug_info_;
@@ -80,6 +90,7 @@ class OfflineUnwinder {
   OfflineUnwinder() {}
 
   UnwindingResult unwinding_result_;
+  UnwindingCacheStat cache_stat_;
   bool is_callchain_broken_for_incomplete_jit_debug_info_ = false;
 };
 
@@ -16,8 +16,12 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
 #include <unwindstack/Maps.h>
 #include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
 
 #include "thread_tree.h"
 
@@ -26,10 +30,15 @@ namespace simpleperf {
 class UnwindMaps : public unwindstack::Maps {
  public:
   void UpdateMaps(const MapSet& map_set);
+  // Count ELF files of maps first used in frames as hits or misses of unwindstack's ELF cache.
+  void CountElfCacheUse(const std::vector<unwindstack::FrameData>& frames,
+                        UnwindingCacheStat* stat);
 
  private:
   uint64_t version_ = 0u;
   std::vector<const MapEntry*> entries_;
+  // Maps not used in unwinding yet, and whether they got ELF files from unwindstack's cache.
+  std::unordered_map<const unwindstack::MapInfo*, bool> maps_with_uncounted_elf_;
 };
 
 class OfflineUnwinderImpl : public OfflineUnwinder {
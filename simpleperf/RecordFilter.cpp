@@ -204,6 +204,16 @@ class TimeRanges {
 
   bool Empty() const { return ranges_.empty(); }
 
+  // Return a range covering all ranges. It should be called after NoMoreTimestamp().
+  TimeRange Bounds() const {
+    TimeRange bounds(UINT64_MAX, 0);
+    for (const TimeRange& range : ranges_) {
+      bounds.first = std::min(bounds.first, range.first);
+      bounds.second = std::max(bounds.second, range.second);
+    }
+    return bounds;
+  }
+
   bool InRange(uint64_t timestamp) const {
     auto it = std::upper_bound(ranges_.begin(), ranges_.end(),
                                std::pair<uint64_t, uint64_t>(timestamp, 0));
@@ -257,6 +267,34 @@ class TimeFilter : public RecordFilterCondition {
     return global_ranges_.Empty() && process_ranges_.empty() && thread_ranges_.empty();
   }
 
+  // Return a range covering timestamps of all samples passing the filter.
+  TimeRange GetTimeRange() const {
+    TimeRange result(0, UINT64_MAX);
+    auto intersect = [&](const TimeRange& range) {
+      result.first = std::max(result.first, range.first);
+      result.second = std::min(result.second, range.second);
+    };
+    auto get_bounds = [](const std::unordered_map<pid_t, TimeRanges>& ranges_map) {
+      TimeRange bounds(UINT64_MAX, 0);
+      for (const auto& [_, ranges] : ranges_map) {
+        TimeRange range = ranges.Bounds();
+        bounds.first = std::min(bounds.first, range.first);
+        bounds.second = std::max(bounds.second, range.second);
+      }
+      return bounds;
+    };
+    if (!global_ranges_.Empty()) {
+      intersect(global_ranges_.Bounds());
+    }
+    if (!process_ranges_.empty()) {
+      intersect(get_bounds(process_ranges_));
+    }
+    if (!thread_ranges_.empty()) {
+      intersect(get_bounds(thread_ranges_));
+    }
+    return result;
+  }
+
   bool Check(const SampleRecord& sample) override {
     uint64_t timestamp = sample.Timestamp();
     if (!global_ranges_.Empty() && !global_ranges_.InRange(timestamp)) {
@@ -521,6 +559,13 @@ bool RecordFilter::CheckClock(const std::string& clock) {
   return true;
 }
 
+std::optional<std::pair<uint64_t, uint64_t>> RecordFilter::GetTimeRange() const {
+  if (auto it = conditions_.find("time"); it != conditions_.end()) {
+    return static_cast<TimeFilter&>(*it->second).GetTimeRange();
+  }
+  return std::nullopt;
+}
+
 void RecordFilter::Clear() {
   conditions_.clear();
 }
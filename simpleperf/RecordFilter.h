@@ -130,6 +130,10 @@ class RecordFilter {
   // Check if the clock matches the clock for timestamps in the filter file.
   bool CheckClock(const std::string& clock);
 
+  // Return [start_time, end_time) containing timestamps of all samples passing the time filter
+  // in the filter file. Return std::nullopt if there is no time filter.
+  std::optional<std::pair<uint64_t, uint64_t>> GetTimeRange() const;
+
   // Clear filter conditions.
   void Clear();
 
@@ -17,6 +17,7 @@
 #include "RecordReadThread.h"
 
 #include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -31,6 +32,13 @@ namespace simpleperf {
 
 static constexpr size_t kDefaultLowBufferLevel = 10 * kMegabyte;
 static constexpr size_t kDefaultCriticalBufferLevel = 5 * kMegabyte;
+// When using multiple read threads, each read thread checks its kernel buffers periodically to
+// update its watermark, even if it doesn't receive data notifications.
+static constexpr double kUpdateWatermarkPeriodInSec = 0.05;
+// The kernel takes the time of a record before writing it to a kernel buffer. If the writing cpu
+// is interrupted in between, a record may be visible after a read with a later start time. So a
+// watermark from the clock is kept behind the read start time by this margin.
+static constexpr uint64_t kWatermarkClockMarginInNs = 100000000;
 
 RecordBuffer::RecordBuffer(size_t buffer_size)
     : read_head_(0), write_head_(0), buffer_size_(buffer_size), buffer_(new char[buffer_size]) {}
@@ -224,9 +232,8 @@ bool KernelRecordReader::MoveToNextRecord(const RecordParser& parser) {
 RecordReadThread::RecordReadThread(size_t record_buffer_size, const perf_event_attr& attr,
                                    size_t min_mmap_pages, size_t max_mmap_pages,
                                    size_t aux_buffer_size, bool allow_truncating_samples,
-                                   bool exclude_perf)
-    : record_buffer_(record_buffer_size),
-      record_parser_(attr),
+                                   bool exclude_perf, size_t read_thread_count)
+    : record_parser_(attr),
       attr_(attr),
       min_mmap_pages_(min_mmap_pages),
       max_mmap_pages_(max_mmap_pages),
@@ -234,6 +241,18 @@ RecordReadThread::RecordReadThread(size_t record_buffer_size, const perf_event_a
   if (attr.sample_type & PERF_SAMPLE_STACK_USER) {
     stack_size_in_sample_record_ = attr.sample_stack_user;
   }
+  read_thread_count = std::max<size_t>(read_thread_count, 1);
+  if (read_thread_count > 1 && !attr.use_clockid) {
+    // Watermarks of read threads are compared with record times. So the records need a clock
+    // readable in userspace.
+    LOG(WARNING) << "Using multiple read threads needs a clockid other than perf. Use one thread.";
+    read_thread_count = 1;
+  }
+  merge_by_time_ = read_thread_count > 1;
+  record_buffer_size /= read_thread_count;
+  for (size_t i = 0; i < read_thread_count; i++) {
+    read_threads_.emplace_back(new ReadThread(i, record_buffer_size));
+  }
   record_buffer_low_level_ = std::min(record_buffer_size / 4, kDefaultLowBufferLevel);
   record_buffer_critical_level_ = std::min(record_buffer_size / 6, kDefaultCriticalBufferLevel);
   LOG(VERBOSE) << "user buffer size = " << record_buffer_size
@@ -248,21 +267,27 @@ RecordReadThread::RecordReadThread(size_t record_buffer_size, const perf_event_a
 }
 
 RecordReadThread::~RecordReadThread() {
-  if (read_thread_) {
+  if (read_thread_started_) {
     StopReadThread();
   }
 }
 
 bool RecordReadThread::RegisterDataCallback(IOEventLoop& loop,
                                             const std::function<bool()>& data_callback) {
-  int cmd_fd[2];
+  for (auto& t : read_threads_) {
+    int cmd_fd[2];
+    if (pipe2(cmd_fd, O_CLOEXEC) != 0) {
+      PLOG(ERROR) << "pipe2";
+      return false;
+    }
+    t->read_cmd_fd.reset(cmd_fd[0]);
+    t->write_cmd_fd.reset(cmd_fd[1]);
+  }
   int data_fd[2];
-  if (pipe2(cmd_fd, O_CLOEXEC) != 0 || pipe2(data_fd, O_CLOEXEC) != 0) {
+  if (pipe2(data_fd, O_CLOEXEC) != 0) {
     PLOG(ERROR) << "pipe2";
     return false;
   }
-  read_cmd_fd_.reset(cmd_fd[0]);
-  write_cmd_fd_.reset(cmd_fd[1]);
   cmd_ = NO_CMD;
   read_data_fd_.reset(data_fd[0]);
   write_data_fd_.reset(data_fd[1]);
@@ -270,7 +295,11 @@ bool RecordReadThread::RegisterDataCallback(IOEventLoop& loop,
   if (!loop.AddReadEvent(read_data_fd_, data_callback)) {
     return false;
   }
-  read_thread_.reset(new std::thread([&]() { RunReadThread(); }));
+  for (auto& t : read_threads_) {
+    ReadThread* p = t.get();
+    t->thread.reset(new std::thread([this, p]() { RunReadThread(*p); }));
+  }
+  read_thread_started_ = true;
   return true;
 }
 
@@ -288,11 +317,14 @@ bool RecordReadThread::SyncKernelBuffer() {
 
 bool RecordReadThread::StopReadThread() {
   bool result = true;
-  if (read_thread_ != nullptr) {
+  if (read_thread_started_) {
     result = SendCmdToReadThread(CMD_STOP_THREAD, nullptr);
     if (result) {
-      read_thread_->join();
-      read_thread_ = nullptr;
+      for (auto& t : read_threads_) {
+        t->thread->join();
+        t->thread = nullptr;
+      }
+      read_thread_started_ = false;
     }
   }
   return result;
@@ -303,10 +335,14 @@ bool RecordReadThread::SendCmdToReadThread(Cmd cmd, void* cmd_arg) {
     std::lock_guard<std::mutex> lock(cmd_mutex_);
     cmd_ = cmd;
     cmd_arg_ = cmd_arg;
+    cmd_result_ = true;
+    cmd_pending_threads_ = read_threads_.size();
   }
   char unused = 0;
-  if (TEMP_FAILURE_RETRY(write(write_cmd_fd_, &unused, 1)) != 1) {
-    return false;
+  for (auto& t : read_threads_) {
+    if (TEMP_FAILURE_RETRY(write(t->write_cmd_fd, &unused, 1)) != 1) {
+      return false;
+    }
   }
   std::unique_lock<std::mutex> lock(cmd_mutex_);
   while (cmd_ != NO_CMD) {
@@ -315,31 +351,112 @@ bool RecordReadThread::SendCmdToReadThread(Cmd cmd, void* cmd_arg) {
   return cmd_result_;
 }
 
-std::unique_ptr<Record> RecordReadThread::GetRecord() {
-  record_buffer_.MoveToNextRecord();
-  char* p = record_buffer_.GetCurrentRecord();
-  if (p != nullptr) {
-    std::unique_ptr<Record> r = ReadRecordFromBuffer(attr_, p, record_buffer_.BufferEnd());
-    CHECK(r);
-    if (r->type() == PERF_RECORD_AUXTRACE) {
-      auto auxtrace = static_cast<AuxTraceRecord*>(r.get());
-      record_buffer_.AddCurrentRecordSize(auxtrace->data->aux_size);
-      auxtrace->location.addr = r->Binary() + r->size();
+size_t RecordReadThread::GetReadThreadIndex(int cpu) const {
+  // Event fds not bound to a cpu are read in the first read thread.
+  return cpu < 0 ? 0 : static_cast<size_t>(cpu) % read_threads_.size();
+}
+
+uint64_t RecordReadThread::GetRecordTime(const char* p) const {
+  perf_event_header header;
+  memcpy(&header, p, sizeof(header));
+  uint64_t time = 0;
+  // Records generated by simpleperf (like AUXTRACE records) don't have time. They are returned
+  // before other records.
+  if (header.type < PERF_RECORD_USER_DEFINED_TYPE_START) {
+    if (size_t time_pos = record_parser_.GetTimePos(header); time_pos != 0) {
+      memcpy(&time, p + time_pos, sizeof(time));
     }
-    return r;
   }
-  if (has_data_notification_) {
+  return time;
+}
+
+uint64_t RecordReadThread::GetCurrentTime() const {
+  timespec ts;
+  clock_gettime(static_cast<clockid_t>(attr_.clockid), &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+const RecordStat& RecordReadThread::GetStat() {
+  stat_ = RecordStat();
+  for (auto& t : read_threads_) {
+    stat_.kernelspace_lost_records += t->stat.kernelspace_lost_records;
+    stat_.userspace_lost_samples += t->stat.userspace_lost_samples;
+    stat_.userspace_lost_non_samples += t->stat.userspace_lost_non_samples;
+    stat_.userspace_truncated_stack_samples += t->stat.userspace_truncated_stack_samples;
+    stat_.aux_data_size += t->stat.aux_data_size;
+    stat_.lost_aux_data_size += t->stat.lost_aux_data_size;
+  }
+  return stat_;
+}
+
+std::unique_ptr<Record> RecordReadThread::GetRecord() {
+  // The record returned last time isn't used any more.
+  if (last_record_thread_ != nullptr) {
+    last_record_thread_->record_buffer.MoveToNextRecord();
+    last_record_thread_->cur_record = nullptr;
+    last_record_thread_ = nullptr;
+  }
+  while (true) {
+    // Records in each RecordBuffer are ordered by time. So merge records by picking the one with
+    // the smallest time among the current records of all RecordBuffers. But a read thread may
+    // not have pushed an earlier record yet. So the picked record is only returned when its time
+    // isn't above the watermarks of all read threads reading kernel buffers. The watermarks are
+    // loaded before the records, so records pushed before the watermarks are visible.
+    uint64_t min_watermark = UINT64_MAX;
+    if (merge_by_time_) {
+      for (auto& t : read_threads_) {
+        if (t->has_kernel_buffers.load(std::memory_order_acquire)) {
+          min_watermark = std::min(min_watermark, t->watermark.load(std::memory_order_acquire));
+        }
+      }
+    }
+    ReadThread* selected = nullptr;
+    for (auto& t : read_threads_) {
+      if (t->cur_record == nullptr) {
+        t->cur_record = t->record_buffer.GetCurrentRecord();
+        if (t->cur_record == nullptr) {
+          continue;
+        }
+        if (merge_by_time_) {
+          t->cur_record_time = GetRecordTime(t->cur_record);
+        }
+      }
+      if (selected == nullptr || t->cur_record_time < selected->cur_record_time) {
+        selected = t.get();
+      }
+    }
+    if (selected != nullptr && selected->cur_record_time <= min_watermark) {
+      last_record_thread_ = selected;
+      RecordBuffer& record_buffer = selected->record_buffer;
+      char* p = selected->cur_record;
+      std::unique_ptr<Record> r = ReadRecordFromBuffer(attr_, p, record_buffer.BufferEnd());
+      CHECK(r);
+      if (r->type() == PERF_RECORD_AUXTRACE) {
+        auto auxtrace = static_cast<AuxTraceRecord*>(r.get());
+        record_buffer.AddCurrentRecordSize(auxtrace->data->aux_size);
+        auxtrace->location.addr = r->Binary() + r->size();
+      }
+      return r;
+    }
+    if (!has_data_notification_) {
+      return nullptr;
+    }
+    // Consume the notification and check again. Records and watermarks updated before the
+    // notification was consumed may not be seen above, and won't cause another notification.
     char unused;
     TEMP_FAILURE_RETRY(read(read_data_fd_, &unused, 1));
     has_data_notification_ = false;
   }
-  return nullptr;
 }
 
-void RecordReadThread::RunReadThread() {
+void RecordReadThread::RunReadThread(ReadThread& t) {
   IncreaseThreadPriority();
   IOEventLoop loop;
-  CHECK(loop.AddReadEvent(read_cmd_fd_, [&]() { return HandleCmd(loop); }));
+  CHECK(loop.AddReadEvent(t.read_cmd_fd, [&]() { return HandleCmd(t, loop); }));
+  if (merge_by_time_) {
+    CHECK(loop.AddPeriodicEvent(SecondToTimeval(kUpdateWatermarkPeriodInSec),
+                                [&]() { return ReadRecordsFromKernelBuffer(t); }));
+  }
   loop.RunLoop();
 }
 
@@ -360,21 +477,23 @@ RecordReadThread::Cmd RecordReadThread::GetCmd() {
   return cmd_;
 }
 
-bool RecordReadThread::HandleCmd(IOEventLoop& loop) {
+bool RecordReadThread::HandleCmd(ReadThread& t, IOEventLoop& loop) {
   char unused;
-  TEMP_FAILURE_RETRY(read(read_cmd_fd_, &unused, 1));
+  TEMP_FAILURE_RETRY(read(t.read_cmd_fd, &unused, 1));
   bool result = true;
   switch (GetCmd()) {
     case CMD_ADD_EVENT_FDS:
-      result = HandleAddEventFds(loop, *static_cast<std::vector<EventFd*>*>(cmd_arg_));
+      result = HandleAddEventFds(t, loop, *static_cast<std::vector<EventFd*>*>(cmd_arg_));
       break;
     case CMD_REMOVE_EVENT_FDS:
-      result = HandleRemoveEventFds(*static_cast<std::vector<EventFd*>*>(cmd_arg_));
+      result = HandleRemoveEventFds(t, *static_cast<std::vector<EventFd*>*>(cmd_arg_));
       break;
     case CMD_SYNC_KERNEL_BUFFER:
-      result = ReadRecordsFromKernelBuffer();
+      result = ReadRecordsFromKernelBuffer(t);
       break;
     case CMD_STOP_THREAD:
+      // No more records will be pushed, so release all records to the main thread.
+      t.watermark.store(UINT64_MAX, std::memory_order_release);
       result = loop.ExitLoop();
       break;
     default:
@@ -383,14 +502,25 @@ bool RecordReadThread::HandleCmd(IOEventLoop& loop) {
       break;
   }
   std::lock_guard<std::mutex> lock(cmd_mutex_);
-  cmd_ = NO_CMD;
-  cmd_result_ = result;
-  cmd_finish_cond_.notify_one();
+  cmd_result_ = cmd_result_ && result;
+  if (--cmd_pending_threads_ == 0) {
+    cmd_ = NO_CMD;
+    cmd_finish_cond_.notify_one();
+  }
   return true;
 }
 
-bool RecordReadThread::HandleAddEventFds(IOEventLoop& loop,
-                                         const std::vector<EventFd*>& event_fds) {
+bool RecordReadThread::HandleAddEventFds(ReadThread& t, IOEventLoop& loop,
+                                         const std::vector<EventFd*>& all_event_fds) {
+  std::vector<EventFd*> event_fds;
+  for (EventFd* fd : all_event_fds) {
+    if (GetReadThreadIndex(fd->Cpu()) == t.index) {
+      event_fds.push_back(fd);
+    }
+  }
+  if (event_fds.empty()) {
+    return true;
+  }
   std::unordered_map<int, EventFd*> cpu_map;
   for (size_t pages = max_mmap_pages_; pages >= min_mmap_pages_; pages >>= 1) {
     bool success = true;
@@ -408,7 +538,7 @@ bool RecordReadThread::HandleAddEventFds(IOEventLoop& loop,
             success = false;
             break;
           }
-          has_etm_events_ = true;
+          t.has_etm_events = true;
         }
         cpu_map[fd->Cpu()] = fd;
       } else {
@@ -432,28 +562,31 @@ bool RecordReadThread::HandleAddEventFds(IOEventLoop& loop,
     return false;
   }
   for (auto& pair : cpu_map) {
-    if (!pair.second->StartPolling(loop, [this]() { return ReadRecordsFromKernelBuffer(); })) {
+    if (!pair.second->StartPolling(loop, [&]() { return ReadRecordsFromKernelBuffer(t); })) {
       return false;
     }
-    kernel_record_readers_.emplace_back(pair.second);
+    t.kernel_record_readers.emplace_back(pair.second);
   }
+  t.has_kernel_buffers.store(!t.kernel_record_readers.empty(), std::memory_order_release);
   return true;
 }
 
-bool RecordReadThread::HandleRemoveEventFds(const std::vector<EventFd*>& event_fds) {
+bool RecordReadThread::HandleRemoveEventFds(ReadThread& t,
+                                            const std::vector<EventFd*>& event_fds) {
   for (auto& event_fd : event_fds) {
     if (event_fd->HasMappedBuffer()) {
       auto it = std::find_if(
-          kernel_record_readers_.begin(), kernel_record_readers_.end(),
+          t.kernel_record_readers.begin(), t.kernel_record_readers.end(),
           [&](const KernelRecordReader& reader) { return reader.GetEventFd() == event_fd; });
-      if (it != kernel_record_readers_.end()) {
-        kernel_record_readers_.erase(it);
+      if (it != t.kernel_record_readers.end()) {
+        t.kernel_record_readers.erase(it);
         event_fd->StopPolling();
         event_fd->DestroyMappedBuffer();
         event_fd->DestroyAuxBuffer();
       }
     }
   }
+  t.has_kernel_buffers.store(!t.kernel_record_readers.empty(), std::memory_order_release);
   return true;
 }
 
@@ -464,10 +597,11 @@ static bool CompareRecordTime(KernelRecordReader* r1, KernelRecordReader* r2) {
 // When reading from mmap buffers, we prefer reading from all buffers at once rather than reading
 // one buffer at a time. Because by reading all buffers at once, we can merge records from
 // different buffers easily in memory. Otherwise, we have to sort records with greater effort.
-bool RecordReadThread::ReadRecordsFromKernelBuffer() {
+bool RecordReadThread::ReadRecordsFromKernelBuffer(ReadThread& t) {
   do {
+    uint64_t start_time = merge_by_time_ ? GetCurrentTime() : 0;
     std::vector<KernelRecordReader*> readers;
-    for (auto& reader : kernel_record_readers_) {
+    for (auto& reader : t.kernel_record_readers) {
       if (reader.GetDataFromKernelBuffer()) {
         readers.push_back(&reader);
       }
@@ -478,7 +612,7 @@ bool RecordReadThread::ReadRecordsFromKernelBuffer() {
       if (readers.size() == 1u) {
         // Only one buffer has data, process it directly.
         while (readers[0]->MoveToNextRecord(record_parser_)) {
-          PushRecordToRecordBuffer(readers[0]);
+          PushRecordToRecordBuffer(t, readers[0]);
         }
       } else {
         // Use a binary heap to merge records from different buffers. As records from the same
@@ -492,7 +626,7 @@ bool RecordReadThread::ReadRecordsFromKernelBuffer() {
         size_t size = readers.size();
         while (size > 0) {
           std::pop_heap(readers.begin(), readers.begin() + size, CompareRecordTime);
-          PushRecordToRecordBuffer(readers[size - 1]);
+          PushRecordToRecordBuffer(t, readers[size - 1]);
           if (readers[size - 1]->MoveToNextRecord(record_parser_)) {
             std::push_heap(readers.begin(), readers.begin() + size, CompareRecordTime);
           } else {
@@ -501,18 +635,30 @@ bool RecordReadThread::ReadRecordsFromKernelBuffer() {
         }
       }
     }
-    ReadAuxDataFromKernelBuffer(&has_data);
+    ReadAuxDataFromKernelBuffer(t, &has_data);
+    if (merge_by_time_) {
+      // Records in a kernel buffer are ordered by time. So records read later have time >= the
+      // time of the last record read. And they have time >= start_time - margin, since the kernel
+      // writes a record soon after taking its time.
+      uint64_t clock_watermark =
+          start_time > kWatermarkClockMarginInNs ? start_time - kWatermarkClockMarginInNs : 0;
+      t.watermark.store(std::max(clock_watermark, t.last_pushed_time), std::memory_order_release);
+    }
     if (!has_data) {
+      // The new watermark may release records held by the main thread.
+      if (merge_by_time_ && !SendDataNotificationToMainThread(t)) {
+        return false;
+      }
       break;
     }
     // Having collected everything available, this is a good time to
     // try to re-enabled any events that might have been disabled by
     // the kernel.
-    for (auto event_fd : event_fds_disabled_by_kernel_) {
+    for (auto event_fd : t.event_fds_disabled_by_kernel) {
       event_fd->SetEnableEvent(true);
     }
-    event_fds_disabled_by_kernel_.clear();
-    if (!SendDataNotificationToMainThread()) {
+    t.event_fds_disabled_by_kernel.clear();
+    if (!SendDataNotificationToMainThread(t)) {
       return false;
     }
     // If there are no commands, we can loop until there is no more data from the kernel.
@@ -520,8 +666,12 @@ bool RecordReadThread::ReadRecordsFromKernelBuffer() {
   return true;
 }
 
-void RecordReadThread::PushRecordToRecordBuffer(KernelRecordReader* kernel_record_reader) {
+void RecordReadThread::PushRecordToRecordBuffer(ReadThread& t,
+                                                KernelRecordReader* kernel_record_reader) {
+  RecordBuffer& record_buffer = t.record_buffer;
+  RecordStat& stat = t.stat;
   const perf_event_header& header = kernel_record_reader->RecordHeader();
+  t.last_pushed_time = std::max(t.last_pushed_time, kernel_record_reader->RecordTime());
   if (header.type == PERF_RECORD_SAMPLE && exclude_pid_ != -1) {
     uint32_t pid;
     kernel_record_reader->ReadRecord(record_parser_.GetPidPosInSampleRecord(), sizeof(pid), &pid);
@@ -530,11 +680,11 @@ void RecordReadThread::PushRecordToRecordBuffer(KernelRecordReader* kernel_recor
     }
   }
   if (header.type == PERF_RECORD_SAMPLE && stack_size_in_sample_record_ > 1024) {
-    size_t free_size = record_buffer_.GetFreeSize();
+    size_t free_size = record_buffer.GetFreeSize();
     if (free_size < record_buffer_critical_level_) {
       // When the free size in record buffer is below critical level, drop sample records to save
       // space for more important records (like mmap or fork records).
-      stat_.userspace_lost_samples++;
+      stat.userspace_lost_samples++;
       return;
     }
     size_t stack_size_limit = stack_size_in_sample_record_;
@@ -570,7 +720,7 @@ void RecordReadThread::PushRecordToRecordBuffer(KernelRecordReader* kernel_recor
         // Remove part of the stack data.
         perf_event_header new_header = header;
         new_header.size -= stack_size - new_stack_size;
-        char* p = record_buffer_.AllocWriteSpace(new_header.size);
+        char* p = record_buffer.AllocWriteSpace(new_header.size);
         if (p != nullptr) {
           memcpy(p, &new_header, sizeof(new_header));
           size_t pos = sizeof(new_header);
@@ -579,18 +729,18 @@ void RecordReadThread::PushRecordToRecordBuffer(KernelRecordReader* kernel_recor
           pos = stack_size_pos + sizeof(uint64_t);
           kernel_record_reader->ReadRecord(pos, new_stack_size, p + pos);
           memcpy(p + pos + new_stack_size, &new_stack_size, sizeof(uint64_t));
-          record_buffer_.FinishWrite();
+          record_buffer.FinishWrite();
           if (new_stack_size < dyn_stack_size) {
-            stat_.userspace_truncated_stack_samples++;
+            stat.userspace_truncated_stack_samples++;
           }
         } else {
-          stat_.userspace_lost_samples++;
+          stat.userspace_lost_samples++;
         }
         return;
       }
     }
   }
-  char* p = record_buffer_.AllocWriteSpace(header.size);
+  char* p = record_buffer.AllocWriteSpace(header.size);
   if (p != nullptr) {
     kernel_record_reader->ReadRecord(0, header.size, p);
     if (header.type == PERF_RECORD_AUX) {
@@ -602,29 +752,31 @@ void RecordReadThread::PushRecordToRecordBuffer(KernelRecordReader* kernel_recor
         // The truncated flag is set by the Coresight driver when some trace was lost,
         // which can be caused by a full buffer. Therefore, try to re-enable the event
         // only after we have collected the aux data.
-        event_fds_disabled_by_kernel_.insert(kernel_record_reader->GetEventFd());
+        t.event_fds_disabled_by_kernel.insert(kernel_record_reader->GetEventFd());
       }
     } else if (header.type == PERF_RECORD_LOST) {
       LostRecord r;
       if (r.Parse(attr_, p, p + header.size)) {
-        stat_.kernelspace_lost_records += static_cast<size_t>(r.lost);
+        stat.kernelspace_lost_records += static_cast<size_t>(r.lost);
       }
     }
-    record_buffer_.FinishWrite();
+    record_buffer.FinishWrite();
   } else {
     if (header.type == PERF_RECORD_SAMPLE) {
-      stat_.userspace_lost_samples++;
+      stat.userspace_lost_samples++;
     } else {
-      stat_.userspace_lost_non_samples++;
+      stat.userspace_lost_non_samples++;
     }
   }
 }
 
-void RecordReadThread::ReadAuxDataFromKernelBuffer(bool* has_data) {
-  if (!has_etm_events_) {
+void RecordReadThread::ReadAuxDataFromKernelBuffer(ReadThread& t, bool* has_data) {
+  if (!t.has_etm_events) {
     return;
   }
-  for (auto& reader : kernel_record_readers_) {
+  RecordBuffer& record_buffer = t.record_buffer;
+  RecordStat& stat = t.stat;
+  for (auto& reader : t.kernel_record_readers) {
     EventFd* event_fd = reader.GetEventFd();
     if (event_fd->HasAuxBuffer()) {
       char* buf[2];
@@ -638,9 +790,9 @@ void RecordReadThread::ReadAuxDataFromKernelBuffer(bool* has_data) {
       AuxTraceRecord auxtrace(Align(aux_size, 8), offset, event_fd->Cpu(), 0, event_fd->Cpu());
       size_t alloc_size = auxtrace.size() + auxtrace.data->aux_size;
       char* p = nullptr;
-      if ((record_buffer_.GetFreeSize() < alloc_size + record_buffer_critical_level_) ||
-          (p = record_buffer_.AllocWriteSpace(alloc_size)) == nullptr) {
-        stat_.lost_aux_data_size += aux_size;
+      if ((record_buffer.GetFreeSize() < alloc_size + record_buffer_critical_level_) ||
+          (p = record_buffer.AllocWriteSpace(alloc_size)) == nullptr) {
+        stat.lost_aux_data_size += aux_size;
       } else {
         CHECK(p != nullptr);
         MoveToBinaryFormat(auxtrace.Binary(), auxtrace.size(), p);
@@ -653,8 +805,8 @@ void RecordReadThread::ReadAuxDataFromKernelBuffer(bool* has_data) {
           uint64_t pad = 0;
           memcpy(p, &pad, pad_size);
         }
-        record_buffer_.FinishWrite();
-        stat_.aux_data_size += aux_size;
+        record_buffer.FinishWrite();
+        stat.aux_data_size += aux_size;
         LOG(DEBUG) << "record aux data " << aux_size << " bytes";
       }
       event_fd->DiscardAuxData(aux_size);
@@ -662,17 +814,18 @@ void RecordReadThread::ReadAuxDataFromKernelBuffer(bool* has_data) {
   }
 }
 
-bool RecordReadThread::SendDataNotificationToMainThread() {
-  if (has_etm_events_) {
+bool RecordReadThread::SendDataNotificationToMainThread(ReadThread& t) {
+  if (t.has_etm_events) {
     // For ETM recording, the default buffer size is large enough to hold ETM data for several
     // seconds. To reduce impact of processing ETM data (especially when --decode-etm is used),
     // delay processing ETM data until the buffer is half full.
-    if (record_buffer_.GetFreeSize() >= record_buffer_.size() / 2) {
+    if (t.record_buffer.GetFreeSize() >= t.record_buffer.size() / 2) {
       return true;
     }
   }
-  if (!has_data_notification_.load(std::memory_order_relaxed)) {
-    has_data_notification_ = true;
+  // Multiple read threads may send notifications at the same time. Only send one of them.
+  if (!has_data_notification_.load() &&
+      !has_data_notification_.exchange(true)) {
     char unused = 0;
     if (TEMP_FAILURE_RETRY(write(write_data_fd_, &unused, 1)) != 1) {
       PLOG(ERROR) << "write";
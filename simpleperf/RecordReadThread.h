@@ -128,12 +128,19 @@ class KernelRecordReader {
 
 // To reduce sample lost rate when recording dwarf based call graph, RecordReadThread uses a
 // separate high priority (nice -20) thread to read records from kernel buffers to a RecordBuffer.
+// On devices with many cpus, one thread may not be fast enough to read all kernel buffers. So
+// RecordReadThread can use multiple read threads. Each read thread reads kernel buffers of a
+// subset of cpus to its own RecordBuffer. And the main thread merges records from all
+// RecordBuffers by time.
 class RecordReadThread {
  public:
+  // record_buffer_size is split evenly between read threads.
   RecordReadThread(size_t record_buffer_size, const perf_event_attr& attr, size_t min_mmap_pages,
                    size_t max_mmap_pages, size_t aux_buffer_size,
-                   bool allow_truncating_samples = true, bool exclude_perf = false);
+                   bool allow_truncating_samples = true, bool exclude_perf = false,
+                   size_t read_thread_count = 1);
   ~RecordReadThread();
+  // Buffer levels are checked against the RecordBuffer of each read thread.
   void SetBufferLevels(size_t record_buffer_low_level, size_t record_buffer_critical_level) {
     record_buffer_low_level_ = record_buffer_low_level;
     record_buffer_critical_level_ = record_buffer_critical_level;
@@ -155,7 +162,7 @@ class RecordReadThread {
   // If available, return the next record in the RecordBuffer, otherwise return nullptr.
   std::unique_ptr<Record> GetRecord();
 
-  const RecordStat& GetStat() const { return stat_; }
+  const RecordStat& GetStat();
 
  private:
   enum Cmd {
@@ -166,22 +173,60 @@ class RecordReadThread {
     CMD_STOP_THREAD,
   };
 
+  // Data owned by a read thread.
+  struct ReadThread {
+    ReadThread(size_t index, size_t record_buffer_size)
+        : index(index), record_buffer(record_buffer_size) {}
+
+    const size_t index;
+    // Written by the read thread, and read by the main thread.
+    RecordBuffer record_buffer;
+    // Used to pass command notification from the main thread to the read thread.
+    android::base::unique_fd write_cmd_fd;
+    android::base::unique_fd read_cmd_fd;
+    std::unique_ptr<std::thread> thread;
+    std::vector<KernelRecordReader> kernel_record_readers;
+    bool has_etm_events = false;
+    std::unordered_set<EventFd*> event_fds_disabled_by_kernel;
+    RecordStat stat;
+
+    // Below fields are used to merge records from multiple read threads.
+    // Set by the read thread when it has kernel buffers to read.
+    std::atomic_bool has_kernel_buffers = false;
+    // Records with time <= watermark have all been pushed into record_buffer. Updated by the
+    // read thread after each pass over its kernel buffers.
+    std::atomic<uint64_t> watermark = 0;
+    // Time of the last record read from kernel buffers. Only used by the read thread.
+    uint64_t last_pushed_time = 0;
+    // The next record to return in record_buffer, or nullptr if not got yet.
+    char* cur_record = nullptr;
+    uint64_t cur_record_time = 0;
+  };
+
   bool SendCmdToReadThread(Cmd cmd, void* cmd_arg);
+  size_t GetReadThreadIndex(int cpu) const;
+  uint64_t GetRecordTime(const char* p) const;
+  uint64_t GetCurrentTime() const;
 
-  // Below functions are called in the read thread:
+  // Below functions are called in read threads:
 
-  void RunReadThread();
+  void RunReadThread(ReadThread& t);
   void IncreaseThreadPriority();
   Cmd GetCmd();
-  bool HandleCmd(IOEventLoop& loop);
-  bool HandleAddEventFds(IOEventLoop& loop, const std::vector<EventFd*>& event_fds);
-  bool HandleRemoveEventFds(const std::vector<EventFd*>& event_fds);
-  bool ReadRecordsFromKernelBuffer();
-  void PushRecordToRecordBuffer(KernelRecordReader* kernel_record_reader);
-  void ReadAuxDataFromKernelBuffer(bool* has_data);
-  bool SendDataNotificationToMainThread();
-
-  RecordBuffer record_buffer_;
+  bool HandleCmd(ReadThread& t, IOEventLoop& loop);
+  bool HandleAddEventFds(ReadThread& t, IOEventLoop& loop,
+                         const std::vector<EventFd*>& event_fds);
+  bool HandleRemoveEventFds(ReadThread& t, const std::vector<EventFd*>& event_fds);
+  bool ReadRecordsFromKernelBuffer(ReadThread& t);
+  void PushRecordToRecordBuffer(ReadThread& t, KernelRecordReader* kernel_record_reader);
+  void ReadAuxDataFromKernelBuffer(ReadThread& t, bool* has_data);
+  bool SendDataNotificationToMainThread(ReadThread& t);
+
+  std::vector<std::unique_ptr<ReadThread>> read_threads_;
+  // Whether records from multiple read threads are merged by time.
+  bool merge_by_time_ = false;
+  // The read thread whose current record was returned by the last GetRecord() call.
+  ReadThread* last_record_thread_ = nullptr;
   // When free size in record buffer is below low level, we cut stack data of sample records to 1K.
   size_t record_buffer_low_level_;
   // When free size in record buffer is below critical level, we drop sample records to avoid
@@ -194,27 +239,24 @@ class RecordReadThread {
   size_t max_mmap_pages_;
   size_t aux_buffer_size_;
 
-  // Used to pass command notification from the main thread to the read thread.
-  android::base::unique_fd write_cmd_fd_;
-  android::base::unique_fd read_cmd_fd_;
+  // Used to pass commands from the main thread to read threads. A command finishes after all
+  // read threads handle it.
   std::mutex cmd_mutex_;
   std::condition_variable cmd_finish_cond_;
   Cmd cmd_;
   void* cmd_arg_;
   bool cmd_result_;
+  size_t cmd_pending_threads_ = 0;
 
-  // Used to send data notification from the read thread to the main thread.
+  // Used to send data notification from read threads to the main thread.
   android::base::unique_fd write_data_fd_;
   android::base::unique_fd read_data_fd_;
   std::atomic_bool has_data_notification_;
 
-  std::unique_ptr<std::thread> read_thread_;
-  std::vector<KernelRecordReader> kernel_record_readers_;
+  bool read_thread_started_ = false;
   pid_t exclude_pid_ = -1;
-  bool has_etm_events_ = false;
-
-  std::unordered_set<EventFd*> event_fds_disabled_by_kernel_;
 
+  // Sum of stats in read threads.
   RecordStat stat_;
 };
 
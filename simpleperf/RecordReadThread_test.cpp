@@ -26,6 +26,7 @@
 #include "record_file.h"
 
 using ::testing::_;
+using ::testing::AtLeast;
 using ::testing::Eq;
 using ::testing::Return;
 using ::testing::Truly;
@@ -237,7 +238,10 @@ TEST(KernelRecordReader, smoke) {
 // @CddTest = 6.1/C-0-2
 class RecordReadThreadTest : public ::testing::Test {
  protected:
-  std::vector<EventFd*> CreateFakeEventFds(const perf_event_attr& attr, size_t event_fd_count) {
+  // With multiple read threads, kernel buffers are also read periodically. So allow reading
+  // them repeatedly.
+  std::vector<EventFd*> CreateFakeEventFds(const perf_event_attr& attr, size_t event_fd_count,
+                                           bool read_repeatedly = false) {
     size_t records_per_fd = records_.size() / event_fd_count;
     buffers_.clear();
     buffers_.resize(event_fd_count);
@@ -256,9 +260,16 @@ class RecordReadThreadTest : public ::testing::Test {
       event_fds_[i].reset(new MockEventFd(attr, i, buffers_[i].data(), buffer_size, false));
       EXPECT_CALL(*event_fds_[i], CreateMappedBuffer(_, _)).Times(1).WillOnce(Return(true));
       EXPECT_CALL(*event_fds_[i], StartPolling(_, _)).Times(1).WillOnce(Return(true));
-      EXPECT_CALL(*event_fds_[i], GetAvailableMmapDataSize(Truly(SetArg(0))))
-          .Times(1)
-          .WillOnce(Return(data_size));
+      if (read_repeatedly) {
+        EXPECT_CALL(*event_fds_[i], GetAvailableMmapDataSize(Truly(SetArg(0))))
+            .Times(AtLeast(1))
+            .WillOnce(Return(data_size))
+            .WillRepeatedly(Return(0));
+      } else {
+        EXPECT_CALL(*event_fds_[i], GetAvailableMmapDataSize(Truly(SetArg(0))))
+            .Times(1)
+            .WillOnce(Return(data_size));
+      }
       EXPECT_CALL(*event_fds_[i], DiscardMmapData(Eq(data_size))).Times(1);
       EXPECT_CALL(*event_fds_[i], StopPolling()).Times(1).WillOnce(Return(true));
       EXPECT_CALL(*event_fds_[i], DestroyMappedBuffer()).Times(1);
@@ -271,9 +282,48 @@ class RecordReadThreadTest : public ::testing::Test {
     return result;
   }
 
+  // Create event fds on cpu 0 and 1, with records of the given times. The read thread of cpu 1
+  // doesn't see its records until cpu1_data_ready is set.
+  std::vector<EventFd*> CreateFakeEventFdsWithDelayedCpu1(const perf_event_attr& attr,
+                                                          const std::vector<uint64_t> (&times)[2],
+                                                          std::atomic_bool& cpu1_data_ready) {
+    buffers_.clear();
+    buffers_.resize(2);
+    event_fds_.resize(2);
+    for (int cpu = 0; cpu < 2; cpu++) {
+      data_read_[cpu] = false;
+      std::vector<char>& buffer = buffers_[cpu];
+      for (uint64_t time : times[cpu]) {
+        SampleRecord r(attr, 0, 0, 0, 0, time, cpu, 1, {}, {}, {}, 0);
+        buffer.insert(buffer.end(), r.Binary(), r.Binary() + r.size());
+      }
+      size_t data_size = buffer.size();
+      buffer.resize(AlignToPowerOfTwo(data_size));
+      auto& fd = event_fds_[cpu];
+      fd.reset(new MockEventFd(attr, cpu, buffer.data(), buffer.size(), false));
+      EXPECT_CALL(*fd, CreateMappedBuffer(_, _)).Times(1).WillOnce(Return(true));
+      EXPECT_CALL(*fd, StartPolling(_, _)).Times(1).WillOnce(Return(true));
+      EXPECT_CALL(*fd, GetAvailableMmapDataSize(_))
+          .WillRepeatedly([&, cpu, data_size](size_t& data_pos) -> size_t {
+            data_pos = 0;
+            if (data_read_[cpu] || (cpu == 1 && !cpu1_data_ready)) {
+              return 0;
+            }
+            data_read_[cpu] = true;
+            return data_size;
+          });
+      EXPECT_CALL(*fd, DiscardMmapData(Eq(data_size))).Times(1);
+      EXPECT_CALL(*fd, StopPolling()).Times(1).WillOnce(Return(true));
+      EXPECT_CALL(*fd, DestroyMappedBuffer()).Times(1);
+      EXPECT_CALL(*fd, DestroyAuxBuffer()).Times(1);
+    }
+    return {event_fds_[0].get(), event_fds_[1].get()};
+  }
+
   std::vector<std::unique_ptr<Record>> records_;
   std::vector<std::vector<char>> buffers_;
   std::vector<std::unique_ptr<MockEventFd>> event_fds_;
+  bool data_read_[2];
 };
 
 // @CddTest = 6.1/C-0-2
@@ -331,6 +381,118 @@ TEST_F(RecordReadThreadTest, read_records) {
   }
 }
 
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordReadThreadTest, read_records_in_multiple_threads) {
+  perf_event_attr attr = CreateFakeEventAttr();
+  attr.use_clockid = 1;
+  attr.clockid = CLOCK_MONOTONIC;
+  // Event fds are read by three threads based on their cpus. Records are merged by time.
+  RecordReadThread thread(3 * 128 * 1024, attr, 1, 1, 0, true, false, 3);
+  IOEventLoop loop;
+  size_t record_index;
+  auto callback = [&]() {
+    while (true) {
+      std::unique_ptr<Record> r = thread.GetRecord();
+      if (!r) {
+        break;
+      }
+      std::unique_ptr<Record>& expected = records_[record_index++];
+      if (r->size() != expected->size() ||
+          memcmp(r->Binary(), expected->Binary(), r->size()) != 0) {
+        return false;
+      }
+    }
+    // Records may be held until all read threads update their watermarks.
+    return record_index == records_.size() ? loop.ExitLoop() : true;
+  };
+  ASSERT_TRUE(thread.RegisterDataCallback(loop, callback));
+  for (size_t event_fd_count = 1; event_fd_count < 10; ++event_fd_count) {
+    records_ = CreateFakeRecords(attr, event_fd_count * 10, 0, 0);
+    std::vector<EventFd*> event_fds = CreateFakeEventFds(attr, event_fd_count, true);
+    record_index = 0;
+    ASSERT_TRUE(thread.AddEventFds(event_fds));
+    ASSERT_TRUE(thread.SyncKernelBuffer());
+    ASSERT_TRUE(loop.RunLoop());
+    ASSERT_EQ(record_index, records_.size());
+    ASSERT_TRUE(thread.RemoveEventFds(event_fds));
+  }
+  ASSERT_TRUE(thread.StopReadThread());
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordReadThreadTest, merge_records_with_a_delayed_read_thread) {
+  perf_event_attr attr = CreateFakeEventAttr();
+  attr.use_clockid = 1;
+  attr.clockid = CLOCK_MONOTONIC;
+  RecordReadThread thread(2 * 128 * 1024, attr, 1, 1, 0, true, false, 2);
+  IOEventLoop loop;
+  ASSERT_TRUE(thread.RegisterDataCallback(loop, []() { return true; }));
+
+  // Records on cpu 0 are read by thread 0, and records on cpu 1 are read by thread 1. Use times
+  // later than the current time, so watermarks from the clock don't release them.
+  timespec ts;
+  ASSERT_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+  uint64_t base_time = (ts.tv_sec + 3600) * 1000000000ULL;
+  std::atomic_bool cpu1_data_ready = false;
+  std::vector<EventFd*> event_fds = CreateFakeEventFdsWithDelayedCpu1(
+      attr, {{base_time + 1, base_time + 3}, {base_time + 2}}, cpu1_data_ready);
+  auto get_record_time = [&]() -> uint64_t {
+    std::unique_ptr<Record> r = thread.GetRecord();
+    return r ? r->Timestamp() : 0;
+  };
+
+  // Thread 0 has pushed its records, but thread 1 may push an earlier record later.
+  ASSERT_TRUE(thread.AddEventFds(event_fds));
+  ASSERT_TRUE(thread.SyncKernelBuffer());
+  ASSERT_EQ(get_record_time(), 0u);
+  // After thread 1 pushes its record, records up to its watermark are released.
+  cpu1_data_ready = true;
+  ASSERT_TRUE(thread.SyncKernelBuffer());
+  ASSERT_EQ(get_record_time(), base_time + 1);
+  ASSERT_EQ(get_record_time(), base_time + 2);
+  ASSERT_EQ(get_record_time(), 0u);
+  // After removing kernel buffers, no records are held.
+  ASSERT_TRUE(thread.RemoveEventFds(event_fds));
+  ASSERT_EQ(get_record_time(), base_time + 3);
+  ASSERT_EQ(get_record_time(), 0u);
+  ASSERT_TRUE(thread.StopReadThread());
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordReadThreadTest, merge_records_committed_after_read) {
+  perf_event_attr attr = CreateFakeEventAttr();
+  attr.use_clockid = 1;
+  attr.clockid = CLOCK_MONOTONIC;
+  RecordReadThread thread(2 * 128 * 1024, attr, 1, 1, 0, true, false, 2);
+  IOEventLoop loop;
+  ASSERT_TRUE(thread.RegisterDataCallback(loop, []() { return true; }));
+
+  // The kernel takes the time of the record on cpu 1 before the read threads start reading. But
+  // the record isn't visible until the first read has finished.
+  timespec ts;
+  ASSERT_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+  uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  std::atomic_bool cpu1_data_ready = false;
+  std::vector<EventFd*> event_fds =
+      CreateFakeEventFdsWithDelayedCpu1(attr, {{now - 1000}, {now - 2000}}, cpu1_data_ready);
+  auto get_record_time = [&]() -> uint64_t {
+    std::unique_ptr<Record> r = thread.GetRecord();
+    return r ? r->Timestamp() : 0;
+  };
+
+  ASSERT_TRUE(thread.AddEventFds(event_fds));
+  ASSERT_TRUE(thread.SyncKernelBuffer());
+  // The watermark of thread 1 is below its read start time, so the record on cpu 0 is held.
+  ASSERT_EQ(get_record_time(), 0u);
+  cpu1_data_ready = true;
+  ASSERT_TRUE(thread.SyncKernelBuffer());
+  ASSERT_EQ(get_record_time(), now - 2000);
+  ASSERT_TRUE(thread.RemoveEventFds(event_fds));
+  ASSERT_EQ(get_record_time(), now - 1000);
+  ASSERT_EQ(get_record_time(), 0u);
+  ASSERT_TRUE(thread.StopReadThread());
+}
+
 // @CddTest = 6.1/C-0-2
 TEST_F(RecordReadThreadTest, process_sample_record) {
   perf_event_attr attr = CreateFakeEventAttr();
@@ -19,6 +19,8 @@
 
 #include <string.h>
 
+#include <functional>
+#include <string_view>
 #include <vector>
 
 namespace simpleperf {
@@ -52,6 +54,21 @@ int Compare(const T& a, const T& b) {
     return strcmp(sample1->compare_part, sample2->compare_part);    \
   }
 
+// The hash functions below are used to hash samples by their item content. If a compare function
+// returns 0 for two samples, its hash function should return the same value for them.
+
+#define BUILD_HASH_VALUE_FUNCTION(function_name, hash_part)              \
+  template <typename EntryT>                                             \
+  size_t function_name(const EntryT* sample) {                           \
+    return std::hash<decltype(sample->hash_part)>()(sample->hash_part); \
+  }
+
+#define BUILD_HASH_STRING_FUNCTION(function_name, hash_part) \
+  template <typename EntryT>                                 \
+  size_t function_name(const EntryT* sample) {               \
+    return std::hash<std::string_view>()(sample->hash_part); \
+  }
+
 BUILD_COMPARE_VALUE_FUNCTION(ComparePid, pid);
 BUILD_COMPARE_VALUE_FUNCTION(CompareTid, tid);
 BUILD_COMPARE_VALUE_FUNCTION_REVERSE(CompareSampleCount, sample_count);
@@ -62,6 +79,14 @@ BUILD_COMPARE_STRING_FUNCTION(CompareDsoFrom, branch_from.map->dso->GetReportPat
 BUILD_COMPARE_STRING_FUNCTION(CompareSymbolFrom, branch_from.symbol->DemangledName());
 BUILD_COMPARE_VALUE_FUNCTION(CompareCallGraphDuplicated, callchain.duplicated);
 
+BUILD_HASH_VALUE_FUNCTION(HashPid, pid);
+BUILD_HASH_VALUE_FUNCTION(HashTid, tid);
+BUILD_HASH_STRING_FUNCTION(HashComm, thread_comm);
+BUILD_HASH_STRING_FUNCTION(HashDso, map->dso->GetReportPath());
+BUILD_HASH_STRING_FUNCTION(HashSymbol, symbol->DemangledName());
+BUILD_HASH_STRING_FUNCTION(HashDsoFrom, branch_from.map->dso->GetReportPath());
+BUILD_HASH_STRING_FUNCTION(HashSymbolFrom, branch_from.symbol->DemangledName());
+
 template <typename EntryT>
 int CompareTotalPeriod(const EntryT* sample1, const EntryT* sample2) {
   uint64_t period1 = sample1->period + sample1->accumulated_period;
@@ -75,17 +100,23 @@ int ComparePeriod(const EntryT* sample1, const EntryT* sample2) {
 }
 
 // SampleComparator is a class using a collection of compare functions to
-// compare two samples.
+// compare two samples. If each compare function has a hash function, it can
+// also hash samples, to find same samples in a hash table.
 
 template <typename EntryT>
 class SampleComparator {
  public:
   typedef int (*compare_sample_func_t)(const EntryT*, const EntryT*);
+  typedef size_t (*hash_sample_func_t)(const EntryT*);
 
-  void AddCompareFunction(compare_sample_func_t func) { compare_v_.push_back(func); }
+  void AddCompareFunction(compare_sample_func_t func, hash_sample_func_t hash_func = nullptr) {
+    compare_v_.push_back(func);
+    hash_v_.push_back(hash_func);
+  }
 
   void AddComparator(const SampleComparator<EntryT>& other) {
     compare_v_.insert(compare_v_.end(), other.compare_v_.begin(), other.compare_v_.end());
+    hash_v_.insert(hash_v_.end(), other.hash_v_.begin(), other.hash_v_.end());
   }
 
   bool operator()(const EntryT* sample1, const EntryT* sample2) const {
@@ -119,8 +150,26 @@ class SampleComparator {
 
   bool empty() const { return compare_v_.empty(); }
 
+  bool CanHash() const {
+    for (const auto& func : hash_v_) {
+      if (func == nullptr) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t Hash(const EntryT* sample) const {
+    size_t hash = 0;
+    for (const auto& func : hash_v_) {
+      hash ^= func(sample) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+  }
+
  private:
   std::vector<compare_sample_func_t> compare_v_;
+  std::vector<hash_sample_func_t> hash_v_;
 };
 
 }  // namespace simpleperf
@@ -133,8 +133,7 @@ class CallgraphDisplayer {
   }
 
   void DisplayCallGraphEntry(FILE* fp, size_t depth, std::string prefix,
-                             const std::unique_ptr<CallChainNodeT>& node, uint64_t parent_period,
-                             bool last) {
+                             const CallChainNodeT* node, uint64_t parent_period, bool last) {
     if (depth > max_stack_) {
       return;
     }
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StackDelta.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+
+#include <android-base/logging.h>
+
+#include "perf_regs.h"
+#include "utils.h"
+
+namespace simpleperf {
+
+namespace {
+
+constexpr uint32_t kStackDeltaOpLiteral = 0;
+constexpr uint32_t kStackDeltaOpCopy = 1;
+
+// Stack data is split into chunks aligned to stack addresses. So chunks of outer frames have the
+// same boundaries in different snapshots of a thread.
+constexpr uint64_t kStackChunkSize = 256;
+
+struct StackDeltaHeader {
+  uint32_t tid;
+  uint32_t stack_offset;
+  uint32_t stack_size;
+  uint32_t op_count;
+};
+
+struct StackDeltaOp {
+  uint32_t type;
+  uint32_t size;
+  uint32_t prev_offset;
+};
+
+static_assert(sizeof(StackDeltaHeader) == 16);
+static_assert(sizeof(StackDeltaOp) == 12);
+
+}  // namespace
+
+bool StackDeltaEncoder::Encode(const SampleRecord& r, std::vector<char>& data) {
+  if ((r.sample_type & PERF_SAMPLE_STACK_USER) == 0 || r.stack_user_data.size == 0) {
+    return false;
+  }
+  const char* stack = r.stack_user_data.data;
+  const uint64_t stack_size = r.stack_user_data.size;
+  const uint64_t stack_offset = stack - r.Binary();
+  uint64_t start_addr = 0;
+  if ((r.sample_type & PERF_SAMPLE_REGS_USER) && r.regs_user_data.reg_nr > 0) {
+    RegSet regs(r.regs_user_data.abi, r.regs_user_data.reg_mask, r.regs_user_data.regs);
+    if (!regs.GetSpRegValue(&start_addr)) {
+      start_addr = 0;
+    }
+  }
+
+  Snapshot& prev = threads_[r.tid_data.tid];
+  std::vector<StackDeltaOp> ops;
+  std::vector<char> literal_data;
+  auto add_op = [&](uint32_t type, const char* chunk, uint32_t size, uint32_t prev_offset) {
+    if (type == kStackDeltaOpLiteral) {
+      literal_data.insert(literal_data.end(), chunk, chunk + size);
+    }
+    if (!ops.empty()) {
+      StackDeltaOp& last = ops.back();
+      if (last.type == type &&
+          (type == kStackDeltaOpLiteral || last.prev_offset + last.size == prev_offset)) {
+        last.size += size;
+        return;
+      }
+    }
+    ops.push_back(StackDeltaOp{type, size, prev_offset});
+  };
+
+  std::unordered_map<size_t, uint32_t> chunk_map;
+  uint64_t offset = 0;
+  while (offset < stack_size) {
+    uint64_t addr = start_addr + offset;
+    uint64_t chunk_size = std::min(kStackChunkSize - addr % kStackChunkSize, stack_size - offset);
+    const char* chunk = stack + offset;
+    std::optional<uint32_t> prev_offset;
+    // Look for the chunk at the same address in the previous snapshot.
+    if (addr >= prev.start_addr && chunk_size <= prev.data.size() &&
+        addr - prev.start_addr <= prev.data.size() - chunk_size) {
+      uint64_t off = addr - prev.start_addr;
+      if (memcmp(prev.data.data() + off, chunk, chunk_size) == 0) {
+        prev_offset = static_cast<uint32_t>(off);
+      }
+    }
+    if (chunk_size == kStackChunkSize) {
+      size_t hash = std::hash<std::string_view>()(std::string_view(chunk, chunk_size));
+      if (!prev_offset) {
+        // Look for the chunk by its content, which may be moved to another address.
+        if (auto it = prev.chunk_map.find(hash);
+            it != prev.chunk_map.end() &&
+            memcmp(prev.data.data() + it->second, chunk, chunk_size) == 0) {
+          prev_offset = it->second;
+        }
+      }
+      chunk_map.emplace(hash, static_cast<uint32_t>(offset));
+    }
+    if (prev_offset) {
+      add_op(kStackDeltaOpCopy, chunk, chunk_size, prev_offset.value());
+    } else {
+      add_op(kStackDeltaOpLiteral, chunk, chunk_size, 0);
+    }
+    offset += chunk_size;
+  }
+
+  const size_t sample_size = r.size();
+  size_t size = Record::header_size() + sizeof(StackDeltaHeader) +
+                ops.size() * sizeof(StackDeltaOp) + sample_size - stack_size + literal_data.size();
+  size = Align(size, 8);
+  if (size > UINT16_MAX) {
+    // Keep the record small enough to not be split into SIMPLE_PERF_RECORD_SPLIT records.
+    // Don't update the snapshot, since the sample is written without encoding.
+    return false;
+  }
+  data.resize(size);
+  char* p = data.data();
+  RecordHeader header;
+  header.type = SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE;
+  header.size = size;
+  header.MoveToBinaryFormat(p);
+  StackDeltaHeader delta_header = {r.tid_data.tid, static_cast<uint32_t>(stack_offset),
+                                   static_cast<uint32_t>(stack_size),
+                                   static_cast<uint32_t>(ops.size())};
+  MoveToBinaryFormat(delta_header, p);
+  MoveToBinaryFormat(ops.data(), ops.size(), p);
+  MoveToBinaryFormat(r.Binary(), stack_offset, p);
+  MoveToBinaryFormat(stack + stack_size, sample_size - stack_offset - stack_size, p);
+  MoveToBinaryFormat(literal_data.data(), literal_data.size(), p);
+  memset(p, 0, data.data() + size - p);
+
+  prev.data.assign(stack, stack + stack_size);
+  prev.start_addr = start_addr;
+  prev.chunk_map = std::move(chunk_map);
+  return true;
+}
+
+bool StackDeltaDecoder::Decode(const char* p, size_t size, std::vector<char>& sample_data) {
+  auto invalid_record = []() {
+    LOG(ERROR) << "invalid stack delta sample record";
+    return false;
+  };
+  const char* end = p + size;
+  if (size < Record::header_size() + sizeof(StackDeltaHeader)) {
+    return invalid_record();
+  }
+  p += Record::header_size();
+  StackDeltaHeader header;
+  MoveFromBinaryFormat(header, p);
+  if (header.op_count > (end - p) / sizeof(StackDeltaOp)) {
+    return invalid_record();
+  }
+  std::vector<StackDeltaOp> ops(header.op_count);
+  MoveFromBinaryFormat(ops.data(), ops.size(), p);
+
+  perf_event_header sample_header;
+  if (end - p < static_cast<ptrdiff_t>(sizeof(sample_header))) {
+    return invalid_record();
+  }
+  memcpy(&sample_header, p, sizeof(sample_header));
+  if (header.stack_offset < sizeof(sample_header) || header.stack_offset > sample_header.size ||
+      header.stack_size > sample_header.size - header.stack_offset ||
+      end - p < sample_header.size - header.stack_size) {
+    return invalid_record();
+  }
+  const char* sample = p;
+  p += sample_header.size - header.stack_size;
+
+  sample_data.resize(sample_header.size);
+  memcpy(sample_data.data(), sample, header.stack_offset);
+  char* stack = sample_data.data() + header.stack_offset;
+  std::vector<char>& prev = threads_[header.tid];
+  uint32_t stack_pos = 0;
+  for (const StackDeltaOp& op : ops) {
+    if (op.size > header.stack_size - stack_pos) {
+      return invalid_record();
+    }
+    if (op.type == kStackDeltaOpCopy) {
+      if (op.prev_offset > prev.size() || op.size > prev.size() - op.prev_offset) {
+        return invalid_record();
+      }
+      memcpy(stack + stack_pos, prev.data() + op.prev_offset, op.size);
+    } else if (op.type == kStackDeltaOpLiteral) {
+      if (op.size > end - p) {
+        return invalid_record();
+      }
+      memcpy(stack + stack_pos, p, op.size);
+      p += op.size;
+    } else {
+      return invalid_record();
+    }
+    stack_pos += op.size;
+  }
+  if (stack_pos != header.stack_size) {
+    return invalid_record();
+  }
+  memcpy(stack + header.stack_size, sample + header.stack_offset,
+         sample_header.size - header.stack_offset - header.stack_size);
+  prev.assign(stack, stack + header.stack_size);
+  return true;
+}
+
+}  // namespace simpleperf
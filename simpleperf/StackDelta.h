@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLE_PERF_STACK_DELTA_H_
+#define SIMPLE_PERF_STACK_DELTA_H_
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "record.h"
+
+namespace simpleperf {
+
+// When recording with `--call-graph dwarf`, each sample contains a snapshot of the user stack.
+// Consecutive samples of the same thread usually share most of the stack. Stack-delta encoding
+// stores a sample as a SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE record, in which the stack data is
+// split into chunks, and chunks also existing in the previous stack snapshot of the same thread
+// are stored as references to that snapshot.
+//
+// The format of a SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE record is:
+//   simpleperf_record_header header;
+//   uint32_t tid;
+//   uint32_t stack_offset;  // offset of the stack data in the sample record
+//   uint32_t stack_size;    // size of the stack data in the sample record
+//   uint32_t op_count;
+//   struct {
+//     uint32_t type;         // kStackDeltaOpLiteral or kStackDeltaOpCopy
+//     uint32_t size;
+//     uint32_t prev_offset;  // for kStackDeltaOpCopy, offset in the previous snapshot
+//   } ops[op_count];         // used to build the stack data in order
+//   char sample_data[];      // the sample record without the stack data
+//   char literal_data[];     // data of kStackDeltaOpLiteral ops
+//   char padding[];          // align the record size to 8 bytes
+//
+// The encoder and the decoder keep the same stack snapshots, by seeing the same sequence of
+// samples and exit records. So records must be decoded in the order they are written.
+class StackDeltaEncoder {
+ public:
+  // Encode a sample record with user stack data into data. Return false if the sample isn't
+  // encoded, like when it has no stack data.
+  bool Encode(const SampleRecord& r, std::vector<char>& data);
+  // Remove the stack snapshot of an exited thread.
+  void RemoveThread(uint32_t tid) { threads_.erase(tid); }
+  // Remove all stack snapshots, so following records can be decoded without previous records.
+  void Reset() { threads_.clear(); }
+
+ private:
+  struct Snapshot {
+    std::vector<char> data;
+    uint64_t start_addr = 0;
+    // Map from hashes of chunks aligned to their stack addresses, to their offsets in data.
+    std::unordered_map<size_t, uint32_t> chunk_map;
+  };
+
+  std::unordered_map<uint32_t, Snapshot> threads_;
+};
+
+class StackDeltaDecoder {
+ public:
+  // Decode a SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE record in [p, p + size) into the binary of
+  // the original sample record.
+  bool Decode(const char* p, size_t size, std::vector<char>& sample_data);
+  void RemoveThread(uint32_t tid) { threads_.erase(tid); }
+
+ private:
+  std::unordered_map<uint32_t, std::vector<char>> threads_;
+};
+
+}  // namespace simpleperf
+
+#endif  // SIMPLE_PERF_STACK_DELTA_H_
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StackDelta.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include "event_attr.h"
+#include "event_type.h"
+#include "record.h"
+
+using namespace simpleperf;
+
+// @CddTest = 6.1/C-0-2
+class StackDeltaTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const EventType* type = FindEventTypeByName("cpu-clock");
+    ASSERT_TRUE(type != nullptr);
+    attr_ = CreateDefaultPerfEventAttr(*type);
+    attr_.sample_type |= PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+  }
+
+  SampleRecord CreateSample(uint32_t tid, const std::vector<char>& stack) {
+    return SampleRecord(attr_, 0, 1, tid, tid, 2, 3, 4, {}, {}, stack, stack.size());
+  }
+
+  // Encode and decode a sample, and return the size of the encoded record.
+  size_t EncodeAndDecode(const SampleRecord& r) {
+    std::vector<char> encoded;
+    EXPECT_TRUE(encoder_.Encode(r, encoded));
+    std::vector<char> decoded;
+    EXPECT_TRUE(decoder_.Decode(encoded.data(), encoded.size(), decoded));
+    EXPECT_EQ(decoded.size(), r.size());
+    EXPECT_EQ(memcmp(decoded.data(), r.Binary(), r.size()), 0);
+    return encoded.size();
+  }
+
+  perf_event_attr attr_;
+  StackDeltaEncoder encoder_;
+  StackDeltaDecoder decoder_;
+};
+
+// @CddTest = 6.1/C-0-2
+TEST_F(StackDeltaTest, smoke) {
+  std::vector<char> stack(8192);
+  for (size_t i = 0; i < stack.size(); i++) {
+    stack[i] = static_cast<char>(i * 7 + i / 256);
+  }
+  SampleRecord r1 = CreateSample(1, stack);
+  ASSERT_GT(EncodeAndDecode(r1), r1.size());
+
+  // Only the top of the stack is changed, so most of the stack is encoded as copies.
+  memset(stack.data(), 0xff, 100);
+  SampleRecord r2 = CreateSample(1, stack);
+  ASSERT_LT(EncodeAndDecode(r2), r2.size() / 4);
+
+  // Samples of another thread don't use snapshots of thread 1.
+  SampleRecord r3 = CreateSample(2, stack);
+  ASSERT_GT(EncodeAndDecode(r3), r3.size());
+
+  // Move the stack by a chunk. Chunks are still found by content.
+  std::vector<char> moved_stack(stack.begin() + 256, stack.end());
+  SampleRecord r4 = CreateSample(1, moved_stack);
+  ASSERT_LT(EncodeAndDecode(r4), r4.size() / 4);
+
+  // After a thread exits, its snapshot is removed.
+  encoder_.RemoveThread(1);
+  decoder_.RemoveThread(1);
+  ASSERT_GT(EncodeAndDecode(r4), r4.size());
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(StackDeltaTest, skip_samples_without_stack) {
+  SampleRecord r = CreateSample(1, {});
+  std::vector<char> encoded;
+  ASSERT_FALSE(encoder_.Encode(r, encoded));
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(StackDeltaTest, invalid_record) {
+  SampleRecord r = CreateSample(1, std::vector<char>(1024, 'a'));
+  std::vector<char> encoded;
+  ASSERT_TRUE(encoder_.Encode(r, encoded));
+  std::vector<char> decoded;
+  ASSERT_FALSE(decoder_.Decode(encoded.data(), encoded.size() / 2, decoded));
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ThreadPool.h"
+
+#include <android-base/logging.h>
+
+namespace simpleperf {
+
+ThreadPool::ThreadPool(size_t thread_count, size_t max_pending_tasks)
+    : max_pending_tasks_(max_pending_tasks) {
+  CHECK_GT(thread_count, 0u);
+  CHECK_GT(max_pending_tasks, 0u);
+  for (size_t i = 0; i < thread_count; i++) {
+    threads_.emplace_back(&ThreadPool::RunWorker, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  task_cond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::AddTask(Task task) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  progress_cond_.wait(lock, [&]() { return tasks_.size() < max_pending_tasks_; });
+  tasks_.push(std::move(task));
+  lock.unlock();
+  task_cond_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  progress_cond_.wait(lock, [&]() { return tasks_.empty() && running_tasks_ == 0; });
+}
+
+void ThreadPool::RunWorker(size_t thread_index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    task_cond_.wait(lock, [&]() { return stopping_ || !tasks_.empty(); });
+    if (tasks_.empty()) {
+      return;
+    }
+    Task task = std::move(tasks_.front());
+    tasks_.pop();
+    running_tasks_++;
+    lock.unlock();
+    progress_cond_.notify_all();
+    task(thread_index);
+    lock.lock();
+    running_tasks_--;
+    progress_cond_.notify_all();
+  }
+}
+
+void ReduceInTree(ThreadPool* pool, size_t count,
+                  const std::function<void(size_t, size_t)>& merge) {
+  for (size_t step = 1; step < count; step *= 2) {
+    for (size_t dst = 0; dst + step < count; dst += step * 2) {
+      if (pool != nullptr) {
+        pool->AddTask([&merge, dst, step](size_t) { merge(dst, dst + step); });
+      } else {
+        merge(dst, dst + step);
+      }
+    }
+    if (pool != nullptr) {
+      pool->Wait();
+    }
+  }
+}
+
+}  // namespace simpleperf
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLE_PERF_THREAD_POOL_H_
+#define SIMPLE_PERF_THREAD_POOL_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace simpleperf {
+
+// ThreadPool runs tasks in a fixed number of worker threads. A task is given the index of the
+// worker thread running it (in range [0, ThreadCount())), so callers can keep per-thread state
+// without locking.
+class ThreadPool {
+ public:
+  using Task = std::function<void(size_t thread_index)>;
+
+  // If max_pending_tasks tasks are waiting to run, AddTask() blocks until one of them starts.
+  // It limits memory used by tasks produced faster than consumed.
+  explicit ThreadPool(size_t thread_count,
+                      size_t max_pending_tasks = std::numeric_limits<size_t>::max());
+  ~ThreadPool();
+
+  size_t ThreadCount() const { return threads_.size(); }
+  void AddTask(Task task);
+  // Wait until all added tasks finish.
+  void Wait();
+
+ private:
+  void RunWorker(size_t thread_index);
+
+  std::vector<std::thread> threads_;
+  const size_t max_pending_tasks_;
+  std::mutex mutex_;
+  // Notified when a task is added, or the pool is stopping.
+  std::condition_variable task_cond_;
+  // Notified when a task starts or finishes.
+  std::condition_variable progress_cond_;
+  std::queue<Task> tasks_;
+  size_t running_tasks_ = 0;
+  bool stopping_ = false;
+};
+
+// Merge results [0, count) into result 0 by a tree reduction. merge(dst, src) merges result src
+// into result dst, where dst < src. Merges in the same round run in parallel in pool, if pool isn't
+// nullptr. Adjacent results are merged in order, so the final result is the same as merging them
+// sequentially, as long as merge is associative.
+void ReduceInTree(ThreadPool* pool, size_t count, const std::function<void(size_t, size_t)>& merge);
+
+}  // namespace simpleperf
+
+#endif  // SIMPLE_PERF_THREAD_POOL_H_
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ThreadPool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+using namespace simpleperf;
+
+// @CddTest = 6.1/C-0-2
+TEST(ThreadPool, run_tasks) {
+  const size_t thread_count = 4;
+  ThreadPool pool(thread_count, 2);
+  ASSERT_EQ(pool.ThreadCount(), thread_count);
+  std::vector<uint64_t> sums(thread_count, 0);
+  std::atomic<size_t> task_count = 0;
+  for (uint64_t i = 1; i <= 1000; i++) {
+    pool.AddTask([&, i](size_t thread_index) {
+      ASSERT_LT(thread_index, thread_count);
+      sums[thread_index] += i;
+      task_count++;
+    });
+  }
+  pool.Wait();
+  ASSERT_EQ(task_count, 1000);
+  uint64_t total = 0;
+  for (uint64_t sum : sums) {
+    total += sum;
+  }
+  ASSERT_EQ(total, 500500);
+
+  // The pool can be reused after Wait().
+  pool.AddTask([&](size_t) { task_count++; });
+  pool.Wait();
+  ASSERT_EQ(task_count, 1001);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(ThreadPool, reduce_in_tree) {
+  ThreadPool pool(3);
+  for (size_t count : {1, 2, 5, 8, 13}) {
+    std::vector<std::vector<size_t>> results(count);
+    for (size_t i = 0; i < count; i++) {
+      results[i].push_back(i);
+    }
+    auto merge = [&](size_t dst, size_t src) {
+      ASSERT_LT(dst, src);
+      results[dst].insert(results[dst].end(), results[src].begin(), results[src].end());
+      results[src].clear();
+    };
+    for (ThreadPool* p : {&pool, static_cast<ThreadPool*>(nullptr)}) {
+      ReduceInTree(p, count, merge);
+      ASSERT_EQ(results[0].size(), count);
+      for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(results[0][i], i);
+      }
+    }
+  }
+}
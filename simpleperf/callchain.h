@@ -23,18 +23,26 @@
 #include <functional>
 #include <memory>
 #include <queue>
+#include <utility>
 #include <vector>
 
 #include <android-base/logging.h>
 
+#include "utils.h"
+
 namespace simpleperf {
 
+// CallChainNodes are allocated from a OneTimeFreeAllocator owned by the SampleTreeBuilder, and
+// destroyed by the CallChainRoot owning them. Their vectors use the heap, since they can grow.
 template <typename EntryT>
 struct CallChainNode {
   uint64_t period;
   uint64_t children_period;
   std::vector<EntryT*> chain;
-  std::vector<std::unique_ptr<CallChainNode>> children;
+  std::vector<CallChainNode*> children;
+
+  CallChainNode(uint64_t period, uint64_t children_period)
+      : period(period), children_period(children_period) {}
 };
 
 template <typename EntryT>
@@ -44,17 +52,35 @@ struct CallChainRoot {
   // And we don't need to show it in brief callgraph report mode.
   bool duplicated;
   uint64_t children_period;
-  std::vector<std::unique_ptr<NodeT>> children;
+  std::vector<NodeT*> children;
 
   CallChainRoot() : duplicated(false), children_period(0) {}
+  CallChainRoot(CallChainRoot&& other)
+      : duplicated(other.duplicated),
+        children_period(other.children_period),
+        children(std::exchange(other.children, {})) {}
+  CallChainRoot(const CallChainRoot&) = delete;
+  CallChainRoot& operator=(const CallChainRoot&) = delete;
+
+  // The memory of nodes is freed with the allocator, but their vectors are freed here.
+  ~CallChainRoot() {
+    std::vector<NodeT*> nodes = std::move(children);
+    while (!nodes.empty()) {
+      NodeT* node = nodes.back();
+      nodes.pop_back();
+      nodes.insert(nodes.end(), node->children.begin(), node->children.end());
+      node->~NodeT();
+    }
+  }
 
+  // New nodes are allocated from allocator, which should outlive the CallChainRoot.
   void AddCallChain(const std::vector<EntryT*>& callchain, uint64_t period,
+                    OneTimeFreeAllocator* allocator,
                     std::function<bool(const EntryT*, const EntryT*)> is_same_sample) {
     children_period += period;
     NodeT* p = FindMatchingNode(children, callchain[0], is_same_sample);
     if (p == nullptr) {
-      std::unique_ptr<NodeT> new_node = AllocateNode(callchain, 0, period, 0);
-      children.push_back(std::move(new_node));
+      children.push_back(AllocateNode(allocator, callchain, 0, period, 0));
       return;
     }
     size_t callchain_pos = 0;
@@ -64,7 +90,7 @@ struct CallChainRoot {
       callchain_pos += match_length;
       bool find_child = true;
       if (match_length < p->chain.size()) {
-        SplitNode(p, match_length);
+        SplitNode(allocator, p, match_length);
         find_child = false;  // No need to find matching node in p->children.
       }
       if (callchain_pos == callchain.size()) {
@@ -79,33 +105,33 @@ struct CallChainRoot {
           continue;
         }
       }
-      std::unique_ptr<NodeT> new_node = AllocateNode(callchain, callchain_pos, period, 0);
-      p->children.push_back(std::move(new_node));
+      p->children.push_back(AllocateNode(allocator, callchain, callchain_pos, period, 0));
       break;
     }
   }
 
   void SortByPeriod() {
-    std::queue<std::vector<std::unique_ptr<NodeT>>*> queue;
-    queue.push(&children);
+    std::sort(children.begin(), children.end(), CallChainRoot::CompareNodeByPeriod);
+    std::queue<NodeT*> queue;
+    for (NodeT* node : children) {
+      queue.push(node);
+    }
     while (!queue.empty()) {
-      std::vector<std::unique_ptr<NodeT>>* v = queue.front();
+      NodeT* node = queue.front();
       queue.pop();
-      std::sort(v->begin(), v->end(), CallChainRoot::CompareNodeByPeriod);
-      for (auto& node : *v) {
-        if (!node->children.empty()) {
-          queue.push(&node->children);
-        }
+      std::sort(node->children.begin(), node->children.end(), CallChainRoot::CompareNodeByPeriod);
+      for (NodeT* child : node->children) {
+        queue.push(child);
       }
     }
   }
 
  private:
-  NodeT* FindMatchingNode(const std::vector<std::unique_ptr<NodeT>>& nodes, const EntryT* sample,
+  NodeT* FindMatchingNode(const std::vector<NodeT*>& nodes, const EntryT* sample,
                           std::function<bool(const EntryT*, const EntryT*)> is_same_sample) {
-    for (auto& node : nodes) {
+    for (NodeT* node : nodes) {
       if (is_same_sample(node->chain.front(), sample)) {
-        return node.get();
+        return node;
       }
     }
     return nullptr;
@@ -122,30 +148,24 @@ struct CallChainRoot {
     return i;
   }
 
-  void SplitNode(NodeT* parent, size_t parent_length) {
-    std::unique_ptr<NodeT> child =
-        AllocateNode(parent->chain, parent_length, parent->period, parent->children_period);
-    child->children = std::move(parent->children);
+  void SplitNode(OneTimeFreeAllocator* allocator, NodeT* parent, size_t parent_length) {
+    NodeT* child = AllocateNode(allocator, parent->chain, parent_length, parent->period,
+                                parent->children_period);
+    child->children.swap(parent->children);
     parent->period = 0;
     parent->children_period = child->period + child->children_period;
     parent->chain.resize(parent_length);
-    parent->children.clear();
-    parent->children.push_back(std::move(child));
+    parent->children.push_back(child);
   }
 
-  std::unique_ptr<NodeT> AllocateNode(const std::vector<EntryT*>& chain, size_t chain_start,
-                                      uint64_t period, uint64_t children_period) {
-    std::unique_ptr<NodeT> node(new NodeT);
-    for (size_t i = chain_start; i < chain.size(); ++i) {
-      node->chain.push_back(chain[i]);
-    }
-    node->period = period;
-    node->children_period = children_period;
+  NodeT* AllocateNode(OneTimeFreeAllocator* allocator, const std::vector<EntryT*>& chain,
+                      size_t chain_start, uint64_t period, uint64_t children_period) {
+    NodeT* node = allocator->New<NodeT>(period, children_period);
+    node->chain.assign(chain.begin() + chain_start, chain.end());
     return node;
   }
 
-  static bool CompareNodeByPeriod(const std::unique_ptr<NodeT>& n1,
-                                  const std::unique_ptr<NodeT>& n2) {
+  static bool CompareNodeByPeriod(const NodeT* n1, const NodeT* n2) {
     uint64_t period1 = n1->period + n1->children_period;
     uint64_t period2 = n2->period + n2->children_period;
     return period1 > period2;
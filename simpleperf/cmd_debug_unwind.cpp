@@ -81,6 +81,7 @@ struct UnwindingStat {
   uint64_t unwinding_sample_count = 0u;
   uint64_t total_unwinding_time_in_ns = 0u;
   uint64_t max_unwinding_time_in_ns = 0u;
+  UnwindingCacheStat cache_stat;
 
   // For memory consumption
   MemStat mem_before_unwinding;
@@ -100,6 +101,8 @@ struct UnwindingStat {
     fprintf(fp, "average_unwinding_time: %.3f us\n",
             total_unwinding_time_in_ns / 1e3 / unwinding_sample_count);
     fprintf(fp, "max_unwinding_time: %.3f us\n", max_unwinding_time_in_ns / 1e3);
+    fprintf(fp, "elf_cache_hits: %" PRIu64 "\n", cache_stat.elf_cache_hits);
+    fprintf(fp, "elf_cache_misses: %" PRIu64 "\n", cache_stat.elf_cache_misses);
 
     if (!mem_before_unwinding.vm_peak.empty()) {
       fprintf(fp, "memory_change_VmPeak: %s -> %s\n", mem_before_unwinding.vm_peak.c_str(),
@@ -245,6 +248,7 @@ class SampleUnwinder : public RecordFileProcessor {
     if (!GetMemStat(&stat_.mem_after_unwinding)) {
       return false;
     }
+    stat_.cache_stat = unwinder_->GetCacheStat();
     stat_.Dump(out_fp_);
     return true;
   }
@@ -16,6 +16,8 @@
 
 #include <gtest/gtest.h>
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <unistd.h>
 
 #include <memory>
@@ -84,6 +86,29 @@ TEST(cmd_debug_unwind, symfs_option) {
             std::string::npos);
 }
 
+// @CddTest = 6.1/C-0-2
+TEST(cmd_debug_unwind, elf_cache_stat) {
+  std::string input_data = GetTestData(NATIVELIB_IN_APK_PERF_DATA);
+  std::string output;
+  // The first run parses ELF files, or uses those parsed by other tests. The second run gets ELF
+  // files from unwindstack's cache.
+  for (int i = 0; i < 2; i++) {
+    CaptureStdout capture;
+    ASSERT_TRUE(capture.Start());
+    ASSERT_TRUE(DebugUnwindCmd()->Run({"-i", input_data, "--symfs", GetTestDataDir(),
+                                       "--unwind-sample", "--sample-time", "500329355223"}));
+    output = capture.Finish();
+  }
+  size_t pos = output.find("elf_cache_hits: ");
+  ASSERT_NE(pos, std::string::npos);
+  uint64_t hits;
+  uint64_t misses;
+  ASSERT_EQ(sscanf(output.c_str() + pos, "elf_cache_hits: %" SCNu64 "\nelf_cache_misses: %" SCNu64,
+                   &hits, &misses),
+            2);
+  ASSERT_GT(hits, 0u);
+}
+
 // @CddTest = 6.1/C-0-2
 TEST(cmd_debug_unwind, unwind_with_ip_zero_in_callchain) {
   CaptureStdout capture;
@@ -599,6 +599,20 @@ bool DumpRecordCommand::DumpFeatureSection() {
       if (!record_file_reader_->ReadInitMapFeature(callback)) {
         return false;
       }
+    } else if (feature == FEAT_COMPRESSED_FRAME_INDEX) {
+      PrintIndented(1, "compressed_frame_index:\n");
+      for (const CompressedFrame& frame : record_file_reader_->ReadCompressedFrameIndexFeature()) {
+        PrintIndented(2, "data_offset %" PRIu64 ", data_size %" PRIu64
+                      ", decompressed_size %" PRIu64 "\n",
+                      frame.data_offset, frame.data_size, frame.decompressed_size);
+      }
+    } else if (feature == FEAT_TIME_INDEX) {
+      PrintIndented(1, "time_index:\n");
+      for (const TimeIndexEntry& entry : record_file_reader_->ReadTimeIndexFeature()) {
+        PrintIndented(2, "data_offset %" PRIu64 ", max_time_before %" PRIu64
+                      ", min_time_after %" PRIu64 "\n",
+                      entry.data_offset, entry.max_time_before, entry.min_time_after);
+      }
     }
   }
   return true;
@@ -18,9 +18,13 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <map>
 #include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
@@ -28,6 +32,7 @@
 #include "BranchListFile.h"
 #include "ETMDecoder.h"
 #include "RegEx.h"
+#include "ThreadPool.h"
 #include "command.h"
 #include "record_file.h"
 #include "system/extras/simpleperf/branch_list.pb.h"
@@ -49,6 +54,10 @@ struct AddrPairHash {
   }
 };
 
+// In multi-thread decoding, ETM data is buffered and decoded in batches. The batch size limits
+// memory used by buffered data.
+constexpr size_t kETMDecodeBatchSize = 64 * kMegabyte;
+
 enum class OutputFormat {
   AutoFDO,
   BranchList,
@@ -183,7 +192,7 @@ class PerfDataReader {
         return false;
       }
     }
-    if (!reader_->ReadDataSection([this](auto r) { return ProcessRecord(*r); })) {
+    if (!reader_->ReadDataSectionInPlace([this](Record* r) { return ProcessRecord(*r); })) {
       return false;
     }
     return PostProcess();
@@ -239,13 +248,23 @@ class ETMThreadTreeWithFilter : public ETMThreadTree {
 };
 
 // Read perf.data with ETM data and generate AutoFDO or branch list data.
+// If a thread pool is given, ETM data of each cpu is decoded by a separate ETMDecoder, and
+// decoders of different cpus run in parallel.
 class ETMPerfDataReader : public PerfDataReader {
  public:
   ETMPerfDataReader(std::unique_ptr<RecordFileReader> reader, bool exclude_perf,
-                    const RegEx* binary_name_regex, ETMDumpOption etm_dump_option)
+                    const RegEx* binary_name_regex, ETMDumpOption etm_dump_option,
+                    ThreadPool* thread_pool = nullptr)
       : PerfDataReader(std::move(reader), exclude_perf, binary_name_regex),
         etm_dump_option_(etm_dump_option),
-        etm_thread_tree_(thread_tree_, exclude_pid_) {}
+        etm_thread_tree_(thread_tree_, exclude_pid_),
+        thread_pool_(thread_pool) {
+    // Dumped data should be in the same order as in the input file.
+    if (etm_dump_option.dump_raw_data || etm_dump_option.dump_packets ||
+        etm_dump_option.dump_elements) {
+      thread_pool_ = nullptr;
+    }
+  }
 
   bool Read() override {
     if (reader_->HasFeature(PerfFileFormat::FEAT_ETM_BRANCH_LIST)) {
@@ -255,21 +274,43 @@ class ETMPerfDataReader : public PerfDataReader {
   }
 
  private:
+  // Decoder and decoding results for ETM data of one cpu.
+  struct CpuDecoder {
+    CpuDecoder(const BinaryFilter& binary_filter) : binary_filter(binary_filter) {}
+
+    std::unique_ptr<ETMDecoder> decoder;
+    // ETM data waiting to be decoded.
+    std::vector<uint8_t> data;
+    // Size and formatted flag of each aux data block in data.
+    std::vector<std::pair<size_t, bool>> blocks;
+    bool decode_ok = true;
+    BinaryFilter binary_filter;
+    std::unordered_map<const Dso*, AutoFDOBinaryInfo> autofdo_binary_map;
+    std::unordered_map<Dso*, ETMBinary> etm_binary_map;
+  };
+
   bool ProcessRecord(Record& r) override {
+    if (thread_pool_ != nullptr && ChangesThreadTree(r)) {
+      // Decoders read the thread tree. So decode pending data before changing it.
+      if (!DecodePendingData()) {
+        return false;
+      }
+    }
     thread_tree_.Update(r);
     if (r.type() == PERF_RECORD_AUXTRACE_INFO) {
-      etm_decoder_ = ETMDecoder::Create(static_cast<AuxTraceInfoRecord&>(r), etm_thread_tree_);
+      if (thread_pool_ != nullptr) {
+        // Decoders are created for each cpu when seeing its ETM data. But like creating a
+        // decoder, keep exited threads from now on, since ETM data usually comes later.
+        etm_thread_tree_.DisableThreadExitRecords();
+        auxtrace_info_ = CopyRecord(reader_->AttrSection()[0].attr, r);
+        return auxtrace_info_ != nullptr;
+      }
+      etm_decoder_ = CreateDecoder(static_cast<AuxTraceInfoRecord&>(r), binary_filter_,
+                                   autofdo_binary_map_, etm_binary_map_);
       if (!etm_decoder_) {
         return false;
       }
       etm_decoder_->EnableDump(etm_dump_option_);
-      if (autofdo_callback_) {
-        etm_decoder_->RegisterCallback(
-            [this](const ETMInstrRange& range) { ProcessInstrRange(range); });
-      } else if (etm_binary_callback_) {
-        etm_decoder_->RegisterCallback(
-            [this](const ETMBranchList& branch) { ProcessETMBranchList(branch); });
-      }
     } else if (r.type() == PERF_RECORD_AUX) {
       AuxRecord& aux = static_cast<AuxRecord&>(r);
       if (aux.data->aux_size > SIZE_MAX) {
@@ -283,6 +324,9 @@ class ETMPerfDataReader : public PerfDataReader {
                                   error)) {
           return !error;
         }
+        if (thread_pool_ != nullptr) {
+          return AddPendingData(aux.Cpu(), aux_size, !aux.Unformatted());
+        }
         if (!etm_decoder_) {
           LOG(ERROR) << "ETMDecoder isn't created";
           return false;
@@ -300,7 +344,31 @@ class ETMPerfDataReader : public PerfDataReader {
   }
 
   bool PostProcess() override {
-    if (etm_decoder_ && !etm_decoder_->FinishData()) {
+    if (thread_pool_ != nullptr) {
+      if (!DecodePendingData()) {
+        return false;
+      }
+      // Merge results of all cpus. Branch maps of a dso are merged at once.
+      std::unordered_map<Dso*, std::vector<const FlatETMBranchMap*>> branch_maps;
+      for (auto& p : cpu_decoders_) {
+        CpuDecoder& cpu_decoder = *p.second;
+        if (!cpu_decoder.decoder->FinishData()) {
+          return false;
+        }
+        for (auto& [dso, binary] : cpu_decoder.autofdo_binary_map) {
+          autofdo_binary_map_[dso].Merge(binary);
+        }
+        for (auto& [dso, binary] : cpu_decoder.etm_binary_map) {
+          branch_maps[dso].push_back(&binary.branch_map);
+        }
+      }
+      for (auto& [dso, maps] : branch_maps) {
+        FlatETMBranchMap& branch_map = etm_binary_map_[dso].branch_map;
+        maps.push_back(&branch_map);
+        branch_map = FlatETMBranchMap::MergeSorted(maps);
+      }
+      cpu_decoders_.clear();
+    } else if (etm_decoder_ && !etm_decoder_->FinishData()) {
       return false;
     }
     if (autofdo_callback_) {
@@ -311,6 +379,105 @@ class ETMPerfDataReader : public PerfDataReader {
     return true;
   }
 
+  std::unique_ptr<ETMDecoder> CreateDecoder(
+      const AuxTraceInfoRecord& auxtrace_info, BinaryFilter& binary_filter,
+      std::unordered_map<const Dso*, AutoFDOBinaryInfo>& autofdo_binary_map,
+      std::unordered_map<Dso*, ETMBinary>& etm_binary_map) {
+    std::unique_ptr<ETMDecoder> decoder = ETMDecoder::Create(auxtrace_info, etm_thread_tree_);
+    if (!decoder) {
+      return nullptr;
+    }
+    if (autofdo_callback_) {
+      decoder->RegisterCallback([&](const ETMInstrRange& range) {
+        ProcessInstrRange(range, binary_filter, autofdo_binary_map);
+      });
+    } else if (etm_binary_callback_) {
+      decoder->RegisterCallback([&](const ETMBranchList& branch) {
+        ProcessETMBranchList(branch, binary_filter, etm_binary_map);
+      });
+    }
+    return decoder;
+  }
+
+  static bool ChangesThreadTree(const Record& r) {
+    switch (r.type()) {
+      case PERF_RECORD_MMAP:
+      case PERF_RECORD_MMAP2:
+      case PERF_RECORD_COMM:
+      case PERF_RECORD_FORK:
+      case PERF_RECORD_EXIT:
+      case SIMPLE_PERF_RECORD_KERNEL_SYMBOL:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool AddPendingData(uint32_t cpu, size_t size, bool formatted) {
+    std::unique_ptr<CpuDecoder>& cpu_decoder = cpu_decoders_[cpu];
+    if (!cpu_decoder) {
+      if (!auxtrace_info_) {
+        LOG(ERROR) << "ETMDecoder isn't created";
+        return false;
+      }
+      cpu_decoder.reset(new CpuDecoder(binary_filter_));
+      cpu_decoder->decoder =
+          CreateDecoder(*static_cast<AuxTraceInfoRecord*>(auxtrace_info_.get()),
+                        cpu_decoder->binary_filter, cpu_decoder->autofdo_binary_map,
+                        cpu_decoder->etm_binary_map);
+      if (!cpu_decoder->decoder) {
+        return false;
+      }
+    }
+    cpu_decoder->data.insert(cpu_decoder->data.end(), aux_data_buffer_.data(),
+                             aux_data_buffer_.data() + size);
+    cpu_decoder->blocks.emplace_back(size, formatted);
+    pending_data_size_ += size;
+    if (pending_data_size_ >= kETMDecodeBatchSize) {
+      return DecodePendingData();
+    }
+    return true;
+  }
+
+  bool DecodePendingData() {
+    if (pending_data_size_ == 0) {
+      return true;
+    }
+    for (Dso* dso : thread_tree_.GetAllDsos()) {
+      if (prepared_dsos_.insert(dso).second) {
+        dso->PrepareIpConversion();
+      }
+    }
+    for (auto& p : cpu_decoders_) {
+      if (p.second->blocks.empty()) {
+        continue;
+      }
+      uint32_t cpu = p.first;
+      CpuDecoder* cpu_decoder = p.second.get();
+      thread_pool_->AddTask([cpu, cpu_decoder](size_t) {
+        const uint8_t* data = cpu_decoder->data.data();
+        for (const auto& [size, formatted] : cpu_decoder->blocks) {
+          if (!cpu_decoder->decoder->ProcessData(data, size, formatted, cpu)) {
+            cpu_decoder->decode_ok = false;
+            break;
+          }
+          data += size;
+        }
+      });
+    }
+    thread_pool_->Wait();
+    pending_data_size_ = 0;
+    for (auto& p : cpu_decoders_) {
+      CpuDecoder& cpu_decoder = *p.second;
+      if (!cpu_decoder.decode_ok) {
+        return false;
+      }
+      cpu_decoder.data.clear();
+      cpu_decoder.blocks.clear();
+    }
+    return true;
+  }
+
   bool ProcessETMBranchListFeature() {
     if (exclude_perf_) {
       LOG(WARNING) << "--exclude-perf has no effect on perf.data with etm branch list";
@@ -337,21 +504,23 @@ class ETMPerfDataReader : public PerfDataReader {
     return true;
   }
 
-  void ProcessInstrRange(const ETMInstrRange& instr_range) {
-    if (!binary_filter_.Filter(instr_range.dso)) {
+  static void ProcessInstrRange(
+      const ETMInstrRange& instr_range, BinaryFilter& binary_filter,
+      std::unordered_map<const Dso*, AutoFDOBinaryInfo>& autofdo_binary_map) {
+    if (!binary_filter.Filter(instr_range.dso)) {
       return;
     }
 
-    autofdo_binary_map_[instr_range.dso].AddInstrRange(instr_range);
+    autofdo_binary_map[instr_range.dso].AddInstrRange(instr_range);
   }
 
-  void ProcessETMBranchList(const ETMBranchList& branch_list) {
-    if (!binary_filter_.Filter(branch_list.dso)) {
+  static void ProcessETMBranchList(const ETMBranchList& branch_list, BinaryFilter& binary_filter,
+                                   std::unordered_map<Dso*, ETMBinary>& etm_binary_map) {
+    if (!binary_filter.Filter(branch_list.dso)) {
       return;
     }
 
-    auto& branch_map = etm_binary_map_[branch_list.dso].branch_map;
-    ++branch_map[branch_list.addr][branch_list.branch];
+    etm_binary_map[branch_list.dso].branch_map.Add(branch_list.addr, branch_list.branch);
   }
 
   void ProcessETMBinary() {
@@ -383,6 +552,13 @@ class ETMPerfDataReader : public PerfDataReader {
   uint64_t kernel_map_start_addr_ = 0;
   // Store etm branch list data.
   std::unordered_map<Dso*, ETMBinary> etm_binary_map_;
+
+  // Used in multi-thread decoding.
+  ThreadPool* thread_pool_;
+  std::unique_ptr<Record> auxtrace_info_;
+  std::map<uint32_t, std::unique_ptr<CpuDecoder>> cpu_decoders_;
+  size_t pending_data_size_ = 0;
+  std::unordered_set<Dso*> prepared_dsos_;
 };
 
 static std::optional<std::vector<AutoFDOBinaryInfo>> ConvertLBRDataToAutoFDO(
@@ -652,12 +828,8 @@ class ETMBranchListToAutoFDOConverter {
       return;
     }
     // Addresses are still kernel ip addrs in memory. Need to convert them to vaddrs in vmlinux.
-    UnorderedETMBranchMap new_branch_map;
-    for (auto& p : binary.branch_map) {
-      uint64_t vaddr_in_file = dso->IpToVaddrInFile(p.first, kernel_start_addr, 0);
-      new_branch_map[vaddr_in_file] = std::move(p.second);
-    }
-    binary.branch_map = std::move(new_branch_map);
+    binary.branch_map.ConvertAddrs(
+        [&](uint64_t addr) { return dso->IpToVaddrInFile(addr, kernel_start_addr, 0); });
   }
 };
 
@@ -802,6 +974,14 @@ struct BranchListMerger {
     }
   }
 
+  // Merge branch lists in other, which are read from input files after those in this merger.
+  void Merge(BranchListMerger& other) {
+    for (auto& [key, binary] : other.etm_data_) {
+      AddETMBinary(key, binary);
+    }
+    AddLBRData(other.lbr_data_);
+  }
+
   ETMBinaryMap& GetETMData() { return etm_data_; }
 
   LBRData& GetLBRData() { return lbr_data_; }
@@ -848,6 +1028,8 @@ class InjectCommand : public Command {
 "                               1. perf.data generated by recording cs-etm event type.\n"
 "                               2. branch_list file generated by `inject --output branch-list`.\n"
 "                             If a file name starts with @, it contains a list of input files.\n"
+"-j <threads>                 Use multiple threads to decode etm data of different cpus, and\n"
+"                             read and merge branch_list files in parallel. Default is 1.\n"
 "-o <file>                    output file. Default is perf_inject.data.\n"
 "--output <format>            Select output file format:\n"
 "                               autofdo      -- text format accepted by TextSampleReader\n"
@@ -901,6 +1083,7 @@ class InjectCommand : public Command {
         {"--dump-etm", {OptionValueType::STRING, OptionType::SINGLE}},
         {"--exclude-perf", {OptionValueType::NONE, OptionType::SINGLE}},
         {"-i", {OptionValueType::STRING, OptionType::MULTIPLE}},
+        {"-j", {OptionValueType::UINT, OptionType::SINGLE}},
         {"-o", {OptionValueType::STRING, OptionType::SINGLE}},
         {"--output", {OptionValueType::STRING, OptionType::SINGLE}},
         {"--symdir", {OptionValueType::STRING, OptionType::MULTIPLE}},
@@ -942,6 +1125,13 @@ class InjectCommand : public Command {
     if (input_filenames_.empty()) {
       input_filenames_.emplace_back("perf.data");
     }
+    size_t num_threads = 1;
+    if (!options.PullUintValue("-j", &num_threads, 1)) {
+      return false;
+    }
+    if (num_threads > 1) {
+      thread_pool_.reset(new ThreadPool(num_threads));
+    }
     options.PullStringValue("-o", &output_filename_);
     if (auto value = options.PullValue("--output"); value) {
       const std::string& output = value->str_value;
@@ -1001,7 +1191,8 @@ class InjectCommand : public Command {
       std::unique_ptr<PerfDataReader> reader;
       if (data_type == "etm") {
         reader.reset(new ETMPerfDataReader(std::move(file_reader), exclude_perf_,
-                                           binary_name_regex_.get(), etm_dump_option_));
+                                           binary_name_regex_.get(), etm_dump_option_,
+                                           thread_pool_.get()));
       } else if (data_type == "lbr") {
         reader.reset(
             new LBRPerfDataReader(std::move(file_reader), exclude_perf_, binary_name_regex_.get()));
@@ -1046,21 +1237,56 @@ class InjectCommand : public Command {
     return WriteBranchListFile(output_filename_, merger.GetETMData(), merger.GetLBRData());
   }
 
-  bool ConvertBranchListToAutoFDO() {
-    // Step1 : Merge branch lists from all input files.
-    BranchListMerger merger;
+  // Merge branch lists from all input files. With multiple threads, input files are split into
+  // one contiguous range per thread. Each range is read and merged into its own merger, so at most
+  // ThreadCount() partial results are kept in memory. Then the mergers are combined by a tree
+  // reduction, which keeps the order of input files.
+  bool ReadBranchListFiles(BranchListMerger& merger) {
+    if (!thread_pool_) {
+      return ReadBranchListFilesInRange(0, input_filenames_.size(), merger);
+    }
+    size_t range_count = std::min(thread_pool_->ThreadCount(), input_filenames_.size());
+    std::vector<BranchListMerger> mergers(range_count);
+    std::vector<uint8_t> results(range_count, 0);
+    for (size_t i = 0; i < range_count; i++) {
+      thread_pool_->AddTask([&, i](size_t) {
+        size_t begin = input_filenames_.size() * i / range_count;
+        size_t end = input_filenames_.size() * (i + 1) / range_count;
+        results[i] = ReadBranchListFilesInRange(begin, end, mergers[i]);
+      });
+    }
+    thread_pool_->Wait();
+    if (std::find(results.begin(), results.end(), 0) != results.end()) {
+      return false;
+    }
+    ReduceInTree(thread_pool_.get(), range_count,
+                 [&](size_t dst, size_t src) { mergers[dst].Merge(mergers[src]); });
+    merger.Merge(mergers[0]);
+    return true;
+  }
+
+  bool ReadBranchListFilesInRange(size_t begin, size_t end, BranchListMerger& merger) {
     auto etm_callback = [&](const BinaryKey& key, ETMBinary& binary) {
       merger.AddETMBinary(key, binary);
     };
     auto lbr_callback = [&](LBRData& lbr_data) { merger.AddLBRData(lbr_data); };
-    for (const auto& input_filename : input_filenames_) {
-      BranchListReader reader(input_filename, binary_name_regex_.get());
+    for (size_t i = begin; i < end; i++) {
+      BranchListReader reader(input_filenames_[i], binary_name_regex_.get());
       reader.AddCallback(etm_callback);
       reader.AddCallback(lbr_callback);
       if (!reader.Read()) {
         return false;
       }
     }
+    return true;
+  }
+
+  bool ConvertBranchListToAutoFDO() {
+    // Step1 : Merge branch lists from all input files.
+    BranchListMerger merger;
+    if (!ReadBranchListFiles(merger)) {
+      return false;
+    }
 
     // Step2: Convert ETMBinary and LBRData to AutoFDOBinaryInfo.
     AutoFDOWriter autofdo_writer;
@@ -1100,17 +1326,8 @@ class InjectCommand : public Command {
   bool ConvertBranchListToBranchList() {
     // Step1 : Merge branch lists from all input files.
     BranchListMerger merger;
-    auto etm_callback = [&](const BinaryKey& key, ETMBinary& binary) {
-      merger.AddETMBinary(key, binary);
-    };
-    auto lbr_callback = [&](LBRData& lbr_data) { merger.AddLBRData(lbr_data); };
-    for (const auto& input_filename : input_filenames_) {
-      BranchListReader reader(input_filename, binary_name_regex_.get());
-      reader.AddCallback(etm_callback);
-      reader.AddCallback(lbr_callback);
-      if (!reader.Read()) {
-        return false;
-      }
+    if (!ReadBranchListFiles(merger)) {
+      return false;
     }
     // Step2: Write ETMBinary.
     return WriteBranchListFile(output_filename_, merger.GetETMData(), merger.GetLBRData());
@@ -1122,6 +1339,7 @@ class InjectCommand : public Command {
   std::string output_filename_ = "perf_inject.data";
   OutputFormat output_format_ = OutputFormat::AutoFDO;
   ETMDumpOption etm_dump_option_;
+  std::unique_ptr<ThreadPool> thread_pool_;
 
   std::unique_ptr<Dso> placeholder_dso_;
 };
@@ -20,6 +20,7 @@
 
 #include "command.h"
 #include "get_test_data.h"
+#include "record_file.h"
 #include "test_util.h"
 #include "utils.h"
 
@@ -187,6 +188,103 @@ TEST(cmd_inject, merge_branch_list_files) {
   ASSERT_NE(autofdo_data.find("106c->1074:200"), std::string::npos);
 }
 
+// @CddTest = 6.1/C-0-2
+TEST(cmd_inject, multiple_threads) {
+  // Decode etm data in multiple threads.
+  std::string data;
+  ASSERT_TRUE(RunInjectCmd({"-j", "4"}, &data));
+  CheckMatchingExpectedData("perf_inject.data", data);
+
+  // Read branch list files in multiple threads.
+  TemporaryFile tmpfile;
+  close(tmpfile.release());
+  ASSERT_TRUE(RunInjectCmd({"-j", "4", "--output", "branch-list", "-o", tmpfile.path}));
+  std::string input = std::string(tmpfile.path) + "," + tmpfile.path;
+  ASSERT_TRUE(RunInjectCmd({"-i", input, "-j", "2", "--output", "autofdo"}, &data));
+  ASSERT_NE(data.find("106c->1074:200"), std::string::npos);
+
+  // Merge more input files than threads, in a tree reduction.
+  for (size_t i = 0; i < 3; i++) {
+    input += std::string(",") + tmpfile.path;
+  }
+  std::string expected_data;
+  ASSERT_TRUE(RunInjectCmd({"-i", input, "--output", "autofdo"}, &expected_data));
+  ASSERT_NE(expected_data.find("106c->1074:500"), std::string::npos);
+  ASSERT_TRUE(RunInjectCmd({"-i", input, "-j", "3", "--output", "autofdo"}, &data));
+  ASSERT_EQ(data, expected_data);
+
+  ASSERT_FALSE(RunInjectCmd({"-j", "0"}, nullptr));
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(cmd_inject, multiple_threads_with_exit_records_before_aux_data) {
+  // Copy PERF_DATA_ETM_TEST_LOOP, adding an exit record for each thread seen before the first
+  // AUX record. Exited threads are still needed to decode ETM data coming later.
+  std::unique_ptr<RecordFileReader> reader =
+      RecordFileReader::CreateInstance(GetTestData(PERF_DATA_ETM_TEST_LOOP));
+  ASSERT_TRUE(reader);
+  std::vector<std::unique_ptr<Record>> records = reader->DataSection();
+  TemporaryFile tmpfile;
+  close(tmpfile.release());
+  std::unique_ptr<RecordFileWriter> writer = RecordFileWriter::CreateInstance(tmpfile.path);
+  ASSERT_TRUE(writer);
+  ASSERT_TRUE(writer->WriteAttrSection(reader->AttrSection()));
+  const perf_event_attr& attr = reader->AttrSection()[0].attr;
+  uint64_t event_id = reader->AttrSection()[0].ids[0];
+  std::vector<std::pair<uint32_t, uint32_t>> threads;
+  size_t exit_record_count = 0;
+  std::vector<char> aux_data;
+  for (auto& r : records) {
+    if (r->type() == PERF_RECORD_COMM) {
+      auto& comm = *static_cast<CommRecord*>(r.get());
+      threads.emplace_back(comm.data->pid, comm.data->tid);
+    } else if (r->type() == PERF_RECORD_AUX && exit_record_count == 0) {
+      // There is no constructor for ExitRecord. So build it from a ForkRecord.
+      for (auto& [pid, tid] : threads) {
+        ForkRecord fork(attr, pid, tid, pid, tid, event_id);
+        std::vector<char> binary(fork.Binary(), fork.Binary() + fork.size());
+        reinterpret_cast<perf_event_header*>(binary.data())->type = PERF_RECORD_EXIT;
+        std::unique_ptr<Record> exit_r = ReadRecordFromBuffer(
+            attr, PERF_RECORD_EXIT, binary.data(), binary.data() + binary.size());
+        ASSERT_TRUE(exit_r);
+        ASSERT_TRUE(writer->WriteRecord(*exit_r));
+        exit_record_count++;
+      }
+    } else if (r->type() == PERF_RECORD_AUXTRACE) {
+      auto& auxtrace = *static_cast<AuxTraceRecord*>(r.get());
+      aux_data.resize(auxtrace.data->aux_size);
+      ASSERT_TRUE(
+          reader->ReadAtOffset(auxtrace.location.file_offset, aux_data.data(), aux_data.size()));
+      auxtrace.location.addr = aux_data.data();
+    }
+    ASSERT_TRUE(writer->WriteRecord(*r));
+  }
+  ASSERT_GT(exit_record_count, 0u);
+  ASSERT_TRUE(writer->FinishWritingDataSection());
+  std::vector<int> features;
+  for (const auto& [feature, _] : reader->FeatureSectionDescriptors()) {
+    if (feature != PerfFileFormat::FEAT_AUXTRACE) {
+      features.push_back(feature);
+    }
+  }
+  ASSERT_TRUE(writer->BeginWriteFeatures(features.size() + 1));
+  for (int feature : features) {
+    std::vector<char> data;
+    ASSERT_TRUE(reader->ReadFeatureSection(feature, &data));
+    ASSERT_TRUE(writer->WriteFeature(feature, data.data(), data.size()));
+  }
+  ASSERT_TRUE(writer->WriteAuxTraceFeature(writer->AuxTraceRecordOffsets()));
+  ASSERT_TRUE(writer->EndWriteFeatures());
+  ASSERT_TRUE(writer->Close());
+
+  std::string expected_data;
+  ASSERT_TRUE(RunInjectCmd({"-i", tmpfile.path, "-j", "1"}, &expected_data));
+  std::string data;
+  ASSERT_TRUE(RunInjectCmd({"-i", tmpfile.path, "-j", "4"}, &data));
+  ASSERT_EQ(data, expected_data);
+  CheckMatchingExpectedData("perf_inject.data", data);
+}
+
 // @CddTest = 6.1/C-0-2
 TEST(cmd_inject, report_warning_when_overflow) {
   CapturedStderr capture;
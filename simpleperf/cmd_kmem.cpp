@@ -67,6 +67,9 @@ BUILD_COMPARE_VALUE_FUNCTION_REVERSE(CompareBytesAlloc, bytes_alloc);
 BUILD_COMPARE_VALUE_FUNCTION(CompareGfpFlags, gfp_flags);
 BUILD_COMPARE_VALUE_FUNCTION_REVERSE(CompareCrossCpuAllocations, cross_cpu_allocations);
 
+BUILD_HASH_VALUE_FUNCTION(HashPtr, ptr);
+BUILD_HASH_VALUE_FUNCTION(HashGfpFlags, gfp_flags);
+
 BUILD_DISPLAY_HEX64_FUNCTION(DisplayPtr, ptr);
 BUILD_DISPLAY_UINT64_FUNCTION(DisplayBytesReq, bytes_req);
 BUILD_DISPLAY_UINT64_FUNCTION(DisplayBytesAlloc, bytes_alloc);
@@ -174,8 +177,8 @@ class SlabSampleTreeBuilder : public SampleTreeBuilder<SlabSample, SlabAccumulat
       uint64_t bytes_req = format->bytes_req.ReadFromData(raw_data);
       uint64_t bytes_alloc = format->bytes_alloc.ReadFromData(raw_data);
       uint64_t gfp_flags = format->gfp_flags.ReadFromData(raw_data);
-      SlabSample* sample = InsertSample(std::unique_ptr<SlabSample>(
-          new SlabSample(symbol, ptr, bytes_req, bytes_alloc, 1, gfp_flags, 0)));
+      SlabSample* sample =
+          InsertSample(SlabSample(symbol, ptr, bytes_req, bytes_alloc, 1, gfp_flags, 0));
       alloc_cpu_record_map_.insert(std::make_pair(ptr, std::make_pair(r.cpu_data.cpu, sample)));
       acc_info->bytes_req = bytes_req;
       acc_info->bytes_alloc = bytes_alloc;
@@ -207,10 +210,9 @@ class SlabSampleTreeBuilder : public SampleTreeBuilder<SlabSample, SlabAccumulat
       return nullptr;
     }
     const Symbol* symbol = thread_tree_->FindKernelSymbol(ip);
-    return InsertCallChainSample(
-        std::unique_ptr<SlabSample>(new SlabSample(symbol, sample->ptr, acc_info.bytes_req,
-                                                   acc_info.bytes_alloc, 1, sample->gfp_flags, 0)),
-        callchain);
+    return InsertCallChainSample(SlabSample(symbol, sample->ptr, acc_info.bytes_req,
+                                            acc_info.bytes_alloc, 1, sample->gfp_flags, 0),
+                                 callchain);
   }
 
   const ThreadEntry* GetThreadOfSample(SlabSample*) override { return nullptr; }
@@ -495,10 +497,10 @@ bool KmemCommand::PrepareToBuildSampleTree() {
         sort_comparator.AddCompareFunction(CompareSampleCount);
         displayer.AddDisplayFunction(accumulated_name + "Hit", DisplaySampleCount<SlabSample>);
       } else if (key == "caller") {
-        comparator.AddCompareFunction(CompareSymbol);
+        comparator.AddCompareFunction(CompareSymbol, HashSymbol);
         displayer.AddDisplayFunction("Caller", DisplaySymbol<SlabSample>);
       } else if (key == "ptr") {
-        comparator.AddCompareFunction(ComparePtr);
+        comparator.AddCompareFunction(ComparePtr, HashPtr);
         displayer.AddDisplayFunction("Ptr", DisplayPtr<SlabSample>);
       } else if (key == "bytes_req") {
         sort_comparator.AddCompareFunction(CompareBytesReq);
@@ -511,7 +513,7 @@ bool KmemCommand::PrepareToBuildSampleTree() {
         sort_comparator.AddCompareFunction(CompareFragment);
         displayer.AddDisplayFunction(accumulated_name + "Fragment", DisplayFragment);
       } else if (key == "gfp_flags") {
-        comparator.AddCompareFunction(CompareGfpFlags);
+        comparator.AddCompareFunction(CompareGfpFlags, HashGfpFlags);
         displayer.AddDisplayFunction("GfpFlags", DisplayGfpFlags<SlabSample>);
       } else if (key == "pingpong") {
         sort_comparator.AddCompareFunction(CompareCrossCpuAllocations);
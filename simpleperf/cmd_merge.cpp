@@ -16,13 +16,17 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+#include <map>
 #include <memory>
 #include <regex>
 #include <string>
+#include <unordered_set>
 
 #include <android-base/macros.h>
 #include <android-base/strings.h>
 
+#include "ThreadPool.h"
 #include "command.h"
 #include "event_attr.h"
 #include "record_file.h"
@@ -52,27 +56,23 @@ class MergedFileFeature {
       return false;
     }
     for (auto& symbol : file.symbols) {
-      auto it = symbol_map_.lower_bound(symbol.addr);
-      if (it != symbol_map_.end()) {
-        const auto& found = it->second;
-        if (found.addr == symbol.addr && found.len == symbol.len &&
-            strcmp(found.Name(), symbol.Name()) == 0) {
-          // The symbol already exists in symbol_map.
-          continue;
-        }
-        if (symbol.addr + symbol.len > found.addr) {
-          // an address conflict with the next symbol
-          return false;
-        }
+      if (!AddSymbol(symbol)) {
+        return false;
       }
-      if (it != symbol_map_.begin()) {
-        --it;
-        if (it->second.addr + it->second.len > symbol.addr) {
-          // an address conflict with the previous symbol
-          return false;
-        }
+    }
+    return true;
+  }
+
+  bool Merge(MergedFileFeature& other) {
+    if (other.type_ != type_ || other.min_vaddr_ != min_vaddr_ ||
+        other.file_offset_of_min_vaddr_ != file_offset_of_min_vaddr_ ||
+        other.dex_file_offsets_ != dex_file_offsets_) {
+      return false;
+    }
+    for (auto& [_, symbol] : other.symbol_map_) {
+      if (!AddSymbol(symbol)) {
+        return false;
       }
-      symbol_map_.emplace(symbol.addr, std::move(symbol));
     }
     return true;
   }
@@ -90,6 +90,31 @@ class MergedFileFeature {
   }
 
  private:
+  bool AddSymbol(Symbol& symbol) {
+    auto it = symbol_map_.lower_bound(symbol.addr);
+    if (it != symbol_map_.end()) {
+      const auto& found = it->second;
+      if (found.addr == symbol.addr && found.len == symbol.len &&
+          strcmp(found.Name(), symbol.Name()) == 0) {
+        // The symbol already exists in symbol_map.
+        return true;
+      }
+      if (symbol.addr + symbol.len > found.addr) {
+        // an address conflict with the next symbol
+        return false;
+      }
+    }
+    if (it != symbol_map_.begin()) {
+      --it;
+      if (it->second.addr + it->second.len > symbol.addr) {
+        // an address conflict with the previous symbol
+        return false;
+      }
+    }
+    symbol_map_.emplace(symbol.addr, std::move(symbol));
+    return true;
+  }
+
   std::string path_;
   DsoType type_;
   uint64_t min_vaddr_;
@@ -100,6 +125,46 @@ class MergedFileFeature {
   DISALLOW_COPY_AND_ASSIGN(MergedFileFeature);
 };
 
+// File features merged from a range of input files.
+struct MergedFileFeatureMap {
+  std::map<std::string, MergedFileFeature> file_map;
+  std::unordered_set<std::string> files_to_drop;
+
+  void DropFile(const std::string& path) {
+    LOG(WARNING) << path
+                 << " has address-conflict symbols in different record files. So drop its symbols.";
+    files_to_drop.emplace(path);
+  }
+
+  void Add(FileFeature& file) {
+    if (files_to_drop.count(file.path) != 0) {
+      return;
+    }
+    if (auto it = file_map.find(file.path); it == file_map.end()) {
+      file_map.emplace(file.path, file);
+    } else if (!it->second.Merge(file)) {
+      DropFile(file.path);
+    }
+  }
+
+  // Merge file features in other, which are read from input files after those in this map.
+  void Merge(MergedFileFeatureMap& other) {
+    files_to_drop.insert(other.files_to_drop.begin(), other.files_to_drop.end());
+    while (!other.file_map.empty()) {
+      auto node = other.file_map.extract(other.file_map.begin());
+      const std::string& path = node.key();
+      if (files_to_drop.count(path) != 0) {
+        continue;
+      }
+      if (auto it = file_map.find(path); it == file_map.end()) {
+        file_map.insert(std::move(node));
+      } else if (!it->second.Merge(node.mapped())) {
+        DropFile(path);
+      }
+    }
+  }
+};
+
 class MergeCommand : public Command {
  public:
   MergeCommand()
@@ -109,6 +174,8 @@ class MergeCommand : public Command {
 "       Merge multiple perf.data into one. The input files should be recorded on the same\n"
 "       device using the same event types.\n"
 "-i <file1>,<file2>,...       Input recording files separated by comma\n"
+"-j <threads>                 Use multiple threads to read and merge features of input files.\n"
+"                             Default is 1.\n"
 "-o <file>                    output recording file\n"
 "\n"
 "Examples:\n"
@@ -148,6 +215,7 @@ class MergeCommand : public Command {
   bool ParseOptions(const std::vector<std::string>& args) {
     const OptionFormatMap option_formats = {
         {"-i", {OptionValueType::STRING, OptionType::MULTIPLE}},
+        {"-j", {OptionValueType::UINT, OptionType::SINGLE}},
         {"-o", {OptionValueType::STRING, OptionType::SINGLE}},
     };
     OptionValueMap options;
@@ -159,6 +227,13 @@ class MergeCommand : public Command {
       auto files = android::base::Split(value.str_value, ",");
       input_files_.insert(input_files_.end(), files.begin(), files.end());
     }
+    size_t num_threads = 1;
+    if (!options.PullUintValue("-j", &num_threads, 1)) {
+      return false;
+    }
+    if (num_threads > 1) {
+      thread_pool_.reset(new ThreadPool(num_threads));
+    }
     options.PullStringValue("-o", &output_file_);
 
     CHECK(options.values.empty());
@@ -322,6 +397,11 @@ class MergeCommand : public Command {
   bool MergeFeatureSection() {
     std::vector<int> features;
     for (const auto& [key, _] : readers_[0]->FeatureSectionDescriptors()) {
+      // The writer generates them for the merged data section.
+      if (key == PerfFileFormat::FEAT_COMPRESSED_FRAME_INDEX ||
+          key == PerfFileFormat::FEAT_TIME_INDEX) {
+        continue;
+      }
       features.push_back(key);
     }
     if (!writer_->BeginWriteFeatures(features.size())) {
@@ -374,35 +454,34 @@ class MergeCommand : public Command {
     return writer_->WriteBuildIdFeature(records);
   }
 
+  // With multiple threads, input files are split into one contiguous range per thread. File
+  // features of each range are read and merged in parallel, then combined by a tree reduction.
   bool WriteFileFeature() {
-    std::map<std::string, MergedFileFeature> file_map;
-    std::unordered_set<std::string> files_to_drop;
-
-    // Read file features.
-    for (auto& reader : readers_) {
-      FileFeature file;
-      uint64_t read_pos = 0;
-      bool error = false;
-      while (reader->ReadFileFeature(read_pos, file, error)) {
-        if (files_to_drop.count(file.path) != 0) {
-          continue;
-        }
-        if (auto it = file_map.find(file.path); it == file_map.end()) {
-          file_map.emplace(file.path, file);
-        } else if (!it->second.Merge(file)) {
-          LOG(WARNING)
-              << file.path
-              << " has address-conflict symbols in different record files. So drop its symbols.";
-          files_to_drop.emplace(file.path);
-        }
-      }
-      if (error) {
-        return false;
+    size_t range_count = thread_pool_ ? std::min(thread_pool_->ThreadCount(), readers_.size()) : 1;
+    std::vector<MergedFileFeatureMap> maps(range_count);
+    std::vector<uint8_t> results(range_count, 0);
+    auto read_range = [&](size_t i) {
+      size_t begin = readers_.size() * i / range_count;
+      size_t end = readers_.size() * (i + 1) / range_count;
+      results[i] = ReadFileFeatures(begin, end, maps[i]);
+    };
+    if (thread_pool_) {
+      for (size_t i = 0; i < range_count; i++) {
+        thread_pool_->AddTask([&, i](size_t) { read_range(i); });
       }
+      thread_pool_->Wait();
+    } else {
+      read_range(0);
+    }
+    if (std::find(results.begin(), results.end(), 0) != results.end()) {
+      return false;
     }
+    ReduceInTree(thread_pool_.get(), range_count,
+                 [&](size_t dst, size_t src) { maps[dst].Merge(maps[src]); });
+
     // Write file features.
-    for (const auto& [file_path, file] : file_map) {
-      if (files_to_drop.count(file_path) != 0) {
+    for (const auto& [file_path, file] : maps[0].file_map) {
+      if (maps[0].files_to_drop.count(file_path) != 0) {
         continue;
       }
       FileFeature file_feature;
@@ -414,10 +493,26 @@ class MergeCommand : public Command {
     return true;
   }
 
+  bool ReadFileFeatures(size_t begin, size_t end, MergedFileFeatureMap& map) {
+    for (size_t i = begin; i < end; i++) {
+      FileFeature file;
+      uint64_t read_pos = 0;
+      bool error = false;
+      while (readers_[i]->ReadFileFeature(read_pos, file, error)) {
+        map.Add(file);
+      }
+      if (error) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   std::vector<std::string> input_files_;
   std::vector<std::unique_ptr<RecordFileReader>> readers_;
   std::string output_file_;
   std::unique_ptr<RecordFileWriter> writer_;
+  std::unique_ptr<ThreadPool> thread_pool_;
 };
 
 }  // namespace
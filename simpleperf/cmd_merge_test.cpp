@@ -92,3 +92,23 @@ TEST(merge_cmd, merge_two_files) {
   ASSERT_NE(report.find("sleep_main"), std::string::npos);
   ASSERT_NE(report.find("toybox_main"), std::string::npos);
 }
+
+// @CddTest = 6.1/C-0-2
+TEST(merge_cmd, multiple_threads) {
+  std::string input_file1 = GetTestData("perf_merge1.data");
+  std::string input_file2 = GetTestData("perf_merge2.data");
+  std::string inputs = input_file1 + "," + input_file2 + "," + input_file1 + "," + input_file2;
+  TemporaryFile tmpfile;
+  close(tmpfile.release());
+  ASSERT_TRUE(MergeCmd()->Run({"-i", inputs, "-o", tmpfile.path}));
+  std::string expected_report = GetReport(tmpfile.path);
+  ASSERT_NE(expected_report.find("Samples: 116"), std::string::npos);
+
+  ASSERT_TRUE(MergeCmd()->Run({"-i", inputs, "-j", "3", "-o", tmpfile.path}));
+  std::string report = GetReport(tmpfile.path);
+  ASSERT_EQ(report, expected_report);
+  ASSERT_NE(report.find("malloc"), std::string::npos);
+  ASSERT_NE(report.find("sleep_main"), std::string::npos);
+
+  ASSERT_FALSE(MergeCmd()->Run({"-i", inputs, "-j", "0", "-o", tmpfile.path}));
+}
@@ -53,10 +53,12 @@
 #include "ETMRecorder.h"
 #include "IOEventLoop.h"
 #include "JITDebugReader.h"
+#include "LiveReporter.h"
 #include "MapRecordReader.h"
 #include "OfflineUnwinder.h"
 #include "ProbeEvents.h"
 #include "RecordFilter.h"
+#include "ThreadPool.h"
 #include "cmd_record_impl.h"
 #include "command.h"
 #include "environment.h"
@@ -108,6 +110,8 @@ static constexpr size_t DESIRED_PAGES_IN_MAPPED_BUFFER = 1024;
 
 // Cache size used by CallChainJoiner to cache call chains in memory.
 static constexpr size_t DEFAULT_CALL_CHAIN_JOINER_CACHE_SIZE = 8 * kMegabyte;
+// Limit memory used by records waiting to be unwound in multiple threads.
+static constexpr size_t kPostUnwindBatchSize = 64 * kMegabyte;
 
 static constexpr size_t kDefaultAuxBufferSize = 4 * kMegabyte;
 
@@ -237,6 +241,11 @@ class RecordCommand : public Command {
 "                will be used.\n"
 "--user-buffer-size <buffer_size> Set buffer size in userspace to cache sample data.\n"
 "                                 By default, it is %s.\n"
+"--record-read-threads <n>  Use n threads to read records from kernel buffers. Each thread\n"
+"                           reads buffers of a subset of cpus, and uses 1/n of the user\n"
+"                           buffer. It helps to reduce lost samples on devices with many\n"
+"                           cpus. Default is 1. Using more than one thread needs a\n"
+"                           clockid other than perf.\n"
 "--no-inherit  Don't record created child threads/processes.\n"
 "--cpu-percent <percent>  Set the max percent of cpu time used for recording.\n"
 "                         percent is in range [1-100], default is 25.\n"
@@ -250,6 +259,8 @@ class RecordCommand : public Command {
 "                       stack will be recorded in perf.data and unwound while\n"
 "                       recording by default. Use --post-unwind=yes to switch\n"
 "                       to unwind after recording.\n"
+"--post-unwind-threads <n>  Use n threads to unwind samples when --post-unwind=yes\n"
+"                           is used. Default is 1.\n"
 "--no-unwind   If `--call-graph dwarf` option is used, then the user's stack\n"
 "              will be unwound by default. Use this option to disable the\n"
 "              unwinding of the user's stack.\n"
@@ -260,6 +271,9 @@ class RecordCommand : public Command {
 "--callchain-joiner-min-matching-nodes count\n"
 "               When callchain joiner is used, set the matched nodes needed to join\n"
 "               callchains. The count should be >= 1. By default it is 1.\n"
+"--callchain-joiner-memory SIZE[K|M|G]  When callchain joiner is used, limit the memory\n"
+"               used to keep callchains. Callchains beyond the limit are stored in\n"
+"               temporary files. Default is 64M.\n"
 "--no-cut-samples   Simpleperf uses a record buffer to cache records received from the kernel.\n"
 "                   When the available space in the buffer reaches low level, the stack data in\n"
 "                   samples is truncated to 1KB. When the available space reaches critical level,\n"
@@ -279,15 +293,35 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_RECORDING
 "--no-dump-symbols       Don't dump symbols in perf.data. By default symbols are\n"
 "                        dumped in perf.data, to support reporting in another\n"
 "                        environment.\n"
+"--flight-recorder <duration_in_sec>  Keep records only for the last duration_in_sec seconds\n"
+"                              in memory, and write them when recording stops. Older samples\n"
+"                              are dropped, while threads and maps still alive are kept.\n"
+"                              It is used to keep profiling running and capture the time\n"
+"                              before an anomaly, by stopping with a signal or --stop-signal-fd.\n"
+"--flight-recorder-size SIZE[K|M|G]  Used with --flight-recorder. Limit the memory for kept\n"
+"                              records, including threads and maps kept from dropped\n"
+"                              records. Default is 256M.\n"
 "-o record_file_name    Set record file name, default is perf.data.\n"
 "--size-limit SIZE[K|M|G]      Stop recording after SIZE bytes of records.\n"
 "                              Default is unlimited.\n"
+"--stack-delta    Store user stack data of samples as deltas against the previous sample of\n"
+"                 the same thread. It reduces the file size when samples keep stack data, like\n"
+"                 with --no-unwind or --post-unwind. The recording file can't be read by\n"
+"                 linux perf or older versions of simpleperf.\n"
+"--symbol-cache-dir <dir>  Cache build ids and symbol tables of binaries in <dir>. Later\n"
+"                          recordings of the same binaries read them from the cache when\n"
+"                          dumping build ids and symbols after recording.\n"
+"--symbol-cache-size <MB>  Limit the total size of files in the symbol cache dir.\n"
+"                          Least recently used files are removed. Default is 512.\n"
 "--symfs <dir>    Look for files with symbols relative to this directory.\n"
 "                 This option is used to provide files with symbol table and\n"
 "                 debug information, which are used for unwinding and dumping symbols.\n"
 "--add-meta-info key=value     Add extra meta info, which will be stored in the recording file.\n"
 "-z[=<compression_level>]      Compress records using zstd. compression level: 1 is the fastest,\n"
 "                              22 is the greatest, 3 is the default.\n"
+"--compression-threads <count>   Used with -z. Compress records in independent frames using\n"
+"                                <count> background threads, instead of in the main thread.\n"
+"                                It reduces sample loss when using high compression levels.\n"
 "\n"
 "ETM recording options:\n"
 "--addr-filter filter_str1,filter_str2,...\n"
@@ -322,6 +356,9 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_RECORDING
 "Other options:\n"
 "--exit-with-parent            Stop recording when the thread starting simpleperf dies.\n"
 "--use-cmd-exit-code           Exit with the same exit code as the monitored cmdline.\n"
+"--live-report <interval_in_ms>  While recording, print top symbols and shared objects of samples\n"
+"                                every interval_in_ms milliseconds, like top. Sample weights are\n"
+"                                halved in each interval, to follow recent samples.\n"
 "--start_profiling_fd fd_no    After starting profiling, write \"STARTED\" to\n"
 "                              <fd_no>, then close <fd_no>.\n"
 "--stdio-controls-profiling    Use stdin/stdout to pause/resume profiling.\n"
@@ -402,12 +439,18 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_RECORDING
   bool ProcessControlCmd(IOEventLoop* loop);
   void UpdateRecord(Record* record);
   bool UnwindRecord(SampleRecord& r);
-  bool KeepFailedUnwindingResult(const SampleRecord& r, const std::vector<uint64_t>& ips,
+  bool SaveUnwindingResult(SampleRecord& r, const UnwindingResult& result,
+                           const std::vector<uint64_t>& ips, const std::vector<uint64_t>& sps);
+  bool KeepFailedUnwindingResult(const SampleRecord& r, const UnwindingResult& result,
+                                 const std::vector<uint64_t>& ips,
                                  const std::vector<uint64_t>& sps);
+  bool SaveSampleAfterUnwinding(SampleRecord& r);
 
   // post recording functions
   std::unique_ptr<RecordFileReader> MoveRecordFile(const std::string& old_filename);
   bool PostUnwindRecords();
+  bool AddPostUnwindTask(std::unique_ptr<Record> record);
+  bool FlushPostUnwindTasks();
   bool JoinCallChains();
   bool DumpAdditionalFeatures(const std::vector<std::string>& args);
   bool DumpBuildIdFeature();
@@ -428,6 +471,31 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_RECORDING
   bool keep_failed_unwinding_result_ = false;
   bool keep_failed_unwinding_debug_info_ = false;
   std::unique_ptr<OfflineUnwinder> offline_unwinder_;
+
+  // Used to unwind samples in multiple threads after recording. Records are unwound in batches.
+  // The thread tree isn't changed while unwinding a batch, and results are saved in record order.
+  struct PostUnwindTask {
+    std::unique_ptr<Record> record;
+    bool need_unwinding = false;
+    // A copy of the sample thread. It keeps the maps used for unwinding alive.
+    ThreadEntry thread;
+    bool unwinding_ok = false;
+    UnwindingResult unwinding_result;
+    std::vector<uint64_t> ips;
+    std::vector<uint64_t> sps;
+  };
+  size_t post_unwind_threads_ = 1;
+  std::unique_ptr<ThreadPool> post_unwind_thread_pool_;
+  std::vector<std::unique_ptr<OfflineUnwinder>> post_unwinders_;
+  std::vector<PostUnwindTask> post_unwind_tasks_;
+  size_t post_unwind_tasks_size_ = 0;
+  // Processes of samples in post_unwind_tasks_.
+  std::unordered_set<int> post_unwind_pids_;
+  // Versions of maps used by samples in post_unwind_tasks_, whose dsos have debug file paths
+  // resolved. Dso::GetDebugFilePath() caches the path lazily, so it is called on the main thread
+  // before worker threads use the dsos.
+  std::unordered_map<const MapSet*, uint64_t> post_unwind_prepared_maps_;
+
   bool child_inherit_;
   uint64_t delay_in_ms_ = 0;
   double duration_in_sec_;
@@ -462,6 +530,7 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_RECORDING
   // For CallChainJoiner
   bool allow_callchain_joiner_;
   size_t callchain_joiner_min_matching_nodes_;
+  uint64_t callchain_joiner_memory_size_ = 64 * kMegabyte;
   std::unique_ptr<CallChainJoiner> callchain_joiner_;
   bool allow_truncating_samples_ = true;
 
@@ -472,6 +541,7 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_RECORDING
   // In system wide recording, record if we have dumped map info for a process.
   std::unordered_set<pid_t> dumped_processes_;
   bool exclude_perf_ = false;
+  size_t record_read_threads_ = 1;
   RecordFilter record_filter_;
 
   std::optional<MapRecordReader> map_record_reader_;
@@ -486,6 +556,12 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_RECORDING
   std::chrono::milliseconds etm_flush_interval_{kDefaultEtmDataFlushIntervalInMs};
 
   size_t compression_level_ = 0;
+  size_t compression_threads_ = 0;
+  std::chrono::milliseconds live_report_interval_{0};
+  std::unique_ptr<LiveReporter> live_reporter_;
+  bool stack_delta_ = false;
+  double flight_recorder_duration_in_sec_ = 0;
+  uint64_t flight_recorder_size_ = 256 * kMegabyte;
 };
 
 std::string RecordCommand::LongHelpString() const {
@@ -613,7 +689,8 @@ bool RecordCommand::PrepareRecording(Workload* workload) {
   }
   if (unwind_dwarf_callchain_ && allow_callchain_joiner_) {
     callchain_joiner_.reset(new CallChainJoiner(DEFAULT_CALL_CHAIN_JOINER_CACHE_SIZE,
-                                                callchain_joiner_min_matching_nodes_, false));
+                                                callchain_joiner_min_matching_nodes_, false,
+                                                callchain_joiner_memory_size_));
   }
 
   // 4. Add monitored targets.
@@ -673,7 +750,8 @@ bool RecordCommand::PrepareRecording(Workload* workload) {
   }
   if (!event_selection_set_.MmapEventFiles(mmap_page_range_.first, mmap_page_range_.second,
                                            aux_buffer_size_, record_buffer_size,
-                                           allow_truncating_samples_, exclude_perf_)) {
+                                           allow_truncating_samples_, exclude_perf_,
+                                           record_read_threads_)) {
     return false;
   }
   auto callback = std::bind(&RecordCommand::ProcessRecord, this, std::placeholders::_1);
@@ -858,6 +936,17 @@ bool RecordCommand::PostProcessRecording(const std::vector<std::string>& args) {
   if (!event_selection_set_.FinishReadMmapEventData()) {
     return false;
   }
+  if (live_reporter_) {
+    live_reporter_->Stop();
+  }
+
+  if (const FlightRecorder* recorder = record_file_writer_->GetFlightRecorder(); recorder) {
+    auto [start_time, end_time] = recorder->KeptTimeRange();
+    LOG(INFO) << "Flight recorder kept " << recorder->KeptSize() << " bytes of records in "
+              << (end_time - start_time) / 1e9 << " s, and " << recorder->StateSize()
+              << " bytes of thread and map records. Dropped "
+              << recorder->DroppedRecordCount() << " older records.";
+  }
 
   // 2. Post unwind dwarf callchain.
   if (unwind_dwarf_callchain_ && post_unwind_) {
@@ -888,9 +977,9 @@ bool RecordCommand::PostProcessRecording(const std::vector<std::string>& args) {
 
   // 5. Show brief record result.
   auto report_compression_stat = [&]() {
-    if (auto compressor = record_file_writer_->GetCompressor(); compressor != nullptr) {
-      uint64_t original_size = compressor->TotalInputSize();
-      uint64_t compressed_size = compressor->TotalOutputSize();
+    uint64_t original_size;
+    uint64_t compressed_size;
+    if (record_file_writer_->GetCompressionStat(&original_size, &compressed_size)) {
       LOG(INFO) << "Record compressed: " << ReadableBytes(compressed_size) << " (original "
                 << ReadableBytes(original_size) << ", ratio " << std::setprecision(2)
                 << (static_cast<double>(original_size) / compressed_size) << ")";
@@ -968,6 +1057,15 @@ bool RecordCommand::PostProcessRecording(const std::vector<std::string>& args) {
     if (callchain_joiner_) {
       callchain_joiner_->DumpStat();
     }
+    if (offline_unwinder_) {
+      UnwindingCacheStat cache_stat = offline_unwinder_->GetCacheStat();
+      for (const auto& unwinder : post_unwinders_) {
+        cache_stat.elf_cache_hits += unwinder->GetCacheStat().elf_cache_hits;
+        cache_stat.elf_cache_misses += unwinder->GetCacheStat().elf_cache_misses;
+      }
+      LOG(DEBUG) << "Unwinding ELF cache stat: hits=" << cache_stat.elf_cache_hits
+                 << ", misses=" << cache_stat.elf_cache_misses;
+    }
   }
   LOG(DEBUG) << "Prepare recording time "
              << (time_stat_.start_recording_time - time_stat_.prepare_recording_time) / 1e9
@@ -1041,7 +1139,8 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
   }
 
   if (!options.PullUintValue("--callchain-joiner-min-matching-nodes",
-                             &callchain_joiner_min_matching_nodes_, 1)) {
+                             &callchain_joiner_min_matching_nodes_, 1) ||
+      !options.PullUintValue("--callchain-joiner-memory", &callchain_joiner_memory_size_, 1)) {
     return false;
   }
 
@@ -1070,6 +1169,11 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
   if (options.PullUintValue("--etm-flush-interval", &interval) && interval != 0) {
     etm_flush_interval_ = std::chrono::milliseconds(interval);
   }
+  interval = 0;
+  if (!options.PullUintValue("--live-report", &interval, 1)) {
+    return false;
+  }
+  live_report_interval_ = std::chrono::milliseconds(interval);
 
   if (options.PullBoolValue("--record-timestamp")) {
     ETMRecorder& recorder = ETMRecorder::GetInstance();
@@ -1094,6 +1198,10 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
   if (!options.PullDoubleValue("--duration", &duration_in_sec_, 1e-9)) {
     return false;
   }
+  if (!options.PullDoubleValue("--flight-recorder", &flight_recorder_duration_in_sec_, 1e-9) ||
+      !options.PullUintValue("--flight-recorder-size", &flight_recorder_size_, 1)) {
+    return false;
+  }
 
   exclude_perf_ = options.PullBoolValue("--exclude-perf");
   if (!record_filter_.ParseOptions(options)) {
@@ -1181,6 +1289,9 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
   if (options.PullValue("--post-unwind=no")) {
     post_unwind_ = false;
   }
+  if (!options.PullUintValue("--post-unwind-threads", &post_unwind_threads_, 1)) {
+    return false;
+  }
 
   if (auto value = options.PullValue("--user-buffer-size"); value) {
     uint64_t v = value->uint_value;
@@ -1191,6 +1302,10 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
     user_buffer_size_ = static_cast<size_t>(v);
   }
 
+  if (!options.PullUintValue("--record-read-threads", &record_read_threads_, 1)) {
+    return false;
+  }
+
   if (!options.PullUintValue("--size-limit", &size_limit_in_bytes_, 1)) {
     return false;
   }
@@ -1199,12 +1314,23 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
     start_profiling_fd_.reset(static_cast<int>(value->uint_value));
   }
 
+  stack_delta_ = options.PullBoolValue("--stack-delta");
   stdio_controls_profiling_ = options.PullBoolValue("--stdio-controls-profiling");
 
   if (auto value = options.PullValue("--stop-signal-fd"); value) {
     stop_signal_fd_.reset(static_cast<int>(value->uint_value));
   }
 
+  if (auto value = options.PullValue("--symbol-cache-dir"); value) {
+    uint64_t size_in_mb = 512;
+    if (!options.PullUintValue("--symbol-cache-size", &size_in_mb)) {
+      return false;
+    }
+    Dso::SetSymbolCache(value->str_value, size_in_mb * kMegabyte);
+  } else if (options.PullValue("--symbol-cache-size")) {
+    LOG(ERROR) << "--symbol-cache-size should be used with --symbol-cache-dir";
+    return false;
+  }
   if (auto value = options.PullValue("--symfs"); value) {
     if (!Dso::SetSymFsDir(value->str_value)) {
       return false;
@@ -1241,6 +1367,21 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
       }
     }
   }
+  if (!options.PullUintValue("--compression-threads", &compression_threads_, 1)) {
+    return false;
+  }
+  if (compression_threads_ != 0 && compression_level_ == 0) {
+    LOG(ERROR) << "--compression-threads should be used with -z";
+    return false;
+  }
+  if (flight_recorder_duration_in_sec_ != 0 && size_limit_in_bytes_ != 0) {
+    LOG(ERROR) << "--flight-recorder can't be used with --size-limit";
+    return false;
+  }
+  if (live_report_interval_.count() != 0 && stdio_controls_profiling_) {
+    LOG(ERROR) << "--live-report can't be used with --stdio-controls-profiling";
+    return false;
+  }
 
   CHECK(options.values.empty());
 
@@ -1364,6 +1505,11 @@ bool RecordCommand::ParseOptions(const std::vector<std::string>& args,
     return false;
   }
 
+  if (flight_recorder_duration_in_sec_ != 0 && event_selection_set_.HasAuxTrace()) {
+    LOG(ERROR) << "--flight-recorder can't be used with ETM recording.";
+    return false;
+  }
+
   if (dump_symbols_ && can_dump_kernel_symbols_) {
     // No need to dump kernel symbols as we will dump all required symbols.
     can_dump_kernel_symbols_ = false;
@@ -1477,6 +1623,16 @@ bool RecordCommand::CreateAndInitRecordFile() {
   map_record_reader_.emplace(dumping_attr_id_.attr, dumping_attr_id_.ids[0],
                              event_selection_set_.RecordNotExecutableMaps());
   map_record_reader_->SetCallback([this](Record* r) { return ProcessRecord(r); });
+  if (live_report_interval_.count() != 0) {
+    live_reporter_.reset(new LiveReporter(dumping_attr_id_.attr, live_report_interval_, stdout));
+  }
+  if (flight_recorder_duration_in_sec_ != 0) {
+    // Only the first record file takes records from the kernel. Record files created in post
+    // processing write all records they get.
+    record_file_writer_->EnableFlightRecorder(
+        attrs, static_cast<uint64_t>(flight_recorder_duration_in_sec_ * 1e9),
+        flight_recorder_size_);
+  }
 
   return DumpKernelSymbol() && DumpTracingData() && DumpMaps() && DumpAuxTraceInfo();
 }
@@ -1490,6 +1646,12 @@ std::unique_ptr<RecordFileWriter> RecordCommand::CreateRecordFile(const std::str
   if (compression_level_ != 0 && !writer->SetCompressionLevel(compression_level_)) {
     return nullptr;
   }
+  if (compression_threads_ != 0 && !writer->SetCompressionThreads(compression_threads_)) {
+    return nullptr;
+  }
+  if (stack_delta_) {
+    writer->EnableStackDeltaEncoding();
+  }
   if (!writer->WriteAttrSection(attrs)) {
     return nullptr;
   }
@@ -1564,7 +1726,17 @@ bool RecordCommand::DumpMaps() {
     }
   }
 
-  // Dump each process.
+  // Dump each process. When monitoring many processes, read them in parallel to start recording
+  // earlier.
+  if (process_map.size() > 1) {
+    std::vector<std::pair<pid_t, std::unordered_set<pid_t>>> processes;
+    for (auto& [pid, tids] : process_map) {
+      if (!tids.empty()) {
+        processes.emplace_back(pid, std::move(tids));
+      }
+    }
+    return map_record_reader_->ReadProcessMapsInParallel(processes, 0, GetMapReadThreadCount());
+  }
   for (const auto& [pid, tids] : process_map) {
     if (!map_record_reader_->ReadProcessMaps(pid, tids, 0)) {
       return false;
@@ -1598,6 +1770,9 @@ bool RecordCommand::ProcessRecord(Record* record) {
       return true;
     }
   }
+  if (live_reporter_) {
+    live_reporter_->AddRecord(*record);
+  }
   if (etm_branch_list_generator_) {
     bool consumed = false;
     if (!etm_branch_list_generator_->ProcessRecord(*record, consumed)) {
@@ -1678,19 +1853,23 @@ bool RecordCommand::SaveRecordAfterUnwinding(Record* record) {
     if (!UnwindRecord(r)) {
       return false;
     }
-    // ExcludeKernelCallChain() should go after UnwindRecord() to notice the generated user call
-    // chain.
-    if (r.InKernel() && exclude_kernel_callchain_ && !r.ExcludeKernelCallChain()) {
-      // If current record contains no user callchain, skip it.
-      return true;
-    }
-    sample_record_count_++;
-  } else {
-    thread_tree_.Update(*record);
+    return SaveSampleAfterUnwinding(r);
   }
+  thread_tree_.Update(*record);
   return record_file_writer_->WriteRecord(*record);
 }
 
+bool RecordCommand::SaveSampleAfterUnwinding(SampleRecord& r) {
+  // ExcludeKernelCallChain() should go after UnwindRecord() to notice the generated user call
+  // chain.
+  if (r.InKernel() && exclude_kernel_callchain_ && !r.ExcludeKernelCallChain()) {
+    // If current record contains no user callchain, skip it.
+    return true;
+  }
+  sample_record_count_++;
+  return record_file_writer_->WriteRecord(r);
+}
+
 bool RecordCommand::SaveRecordWithoutUnwinding(Record* record) {
   if (record->type() == PERF_RECORD_SAMPLE) {
     auto& r = *static_cast<SampleRecord*>(record);
@@ -1835,9 +2014,13 @@ void RecordCommand::UpdateRecord(Record* record) {
   }
 }
 
+static bool SkipUnwinding(const SampleRecord& r) {
+  return !(r.sample_type & PERF_SAMPLE_CALLCHAIN) && (r.sample_type & PERF_SAMPLE_REGS_USER) &&
+         (r.regs_user_data.reg_mask != 0) && (r.sample_type & PERF_SAMPLE_STACK_USER);
+}
+
 bool RecordCommand::UnwindRecord(SampleRecord& r) {
-  if (!(r.sample_type & PERF_SAMPLE_CALLCHAIN) && (r.sample_type & PERF_SAMPLE_REGS_USER) &&
-      (r.regs_user_data.reg_mask != 0) && (r.sample_type & PERF_SAMPLE_STACK_USER)) {
+  if (SkipUnwinding(r)) {
     return true;
   }
   if (r.GetValidStackSize() > 0) {
@@ -1860,26 +2043,31 @@ bool RecordCommand::UnwindRecord(SampleRecord& r) {
         return false;
       }
     }
-    if (keep_failed_unwinding_result_ && !KeepFailedUnwindingResult(r, ips, sps)) {
-      return false;
-    }
-    r.ReplaceRegAndStackWithCallChain(ips);
-    if (callchain_joiner_ &&
-        !callchain_joiner_->AddCallChain(r.tid_data.pid, r.tid_data.tid,
-                                         CallChainJoiner::ORIGINAL_OFFLINE, ips, sps)) {
-      return false;
-    }
-  } else {
-    // For kernel samples, we still need to remove user stack and register fields.
-    r.ReplaceRegAndStackWithCallChain({});
+    return SaveUnwindingResult(r, offline_unwinder_->GetUnwindingResult(), ips, sps);
+  }
+  // For kernel samples, we still need to remove user stack and register fields.
+  r.ReplaceRegAndStackWithCallChain({});
+  return true;
+}
+
+bool RecordCommand::SaveUnwindingResult(SampleRecord& r, const UnwindingResult& result,
+                                        const std::vector<uint64_t>& ips,
+                                        const std::vector<uint64_t>& sps) {
+  if (keep_failed_unwinding_result_ && !KeepFailedUnwindingResult(r, result, ips, sps)) {
+    return false;
+  }
+  r.ReplaceRegAndStackWithCallChain(ips);
+  if (callchain_joiner_ &&
+      !callchain_joiner_->AddCallChain(r.tid_data.pid, r.tid_data.tid,
+                                       CallChainJoiner::ORIGINAL_OFFLINE, ips, sps)) {
+    return false;
   }
   return true;
 }
 
-bool RecordCommand::KeepFailedUnwindingResult(const SampleRecord& r,
+bool RecordCommand::KeepFailedUnwindingResult(const SampleRecord& r, const UnwindingResult& result,
                                               const std::vector<uint64_t>& ips,
                                               const std::vector<uint64_t>& sps) {
-  auto& result = offline_unwinder_->GetUnwindingResult();
   if (result.error_code != unwindstack::ERROR_NONE) {
     if (keep_failed_unwinding_debug_info_) {
       return record_file_writer_->WriteRecord(UnwindingResultRecord(
@@ -1937,12 +2125,125 @@ bool RecordCommand::PostUnwindRecords() {
   }
 
   sample_record_count_ = 0;
+  if (post_unwind_threads_ > 1) {
+    post_unwind_thread_pool_.reset(new ThreadPool(post_unwind_threads_));
+    bool collect_stat = keep_failed_unwinding_result_;
+    for (size_t i = 0; i < post_unwind_threads_; i++) {
+      post_unwinders_.emplace_back(OfflineUnwinder::Create(collect_stat));
+    }
+    auto callback = [this](std::unique_ptr<Record> record) {
+      return AddPostUnwindTask(std::move(record));
+    };
+    return reader->ReadDataSection(callback) && FlushPostUnwindTasks();
+  }
   auto callback = [this](std::unique_ptr<Record> record) {
     return SaveRecordAfterUnwinding(record.get());
   };
   return reader->ReadDataSection(callback);
 }
 
+// Return the process whose maps are changed by a record, or -1 if no user maps are changed.
+static int GetPidChangingMaps(const Record& record) {
+  if (record.type() == PERF_RECORD_MMAP) {
+    auto& r = static_cast<const MmapRecord&>(record);
+    return r.InKernel() ? -1 : static_cast<int>(r.data->pid);
+  }
+  if (record.type() == PERF_RECORD_MMAP2) {
+    auto& r = static_cast<const Mmap2Record&>(record);
+    return r.InKernel() ? -1 : static_cast<int>(r.data->pid);
+  }
+  if (record.type() == PERF_RECORD_FORK) {
+    return static_cast<int>(static_cast<const ForkRecord&>(record).data->pid);
+  }
+  return -1;
+}
+
+bool RecordCommand::AddPostUnwindTask(std::unique_ptr<Record> record) {
+  PostUnwindTask task;
+  if (record->type() == PERF_RECORD_SAMPLE) {
+    auto& r = *static_cast<SampleRecord*>(record.get());
+    r.AdjustCallChainGeneratedByKernel();
+    if (!SkipUnwinding(r) && r.GetValidStackSize() > 0) {
+      task.need_unwinding = true;
+      task.thread = *thread_tree_.FindThreadOrNew(r.tid_data.pid, r.tid_data.tid);
+      post_unwind_pids_.insert(task.thread.pid);
+      const MapSet* maps = task.thread.maps.get();
+      if (auto it = post_unwind_prepared_maps_.find(maps);
+          it == post_unwind_prepared_maps_.end() || it->second != maps->version) {
+        for (const auto& [_, map] : maps->maps) {
+          map->dso->GetDebugFilePath();
+        }
+        post_unwind_prepared_maps_[maps] = maps->version;
+      }
+    }
+  } else {
+    // Samples before the record should be unwound with maps before the record.
+    if (int pid = GetPidChangingMaps(*record); pid != -1 && post_unwind_pids_.count(pid) != 0) {
+      if (!FlushPostUnwindTasks()) {
+        return false;
+      }
+    }
+    thread_tree_.Update(*record);
+  }
+  post_unwind_tasks_size_ += record->size();
+  task.record = std::move(record);
+  post_unwind_tasks_.emplace_back(std::move(task));
+  if (post_unwind_tasks_size_ >= kPostUnwindBatchSize) {
+    return FlushPostUnwindTasks();
+  }
+  return true;
+}
+
+bool RecordCommand::FlushPostUnwindTasks() {
+  // Split tasks into more pieces than threads, to balance load between threads.
+  size_t piece_count = post_unwind_thread_pool_->ThreadCount() * 4;
+  size_t piece_size = (post_unwind_tasks_.size() + piece_count - 1) / piece_count;
+  for (size_t start = 0; start < post_unwind_tasks_.size(); start += piece_size) {
+    size_t end = std::min(start + piece_size, post_unwind_tasks_.size());
+    post_unwind_thread_pool_->AddTask([this, start, end](size_t thread_index) {
+      OfflineUnwinder& unwinder = *post_unwinders_[thread_index];
+      for (size_t i = start; i < end; i++) {
+        PostUnwindTask& task = post_unwind_tasks_[i];
+        if (!task.need_unwinding) {
+          continue;
+        }
+        auto& r = *static_cast<SampleRecord*>(task.record.get());
+        RegSet regs(r.regs_user_data.abi, r.regs_user_data.reg_mask, r.regs_user_data.regs);
+        task.unwinding_ok = unwinder.UnwindCallChain(task.thread, regs, r.stack_user_data.data,
+                                                     r.GetValidStackSize(), &task.ips, &task.sps);
+        task.unwinding_result = unwinder.GetUnwindingResult();
+      }
+    });
+  }
+  post_unwind_thread_pool_->Wait();
+
+  for (PostUnwindTask& task : post_unwind_tasks_) {
+    if (task.record->type() != PERF_RECORD_SAMPLE) {
+      if (!record_file_writer_->WriteRecord(*task.record)) {
+        return false;
+      }
+      continue;
+    }
+    auto& r = *static_cast<SampleRecord*>(task.record.get());
+    if (task.need_unwinding) {
+      if (!task.unwinding_ok ||
+          !SaveUnwindingResult(r, task.unwinding_result, task.ips, task.sps)) {
+        return false;
+      }
+    } else if (!UnwindRecord(r)) {
+      return false;
+    }
+    if (!SaveSampleAfterUnwinding(r)) {
+      return false;
+    }
+  }
+  post_unwind_tasks_.clear();
+  post_unwind_tasks_size_ = 0;
+  post_unwind_pids_.clear();
+  post_unwind_prepared_maps_.clear();
+  return true;
+}
+
 bool RecordCommand::JoinCallChains() {
   // 1. Prepare joined callchains.
   if (!callchain_joiner_->JoinCallChains()) {
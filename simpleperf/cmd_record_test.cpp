@@ -24,6 +24,7 @@
 #include <map>
 #include <memory>
 #include <regex>
+#include <set>
 #include <thread>
 
 #include <android-base/file.h>
@@ -310,6 +311,64 @@ TEST(record_cmd, post_unwind_option) {
   ASSERT_TRUE(RunRecordCmd({"-p", pid, "--call-graph", "dwarf", "--post-unwind"}));
   ASSERT_TRUE(RunRecordCmd({"-p", pid, "--call-graph", "dwarf", "--post-unwind=yes"}));
   ASSERT_TRUE(RunRecordCmd({"-p", pid, "--call-graph", "dwarf", "--post-unwind=no"}));
+  ASSERT_TRUE(RunRecordCmd(
+      {"-p", pid, "--call-graph", "dwarf", "--post-unwind=yes", "--post-unwind-threads", "4"}));
+  ASSERT_FALSE(RunRecordCmd({"-p", pid, "--call-graph", "dwarf", "--post-unwind-threads", "0"}));
+}
+
+// Return callchains of samples in a recording file, excluding sampled ips.
+static std::set<std::vector<uint64_t>> GetCallersOfSamples(const std::string& path) {
+  std::set<std::vector<uint64_t>> result;
+  auto reader = RecordFileReader::CreateInstance(path);
+  if (!reader) {
+    return result;
+  }
+  for (const std::unique_ptr<Record>& record : reader->DataSection()) {
+    if (record->type() == PERF_RECORD_SAMPLE) {
+      auto& r = *static_cast<SampleRecord*>(record.get());
+      std::vector<uint64_t> ips;
+      for (size_t i = 1; i < r.callchain_data.ip_nr; i++) {
+        if (r.callchain_data.ips[i] < PERF_CONTEXT_MAX) {
+          ips.push_back(r.callchain_data.ips[i]);
+        }
+      }
+      result.emplace(std::move(ips));
+    }
+  }
+  return result;
+}
+
+// Spin in one function without syscalls, so all samples have the same callers.
+static void SpinForever() {
+  while (true) {
+    for (volatile int i = 0; i < 10000; ++i) {
+    }
+  }
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(record_cmd, post_unwind_threads_option) {
+  OMIT_TEST_ON_NON_NATIVE_ABIS();
+  ASSERT_TRUE(IsDwarfCallChainSamplingSupported());
+  auto workload = Workload::CreateWorkload(SpinForever);
+  ASSERT_TRUE(workload);
+  ASSERT_TRUE(workload->Start());
+  std::string pid = std::to_string(workload->GetPid());
+  std::vector<std::string> args = {"-p", pid, "-e", "cpu-clock:u", "--call-graph", "dwarf",
+                                   "--duration", "1", "--post-unwind=yes"};
+  TemporaryFile tmpfile1;
+  std::vector<std::string> args1 = args;
+  args1.insert(args1.end(), {"-o", tmpfile1.path});
+  ASSERT_TRUE(RecordCmd()->Run(args1));
+  TemporaryFile tmpfile2;
+  std::vector<std::string> args2 = args;
+  args2.insert(args2.end(), {"--post-unwind-threads", "4", "-o", tmpfile2.path});
+  ASSERT_TRUE(RecordCmd()->Run(args2));
+
+  // Unwinding in multiple threads should produce the same callchains as in one thread.
+  std::set<std::vector<uint64_t>> callers1 = GetCallersOfSamples(tmpfile1.path);
+  ASSERT_FALSE(callers1.empty());
+  ASSERT_EQ(callers1, GetCallersOfSamples(tmpfile2.path));
 }
 
 // @CddTest = 6.1/C-0-2
@@ -667,6 +726,7 @@ TEST(record_cmd, generate_samples_by_hw_counters) {
 TEST(record_cmd, callchain_joiner_options) {
   ASSERT_TRUE(RunRecordCmd({"--no-callchain-joiner"}));
   ASSERT_TRUE(RunRecordCmd({"--callchain-joiner-min-matching-nodes", "2"}));
+  ASSERT_TRUE(RunRecordCmd({"--callchain-joiner-memory", "1M"}));
 }
 
 // @CddTest = 6.1/C-0-2
@@ -1496,3 +1556,33 @@ TEST(record_cmd, compression_option) {
 
   ASSERT_TRUE(RunRecordCmd({"-z=3"}, tmpfile.path));
 }
+
+// @CddTest = 6.1/C-0-2
+TEST(record_cmd, live_report_option) {
+  CaptureStdout capture;
+  ASSERT_TRUE(capture.Start());
+  ASSERT_TRUE(RunRecordCmd({"--live-report", "100"}));
+  ASSERT_NE(capture.Finish().find("Live report at"), std::string::npos);
+  ASSERT_FALSE(RunRecordCmd({"--live-report", "0"}));
+  ASSERT_FALSE(RunRecordCmd({"--live-report", "100", "--stdio-controls-profiling"}));
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(record_cmd, flight_recorder_option) {
+  TemporaryFile tmpfile;
+  ASSERT_TRUE(RunRecordCmd({"--flight-recorder", "0.01", "--flight-recorder-size", "1M"},
+                           tmpfile.path));
+  std::unique_ptr<RecordFileReader> reader = RecordFileReader::CreateInstance(tmpfile.path);
+  ASSERT_TRUE(reader);
+  // Comm records older than the flight recorder window are still kept.
+  bool has_comm = false;
+  ASSERT_TRUE(reader->ReadDataSection([&](std::unique_ptr<Record> r) {
+    if (r->type() == PERF_RECORD_COMM) {
+      has_comm = true;
+    }
+    return true;
+  }));
+  ASSERT_TRUE(has_comm);
+  ASSERT_FALSE(RunRecordCmd({"--flight-recorder", "0"}));
+  ASSERT_FALSE(RunRecordCmd({"--flight-recorder", "1", "--size-limit", "1M"}));
+}
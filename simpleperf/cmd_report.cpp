@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -31,6 +32,7 @@
 #include <android-base/strings.h>
 
 #include "RecordFilter.h"
+#include "ThreadPool.h"
 #include "command.h"
 #include "event_attr.h"
 #include "event_type.h"
@@ -117,6 +119,7 @@ struct SampleTree {
 };
 
 BUILD_COMPARE_VALUE_FUNCTION(CompareVaddrInFile, vaddr_in_file);
+BUILD_HASH_VALUE_FUNCTION(HashVaddrInFile, vaddr_in_file);
 BUILD_DISPLAY_HEX64_FUNCTION(DisplayVaddrInFile, vaddr_in_file);
 
 static std::string DisplayEventName(const SampleEntry*, const SampleTree* info) {
@@ -171,6 +174,27 @@ class ReportCmdSampleTreeBuilder : public SampleTreeBuilder<SampleEntry, AccInfo
     return ProcessSampleRecord(r);
   }
 
+  // Add a sample built outside the builder, like by worker threads in a parallel report.
+  void AddSample(SampleEntry&& sample) { InsertSample(std::move(sample)); }
+
+  std::vector<uint64_t> GetCountsForSample(const SampleRecord& r) {
+    CHECK_EQ(r.read_data.counts.size(), r.read_data.ids.size());
+    std::vector<uint64_t> res(r.read_data.counts.size(), 0);
+    for (size_t i = 0; i < r.read_data.counts.size(); i++) {
+      uint64_t event_id = r.read_data.ids[i];
+      uint64_t count = r.read_data.counts[i];
+      uint64_t& last_count = event_id_count_map_[event_id];
+      uint64_t added_count = count - last_count;
+      last_count = count;
+      auto it = event_id_to_attr_index_.find(event_id);
+      CHECK(it != event_id_to_attr_index_.end());
+      CHECK_LT(it->second, res.size());
+      // Count for the current sample is the added event count after generating the previous sample.
+      res[it->second] = added_count;
+    }
+    return res;
+  }
+
  protected:
   virtual uint64_t GetPeriod(const SampleRecord& r) = 0;
 
@@ -183,9 +207,8 @@ class ReportCmdSampleTreeBuilder : public SampleTreeBuilder<SampleEntry, AccInfo
     acc_info->period = period;
     std::vector<uint64_t> counts = GetCountsForSample(r);
     acc_info->counts = counts;
-    std::unique_ptr<SampleEntry> sample(new SampleEntry(r.time_data.time, period, 0, 1, r.Cpu(),
-                                                        thread, map, symbol, vaddr_in_file, counts,
-                                                        counts));
+    SampleEntry sample(r.time_data.time, period, 0, 1, r.Cpu(), thread, map, symbol, vaddr_in_file,
+                       counts, counts);
     return InsertSample(std::move(sample));
   }
 
@@ -197,13 +220,12 @@ class ReportCmdSampleTreeBuilder : public SampleTreeBuilder<SampleEntry, AccInfo
     const MapEntry* to_map = thread_tree_->FindMap(thread, item.to);
     uint64_t to_vaddr_in_file;
     const Symbol* to_symbol = thread_tree_->FindSymbol(to_map, item.to, &to_vaddr_in_file);
-    std::unique_ptr<SampleEntry> sample(new SampleEntry(r.time_data.time, r.period_data.period, 0,
-                                                        1, r.Cpu(), thread, to_map, to_symbol,
-                                                        to_vaddr_in_file, {}, {}));
-    sample->branch_from.map = from_map;
-    sample->branch_from.symbol = from_symbol;
-    sample->branch_from.vaddr_in_file = from_vaddr_in_file;
-    sample->branch_from.flags = item.flags;
+    SampleEntry sample(r.time_data.time, r.period_data.period, 0, 1, r.Cpu(), thread, to_map,
+                       to_symbol, to_vaddr_in_file, {}, {});
+    sample.branch_from.map = from_map;
+    sample.branch_from.symbol = from_symbol;
+    sample.branch_from.vaddr_in_file = from_vaddr_in_file;
+    sample.branch_from.flags = item.flags;
     return InsertSample(std::move(sample));
   }
 
@@ -219,10 +241,9 @@ class ReportCmdSampleTreeBuilder : public SampleTreeBuilder<SampleEntry, AccInfo
     }
     uint64_t vaddr_in_file;
     const Symbol* symbol = thread_tree_->FindSymbol(map, ip, &vaddr_in_file);
-    std::unique_ptr<SampleEntry> callchain_sample(
-        new SampleEntry(sample->time, 0, acc_info.period, 0, sample->cpu, thread, map, symbol,
-                        vaddr_in_file, {}, acc_info.counts));
-    callchain_sample->thread_comm = sample->thread_comm;
+    SampleEntry callchain_sample(sample->time, 0, acc_info.period, 0, sample->cpu, thread, map,
+                                 symbol, vaddr_in_file, {}, acc_info.counts);
+    callchain_sample.thread_comm = sample->thread_comm;
     return InsertCallChainSample(std::move(callchain_sample), callchain);
   }
 
@@ -272,24 +293,6 @@ class ReportCmdSampleTreeBuilder : public SampleTreeBuilder<SampleEntry, AccInfo
   }
 
  private:
-  std::vector<uint64_t> GetCountsForSample(const SampleRecord& r) {
-    CHECK_EQ(r.read_data.counts.size(), r.read_data.ids.size());
-    std::vector<uint64_t> res(r.read_data.counts.size(), 0);
-    for (size_t i = 0; i < r.read_data.counts.size(); i++) {
-      uint64_t event_id = r.read_data.ids[i];
-      uint64_t count = r.read_data.counts[i];
-      uint64_t& last_count = event_id_count_map_[event_id];
-      uint64_t added_count = count - last_count;
-      last_count = count;
-      auto it = event_id_to_attr_index_.find(event_id);
-      CHECK(it != event_id_to_attr_index_.end());
-      CHECK_LT(it->second, res.size());
-      // Count for the current sample is the added event count after generating the previous sample.
-      res[it->second] = added_count;
-    }
-    return res;
-  }
-
   ThreadTree* thread_tree_;
   const std::unordered_map<uint64_t, size_t>& event_id_to_attr_index_;
 
@@ -396,6 +399,35 @@ class ReportCmdCallgraphDisplayerWithVaddrInFile : public ReportCmdCallgraphDisp
   }
 };
 
+// A sample read in the main thread of a parallel report. It keeps what is needed to build a
+// SampleEntry, so worker threads don't need to access the thread tree, which keeps changing.
+struct PendingSample {
+  size_t attr_id;
+  uint64_t time;
+  uint64_t period;
+  int cpu;
+  pid_t pid;
+  pid_t tid;
+  const char* thread_comm;
+  const MapEntry* map;
+  uint64_t ip;
+  // Only used for branch samples.
+  const MapEntry* from_map;
+  uint64_t from_ip;
+  uint64_t branch_flags;
+  std::vector<uint64_t> counts;
+};
+
+// Data owned by a worker thread of a parallel report.
+struct ReportWorker {
+  // One builder for each event attr.
+  std::vector<std::unique_ptr<ReportCmdSampleTreeBuilder>> builders;
+  // Map from (map, ip) to (symbol, vaddr_in_file). It avoids taking the lock to find symbols.
+  std::unordered_map<const MapEntry*,
+                     std::unordered_map<uint64_t, std::pair<const Symbol*, uint64_t>>>
+      symbol_cache;
+};
+
 class ReportCommand : public Command {
  public:
   ReportCommand()
@@ -419,6 +451,9 @@ class ReportCommand : public Command {
 "                      the graph shows how functions call others.\n"
 "                      Default is caller mode.\n"
 "-i <file>  Specify path of record file, default is perf.data.\n"
+"-j <threads>          Use multiple threads to load symbols, find symbols and aggregate samples.\n"
+"                      Default is 1. Samples with callchains (-g, --children), or recorded\n"
+"                      with --trace-offcpu, are always aggregated in one thread.\n"
 "--kallsyms <file>     Set the file to read kernel symbols.\n"
 "--max-stack <frames>  Set max stack frames shown when printing call graph.\n"
 "-n         Print the sample count for each item.\n"
@@ -448,6 +483,10 @@ class ReportCommand : public Command {
 "                        symbol_to       -- name of function branched to\n"
 "                      The default sort keys are:\n"
 "                        comm,pid,tid,dso,symbol\n"
+"--symbol-cache-dir <dir>  Cache symbol tables of binaries with build ids in <dir>. Later\n"
+"                          reports using the same binaries read symbols from the cache.\n"
+"--symbol-cache-size <MB>  Limit the total size of files in the symbol cache dir.\n"
+"                          Least recently used files are removed. Default is 512.\n"
 "--symfs <dir>         Look for files with symbols relative to this directory.\n"
 "--symdir <dir>        Look for files with symbols in a directory recursively.\n"
 "--vmlinux <file>      Parse kernel symbols from <file>.\n"
@@ -484,8 +523,13 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_REPORTING
   bool ReadEventAttrFromRecordFile();
   bool ReadFeaturesFromRecordFile();
   bool ReadSampleTreeFromRecordFile();
-  bool ProcessRecord(std::unique_ptr<Record> record);
-  void ProcessSampleRecordInTraceOffCpuMode(std::unique_ptr<Record> record, size_t attr_id);
+  bool ProcessRecord(Record& record);
+  void ProcessSampleRecordInTraceOffCpuMode(const SampleRecord& record, size_t attr_id);
+  void AddPendingSamples(const SampleRecord& record, size_t attr_id);
+  void FlushPendingSamples();
+  void BuildPendingSamples(const std::vector<PendingSample>& samples, ReportWorker& worker);
+  const Symbol* FindSymbolInWorker(ReportWorker& worker, const MapEntry* map, uint64_t ip,
+                                   uint64_t* vaddr_in_file);
   bool ProcessTracingData(const std::vector<char>& data);
   bool PrintReport();
   void PrintReportContext(FILE* fp);
@@ -521,6 +565,14 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_REPORTING
   std::vector<std::string> sort_keys_;
   std::string report_filename_;
   RecordFilter record_filter_;
+  size_t num_threads_ = 1;
+
+  // Used when building sample trees in worker threads.
+  std::unique_ptr<ThreadPool> thread_pool_;
+  std::vector<ReportWorker> workers_;
+  std::vector<PendingSample> pending_samples_;
+  // Protect the thread tree and dsos used by both the main thread and worker threads.
+  std::mutex symbol_mutex_;
 };
 
 bool ReportCommand::Run(const std::vector<std::string>& args) {
@@ -548,6 +600,9 @@ bool ReportCommand::Run(const std::vector<std::string>& args) {
     return false;
   }
   ScopedCurrentArch scoped_arch(record_file_arch_);
+  // Load symbols of binaries in the file feature section in parallel, instead of loading them
+  // one by one when processing samples.
+  thread_tree_.PrefetchSymbols(num_threads_);
   if (!ReadSampleTreeFromRecordFile()) {
     return false;
   }
@@ -572,6 +627,7 @@ bool ReportCommand::ParseOptions(const std::vector<std::string>& args) {
       {"--full-callgraph", {OptionValueType::NONE, OptionType::SINGLE}},
       {"-g", {OptionValueType::OPT_STRING, OptionType::SINGLE}},
       {"-i", {OptionValueType::STRING, OptionType::SINGLE}},
+      {"-j", {OptionValueType::UINT, OptionType::SINGLE}},
       {"--kallsyms", {OptionValueType::STRING, OptionType::SINGLE}},
       {"--max-stack", {OptionValueType::UINT, OptionType::SINGLE}},
       {"-n", {OptionValueType::NONE, OptionType::SINGLE}},
@@ -584,6 +640,8 @@ bool ReportCommand::ParseOptions(const std::vector<std::string>& args) {
       {"--tids", {OptionValueType::STRING, OptionType::MULTIPLE}},
       {"--raw-period", {OptionValueType::NONE, OptionType::SINGLE}},
       {"--sort", {OptionValueType::STRING, OptionType::SINGLE}},
+      {"--symbol-cache-dir", {OptionValueType::STRING, OptionType::SINGLE}},
+      {"--symbol-cache-size", {OptionValueType::UINT, OptionType::SINGLE}},
       {"--symbols", {OptionValueType::STRING, OptionType::MULTIPLE}},
       {"--symfs", {OptionValueType::STRING, OptionType::SINGLE}},
       {"--symdir", {OptionValueType::STRING, OptionType::SINGLE}},
@@ -638,6 +696,9 @@ bool ReportCommand::ParseOptions(const std::vector<std::string>& args) {
     }
   }
   options.PullStringValue("-i", &record_filename_);
+  if (!options.PullUintValue("-j", &num_threads_, 1)) {
+    return false;
+  }
   if (auto value = options.PullValue("--kallsyms"); value) {
     std::string kallsyms;
     if (!android::base::ReadFileToString(value->str_value, &kallsyms)) {
@@ -684,6 +745,16 @@ bool ReportCommand::ParseOptions(const std::vector<std::string>& args) {
     sort_keys_ = Split(value->str_value, ",");
   }
 
+  if (auto value = options.PullValue("--symbol-cache-dir"); value) {
+    uint64_t size_in_mb = 512;
+    if (!options.PullUintValue("--symbol-cache-size", &size_in_mb)) {
+      return false;
+    }
+    Dso::SetSymbolCache(value->str_value, size_in_mb * kMegabyte);
+  } else if (options.PullValue("--symbol-cache-size")) {
+    LOG(ERROR) << "--symbol-cache-size should be used with --symbol-cache-dir";
+    return false;
+  }
   for (const OptionValue& value : options.PullValues("--symbols")) {
     std::vector<std::string> symbols = Split(value.str_value, ";");
     sample_tree_builder_options_.symbol_filter.insert(symbols.begin(), symbols.end());
@@ -763,34 +834,34 @@ bool ReportCommand::BuildSampleComparatorAndDisplayer() {
       return false;
     }
     if (key == "pid") {
-      comparator.AddCompareFunction(ComparePid);
+      comparator.AddCompareFunction(ComparePid, HashPid);
       displayer.AddDisplayFunction("Pid", DisplayPid<SampleEntry>);
     } else if (key == "tid") {
-      comparator.AddCompareFunction(CompareTid);
+      comparator.AddCompareFunction(CompareTid, HashTid);
       displayer.AddDisplayFunction("Tid", DisplayTid<SampleEntry>);
     } else if (key == "comm") {
-      comparator.AddCompareFunction(CompareComm);
+      comparator.AddCompareFunction(CompareComm, HashComm);
       displayer.AddDisplayFunction("Command", DisplayComm<SampleEntry>);
     } else if (key == "dso") {
-      comparator.AddCompareFunction(CompareDso);
+      comparator.AddCompareFunction(CompareDso, HashDso);
       displayer.AddDisplayFunction("Shared Object", DisplayDso<SampleEntry>);
     } else if (key == "symbol") {
-      comparator.AddCompareFunction(CompareSymbol);
+      comparator.AddCompareFunction(CompareSymbol, HashSymbol);
       displayer.AddDisplayFunction("Symbol", DisplaySymbol<SampleEntry>);
     } else if (key == "vaddr_in_file") {
-      comparator.AddCompareFunction(CompareVaddrInFile);
+      comparator.AddCompareFunction(CompareVaddrInFile, HashVaddrInFile);
       displayer.AddDisplayFunction("VaddrInFile", DisplayVaddrInFile<SampleEntry>);
     } else if (key == "dso_from") {
-      comparator.AddCompareFunction(CompareDsoFrom);
+      comparator.AddCompareFunction(CompareDsoFrom, HashDsoFrom);
       displayer.AddDisplayFunction("Source Shared Object", DisplayDsoFrom<SampleEntry>);
     } else if (key == "dso_to") {
-      comparator.AddCompareFunction(CompareDso);
+      comparator.AddCompareFunction(CompareDso, HashDso);
       displayer.AddDisplayFunction("Target Shared Object", DisplayDso<SampleEntry>);
     } else if (key == "symbol_from") {
-      comparator.AddCompareFunction(CompareSymbolFrom);
+      comparator.AddCompareFunction(CompareSymbolFrom, HashSymbolFrom);
       displayer.AddDisplayFunction("Source Symbol", DisplaySymbolFrom<SampleEntry>);
     } else if (key == "symbol_to") {
-      comparator.AddCompareFunction(CompareSymbol);
+      comparator.AddCompareFunction(CompareSymbol, HashSymbol);
       displayer.AddDisplayFunction("Target Symbol", DisplaySymbol<SampleEntry>);
     } else {
       LOG(ERROR) << "Unknown sort key: " << key;
@@ -857,7 +928,13 @@ bool ReportCommand::ReadMetaInfoFromRecordFile() {
   if (auto it = meta_info.find("trace_offcpu"); it != meta_info.end()) {
     trace_offcpu_ = it->second == "true";
   }
-  return record_filter_.CheckClock(record_file_reader_->GetClockId());
+  if (!record_filter_.CheckClock(record_file_reader_->GetClockId())) {
+    return false;
+  }
+  if (auto time_range = record_filter_.GetTimeRange(); time_range) {
+    record_file_reader_->SetTimeRange(time_range->first, time_range->second);
+  }
+  return true;
 }
 
 bool ReportCommand::ReadEventAttrFromRecordFile() {
@@ -945,10 +1022,33 @@ bool ReportCommand::ReadSampleTreeFromRecordFile() {
     }
   }
 
-  if (!record_file_reader_->ReadDataSection(
-          [this](std::unique_ptr<Record> record) { return ProcessRecord(std::move(record)); })) {
+  if (num_threads_ > 1 && !accumulate_callchain_ && !trace_offcpu_) {
+    // Callchains and off-cpu time depend on previous samples, so they can't be split into tasks.
+    thread_pool_.reset(new ThreadPool(num_threads_, num_threads_ * 2));
+    workers_.resize(num_threads_);
+    for (ReportWorker& worker : workers_) {
+      for (size_t i = 0; i < event_attrs_.size(); ++i) {
+        worker.builders.push_back(
+            sample_tree_builder_options_.CreateSampleTreeBuilder(*record_file_reader_));
+      }
+    }
+  }
+
+  if (!record_file_reader_->ReadDataSectionInPlace(
+          [this](Record* record) { return ProcessRecord(*record); })) {
     return false;
   }
+  if (thread_pool_) {
+    FlushPendingSamples();
+    thread_pool_->Wait();
+    for (ReportWorker& worker : workers_) {
+      for (size_t i = 0; i < sample_tree_builder_.size(); ++i) {
+        sample_tree_builder_[i]->MergeSamplesFrom(*worker.builders[i]);
+      }
+    }
+    thread_pool_.reset();
+    workers_.clear();
+  }
   for (size_t i = 0; i < sample_tree_builder_.size(); ++i) {
     sample_tree_.push_back(sample_tree_builder_[i]->GetSampleTree());
     sample_tree_sorter_->Sort(sample_tree_.back().samples, print_callgraph_);
@@ -956,22 +1056,30 @@ bool ReportCommand::ReadSampleTreeFromRecordFile() {
   return true;
 }
 
-bool ReportCommand::ProcessRecord(std::unique_ptr<Record> record) {
-  thread_tree_.Update(*record);
-  if (record->type() == PERF_RECORD_SAMPLE) {
-    if (!record_filter_.Check(static_cast<SampleRecord&>(*record))) {
+bool ReportCommand::ProcessRecord(Record& record) {
+  if (thread_pool_ && record.type() != PERF_RECORD_SAMPLE) {
+    // Updating the thread tree may change dsos used by worker threads.
+    std::lock_guard<std::mutex> lock(symbol_mutex_);
+    thread_tree_.Update(record);
+  } else {
+    thread_tree_.Update(record);
+  }
+  if (record.type() == PERF_RECORD_SAMPLE) {
+    auto& r = static_cast<SampleRecord&>(record);
+    if (!record_filter_.Check(r)) {
       return true;
     }
-    size_t attr_id = record_file_reader_->GetAttrIndexOfRecord(record.get());
-    if (!trace_offcpu_) {
-      sample_tree_builder_[attr_id]->ReportCmdProcessSampleRecord(
-          *static_cast<SampleRecord*>(record.get()));
+    size_t attr_id = record_file_reader_->GetAttrIndexOfRecord(&record);
+    if (thread_pool_) {
+      AddPendingSamples(r, attr_id);
+    } else if (!trace_offcpu_) {
+      sample_tree_builder_[attr_id]->ReportCmdProcessSampleRecord(r);
     } else {
-      ProcessSampleRecordInTraceOffCpuMode(std::move(record), attr_id);
+      ProcessSampleRecordInTraceOffCpuMode(r, attr_id);
     }
-  } else if (record->type() == PERF_RECORD_TRACING_DATA ||
-             record->type() == SIMPLE_PERF_RECORD_TRACING_DATA) {
-    const auto& r = *static_cast<TracingDataRecord*>(record.get());
+  } else if (record.type() == PERF_RECORD_TRACING_DATA ||
+             record.type() == SIMPLE_PERF_RECORD_TRACING_DATA) {
+    const auto& r = static_cast<TracingDataRecord&>(record);
     if (!ProcessTracingData(std::vector<char>(r.data, r.data + r.data_size))) {
       return false;
     }
@@ -979,9 +1087,12 @@ bool ReportCommand::ProcessRecord(std::unique_ptr<Record> record) {
   return true;
 }
 
-void ReportCommand::ProcessSampleRecordInTraceOffCpuMode(std::unique_ptr<Record> record,
+void ReportCommand::ProcessSampleRecordInTraceOffCpuMode(const SampleRecord& record,
                                                          size_t attr_id) {
-  std::shared_ptr<SampleRecord> r(static_cast<SampleRecord*>(record.release()));
+  // The record is only valid during the callback of ReadDataSectionInPlace(). But it is kept
+  // until the next sample of the same thread. So make a copy.
+  const perf_event_attr& attr = record_file_reader_->AttrSection()[attr_id].attr;
+  std::shared_ptr<SampleRecord> r(static_cast<SampleRecord*>(CopyRecord(attr, record).release()));
   if (attr_id == sched_switch_attr_id_) {
     // If this sample belongs to sched_switch event, we should broadcast the offcpu info
     // to other event types.
@@ -996,6 +1107,94 @@ void ReportCommand::ProcessSampleRecordInTraceOffCpuMode(std::unique_ptr<Record>
   }
 }
 
+void ReportCommand::AddPendingSamples(const SampleRecord& record, size_t attr_id) {
+  // Number of samples processed in each task of the thread pool.
+  static constexpr size_t kSamplesPerTask = 4096;
+
+  const ThreadEntry* thread =
+      thread_tree_.FindThreadOrNew(record.tid_data.pid, record.tid_data.tid);
+  PendingSample sample;
+  sample.attr_id = attr_id;
+  sample.time = record.time_data.time;
+  sample.period = record.period_data.period;
+  sample.cpu = record.Cpu();
+  sample.pid = thread->pid;
+  sample.tid = thread->tid;
+  sample.thread_comm = thread->comm;
+  // Maps are found in the main thread, because they are changed by following records.
+  if (use_branch_address_ && (record.sample_type & PERF_SAMPLE_BRANCH_STACK)) {
+    for (uint64_t i = 0; i < record.branch_stack_data.stack_nr; ++i) {
+      auto& item = record.branch_stack_data.stack[i];
+      if (item.from != 0 && item.to != 0) {
+        sample.map = thread_tree_.FindMap(thread, item.to);
+        sample.ip = item.to;
+        sample.from_map = thread_tree_.FindMap(thread, item.from);
+        sample.from_ip = item.from;
+        sample.branch_flags = item.flags;
+        pending_samples_.push_back(sample);
+      }
+    }
+  } else {
+    sample.map = thread_tree_.FindMap(thread, record.ip_data.ip, record.InKernel());
+    sample.ip = record.ip_data.ip;
+    sample.from_map = nullptr;
+    sample.from_ip = 0;
+    sample.branch_flags = 0;
+    sample.counts = sample_tree_builder_[attr_id]->GetCountsForSample(record);
+    pending_samples_.push_back(std::move(sample));
+  }
+  if (pending_samples_.size() >= kSamplesPerTask) {
+    FlushPendingSamples();
+  }
+}
+
+void ReportCommand::FlushPendingSamples() {
+  if (pending_samples_.empty()) {
+    return;
+  }
+  auto samples = std::make_shared<std::vector<PendingSample>>(std::move(pending_samples_));
+  pending_samples_.clear();
+  thread_pool_->AddTask([this, samples](size_t thread_index) {
+    BuildPendingSamples(*samples, workers_[thread_index]);
+  });
+}
+
+void ReportCommand::BuildPendingSamples(const std::vector<PendingSample>& samples,
+                                        ReportWorker& worker) {
+  for (const PendingSample& s : samples) {
+    ThreadEntry thread = {s.pid, s.tid, s.thread_comm, nullptr};
+    uint64_t vaddr_in_file;
+    const Symbol* symbol = FindSymbolInWorker(worker, s.map, s.ip, &vaddr_in_file);
+    SampleEntry sample(s.time, s.period, 0, 1, s.cpu, &thread, s.map, symbol, vaddr_in_file,
+                       s.counts, s.counts);
+    if (s.from_map != nullptr) {
+      sample.branch_from.map = s.from_map;
+      sample.branch_from.symbol =
+          FindSymbolInWorker(worker, s.from_map, s.from_ip, &sample.branch_from.vaddr_in_file);
+      sample.branch_from.flags = s.branch_flags;
+    }
+    worker.builders[s.attr_id]->AddSample(std::move(sample));
+  }
+}
+
+const Symbol* ReportCommand::FindSymbolInWorker(ReportWorker& worker, const MapEntry* map,
+                                                uint64_t ip, uint64_t* vaddr_in_file) {
+  auto& cache = worker.symbol_cache[map];
+  if (auto it = cache.find(ip); it != cache.end()) {
+    *vaddr_in_file = it->second.second;
+    return it->second.first;
+  }
+  const Symbol* symbol;
+  {
+    std::lock_guard<std::mutex> lock(symbol_mutex_);
+    symbol = thread_tree_.FindSymbol(map, ip, vaddr_in_file);
+    // Demangle with the lock held. Then the worker can compare symbol names without the lock.
+    symbol->DemangledName();
+  }
+  cache.emplace(ip, std::make_pair(symbol, *vaddr_in_file));
+  return symbol;
+}
+
 bool ReportCommand::ProcessTracingData(const std::vector<char>& data) {
   auto tracing = Tracing::Create(data);
   if (!tracing) {
@@ -204,7 +204,7 @@ RECORD_FILTER_OPTION_HELP_MSG_FOR_REPORTING
   bool DumpProtobufReport(const std::string& filename);
   bool OpenRecordFile();
   bool PrintMetaInfo();
-  bool ProcessRecord(std::unique_ptr<Record> record);
+  bool ProcessRecord(Record& record);
   void UpdateThreadName(uint32_t pid, uint32_t tid);
   bool ProcessSampleRecord(const SampleRecord& r);
   bool ProcessSample(const ThreadEntry& thread, SampleEntry& sample);
@@ -298,8 +298,8 @@ bool ReportSampleCommand::Run(const std::vector<std::string>& args) {
   if (!PrintMetaInfo()) {
     return false;
   }
-  if (!record_file_reader_->ReadDataSection(
-          [this](std::unique_ptr<Record> record) { return ProcessRecord(std::move(record)); })) {
+  if (!record_file_reader_->ReadDataSectionInPlace(
+          [this](Record* record) { return ProcessRecord(*record); })) {
     return false;
   }
 
@@ -582,6 +582,9 @@ bool ReportSampleCommand::OpenRecordFile() {
   if (!record_filter_.CheckClock(record_file_reader_->GetClockId())) {
     return false;
   }
+  if (auto time_range = record_filter_.GetTimeRange(); time_range) {
+    record_file_reader_->SetTimeRange(time_range->first, time_range->second);
+  }
   for (const EventAttrWithId& attr : record_file_reader_->AttrSection()) {
     event_types_.push_back(GetEventNameByAttr(attr.attr));
   }
@@ -644,27 +647,31 @@ bool ReportSampleCommand::PrintMetaInfo() {
   return true;
 }
 
-bool ReportSampleCommand::ProcessRecord(std::unique_ptr<Record> record) {
-  thread_tree_.Update(*record);
+bool ReportSampleCommand::ProcessRecord(Record& record) {
+  thread_tree_.Update(record);
   bool result = true;
-  switch (record->type()) {
+  switch (record.type()) {
     case PERF_RECORD_SAMPLE: {
-      result = ProcessSampleRecord(*static_cast<SampleRecord*>(record.get()));
+      result = ProcessSampleRecord(static_cast<SampleRecord&>(record));
       last_unwinding_result_.reset();
       break;
     }
     case SIMPLE_PERF_RECORD_UNWINDING_RESULT: {
-      last_unwinding_result_.reset(static_cast<UnwindingResultRecord*>(record.release()));
+      // The record is only valid during the callback, so keep a copy for the next sample.
+      size_t attr_index = record_file_reader_->GetAttrIndexOfRecord(&record);
+      const perf_event_attr& attr = record_file_reader_->AttrSection()[attr_index].attr;
+      last_unwinding_result_.reset(
+          static_cast<UnwindingResultRecord*>(CopyRecord(attr, record).release()));
       break;
     }
     case PERF_RECORD_LOST: {
-      lost_count_ += static_cast<const LostRecord*>(record.get())->lost;
+      lost_count_ += static_cast<const LostRecord&>(record).lost;
       break;
     }
     case PERF_RECORD_SWITCH:
       [[fallthrough]];
     case PERF_RECORD_SWITCH_CPU_WIDE: {
-      result = ProcessSwitchRecord(record.get());
+      result = ProcessSwitchRecord(&record);
       break;
     }
   }
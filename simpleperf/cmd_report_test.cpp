@@ -349,6 +349,28 @@ TEST_F(ReportCommandTest, use_branch_address) {
             hit_set.end());
 }
 
+// @CddTest = 6.1/C-0-2
+TEST_F(ReportCommandTest, multiple_threads) {
+  auto check = [&](const std::string& record_file, const std::vector<std::string>& args) {
+    Report(record_file, args);
+    ASSERT_TRUE(success);
+    std::string serial_content = content;
+    std::vector<std::string> parallel_args = args;
+    parallel_args.insert(parallel_args.end(), {"-j", "4"});
+    Report(record_file, parallel_args);
+    ASSERT_TRUE(success);
+    ASSERT_EQ(content, serial_content);
+  };
+  check(PERF_DATA, {});
+  check(PERF_DATA, {"--sort", "dso,vaddr_in_file", "-n"});
+  check(PERF_DATA_WITH_SYMBOLS, {"--symbols", "GlobalFunc", "--percent-limit", "1"});
+  check(BRANCH_PERF_DATA, {"-b", "--sort", "symbol_from,symbol_to"});
+  check("perf_with_add_counter.data", {"--print-event-count"});
+  check(PERF_DATA_WITH_KERNEL_SYMBOLS_AVAILABLE_TRUE, {"--raw-period"});
+  // Reports with callchains are built in one thread.
+  check(CALLGRAPH_FP_PERF_DATA, {"-g", "--children"});
+}
+
 // @CddTest = 6.1/C-0-2
 TEST_F(ReportCommandTest, report_symbols_of_nativelib_in_apk) {
   Report(NATIVELIB_IN_APK_PERF_DATA);
@@ -33,6 +33,7 @@
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 
+#include "CounterFile.h"
 #include "IOEventLoop.h"
 #include "ProbeEvents.h"
 #include "cmd_stat_impl.h"
@@ -363,6 +364,9 @@ class StatCommand : public Command {
 "                      On non-rooted devices, the app must be debuggable,\n"
 "                      because we use run-as to switch to the app's context.\n"
 #endif
+"--binary-output <file>  Write counters to file in a compact binary format instead of printing\n"
+"                        them. With --interval, it stores counter deltas of each thread and\n"
+"                        cpu in each interval. It can be read by simpleperf_report_lib.py.\n"
 "--cpu cpu_item1,cpu_item2,...  Monitor events on selected cpus. cpu_item can be a number like\n"
 "                               1, or a range like 0-3. A --cpu option affects all event types\n"
 "                               following it until meeting another --cpu option.\n"
@@ -375,6 +379,10 @@ class StatCommand : public Command {
 "                        number. Simpleperf prints total values from the\n"
 "                        starting point. But this can be changed by\n"
 "                        --interval-only-values.\n"
+"                        Events in a group (added by --group) are read with\n"
+"                        one read call per thread and cpu, which reduces the\n"
+"                        overhead in each interval. Other events are read\n"
+"                        one by one. The read time is shown with --verbose.\n"
 "--interval-only-values  Print numbers of events happened in each interval.\n"
 "-e event1[:modifier1],event2[:modifier2],...\n"
 "                 Select a list of events to count. An event can be:\n"
@@ -388,7 +396,7 @@ class StatCommand : public Command {
 "--group event1[:modifier],event2[:modifier2],...\n"
 "             Similar to -e option. But events specified in the same --group\n"
 "             option are monitored as a group, and scheduled in and out at the\n"
-"             same time.\n"
+"             same time. Counters in a group are read with one syscall.\n"
 "--kprobe kprobe_event1,kprobe_event2,...\n"
 "             Add kprobe events during stating. The kprobe_event format is in\n"
 "             Documentation/trace/kprobetrace.rst in the kernel. Examples:\n"
@@ -462,6 +470,8 @@ class StatCommand : public Command {
   void MonitorEachThread();
   void AdjustToIntervalOnlyValues(std::vector<CountersInfo>& counters);
   bool ShowCounters(const std::vector<CountersInfo>& counters, double duration_in_sec, FILE* fp);
+  bool WriteCountersToBinaryOutput(const std::vector<CountersInfo>& counters,
+                                   uint64_t time_in_ns);
   void CheckHardwareCounterMultiplexing();
   void PrintWarningForInaccurateEvents();
 
@@ -471,6 +481,11 @@ class StatCommand : public Command {
   double duration_in_sec_;
   double interval_in_ms_;
   bool interval_only_values_;
+  // Time used by the last ReadCounters(), reported in interval mode.
+  double counter_read_time_in_sec_ = 0;
+  std::string binary_output_filename_;
+  std::unique_ptr<CounterFileWriter> binary_output_writer_;
+  std::vector<CounterFileEntry> binary_output_entries_;
   std::vector<std::vector<CounterSum>> last_sum_values_;
   EventSelectionSet event_selection_set_;
   std::string output_filename_;
@@ -579,6 +594,14 @@ bool StatCommand::Run(const std::vector<std::string>& args) {
     }
   }
   FILE* fp = fp_holder ? fp_holder.get() : stdout;
+  if (!binary_output_filename_.empty()) {
+    binary_output_writer_ = CounterFileWriter::Create(binary_output_filename_);
+    // Write the header before counting, so the file is valid even if no counters are read.
+    if (!binary_output_writer_ ||
+        !binary_output_writer_->WriteHeader(event_selection_set_.GetEventNamesWithModifiers())) {
+      return false;
+    }
+  }
 
   // 4. Add signal/periodic Events.
   IOEventLoop* loop = event_selection_set_.GetIOEventLoop();
@@ -606,6 +629,14 @@ bool StatCommand::Run(const std::vector<std::string>& args) {
     if (!event_selection_set_.ReadCounters(&counters)) {
       return false;
     }
+    counter_read_time_in_sec_ = std::chrono::duration_cast<std::chrono::duration<double>>(
+                                    std::chrono::steady_clock::now() - end_time)
+                                    .count();
+    if (binary_output_writer_) {
+      uint64_t time_in_ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+      return WriteCountersToBinaryOutput(counters, time_in_ns);
+    }
     double duration_in_sec =
         std::chrono::duration_cast<std::chrono::duration<double>>(end_time - start_time).count();
     if (interval_only_values_) {
@@ -639,6 +670,10 @@ bool StatCommand::Run(const std::vector<std::string>& args) {
     }
   }
 
+  if (binary_output_writer_ && !binary_output_writer_->Close()) {
+    return false;
+  }
+
   // 7. Print warnings when needed.
   event_selection_set_.CloseEventFiles();
   CheckHardwareCounterMultiplexing();
@@ -664,6 +699,9 @@ bool StatCommand::ParseOptions(const std::vector<std::string>& args,
   if (auto value = options.PullValue("--app"); value) {
     app_package_name_ = value->str_value;
   }
+  if (auto value = options.PullValue("--binary-output"); value) {
+    binary_output_filename_ = value->str_value;
+  }
   csv_ = options.PullBoolValue("--csv");
 
   if (!options.PullDoubleValue("--duration", &duration_in_sec_, 1e-9)) {
@@ -970,9 +1008,34 @@ bool StatCommand::ShowCounters(const std::vector<CountersInfo>& counters, double
   } else {
     fprintf(fp, "\nTotal test time: %lf seconds.\n", duration_in_sec);
   }
+  if (interval_in_ms_ != 0 && verbose_mode_) {
+    // Report the overhead of reading counters, which is spent in each interval.
+    size_t read_calls = event_selection_set_.GetReadCounterCalls();
+    if (csv_) {
+      fprintf(fp, "Counter read time,%lf,ms,read calls,%zu,\n", counter_read_time_in_sec_ * 1e3,
+              read_calls);
+    } else {
+      fprintf(fp, "Counter read time: %lf ms in %zu read calls.\n",
+              counter_read_time_in_sec_ * 1e3, read_calls);
+    }
+  }
   return true;
 }
 
+bool StatCommand::WriteCountersToBinaryOutput(const std::vector<CountersInfo>& counters,
+                                              uint64_t time_in_ns) {
+  binary_output_entries_.clear();
+  for (size_t i = 0; i < counters.size(); i++) {
+    for (const CounterInfo& counter_info : counters[i].counters) {
+      const PerfCounter& counter = counter_info.counter;
+      binary_output_entries_.emplace_back(CounterFileEntry{
+          static_cast<uint32_t>(i), counter_info.tid, counter_info.cpu, 0, counter.value,
+          counter.time_enabled, counter.time_running});
+    }
+  }
+  return binary_output_writer_->WriteInterval(time_in_ns, binary_output_entries_);
+}
+
 void StatCommand::CheckHardwareCounterMultiplexing() {
   for (const auto& [cpu, hardware_events] : event_selection_set_.GetHardwareCountersForCpus()) {
     std::optional<bool> result = CheckHardwareCountersOnCpu(cpu, hardware_events);
@@ -22,6 +22,7 @@
 
 #include <thread>
 
+#include "CounterFile.h"
 #include "ProbeEvents.h"
 #include "cmd_stat_impl.h"
 #include "command.h"
@@ -203,6 +204,65 @@ TEST(stat_cmd, interval_option) {
   ASSERT_EQ(count, 2UL);
 }
 
+// @CddTest = 6.1/C-0-2
+TEST(stat_cmd, read_group_counters_in_interval_mode) {
+  TemporaryFile tmp_file;
+  ASSERT_TRUE(StatCmd()->Run({"--group", "cpu-clock,page-faults", "--interval", "500.0",
+                              "--duration", "1.2", "--verbose", "-o", tmp_file.path, "sleep",
+                              "2"}));
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFileToString(tmp_file.path, &s));
+  // The two counters in the group are read with one read() call.
+  ASSERT_NE(s.find("Counter read time: "), s.npos);
+  ASSERT_NE(s.find(" in 1 read calls."), s.npos);
+
+  // The read time is only shown with --verbose.
+  ASSERT_TRUE(StatCmd()->Run({"--group", "cpu-clock,page-faults", "--interval", "500.0",
+                              "--duration", "0.6", "-o", tmp_file.path, "sleep", "2"}));
+  ASSERT_TRUE(android::base::ReadFileToString(tmp_file.path, &s));
+  ASSERT_EQ(s.find("Counter read time"), s.npos);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(stat_cmd, binary_output_option) {
+  TemporaryFile tmp_file;
+  ASSERT_TRUE(StatCmd()->Run({"-e", "cpu-clock,task-clock", "--interval", "100", "--duration",
+                              "0.55", "--binary-output", tmp_file.path, "sleep", "1"}));
+  std::unique_ptr<CounterFileReader> reader = CounterFileReader::Open(tmp_file.path);
+  ASSERT_TRUE(reader);
+  ASSERT_EQ(reader->EventNames(), std::vector<std::string>({"cpu-clock", "task-clock"}));
+  CounterInterval interval;
+  bool eof;
+  size_t interval_count = 0;
+  uint64_t prev_time = 0;
+  while (true) {
+    ASSERT_TRUE(reader->ReadInterval(&interval, &eof));
+    if (eof) {
+      break;
+    }
+    interval_count++;
+    ASSERT_GT(interval.time_in_ns, prev_time);
+    prev_time = interval.time_in_ns;
+    ASSERT_FALSE(interval.counters.empty());
+  }
+  ASSERT_GE(interval_count, 4);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(stat_cmd, binary_output_option_without_intervals) {
+  // The workload ends before the first interval. The file still has a header.
+  TemporaryFile tmp_file;
+  ASSERT_TRUE(StatCmd()->Run({"-e", "cpu-clock", "--interval", "10000", "--binary-output",
+                              tmp_file.path, "sleep", "0.1"}));
+  std::unique_ptr<CounterFileReader> reader = CounterFileReader::Open(tmp_file.path);
+  ASSERT_TRUE(reader);
+  ASSERT_EQ(reader->EventNames(), std::vector<std::string>({"cpu-clock"}));
+  CounterInterval interval;
+  bool eof;
+  ASSERT_TRUE(reader->ReadInterval(&interval, &eof));
+  ASSERT_TRUE(eof);
+}
+
 // @CddTest = 6.1/C-0-2
 TEST(stat_cmd, interval_option_in_system_wide) {
   TEST_IN_ROOT(ASSERT_TRUE(StatCmd()->Run({"-a", "--interval", "100", "--duration", "0.3"})));
@@ -36,6 +36,7 @@
 #include "read_apk.h"
 #include "read_dex_file.h"
 #include "read_elf.h"
+#include "symbol_cache.h"
 #include "utils.h"
 
 namespace simpleperf {
@@ -262,14 +263,24 @@ std::optional<std::string> DebugElfFileFinder::SearchFileMapByPath(const std::st
 }  // namespace simpleperf_dso_impl
 
 static OneTimeFreeAllocator symbol_name_allocator;
+// Symbols can be created in multiple threads by Dso::PrefetchSymbols().
+static std::mutex symbol_name_allocator_mutex;
+
+static const char* AllocateSymbolName(std::string_view name) {
+  std::lock_guard<std::mutex> lock(symbol_name_allocator_mutex);
+  return symbol_name_allocator.AllocateString(name);
+}
 
 Symbol::Symbol(std::string_view name, uint64_t addr, uint64_t len)
     : addr(addr),
       len(len),
-      name_(symbol_name_allocator.AllocateString(name)),
+      name_(AllocateSymbolName(name)),
       demangled_name_(nullptr),
       dump_id_(UINT_MAX) {}
 
+Symbol::Symbol(const char* name, const char* demangled_name, uint64_t addr, uint64_t len)
+    : addr(addr), len(len), name_(name), demangled_name_(demangled_name), dump_id_(UINT_MAX) {}
+
 const char* Symbol::DemangledName() const {
   if (demangled_name_ == nullptr) {
     const std::string s = Dso::Demangle(name_);
@@ -282,7 +293,7 @@ void Symbol::SetDemangledName(std::string_view name) const {
   if (name == name_) {
     demangled_name_ = name_;
   } else {
-    demangled_name_ = symbol_name_allocator.AllocateString(name);
+    demangled_name_ = AllocateSymbolName(name);
   }
 }
 
@@ -312,9 +323,11 @@ bool Dso::demangle_ = true;
 std::string Dso::vmlinux_;
 std::string Dso::kallsyms_;
 std::unordered_map<std::string, BuildId> Dso::build_id_map_;
-size_t Dso::dso_count_;
+std::atomic<size_t> Dso::dso_count_;
 uint32_t Dso::g_dump_id_;
 simpleperf_dso_impl::DebugElfFileFinder Dso::debug_elf_file_finder_;
+std::unique_ptr<SymbolCache> Dso::symbol_cache_;
+std::unique_ptr<BuildIdCache> Dso::build_id_cache_;
 
 void Dso::SetDemangle(bool demangle) {
   demangle_ = demangle;
@@ -325,10 +338,7 @@ extern "C" char* __cxa_demangle(const char* mangled_name, char* buf, size_t* n,
 extern "C" char* rustc_demangle(const char* mangled, char* out, size_t* len, int* status);
 #endif
 
-std::string Dso::Demangle(const std::string& name) {
-  if (!demangle_) {
-    return name;
-  }
+static std::string DemangleName(const std::string& name) {
   int status;
   bool is_linker_symbol = (name.find(linker_prefix) == 0);
   const char* mangled_str = name.c_str();
@@ -366,6 +376,13 @@ std::string Dso::Demangle(const std::string& name) {
   return name;
 }
 
+std::string Dso::Demangle(const std::string& name) {
+  if (!demangle_) {
+    return name;
+  }
+  return DemangleName(name);
+}
+
 bool Dso::SetSymFsDir(const std::string& symfs_dir) {
   return debug_elf_file_finder_.SetSymFsDir(symfs_dir);
 }
@@ -395,6 +412,11 @@ void Dso::SetVdsoFile(const std::string& vdso_file, bool is_64bit) {
   debug_elf_file_finder_.SetVdsoFile(vdso_file, is_64bit);
 }
 
+void Dso::SetSymbolCache(const std::string& symbol_cache_dir, uint64_t max_size) {
+  symbol_cache_.reset(new SymbolCache(symbol_cache_dir, max_size));
+  build_id_cache_.reset(new BuildIdCache(symbol_cache_dir));
+}
+
 BuildId Dso::FindExpectedBuildIdForPath(const std::string& path) {
   auto it = build_id_map_.find(path);
   if (it != build_id_map_.end()) {
@@ -433,6 +455,8 @@ Dso::~Dso() {
     build_id_map_.clear();
     g_dump_id_ = 0;
     debug_elf_file_finder_.Reset();
+    symbol_cache_.reset();
+    build_id_cache_.reset();
   }
 }
 
@@ -499,7 +523,17 @@ bool Dso::IsForJavaMethod() const {
 void Dso::LoadSymbols() {
   if (!is_loaded_) {
     is_loaded_ = true;
-    std::vector<Symbol> symbols = LoadSymbolsImpl();
+    std::vector<Symbol> symbols;
+    bool prefetched;
+    {
+      std::lock_guard<std::mutex> lock(prefetch_mutex_);
+      prefetched = prefetched_;
+      symbols = std::move(prefetched_symbols_);
+      prefetched_symbols_.clear();
+    }
+    if (!prefetched) {
+      symbols = LoadSymbolsImpl();
+    }
     if (symbols_.empty()) {
       symbols_ = std::move(symbols);
     } else {
@@ -511,6 +545,54 @@ void Dso::LoadSymbols() {
   }
 }
 
+bool Dso::LoadSymbolsFromCache(const BuildId& build_id, std::vector<Symbol>* symbols) {
+  if (!symbol_cache_ || build_id.IsEmpty()) {
+    return false;
+  }
+  std::vector<SymbolCache::Entry> entries;
+  if (!symbol_cache_->Load(build_id, &entries)) {
+    return false;
+  }
+  symbols->clear();
+  symbols->reserve(entries.size());
+  for (const SymbolCache::Entry& entry : entries) {
+    symbols->push_back(Symbol(entry.name, demangle_ ? entry.demangled_name : entry.name,
+                              entry.addr, entry.len));
+  }
+  LOG(VERBOSE) << "Read symbols of " << path_ << " from symbol cache";
+  return true;
+}
+
+void Dso::StoreSymbolsInCache(const BuildId& build_id, const std::vector<Symbol>& symbols) {
+  if (!symbol_cache_ || build_id.IsEmpty()) {
+    return;
+  }
+  // The cache always has demangled names, so it can be used with or without --no-demangle.
+  std::vector<std::string> demangled_names(demangle_ ? 0 : symbols.size());
+  std::vector<SymbolCache::Entry> entries;
+  entries.reserve(symbols.size());
+  for (size_t i = 0; i < symbols.size(); i++) {
+    const Symbol& symbol = symbols[i];
+    const char* demangled_name;
+    if (demangle_) {
+      demangled_name = symbol.DemangledName();
+    } else {
+      demangled_names[i] = DemangleName(symbol.name_);
+      demangled_name = demangled_names[i].c_str();
+    }
+    entries.push_back(SymbolCache::Entry{symbol.addr, symbol.len, symbol.name_, demangled_name});
+  }
+  symbol_cache_->Store(build_id, entries);
+}
+
+void Dso::PrefetchSymbols() {
+  std::lock_guard<std::mutex> lock(prefetch_mutex_);
+  if (!prefetched_) {
+    prefetched_ = true;
+    prefetched_symbols_ = LoadSymbolsImpl();
+  }
+}
+
 static void ReportReadElfSymbolResult(
     ElfStatus result, const std::string& path, const std::string& debug_file_path,
     android::base::LogSeverity warning_loglevel = android::base::WARNING) {
@@ -529,7 +611,10 @@ static void ReportReadElfSymbolResult(
 }
 
 static void SortAndFixSymbols(std::vector<Symbol>& symbols) {
-  std::sort(symbols.begin(), symbols.end(), Symbol::CompareValueByAddr);
+  // Symbols from kallsyms and symbol tables are mostly sorted already.
+  if (!std::is_sorted(symbols.begin(), symbols.end(), Symbol::CompareValueByAddr)) {
+    std::sort(symbols.begin(), symbols.end(), Symbol::CompareValueByAddr);
+  }
   Symbol* prev_symbol = nullptr;
   for (auto& symbol : symbols) {
     if (prev_symbol != nullptr && prev_symbol->len == 0) {
@@ -603,6 +688,15 @@ class DexFileDso : public Dso {
   std::vector<uint64_t> dex_file_offsets_;
 };
 
+static bool HasSymtabSection(ElfFile& elf) {
+  for (const ElfSection& section : elf.GetSectionHeader()) {
+    if (section.name == ".symtab") {
+      return true;
+    }
+  }
+  return false;
+}
+
 class ElfDso : public Dso {
  public:
   ElfDso(const std::string& path, bool force_64bit)
@@ -646,6 +740,13 @@ class ElfDso : public Dso {
     *file_offset = file_offset_of_min_vaddr_;
   }
 
+  void PrepareIpConversion() override {
+    Dso::PrepareIpConversion();
+    uint64_t min_vaddr;
+    uint64_t file_offset_of_min_vaddr;
+    GetMinExecutableVaddr(&min_vaddr, &file_offset_of_min_vaddr);
+  }
+
   uint64_t IpToVaddrInFile(uint64_t ip, uint64_t map_start, uint64_t map_pgoff) override {
     if (type_ == DSO_DEX_FILE) {
       return dex_file_dso_->IpToVaddrInFile(ip, map_start, map_pgoff);
@@ -691,6 +792,14 @@ class ElfDso : public Dso {
     }
     std::vector<Symbol> symbols;
     BuildId build_id = GetExpectedBuildId();
+    if (build_id.IsEmpty() && symbol_cache_) {
+      // Like when recording, the expected build id isn't known. Use the build id of the file to
+      // read, which is cheap to get from the build id cache.
+      build_id_cache_->GetBuildId(GetDebugFilePath(), &build_id);
+    }
+    if (LoadSymbolsFromCache(build_id, &symbols)) {
+      return symbols;
+    }
     auto symbol_callback = [&](const ElfFileSymbol& symbol) {
       if (symbol.is_func || (symbol.is_label && symbol.is_in_text_section)) {
         symbols.emplace_back(symbol.name, symbol.vaddr, symbol.len);
@@ -713,6 +822,12 @@ class ElfDso : public Dso {
     }
     ReportReadElfSymbolResult(status, path_, GetDebugFilePath(), log_level);
     SortAndFixSymbols(symbols);
+    // Only cache symbols read from .symtab. Files with the same build id may be stripped
+    // differently, and symbols from .dynsym or .gnu_debugdata may be fewer than those in an
+    // unstripped file read later. ElfFile::Open() has checked that the build id matches.
+    if (status == ElfStatus::NO_ERROR && HasSymtabSection(*elf)) {
+      StoreSymbolsInCache(build_id, symbols);
+    }
     return symbols;
   }
 
@@ -740,6 +855,11 @@ class KernelDso : public Dso {
     return ip;
   }
 
+  void PrepareIpConversion() override {
+    Dso::PrepareIpConversion();
+    GetKernelStartAddr();
+  }
+
   std::optional<uint64_t> IpToFileOffset(uint64_t ip, uint64_t map_start, uint64_t) override {
     if (map_start != 0 && GetKernelStartOffset() != 0) {
       return ip - map_start + GetKernelStartOffset();
@@ -808,12 +928,15 @@ class KernelDso : public Dso {
   }
 
   void ReadSymbolsFromKallsyms(std::string& kallsyms, std::vector<Symbol>* symbols) {
+    // Each line in kallsyms is about 40 bytes, and most of them are function symbols.
+    symbols->reserve(symbols->size() + kallsyms.size() / 40);
+    std::string name;
     auto symbol_callback = [&](const KernelSymbol& symbol) {
       if (strchr("TtWw", symbol.type) && symbol.addr != 0u) {
         if (symbol.module == nullptr) {
           symbols->emplace_back(symbol.name, symbol.addr, 0);
         } else {
-          std::string name = std::string(symbol.name) + " [" + symbol.module + "]";
+          name.assign(symbol.name).append(" [").append(symbol.module).append("]");
           symbols->emplace_back(name, symbol.addr, 0);
         }
       }
@@ -906,6 +1029,13 @@ class KernelModuleDso : public Dso {
     *memory_offset = memory_offset_of_min_vaddr_.value();
   }
 
+  void PrepareIpConversion() override {
+    Dso::PrepareIpConversion();
+    uint64_t min_vaddr;
+    uint64_t memory_offset;
+    GetMinExecutableVaddr(&min_vaddr, &memory_offset);
+  }
+
   uint64_t IpToVaddrInFile(uint64_t ip, uint64_t map_start, uint64_t) override {
     uint64_t min_vaddr;
     uint64_t memory_offset;
@@ -1081,6 +1211,9 @@ const char* DsoTypeToString(DsoType dso_type) {
 }
 
 bool GetBuildIdFromDsoPath(const std::string& dso_path, BuildId* build_id) {
+  if (BuildIdCache* cache = Dso::GetBuildIdCache(); cache != nullptr) {
+    return cache->GetBuildId(dso_path, build_id);
+  }
   ElfStatus status;
   auto elf = ElfFile::Open(dso_path, &status);
   if (status == ElfStatus::NO_ERROR && elf->GetBuildId(build_id) == ElfStatus::NO_ERROR) {
@@ -17,7 +17,9 @@
 #ifndef SIMPLE_PERF_DSO_H_
 #define SIMPLE_PERF_DSO_H_
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -32,6 +34,10 @@
 #include "read_elf.h"
 
 namespace simpleperf {
+
+class BuildIdCache;
+class SymbolCache;
+
 namespace simpleperf_dso_impl {
 
 // Find elf files with symbol table and debug information.
@@ -98,6 +104,9 @@ struct Symbol {
   static bool CompareValueByAddr(const Symbol& s1, const Symbol& s2) { return s1.addr < s2.addr; }
 
  private:
+  // Used for names allocated elsewhere, like in a SymbolCache.
+  Symbol(const char* name, const char* demangled_name, uint64_t addr, uint64_t len);
+
   const char* name_;
   mutable const char* demangled_name_;
   mutable uint32_t dump_id_;
@@ -137,6 +146,10 @@ class Dso {
   static void SetBuildIds(const std::vector<std::pair<std::string, BuildId>>& build_ids);
   static BuildId FindExpectedBuildIdForPath(const std::string& path);
   static void SetVdsoFile(const std::string& vdso_file, bool is_64bit);
+  // Cache symbol tables of ELF files with build ids, and build ids of ELF files, in
+  // symbol_cache_dir. It should be called before loading any symbols.
+  static void SetSymbolCache(const std::string& symbol_cache_dir, uint64_t max_size);
+  static BuildIdCache* GetBuildIdCache() { return build_id_cache_.get(); }
 
   static std::unique_ptr<Dso> CreateDso(DsoType dso_type, const std::string& dso_path,
                                         bool force_64bit = false);
@@ -188,9 +201,16 @@ class Dso {
   virtual uint64_t IpToVaddrInFile(uint64_t ip, uint64_t map_start, uint64_t map_pgoff) = 0;
   virtual std::optional<uint64_t> IpToFileOffset(uint64_t ip, uint64_t map_start,
                                                  uint64_t map_pgoff);
+  // IpToVaddrInFile() and IpToFileOffset() read some info lazily, like the debug file path and
+  // the min executable vaddr. Read it in advance, so they can be called in multiple threads.
+  virtual void PrepareIpConversion() { GetDebugFilePath(); }
 
   const Symbol* FindSymbol(uint64_t vaddr_in_dso);
   void LoadSymbols();
+  // Load symbols in another thread, and hand them over to the next LoadSymbols() call.
+  // PrefetchSymbols() can run for different dsos at the same time. But while it runs, the dso
+  // shouldn't be used by other threads, except calling LoadSymbols(), which waits for the prefetch.
+  void PrefetchSymbols();
   const std::vector<Symbol>& GetSymbols() const { return symbols_; }
   void SetSymbols(std::vector<Symbol>* symbols);
 
@@ -204,12 +224,17 @@ class Dso {
   static std::string vmlinux_;
   static std::string kallsyms_;
   static std::unordered_map<std::string, BuildId> build_id_map_;
-  static size_t dso_count_;
+  // Dsos can be created in multiple threads, like by LiveReporter.
+  static std::atomic<size_t> dso_count_;
   static uint32_t g_dump_id_;
   static simpleperf_dso_impl::DebugElfFileFinder debug_elf_file_finder_;
+  static std::unique_ptr<SymbolCache> symbol_cache_;
+  static std::unique_ptr<BuildIdCache> build_id_cache_;
 
   Dso(DsoType type, const std::string& path);
   BuildId GetExpectedBuildId() const;
+  bool LoadSymbolsFromCache(const BuildId& build_id, std::vector<Symbol>* symbols);
+  void StoreSymbolsInCache(const BuildId& build_id, const std::vector<Symbol>& symbols);
 
   virtual std::string FindDebugFilePath() const { return path_; }
   virtual std::vector<Symbol> LoadSymbolsImpl() = 0;
@@ -226,6 +251,9 @@ class Dso {
   // unknown symbols are like [libc.so+0x1234].
   std::unordered_map<uint64_t, Symbol> unknown_symbols_;
   bool is_loaded_;
+  std::mutex prefetch_mutex_;
+  bool prefetched_ = false;
+  std::vector<Symbol> prefetched_symbols_;
   // Used to identify current dso if it needs to be dumped.
   uint32_t dump_id_;
   // Used to assign dump_id for symbols in current dso.
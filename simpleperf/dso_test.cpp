@@ -24,6 +24,7 @@
 
 #include "get_test_data.h"
 #include "read_apk.h"
+#include "read_elf.h"
 #include "thread_tree.h"
 #include "utils.h"
 
@@ -423,3 +424,44 @@ TEST(dso, demangle) {
   ASSERT_EQ(Dso::Demangle("_RNvC6_123foo3bar"), "123foo::bar");
 #endif
 }
+
+// @CddTest = 6.1/C-0-2
+TEST(dso, symbol_cache) {
+  TemporaryDir tmpdir;
+  std::string elf_path = GetTestData(ELF_FILE);
+  std::string missing_path = GetTestData("not_exist_file");
+  Dso::SetBuildIds({std::make_pair(elf_path, BuildId(ELF_FILE_BUILD_ID)),
+                    std::make_pair(missing_path, BuildId(ELF_FILE_BUILD_ID))});
+  Dso::SetSymbolCache(tmpdir.path, kMegabyte);
+  auto dso = Dso::CreateDso(DSO_ELF_FILE, elf_path);
+  dso->LoadSymbols();
+  const std::vector<Symbol>& symbols = dso->GetSymbols();
+  ASSERT_FALSE(symbols.empty());
+  ASSERT_TRUE(IsRegularFile(std::string(tmpdir.path) + "/" + ELF_FILE_BUILD_ID + ".symcache"));
+
+  // A dso with the same build id reads symbols from the cache, even if the file doesn't exist.
+  auto cached_dso = Dso::CreateDso(DSO_ELF_FILE, missing_path);
+  cached_dso->LoadSymbols();
+  const std::vector<Symbol>& cached_symbols = cached_dso->GetSymbols();
+  ASSERT_EQ(cached_symbols.size(), symbols.size());
+  for (size_t i = 0; i < symbols.size(); i++) {
+    ASSERT_EQ(cached_symbols[i].addr, symbols[i].addr);
+    ASSERT_EQ(cached_symbols[i].len, symbols[i].len);
+    ASSERT_STREQ(cached_symbols[i].Name(), symbols[i].Name());
+    ASSERT_STREQ(cached_symbols[i].DemangledName(), symbols[i].DemangledName());
+  }
+
+  // Symbols of a file without .symtab aren't cached, since an unstripped file with the same build
+  // id may have more symbols.
+  std::string mini_debug_info_path = GetTestData(ELF_FILE_WITH_MINI_DEBUG_INFO);
+  ElfStatus status;
+  auto elf = ElfFile::Open(mini_debug_info_path, &status);
+  ASSERT_TRUE(elf);
+  BuildId build_id;
+  ASSERT_EQ(elf->GetBuildId(&build_id), ElfStatus::NO_ERROR);
+  Dso::SetBuildIds({std::make_pair(mini_debug_info_path, build_id)});
+  auto stripped_dso = Dso::CreateDso(DSO_ELF_FILE, mini_debug_info_path);
+  stripped_dso->LoadSymbols();
+  ASSERT_FALSE(stripped_dso->GetSymbols().empty());
+  ASSERT_FALSE(IsRegularFile(std::string(tmpdir.path) + "/" + build_id.ToString() + ".symcache"));
+}
@@ -24,6 +24,7 @@
 #include <sys/mman.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <utils/Trace.h>
 #include <atomic>
 #include <memory>
@@ -144,17 +145,52 @@ bool EventFd::ReadCounter(PerfCounter* counter) {
   if (!InnerReadCounter(counter)) {
     return false;
   }
+  TraceCounter(*counter);
+  return true;
+}
+
+bool EventFd::ReadGroupCounters(const std::vector<EventFd*>& group_fds,
+                                std::vector<PerfCounter>* counters) {
+  CHECK(attr_.read_format & PERF_FORMAT_GROUP);
+  CHECK(!group_fds.empty() && group_fds[0] == this);
+  // With PERF_FORMAT_GROUP, the kernel returns:
+  //   u64 nr, time_enabled, time_running;
+  //   { u64 value, id; } cntr[nr];
+  size_t nr = group_fds.size();
+  std::vector<uint64_t> buf(3 + nr * 2);
+  ssize_t size = TEMP_FAILURE_RETRY(read(perf_event_fd_, buf.data(), buf.size() * sizeof(buf[0])));
+  if (size < 0) {
+    PLOG(ERROR) << "ReadGroupCounters from " << Name() << " failed";
+    return false;
+  }
+  if (static_cast<size_t>(size) != buf.size() * sizeof(buf[0]) || buf[0] != nr) {
+    LOG(ERROR) << "ReadGroupCounters from " << Name() << " failed: expected " << nr
+               << " counters, got " << buf[0];
+    return false;
+  }
+  counters->resize(nr);
+  for (size_t i = 0; i < nr; i++) {
+    PerfCounter& counter = (*counters)[i];
+    counter.value = buf[3 + i * 2];
+    counter.time_enabled = buf[1];
+    counter.time_running = buf[2];
+    counter.id = buf[3 + i * 2 + 1];
+    group_fds[i]->TraceCounter(counter);
+  }
+  return true;
+}
+
+void EventFd::TraceCounter(const PerfCounter& counter) {
   // Trace is always available to systrace if enabled
   if (tid_ > 0) {
     ATRACE_INT64(
         android::base::StringPrintf("%s_tid%d_cpu%d", event_name_.c_str(), tid_, cpu_).c_str(),
-        counter->value - last_counter_value_);
+        counter.value - last_counter_value_);
   } else {
     ATRACE_INT64(android::base::StringPrintf("%s_cpu%d", event_name_.c_str(), cpu_).c_str(),
-                 counter->value - last_counter_value_);
+                 counter.value - last_counter_value_);
   }
-  last_counter_value_ = counter->value;
-  return true;
+  last_counter_value_ = counter.value;
 }
 
 bool EventFd::CreateMappedBuffer(size_t mmap_pages, bool report_error) {
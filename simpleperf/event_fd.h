@@ -65,6 +65,12 @@ class EventFd {
 
   bool ReadCounter(PerfCounter* counter);
 
+  // Read counters of all events in the group led by this EventFd with one read() call. It needs
+  // PERF_FORMAT_GROUP in read_format. group_fds are EventFds in the group in the order of opening,
+  // starting with this EventFd. counters[i] is set to the counter of group_fds[i].
+  bool ReadGroupCounters(const std::vector<EventFd*>& group_fds,
+                         std::vector<PerfCounter>* counters);
+
   // Create mapped buffer used to receive records sent by the kernel.
   // mmap_pages should be power of 2.
   virtual bool CreateMappedBuffer(size_t mmap_pages, bool report_error);
@@ -126,6 +132,7 @@ class EventFd {
         last_counter_value_(0) {}
 
   bool InnerReadCounter(PerfCounter* counter) const;
+  void TraceCounter(const PerfCounter& counter);
 
   const perf_event_attr attr_;
   int perf_event_fd_;
@@ -313,6 +313,12 @@ bool EventSelectionSet::AddEventGroup(const std::vector<std::string>& event_name
     first_in_group = false;
     group.selections.emplace_back(std::move(selection));
   }
+  if (for_stat_cmd_ && group.selections.size() > 1) {
+    // Read counters of a group with one read() call.
+    for (auto& selection : group.selections) {
+      selection.event_attr.read_format |= PERF_FORMAT_GROUP;
+    }
+  }
   if (sample_rate_) {
     SetSampleRateForGroup(group, sample_rate_.value());
   }
@@ -359,6 +365,20 @@ std::vector<const EventType*> EventSelectionSet::GetEvents() const {
   return result;
 }
 
+std::vector<std::string> EventSelectionSet::GetEventNamesWithModifiers() const {
+  std::vector<std::string> result;
+  for (const auto& group : groups_) {
+    for (const auto& selection : group.selections) {
+      std::string name = selection.event_type_modifier.event_type.name;
+      if (!selection.event_type_modifier.modifier.empty()) {
+        name += ":" + selection.event_type_modifier.modifier;
+      }
+      result.emplace_back(std::move(name));
+    }
+  }
+  return result;
+}
+
 std::vector<const EventType*> EventSelectionSet::GetTracepointEvents() const {
   std::vector<const EventType*> result;
   for (const auto& group : groups_) {
@@ -824,21 +844,57 @@ static bool ReadCounter(EventFd* event_fd, CounterInfo* counter) {
 
 bool EventSelectionSet::ReadCounters(std::vector<CountersInfo>* counters) {
   counters->clear();
+  read_counter_calls_ = 0;
   for (size_t i = 0; i < groups_.size(); ++i) {
-    for (auto& selection : groups_[i].selections) {
+    auto& group = groups_[i];
+    size_t first = counters->size();
+    for (auto& selection : group.selections) {
       CountersInfo counters_info;
       counters_info.group_id = i;
       counters_info.event_name = selection.event_type_modifier.event_type.name;
       counters_info.event_modifier = selection.event_type_modifier.modifier;
       counters_info.counters = selection.hotplugged_counters;
-      for (auto& event_fd : selection.event_fds) {
+      counters->push_back(counters_info);
+    }
+    if (group.selections[0].event_attr.read_format & PERF_FORMAT_GROUP) {
+      if (!ReadGroupCounters(group, &(*counters)[first])) {
+        return false;
+      }
+      continue;
+    }
+    for (size_t j = 0; j < group.selections.size(); j++) {
+      for (auto& event_fd : group.selections[j].event_fds) {
         CounterInfo counter;
         if (!ReadCounter(event_fd.get(), &counter)) {
           return false;
         }
-        counters_info.counters.push_back(counter);
+        read_counter_calls_++;
+        (*counters)[first + j].counters.push_back(counter);
       }
-      counters->push_back(counters_info);
+    }
+  }
+  return true;
+}
+
+// Read counters of a group opened with PERF_FORMAT_GROUP. event_fds[k] of all selections in a
+// group are opened together on the same thread and cpu, with the first selection as the leader.
+bool EventSelectionSet::ReadGroupCounters(EventSelectionGroup& group, CountersInfo* counters) {
+  std::vector<EventFd*> group_fds(group.selections.size());
+  std::vector<PerfCounter> group_counters;
+  for (size_t k = 0; k < group.selections[0].event_fds.size(); k++) {
+    for (size_t j = 0; j < group.selections.size(); j++) {
+      group_fds[j] = group.selections[j].event_fds[k].get();
+    }
+    if (!group_fds[0]->ReadGroupCounters(group_fds, &group_counters)) {
+      return false;
+    }
+    read_counter_calls_++;
+    for (size_t j = 0; j < group.selections.size(); j++) {
+      CounterInfo counter;
+      counter.tid = group_fds[j]->ThreadId();
+      counter.cpu = group_fds[j]->Cpu();
+      counter.counter = group_counters[j];
+      counters[j].counters.push_back(counter);
     }
   }
   return true;
@@ -846,10 +902,11 @@ bool EventSelectionSet::ReadCounters(std::vector<CountersInfo>* counters) {
 
 bool EventSelectionSet::MmapEventFiles(size_t min_mmap_pages, size_t max_mmap_pages,
                                        size_t aux_buffer_size, size_t record_buffer_size,
-                                       bool allow_truncating_samples, bool exclude_perf) {
+                                       bool allow_truncating_samples, bool exclude_perf,
+                                       size_t record_read_threads) {
   record_read_thread_.reset(new simpleperf::RecordReadThread(
       record_buffer_size, groups_[0].selections[0].event_attr, min_mmap_pages, max_mmap_pages,
-      aux_buffer_size, allow_truncating_samples, exclude_perf));
+      aux_buffer_size, allow_truncating_samples, exclude_perf, record_read_threads));
   return true;
 }
 
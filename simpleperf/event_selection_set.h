@@ -113,6 +113,8 @@ class EventSelectionSet {
   // For each sample generated for the existing event group, add counters for selected events.
   bool AddCounters(const std::vector<std::string>& event_names);
   std::vector<const EventType*> GetEvents() const;
+  // Return event names with modifiers, in the order of counters returned by ReadCounters().
+  std::vector<std::string> GetEventNamesWithModifiers() const;
   std::vector<const EventType*> GetTracepointEvents() const;
   bool ExcludeKernel() const;
   bool HasAuxTrace() const { return has_aux_trace_; }
@@ -166,8 +168,11 @@ class EventSelectionSet {
 
   bool OpenEventFiles();
   bool ReadCounters(std::vector<CountersInfo>* counters);
+  // Return the number of read() calls used by the last ReadCounters().
+  size_t GetReadCounterCalls() const { return read_counter_calls_; }
   bool MmapEventFiles(size_t min_mmap_pages, size_t max_mmap_pages, size_t aux_buffer_size,
-                      size_t record_buffer_size, bool allow_truncating_samples, bool exclude_perf);
+                      size_t record_buffer_size, bool allow_truncating_samples, bool exclude_perf,
+                      size_t record_read_threads = 1);
   bool PrepareToReadMmapEventData(const std::function<bool(Record*)>& callback);
   bool SyncKernelBuffer();
   bool FinishReadMmapEventData();
@@ -215,6 +220,7 @@ class EventSelectionSet {
   bool ApplyAddrFilters();
   bool ApplyTracepointFilters();
   bool ReadMmapEventData(bool with_time_limit);
+  bool ReadGroupCounters(EventSelectionGroup& group, CountersInfo* counters);
 
   bool CheckMonitoredTargets();
   bool HasSampler();
@@ -237,6 +243,7 @@ class EventSelectionSet {
 
   std::set<int> etm_event_cpus_;
   std::set<int>::const_iterator etm_event_cpus_it_;
+  size_t read_counter_calls_ = 0;
 
   DISALLOW_COPY_AND_ASSIGN(EventSelectionSet);
 };
@@ -16,6 +16,7 @@
 #include "kallsyms.h"
 
 #include <inttypes.h>
+#include <string.h>
 
 #include <string>
 
@@ -240,46 +241,93 @@ void ResetKernelAddressWarning() {
 
 #endif  // defined(__linux__)
 
+static inline bool IsSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline char* SkipSpaces(char* p, char* end) {
+  while (p < end && IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static inline char* SkipNonSpaces(char* p, char* end) {
+  while (p < end && !IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static inline int HexDigitValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Parse lines in place, like: ffffffffa005c4e4 d __warned.41698       [libsas]
+// There are about 200k lines in /proc/kallsyms. So instead of sscanf, lines are found by memchr
+// (which is vectorized in libc), and fields are scanned by hand. Names are terminated by writing
+// '\0' into symbol_data, and restored after calling the callback.
 bool ProcessKernelSymbols(std::string& symbol_data,
                           const std::function<bool(const KernelSymbol&)>& callback) {
-  char* p = &symbol_data[0];
+  char* p = symbol_data.data();
   char* data_end = p + symbol_data.size();
   while (p < data_end) {
-    char* line_end = strchr(p, '\n');
-    if (line_end != nullptr) {
-      *line_end = '\0';
+    char* line_end = static_cast<char*>(memchr(p, '\n', data_end - p));
+    if (line_end == nullptr) {
+      line_end = data_end;
     }
-    size_t line_size = (line_end != nullptr) ? (line_end - p) : (data_end - p);
-    // Parse line like: ffffffffa005c4e4 d __warned.41698       [libsas]
-    char name[line_size];
-    char module[line_size];
-    strcpy(module, "");
+    char* s = SkipSpaces(p, line_end);
+    p = (line_end < data_end) ? line_end + 1 : data_end;
 
     KernelSymbol symbol;
-    int ret = sscanf(p, "%" PRIx64 " %c %s%s", &symbol.addr, &symbol.type, name, module);
-    if (line_end != nullptr) {
-      *line_end = '\n';
-      p = line_end + 1;
-    } else {
-      p = data_end;
+    symbol.addr = 0;
+    char* addr_start = s;
+    for (int value; s < line_end && (value = HexDigitValue(*s)) >= 0; s++) {
+      symbol.addr = (symbol.addr << 4) | value;
     }
-    if (ret >= 3) {
-      if (IsArmMappingSymbol(name)) {
-        continue;
-      }
-
-      symbol.name = name;
-      size_t module_len = strlen(module);
-      if (module_len > 2 && module[0] == '[' && module[module_len - 1] == ']') {
-        module[module_len - 1] = '\0';
-        symbol.module = &module[1];
-      } else {
-        symbol.module = nullptr;
-      }
-
-      if (callback(symbol)) {
-        return true;
-      }
+    if (s == addr_start) {
+      continue;
+    }
+    s = SkipSpaces(s, line_end);
+    if (s == line_end) {
+      continue;
+    }
+    symbol.type = *s++;
+    char* name = SkipSpaces(s, line_end);
+    char* name_end = SkipNonSpaces(name, line_end);
+    if (name == name_end) {
+      continue;
+    }
+    char* module = SkipSpaces(name_end, line_end);
+    char* module_end = SkipNonSpaces(module, line_end);
+
+    // name_end may point to the terminating '\0' of symbol_data, which isn't changed.
+    char saved_name_end = *name_end;
+    *name_end = '\0';
+    if (IsArmMappingSymbol(name)) {
+      *name_end = saved_name_end;
+      continue;
+    }
+    symbol.name = name;
+    symbol.module = nullptr;
+    if (module_end - module > 2 && module[0] == '[' && module_end[-1] == ']') {
+      module_end[-1] = '\0';
+      symbol.module = module + 1;
+    }
+    bool stop = callback(symbol);
+    *name_end = saved_name_end;
+    if (symbol.module != nullptr) {
+      module_end[-1] = ']';
+    }
+    if (stop) {
+      return true;
     }
   }
   return false;
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <string>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "kallsyms.h"
+#include "read_elf.h"
+
+using namespace simpleperf;
+
+namespace {
+
+// Generate content like /proc/kallsyms, with about the same number of symbols as a kernel.
+std::string GenerateKallsyms() {
+  static const char types[] = {'T', 't', 'D', 'd', 'W', 'b', 'r'};
+  std::string data;
+  uint64_t addr = 0xffffffc008000000ULL;
+  for (size_t i = 0; i < 200000; i++) {
+    char type = types[i % sizeof(types)];
+    data += android::base::StringPrintf("%016" PRIx64 " %c kernel_function_%zu", addr, type, i);
+    if (i % 4 == 0) {
+      data += android::base::StringPrintf("\t[module_%zu]", i % 97);
+    }
+    data += '\n';
+    addr += 0x40 + (i % 7) * 8;
+  }
+  return data;
+}
+
+std::string& GetKallsyms() {
+  static std::string data = GenerateKallsyms();
+  return data;
+}
+
+// The sscanf based parser used before, kept as a reference.
+bool ProcessKernelSymbolsWithSscanf(std::string& symbol_data,
+                                    const std::function<bool(const KernelSymbol&)>& callback) {
+  char* p = &symbol_data[0];
+  char* data_end = p + symbol_data.size();
+  std::string name;
+  std::string module;
+  while (p < data_end) {
+    char* line_end = strchr(p, '\n');
+    if (line_end != nullptr) {
+      *line_end = '\0';
+    }
+    size_t line_size = (line_end != nullptr) ? (line_end - p) : (data_end - p);
+    name.resize(line_size + 1);
+    module.assign(line_size + 1, '\0');
+
+    KernelSymbol symbol;
+    int ret = sscanf(p, "%" PRIx64 " %c %s%s", &symbol.addr, &symbol.type, name.data(),
+                     module.data());
+    if (line_end != nullptr) {
+      *line_end = '\n';
+      p = line_end + 1;
+    } else {
+      p = data_end;
+    }
+    if (ret >= 3) {
+      if (IsArmMappingSymbol(name.c_str())) {
+        continue;
+      }
+      symbol.name = name.c_str();
+      size_t module_len = strlen(module.c_str());
+      if (module_len > 2 && module[0] == '[' && module[module_len - 1] == ']') {
+        module[module_len - 1] = '\0';
+        symbol.module = &module[1];
+      } else {
+        symbol.module = nullptr;
+      }
+      if (callback(symbol)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void BM_ProcessKernelSymbols(benchmark::State& state) {
+  std::string& data = GetKallsyms();
+  for (auto _ : state) {
+    size_t count = 0;
+    ProcessKernelSymbols(data, [&](const KernelSymbol& symbol) {
+      count += symbol.module != nullptr;
+      return false;
+    });
+    benchmark::DoNotOptimize(count);
+  }
+}
+
+void BM_ProcessKernelSymbolsWithSscanf(benchmark::State& state) {
+  std::string& data = GetKallsyms();
+  for (auto _ : state) {
+    size_t count = 0;
+    ProcessKernelSymbolsWithSscanf(data, [&](const KernelSymbol& symbol) {
+      count += symbol.module != nullptr;
+      return false;
+    });
+    benchmark::DoNotOptimize(count);
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_ProcessKernelSymbols)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ProcessKernelSymbolsWithSscanf)->Unit(benchmark::kMillisecond);
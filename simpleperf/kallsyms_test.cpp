@@ -16,6 +16,9 @@
 
 #include <gtest/gtest.h>
 
+#include <inttypes.h>
+
+#include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 
 #include "get_test_data.h"
@@ -85,6 +88,27 @@ TEST(kallsyms, ProcessKernelSymbols_ignore_arm_mapping_symbols) {
   ASSERT_FALSE(has_arm_mapping_symbol);
 }
 
+// @CddTest = 6.1/C-0-2
+TEST(kallsyms, ProcessKernelSymbols_keep_data_unchanged) {
+  std::string data =
+      "ffffffc008010000 T _stext\n"
+      "ffffffc008020000\tt\tetm4_pm_clear\t[coresight_etm4x]\n"
+      "invalid line\n"
+      "ffffffc008030000 W weak_func";
+  const std::string orig_data = data;
+  std::vector<std::string> symbols;
+  auto callback = [&](const KernelSymbol& sym) {
+    symbols.emplace_back(android::base::StringPrintf("%" PRIx64 " %c %s %s", sym.addr, sym.type,
+                                                     sym.name, sym.module ? sym.module : "-"));
+    return false;
+  };
+  ASSERT_FALSE(ProcessKernelSymbols(data, callback));
+  ASSERT_EQ(data, orig_data);
+  ASSERT_EQ(symbols, std::vector<std::string>({"ffffffc008010000 T _stext -",
+                                                "ffffffc008020000 t etm4_pm_clear coresight_etm4x",
+                                                "ffffffc008030000 W weak_func -"}));
+}
+
 #if defined(__ANDROID__)
 // @CddTest = 6.1/C-0-2
 TEST(kallsyms, GetKernelStartAddress) {
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <unordered_map>
@@ -78,6 +79,9 @@ class ApkInspector {
     // Map from entry_name to EmbeddedElf.
     std::unordered_map<std::string, EmbeddedElf*> name_map;
   };
+  // Protects embedded_elf_cache_, as ELF files in apks can be opened in multiple threads by
+  // Dso::PrefetchSymbols().
+  static std::mutex cache_mutex_;
   static std::unordered_map<std::string, ApkNode> embedded_elf_cache_;
 };
 
@@ -73,6 +73,7 @@ static std::string RecordTypeToString(int record_type) {
       {SIMPLE_PERF_RECORD_UNWINDING_RESULT, "unwinding_result"},
       {SIMPLE_PERF_RECORD_TRACING_DATA, "tracing_data"},
       {SIMPLE_PERF_RECORD_DEBUG, "debug"},
+      {SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE, "stack_delta_sample"},
   };
 
   auto it = record_type_names.find(record_type);
@@ -1646,8 +1647,7 @@ bool UnknownRecord::Parse(const perf_event_attr&, char* p, char* end) {
 
 void UnknownRecord::DumpData(size_t) const {}
 
-std::unique_ptr<Record> ReadRecordFromBuffer(const perf_event_attr& attr, uint32_t type, char* p,
-                                             char* end) {
+static std::unique_ptr<Record> CreateEmptyRecord(uint32_t type) {
   std::unique_ptr<Record> r;
   switch (type) {
     case PERF_RECORD_MMAP:
@@ -1717,6 +1717,12 @@ std::unique_ptr<Record> ReadRecordFromBuffer(const perf_event_attr& attr, uint32
       r.reset(new UnknownRecord);
       break;
   }
+  return r;
+}
+
+std::unique_ptr<Record> ReadRecordFromBuffer(const perf_event_attr& attr, uint32_t type, char* p,
+                                             char* end) {
+  std::unique_ptr<Record> r = CreateEmptyRecord(type);
   if (UNLIKELY(!r->Parse(attr, p, end))) {
     LOG(ERROR) << "failed to parse record " << RecordTypeToString(type);
     return nullptr;
@@ -1745,4 +1751,31 @@ std::unique_ptr<Record> ReadRecordFromBuffer(const perf_event_attr& attr, char*
   return ReadRecordFromBuffer(attr, header->type, p, end);
 }
 
+std::unique_ptr<Record> CopyRecord(const perf_event_attr& attr, const Record& record) {
+  std::unique_ptr<char[]> binary(new char[record.size()]);
+  memcpy(binary.get(), record.Binary(), record.size());
+  std::unique_ptr<Record> r =
+      ReadRecordFromBuffer(attr, record.type(), binary.get(), binary.get() + record.size());
+  if (r) {
+    binary.release();
+    r->OwnBinary();
+  }
+  return r;
+}
+
+Record* InPlaceRecordParser::Parse(const perf_event_attr& attr, uint32_t type, char* p,
+                                   char* end) {
+  std::unique_ptr<Record>& r = records_[type];
+  // A record owning its binary has been modified by the previous user, so don't reuse it.
+  if (!r || r->OwnsBinary()) {
+    r = CreateEmptyRecord(type);
+  }
+  if (UNLIKELY(!r->Parse(attr, p, end))) {
+    LOG(ERROR) << "failed to parse record " << RecordTypeToString(type);
+    r.reset();
+    return nullptr;
+  }
+  return r.get();
+}
+
 }  // namespace simpleperf
@@ -23,6 +23,7 @@
 #include <memory>
 #include <queue>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -58,6 +59,8 @@ enum user_record_type {
   SIMPLE_PERF_RECORD_UNWINDING_RESULT,
   SIMPLE_PERF_RECORD_TRACING_DATA,
   SIMPLE_PERF_RECORD_DEBUG,
+  // A sample record with user stack data stored as a delta, see StackDelta.h.
+  SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE,
 };
 
 // perf_event_header uses u16 to store record size. However, that is not
@@ -242,6 +245,7 @@ struct Record {
   virtual bool Parse(const perf_event_attr& attr, char* p, char* end) = 0;
 
   void OwnBinary() { own_binary_ = true; }
+  bool OwnsBinary() const { return own_binary_; }
 
   uint32_t type() const { return header.type; }
 
@@ -714,6 +718,21 @@ std::vector<std::unique_ptr<Record>> ReadRecordsFromBuffer(const perf_event_attr
 // own the buffer.
 std::unique_ptr<Record> ReadRecordFromBuffer(const perf_event_attr& attr, char* p, char* end);
 
+// Copy a record into a new record owning its binary. It is used to keep records only valid
+// temporarily, like those returned by InPlaceRecordParser.
+std::unique_ptr<Record> CopyRecord(const perf_event_attr& attr, const Record& record);
+
+// InPlaceRecordParser parses records in buffers without allocating a Record for each of them.
+// It reuses one Record object per record type. So a returned record doesn't own the buffer, and
+// is only valid until the next call to Parse().
+class InPlaceRecordParser {
+ public:
+  Record* Parse(const perf_event_attr& attr, uint32_t type, char* p, char* end);
+
+ private:
+  std::unordered_map<uint32_t, std::unique_ptr<Record>> records_;
+};
+
 }  // namespace simpleperf
 
 #endif  // SIMPLE_PERF_RECORD_H_
@@ -19,9 +19,12 @@
 
 #include <stdio.h>
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -29,11 +32,14 @@
 
 #include <android-base/macros.h>
 
+#include "FlightRecorder.h"
 #include "ZstdUtil.h"
 #include "dso.h"
 #include "event_attr.h"
 #include "event_type.h"
 #include "perf_event.h"
+#include "StackDelta.h"
+#include "ThreadPool.h"
 #include "record.h"
 #include "record_file_format.h"
 #include "thread_tree.h"
@@ -83,6 +89,17 @@ class RecordFileWriter {
   ~RecordFileWriter();
 
   bool SetCompressionLevel(size_t compression_level);
+  // Compress records in the data section as independent frames in thread_count background
+  // threads, and write a compressed frame index feature section. It should be called after
+  // SetCompressionLevel().
+  bool SetCompressionThreads(size_t thread_count);
+  // Store user stack data of samples as deltas against previous samples of the same thread.
+  void EnableStackDeltaEncoding();
+  // Keep records in a FlightRecorder instead of writing them, so only records in the last
+  // max_duration_in_ns and max_size are written in FinishWritingDataSection().
+  void EnableFlightRecorder(const EventAttrIds& attr_ids, uint64_t max_duration_in_ns,
+                            uint64_t max_size);
+  const FlightRecorder* GetFlightRecorder() const { return flight_recorder_.get(); }
   bool WriteAttrSection(const EventAttrIds& attr_ids);
   bool WriteRecord(const Record& record);
   bool FinishWritingDataSection();
@@ -107,7 +124,8 @@ class RecordFileWriter {
   bool EndWriteFeatures();
 
   bool Close();
-  Compressor* GetCompressor() { return compressor_.get(); }
+  // Return false if not compressing.
+  bool GetCompressionStat(uint64_t* input_size, uint64_t* output_size) const;
 
  private:
   void GetHitModulesInBuffer(const char* p, const char* end,
@@ -118,10 +136,18 @@ class RecordFileWriter {
   // If flush=true, the previous data can be decompressed without any following data.
   bool WriteCompressorOutput(bool flush, bool data_section);
   bool WriteCompressRecord(const char* data, size_t size, bool data_section);
+  bool AddCompressedFrameTask();
+  // Write compressed frames in order, until there are at most max_pending_frames frames left.
+  bool WriteCompressedFrames(size_t max_pending_frames);
+  bool WriteCompressedFrameIndexFeature();
+  void AddTimeIndexEntry(uint64_t data_offset);
+  void AddTimeToIndex(uint64_t min_time, uint64_t max_time);
+  bool WriteTimeIndexFeature();
   bool WriteData(const void* buf, size_t len);
   bool Write(const void* buf, size_t len);
-  bool ReadFromDecompressor(Decompressor& decompressor,
+  bool ReadFromDecompressor(Decompressor& decompressor, StackDeltaDecoder& stack_delta_decoder,
                             const std::function<void(const Record*)>& callback);
+  std::unique_ptr<Record> ParseRecordForRead(char* p, StackDeltaDecoder& stack_delta_decoder);
   bool Read(void* buf, size_t len);
   bool GetFilePos(uint64_t* file_pos);
   bool WriteStringWithLength(const std::string& s);
@@ -143,8 +169,50 @@ class RecordFileWriter {
   size_t feature_count_;
 
   std::unique_ptr<Compressor> compressor_;
+  size_t compression_level_ = 0;
   std::vector<uint64_t> auxtrace_record_offsets_;
 
+  // Used when compressing the data section in frames.
+  struct CompressedFrameTask {
+    std::vector<char> input;
+    uint64_t min_time;
+    uint64_t max_time;
+    // Whether the frame starts a time index entry.
+    bool starts_time_index_entry;
+    std::string output;
+    bool finished = false;
+    bool result = false;
+  };
+  std::vector<std::unique_ptr<Compressor>> frame_compressors_;
+  std::vector<char> frame_buf_;
+  // Timestamp range of records in frame_buf_.
+  uint64_t frame_min_time_ = UINT64_MAX;
+  uint64_t frame_max_time_ = 0;
+  // Whether records in frame_buf_ start a time index entry, and the input size of frames since
+  // the last time index entry.
+  bool frame_starts_time_index_entry_ = true;
+  uint64_t frame_input_size_since_time_index_entry_ = 0;
+  std::deque<std::unique_ptr<CompressedFrameTask>> frame_tasks_;
+  std::mutex frame_mutex_;
+  std::condition_variable frame_cond_;
+  std::vector<PerfFileFormat::CompressedFrame> compressed_frames_;
+  uint64_t frame_input_size_ = 0;
+  uint64_t frame_output_size_ = 0;
+  // Declared after the fields used by its tasks, so it is destroyed first.
+  std::unique_ptr<ThreadPool> compression_thread_pool_;
+
+  // Used to build the time index feature. Until the feature is written, min_time_after of an
+  // entry is the min timestamp of records from the entry to the next entry.
+  std::vector<PerfFileFormat::TimeIndexEntry> time_index_;
+  // Max timestamp of records added to time_index_.
+  uint64_t time_index_max_time_ = 0;
+
+  std::unique_ptr<StackDeltaEncoder> stack_delta_encoder_;
+  // Hold encoded records when writing, and decoded records when reading.
+  std::vector<char> stack_delta_buf_;
+
+  std::unique_ptr<FlightRecorder> flight_recorder_;
+
   DISALLOW_COPY_AND_ASSIGN(RecordFileWriter);
 };
 
@@ -184,6 +252,23 @@ class RecordFileReader {
   // Otherwise return false.
   bool ReadRecord(std::unique_ptr<Record>& record);
 
+  // ReadDataSectionInPlace() and ReadRecordInPlace() are faster versions of ReadDataSection() and
+  // ReadRecord(). They don't allocate or copy records. Instead, a record is parsed in place: in
+  // the memory mapped data section if possible, or in a reused buffer if the data section is
+  // compressed or can't be mapped. A Record object is also reused for all records of the same
+  // type. So a record is only valid until reading the next record. Use CopyRecord() to keep it.
+  // Records can be modified in place, which doesn't change the record file.
+  // Don't mix them with ReadDataSection() and ReadRecord() on the same reader.
+  bool ReadDataSectionInPlace(const std::function<bool(Record*)>& callback);
+  bool ReadRecordInPlace(Record*& record);
+
+  // Use the time index feature to avoid reading records out of [start_time, end_time) in the data
+  // section: sample records certainly before start_time are skipped without parsing, and reading
+  // stops when all left records are after end_time. Other records before start_time are still
+  // read, since they are needed to build thread and map info.
+  // It should be called before reading the data section. Return false if there is no time index.
+  bool SetTimeRange(uint64_t start_time, uint64_t end_time);
+
   size_t GetAttrIndexOfRecord(const Record* record);
   std::optional<size_t> GetAttrIndexByEventId(uint64_t event_id);
 
@@ -204,6 +289,14 @@ class RecordFileReader {
   std::string GetClockId();
   std::optional<DebugUnwindFeature> ReadDebugUnwindFeature();
   bool ReadInitMapFeature(const std::function<bool(std::unique_ptr<Record>)>& callback);
+  std::vector<PerfFileFormat::CompressedFrame> ReadCompressedFrameIndexFeature();
+  std::vector<PerfFileFormat::TimeIndexEntry> ReadTimeIndexFeature();
+  // Decompress a frame in the compressed frame index into the binary of its records. It doesn't
+  // use the read position of the reader, so it can be called in multiple threads.
+  // Records in a frame can only be parsed on their own when the file doesn't have
+  // SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE records, or when the frame starts at the data_offset of
+  // a time index entry. Otherwise, stack deltas refer to samples in previous frames.
+  bool DecompressFrame(const PerfFileFormat::CompressedFrame& frame, std::vector<char>& data);
 
   bool LoadBuildIdAndFileFeatures(ThreadTree& thread_tree);
 
@@ -252,6 +345,12 @@ class RecordFileReader {
   void UseRecordingEnvironment();
   std::unique_ptr<Record> ReadRecord(ReadPos& pos);
   std::unique_ptr<char[]> ReadRecordWithDecompression(ReadPos& pos);
+  const perf_event_attr& GetAttrOfRecordBinary(const RecordHeader& header, const char* p);
+  bool MapDataSection();
+  void UnmapDataSection();
+  bool ReadRecordBinaryInPlace(ReadPos& pos, char*& p);
+  bool DecodeStackDeltaRecord(RecordHeader& header, char*& p);
+  bool IsSkippedSample(const ReadPos& pos, uint32_t type, uint64_t data_end);
   bool Read(void* buf, size_t len);
   void ProcessEventIdRecord(const EventIdRecord& r);
   bool BuildAuxDataLocation();
@@ -272,6 +371,10 @@ class RecordFileReader {
   size_t event_id_reverse_pos_in_non_sample_records_;
 
   ReadPos read_record_pos_;
+  // Set by SetTimeRange(). Sample records in [0, skip_samples_end_) of the data section are
+  // skipped, and records after data_read_end_ are not read.
+  uint64_t skip_samples_end_ = 0;
+  uint64_t data_read_end_ = UINT64_MAX;
 
   std::unordered_map<std::string, std::string> meta_info_;
   std::unique_ptr<ScopedCurrentArch> scoped_arch_;
@@ -289,6 +392,20 @@ class RecordFileReader {
   };
   std::unique_ptr<AuxDataDecompressor> auxdata_decompressor_;
 
+  // Used by reading records in place.
+  std::unique_ptr<InPlaceRecordParser> record_parser_;
+  void* mapped_addr_ = nullptr;
+  size_t mapped_size_ = 0;
+  // Start of the data section in the mapped file, or nullptr if the data section isn't mapped.
+  char* mapped_data_ = nullptr;
+  // Hold records not parsed in the mapped file.
+  std::vector<char> record_buf_;
+  std::vector<char> split_record_buf_;
+
+  // Used by reading SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE records.
+  std::unique_ptr<StackDeltaDecoder> stack_delta_decoder_;
+  std::vector<char> stack_delta_buf_;
+
   DISALLOW_COPY_AND_ASSIGN(RecordFileReader);
 };
 
@@ -88,6 +88,21 @@ etm_branch_list feature section:
 
 init_map feature section:
   Record record[];  // MmapRecord, Mmap2Record or CommRecord
+
+compressed_frame_index feature section:
+  CompressedFrame frames[];
+
+  The data section is compressed in independent zstd frames. Each frame contains whole records,
+  and is stored in one or more PERF_RECORD_COMPRESSED records. So frames can be decompressed in
+  parallel, or from the middle of the data section. But SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE
+  records may refer to samples in previous frames, unless the frame starts at a time index entry.
+
+time_index feature section:
+  TimeIndexEntry entries[];  // sorted by data_offset
+
+  Entries are added at fixed intervals of the data section, at record boundaries or compressed
+  frame boundaries. They are used to skip records out of a time range. Records generated by
+  simpleperf without a timestamp are treated as having timestamp 0.
 */
 
 namespace simpleperf {
@@ -124,6 +139,8 @@ enum {
   FEAT_FILE2,
   FEAT_ETM_BRANCH_LIST,
   FEAT_INIT_MAP,
+  FEAT_COMPRESSED_FRAME_INDEX,
+  FEAT_TIME_INDEX,
   FEAT_MAX_NUM = 256,
 };
 
@@ -152,6 +169,18 @@ struct FileAttr {
   SectionDesc ids;
 };
 
+struct CompressedFrame {
+  uint64_t data_offset;        // offset of the first COMPRESSED record in the data section
+  uint64_t data_size;          // size of the COMPRESSED records of the frame
+  uint64_t decompressed_size;  // size of records in the frame
+};
+
+struct TimeIndexEntry {
+  uint64_t data_offset;      // offset in the data section
+  uint64_t max_time_before;  // max timestamp of records before data_offset
+  uint64_t min_time_after;   // min timestamp of records at or after data_offset
+};
+
 }  // namespace PerfFileFormat
 }  // namespace simpleperf
 
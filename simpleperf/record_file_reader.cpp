@@ -18,11 +18,16 @@
 
 #include <fcntl.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 
+#include <algorithm>
 #include <set>
 #include <string_view>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/scopeguard.h>
 
@@ -63,6 +68,8 @@ static const std::map<int, std::string> feature_name_map = {
     {FEAT_FILE2, "file2"},
     {FEAT_ETM_BRANCH_LIST, "etm_branch_list"},
     {FEAT_INIT_MAP, "init_map"},
+    {FEAT_COMPRESSED_FRAME_INDEX, "compressed_frame_index"},
+    {FEAT_TIME_INDEX, "time_index"},
 };
 
 std::string GetFeatureName(int feature_id) {
@@ -113,6 +120,7 @@ RecordFileReader::~RecordFileReader() {
 
 bool RecordFileReader::Close() {
   bool result = true;
+  UnmapDataSection();
   if (fclose(record_fp_) != 0) {
     PLOG(ERROR) << "failed to close record file '" << filename_ << "'";
     result = false;
@@ -285,7 +293,7 @@ bool RecordFileReader::ReadRecord(std::unique_ptr<Record>& record) {
       PLOG(ERROR) << "fseek() failed";
       return false;
     }
-    read_record_pos_.end = header_.data.size;
+    read_record_pos_.end = std::min(header_.data.size, data_read_end_);
   }
   record = nullptr;
   if (read_record_pos_.pos < read_record_pos_.end ||
@@ -333,7 +341,39 @@ std::unique_ptr<Record> RecordFileReader::ReadRecord(ReadPos& pos) {
     p.reset(new char[buf.size()]);
     memcpy(p.get(), buf.data(), buf.size());
   }
+  if (header.type == SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE) {
+    char* sample = p.get();
+    if (!DecodeStackDeltaRecord(header, sample)) {
+      return nullptr;
+    }
+    p.reset(new char[header.size]);
+    memcpy(p.get(), sample, header.size);
+  }
 
+  const perf_event_attr& attr = GetAttrOfRecordBinary(header, p.get());
+  auto r = ReadRecordFromBuffer(attr, header.type, p.get(), p.get() + header.size);
+  if (!r) {
+    return nullptr;
+  }
+  p.release();
+  r->OwnBinary();
+  if (r->type() == PERF_RECORD_EXIT && stack_delta_decoder_) {
+    stack_delta_decoder_->RemoveThread(static_cast<ExitRecord*>(r.get())->data->tid);
+  }
+  if (r->type() == PERF_RECORD_AUXTRACE) {
+    auto auxtrace = static_cast<AuxTraceRecord*>(r.get());
+    auxtrace->location.file_offset = header_.data.offset + read_record_pos_.pos;
+    read_record_pos_.pos += auxtrace->data->aux_size;
+    if (fseek(record_fp_, auxtrace->data->aux_size, SEEK_CUR) != 0) {
+      PLOG(ERROR) << "fseek() failed";
+      return nullptr;
+    }
+  }
+  return r;
+}
+
+const perf_event_attr& RecordFileReader::GetAttrOfRecordBinary(const RecordHeader& header,
+                                                                const char* p) {
   const perf_event_attr* attr = &event_attrs_[0].attr;
   if (event_attrs_.size() > 1 && header.type < PERF_RECORD_USER_DEFINED_TYPE_START) {
     bool has_event_id = false;
@@ -341,13 +381,13 @@ std::unique_ptr<Record> RecordFileReader::ReadRecord(ReadPos& pos) {
     if (header.type == PERF_RECORD_SAMPLE) {
       if (header.size > event_id_pos_in_sample_records_ + sizeof(uint64_t)) {
         has_event_id = true;
-        event_id = *reinterpret_cast<uint64_t*>(p.get() + event_id_pos_in_sample_records_);
+        event_id = *reinterpret_cast<const uint64_t*>(p + event_id_pos_in_sample_records_);
       }
     } else {
       if (header.size > event_id_reverse_pos_in_non_sample_records_) {
         has_event_id = true;
-        event_id = *reinterpret_cast<uint64_t*>(p.get() + header.size -
-                                                event_id_reverse_pos_in_non_sample_records_);
+        event_id = *reinterpret_cast<const uint64_t*>(p + header.size -
+                                                      event_id_reverse_pos_in_non_sample_records_);
       }
     }
     if (has_event_id) {
@@ -357,22 +397,7 @@ std::unique_ptr<Record> RecordFileReader::ReadRecord(ReadPos& pos) {
       }
     }
   }
-  auto r = ReadRecordFromBuffer(*attr, header.type, p.get(), p.get() + header.size);
-  if (!r) {
-    return nullptr;
-  }
-  p.release();
-  r->OwnBinary();
-  if (r->type() == PERF_RECORD_AUXTRACE) {
-    auto auxtrace = static_cast<AuxTraceRecord*>(r.get());
-    auxtrace->location.file_offset = header_.data.offset + read_record_pos_.pos;
-    read_record_pos_.pos += auxtrace->data->aux_size;
-    if (fseek(record_fp_, auxtrace->data->aux_size, SEEK_CUR) != 0) {
-      PLOG(ERROR) << "fseek() failed";
-      return nullptr;
-    }
-  }
-  return r;
+  return *attr;
 }
 
 std::unique_ptr<char[]> RecordFileReader::ReadRecordWithDecompression(ReadPos& pos) {
@@ -382,6 +407,10 @@ std::unique_ptr<char[]> RecordFileReader::ReadRecordWithDecompression(ReadPos& p
       if (output.size() >= sizeof(perf_event_header)) {
         auto header = reinterpret_cast<const perf_event_header*>(output.data());
         if (header->size <= output.size()) {
+          if (IsSkippedSample(pos, header->type, pos.pos)) {
+            decompressor_->ConsumeOutputData(header->size);
+            continue;
+          }
           std::unique_ptr<char[]> p(new char[header->size]);
           memcpy(p.get(), output.data(), header->size);
           decompressor_->ConsumeOutputData(header->size);
@@ -396,6 +425,15 @@ std::unique_ptr<char[]> RecordFileReader::ReadRecordWithDecompression(ReadPos& p
     if (!Read(&header, sizeof(header))) {
       return nullptr;
     }
+    if (IsSkippedSample(pos, header.type, pos.pos + header.size)) {
+      if (header.size < sizeof(header) ||
+          fseek(record_fp_, header.size - sizeof(header), SEEK_CUR) != 0) {
+        LOG(ERROR) << "failed to skip record in " << filename_;
+        return nullptr;
+      }
+      pos.pos += header.size;
+      continue;
+    }
     pos.pos += header.size;
     if (header.type == PERF_RECORD_COMPRESSED) {
       if (!decompressor_) {
@@ -423,6 +461,260 @@ std::unique_ptr<char[]> RecordFileReader::ReadRecordWithDecompression(ReadPos& p
   return nullptr;
 }
 
+bool RecordFileReader::ReadDataSectionInPlace(const std::function<bool(Record*)>& callback) {
+  Record* record;
+  while (ReadRecordInPlace(record)) {
+    if (record == nullptr) {
+      return true;
+    }
+    if (!callback(record)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool RecordFileReader::ReadRecordInPlace(Record*& record) {
+  record = nullptr;
+  if (!record_parser_) {
+    record_parser_.reset(new InPlaceRecordParser);
+    if (!MapDataSection()) {
+      // Fall back to reading records through record_fp_.
+      if (fseek(record_fp_, header_.data.offset, SEEK_SET) != 0) {
+        PLOG(ERROR) << "fseek() failed";
+        return false;
+      }
+    }
+    read_record_pos_.end = std::min(header_.data.size, data_read_end_);
+  }
+  char* p;
+  if (!ReadRecordBinaryInPlace(read_record_pos_, p)) {
+    return false;
+  }
+  if (p == nullptr) {
+    return true;
+  }
+  RecordHeader header;
+  if (!header.Parse(p)) {
+    return false;
+  }
+  if (header.type == SIMPLE_PERF_RECORD_SPLIT) {
+    // Read until meeting a RECORD_SPLIT_END record.
+    split_record_buf_.clear();
+    while (header.type == SIMPLE_PERF_RECORD_SPLIT) {
+      split_record_buf_.insert(split_record_buf_.end(), p + Record::header_size(), p + header.size);
+      if (!ReadRecordBinaryInPlace(read_record_pos_, p) || p == nullptr || !header.Parse(p)) {
+        LOG(ERROR) << "SPLIT records are not followed by a SPLIT_END record.";
+        return false;
+      }
+    }
+    if (header.type != SIMPLE_PERF_RECORD_SPLIT_END) {
+      LOG(ERROR) << "SPLIT records are not followed by a SPLIT_END record.";
+      return false;
+    }
+    p = split_record_buf_.data();
+    if (split_record_buf_.size() < Record::header_size() || !header.Parse(p) ||
+        header.size != split_record_buf_.size()) {
+      LOG(ERROR) << "invalid record merged from SPLIT records";
+      return false;
+    }
+  }
+  if (header.type == SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE &&
+      !DecodeStackDeltaRecord(header, p)) {
+    return false;
+  }
+  record = record_parser_->Parse(GetAttrOfRecordBinary(header, p), header.type, p, p + header.size);
+  if (record == nullptr) {
+    return false;
+  }
+  if (record->type() == PERF_RECORD_AUXTRACE) {
+    // Aux data follows the AUXTRACE record. It is read by ReadAuxData() when needed.
+    auto auxtrace = static_cast<AuxTraceRecord*>(record);
+    uint64_t aux_size = auxtrace->data->aux_size;
+    auxtrace->location.file_offset = header_.data.offset + read_record_pos_.pos;
+    if (aux_size > read_record_pos_.end - read_record_pos_.pos) {
+      LOG(ERROR) << "invalid AUXTRACE record in " << filename_;
+      record = nullptr;
+      return false;
+    }
+    read_record_pos_.pos += aux_size;
+    if (mapped_data_ == nullptr && fseek(record_fp_, aux_size, SEEK_CUR) != 0) {
+      PLOG(ERROR) << "fseek() failed";
+      record = nullptr;
+      return false;
+    }
+  } else if (record->type() == SIMPLE_PERF_RECORD_EVENT_ID) {
+    ProcessEventIdRecord(*static_cast<EventIdRecord*>(record));
+  } else if (record->type() == PERF_RECORD_EXIT && stack_delta_decoder_) {
+    stack_delta_decoder_->RemoveThread(static_cast<ExitRecord*>(record)->data->tid);
+  }
+  return true;
+}
+
+// Return true if a record is a sample before the time range set by SetTimeRange(). [data_end] is
+// the end position of the data containing the record in the data section.
+bool RecordFileReader::IsSkippedSample(const ReadPos& pos, uint32_t type, uint64_t data_end) {
+  return &pos == &read_record_pos_ && data_end <= skip_samples_end_ &&
+         (type == PERF_RECORD_SAMPLE || type == SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE);
+}
+
+bool RecordFileReader::SetTimeRange(uint64_t start_time, uint64_t end_time) {
+  std::vector<TimeIndexEntry> entries = ReadTimeIndexFeature();
+  if (entries.empty()) {
+    return false;
+  }
+  for (const TimeIndexEntry& entry : entries) {
+    if (entry.max_time_before < start_time) {
+      skip_samples_end_ = entry.data_offset;
+    }
+    if (entry.min_time_after >= end_time) {
+      data_read_end_ = entry.data_offset;
+      break;
+    }
+  }
+  return true;
+}
+
+// Decode a stack delta sample record in [p]. On success, [p] and [header] refer to the decoded
+// sample record, which is valid until the next call.
+bool RecordFileReader::DecodeStackDeltaRecord(RecordHeader& header, char*& p) {
+  if (!stack_delta_decoder_) {
+    stack_delta_decoder_.reset(new StackDeltaDecoder);
+  }
+  if (!stack_delta_decoder_->Decode(p, header.size, stack_delta_buf_)) {
+    return false;
+  }
+  p = stack_delta_buf_.data();
+  return header.Parse(p);
+}
+
+// Set [p] to the binary of the next record, or nullptr if there are no more records.
+bool RecordFileReader::ReadRecordBinaryInPlace(ReadPos& pos, char*& p) {
+  p = nullptr;
+  while (true) {
+    if (decompressor_) {
+      std::string_view output = decompressor_->GetOutputData();
+      if (output.size() >= sizeof(perf_event_header)) {
+        auto header = reinterpret_cast<const perf_event_header*>(output.data());
+        if (header->size <= output.size()) {
+          if (IsSkippedSample(pos, header->type, pos.pos)) {
+            decompressor_->ConsumeOutputData(header->size);
+            continue;
+          }
+          // Copy the record because the output buffer can be changed by the decompressor.
+          record_buf_.assign(output.data(), output.data() + header->size);
+          decompressor_->ConsumeOutputData(header->size);
+          p = record_buf_.data();
+          return true;
+        }
+      }
+    }
+    if (pos.pos == pos.end) {
+      return true;
+    }
+    char* data;
+    perf_event_header header;
+    if (mapped_data_ != nullptr) {
+      data = mapped_data_ + pos.pos;
+      if (pos.end - pos.pos < sizeof(header)) {
+        LOG(ERROR) << "invalid record in " << filename_;
+        return false;
+      }
+      memcpy(&header, data, sizeof(header));
+      if (header.size < sizeof(header) || header.size > pos.end - pos.pos) {
+        LOG(ERROR) << "invalid record in " << filename_;
+        return false;
+      }
+      if (IsSkippedSample(pos, header.type, pos.pos + header.size)) {
+        pos.pos += header.size;
+        continue;
+      }
+      if (reinterpret_cast<uintptr_t>(data) % sizeof(uint64_t) != 0) {
+        // Records are parsed as arrays of uint64_t. So copy misaligned records.
+        record_buf_.assign(data, data + header.size);
+        data = record_buf_.data();
+      }
+    } else {
+      if (!Read(&header, sizeof(header))) {
+        return false;
+      }
+      if (header.size < sizeof(header)) {
+        LOG(ERROR) << "invalid record in " << filename_;
+        return false;
+      }
+      if (IsSkippedSample(pos, header.type, pos.pos + header.size)) {
+        if (fseek(record_fp_, header.size - sizeof(header), SEEK_CUR) != 0) {
+          PLOG(ERROR) << "fseek() failed";
+          return false;
+        }
+        pos.pos += header.size;
+        continue;
+      }
+      record_buf_.resize(header.size);
+      memcpy(record_buf_.data(), &header, sizeof(header));
+      if (!Read(record_buf_.data() + sizeof(header), header.size - sizeof(header))) {
+        return false;
+      }
+      data = record_buf_.data();
+    }
+    pos.pos += header.size;
+    if (header.type == PERF_RECORD_COMPRESSED) {
+      if (!decompressor_) {
+        decompressor_ = CreateZstdDecompressor();
+        if (!decompressor_) {
+          return false;
+        }
+      }
+      if (!decompressor_->AddInputData(data + sizeof(header), header.size - sizeof(header))) {
+        return false;
+      }
+    } else {
+      p = data;
+      return true;
+    }
+  }
+}
+
+bool RecordFileReader::MapDataSection() {
+#if defined(_WIN32)
+  return false;
+#else
+  if (header_.data.size == 0) {
+    return false;
+  }
+  uint64_t page_size = GetPageSize();
+  uint64_t map_offset = header_.data.offset & ~(page_size - 1);
+  uint64_t map_size = header_.data.offset + header_.data.size - map_offset;
+  if (map_size > std::numeric_limits<size_t>::max()) {
+    return false;
+  }
+  // Use a private writable mapping, so records can be modified in place like records read by
+  // ReadRecord(), without changing the record file.
+  void* addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(record_fp_),
+                    map_offset);
+  if (addr == MAP_FAILED) {
+    PLOG(DEBUG) << "failed to map the data section of " << filename_;
+    return false;
+  }
+  madvise(addr, map_size, MADV_SEQUENTIAL);
+  mapped_addr_ = addr;
+  mapped_size_ = map_size;
+  mapped_data_ = static_cast<char*>(addr) + (header_.data.offset - map_offset);
+  return true;
+#endif
+}
+
+void RecordFileReader::UnmapDataSection() {
+#if !defined(_WIN32)
+  if (mapped_addr_ != nullptr) {
+    munmap(mapped_addr_, mapped_size_);
+    mapped_addr_ = nullptr;
+    mapped_size_ = 0;
+    mapped_data_ = nullptr;
+  }
+#endif
+}
+
 bool RecordFileReader::Read(void* buf, size_t len) {
   if (len != 0 && fread(buf, len, 1, record_fp_) != 1) {
     PLOG(ERROR) << "failed to read file " << filename_;
@@ -805,6 +1097,81 @@ bool RecordFileReader::ReadInitMapFeature(
   return true;
 }
 
+std::vector<CompressedFrame> RecordFileReader::ReadCompressedFrameIndexFeature() {
+  std::vector<char> buf;
+  if (!ReadFeatureSection(FEAT_COMPRESSED_FRAME_INDEX, &buf) ||
+      buf.size() % sizeof(CompressedFrame) != 0) {
+    return {};
+  }
+  std::vector<CompressedFrame> frames(buf.size() / sizeof(CompressedFrame));
+  memcpy(frames.data(), buf.data(), buf.size());
+  for (const CompressedFrame& frame : frames) {
+    if (frame.data_offset > header_.data.size ||
+        frame.data_size > header_.data.size - frame.data_offset) {
+      LOG(ERROR) << "invalid compressed frame index in " << filename_;
+      return {};
+    }
+  }
+  return frames;
+}
+
+std::vector<TimeIndexEntry> RecordFileReader::ReadTimeIndexFeature() {
+  std::vector<char> buf;
+  if (!ReadFeatureSection(FEAT_TIME_INDEX, &buf) || buf.size() % sizeof(TimeIndexEntry) != 0) {
+    return {};
+  }
+  std::vector<TimeIndexEntry> entries(buf.size() / sizeof(TimeIndexEntry));
+  memcpy(entries.data(), buf.data(), buf.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (entries[i].data_offset > header_.data.size ||
+        (i > 0 && entries[i].data_offset < entries[i - 1].data_offset)) {
+      LOG(ERROR) << "invalid time index in " << filename_;
+      return {};
+    }
+  }
+  return entries;
+}
+
+bool RecordFileReader::DecompressFrame(const CompressedFrame& frame, std::vector<char>& data) {
+  std::vector<char> buf(frame.data_size);
+  if (!android::base::ReadFullyAtOffset(fileno(record_fp_), buf.data(), buf.size(),
+                                        header_.data.offset + frame.data_offset)) {
+    PLOG(ERROR) << "failed to read compressed frame in " << filename_;
+    return false;
+  }
+  std::unique_ptr<Decompressor> decompressor = CreateZstdDecompressor();
+  if (!decompressor) {
+    return false;
+  }
+  data.clear();
+  data.reserve(frame.decompressed_size);
+  const char* p = buf.data();
+  const char* end = buf.data() + buf.size();
+  while (p < end) {
+    perf_event_header header;
+    if (end - p < static_cast<ptrdiff_t>(sizeof(header))) {
+      break;
+    }
+    memcpy(&header, p, sizeof(header));
+    if (header.type != PERF_RECORD_COMPRESSED || header.size < sizeof(header) ||
+        header.size > end - p) {
+      break;
+    }
+    if (!decompressor->AddInputData(p + sizeof(header), header.size - sizeof(header))) {
+      return false;
+    }
+    std::string_view output = decompressor->GetOutputData();
+    data.insert(data.end(), output.begin(), output.end());
+    decompressor->ConsumeOutputData(output.size());
+    p += header.size;
+  }
+  if (p != end || data.size() != frame.decompressed_size) {
+    LOG(ERROR) << "invalid compressed frame in " << filename_;
+    return false;
+  }
+  return true;
+}
+
 bool RecordFileReader::LoadBuildIdAndFileFeatures(ThreadTree& thread_tree) {
   std::vector<BuildIdRecord> records = ReadBuildIdFeature();
   std::vector<std::pair<std::string, BuildId>> build_ids;
@@ -869,7 +1236,13 @@ bool RecordFileReader::ReadAuxData(uint32_t cpu, uint64_t aux_offset, size_t siz
   if (buf.size() < size) {
     buf.resize(size);
   }
-  if (!ReadAtOffset(aux_offset - location->aux_offset + location->file_offset, buf.data(), size)) {
+  uint64_t file_offset = aux_offset - location->aux_offset + location->file_offset;
+  if (mapped_data_ != nullptr && file_offset >= header_.data.offset &&
+      file_offset - header_.data.offset + size <= header_.data.size) {
+    memcpy(buf.data(), mapped_data_ + (file_offset - header_.data.offset), size);
+    return true;
+  }
+  if (!ReadAtOffset(file_offset, buf.data(), size)) {
     error = true;
     return false;
   }
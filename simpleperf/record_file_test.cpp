@@ -19,6 +19,7 @@
 #include <string.h>
 
 #include <memory>
+#include <set>
 #include <vector>
 
 #include <android-base/file.h>
@@ -28,6 +29,7 @@
 #include "event_type.h"
 #include "record.h"
 #include "record_file.h"
+#include "ThreadPool.h"
 #include "utils.h"
 
 #include "record_equal_test.h"
@@ -342,3 +344,292 @@ TEST_F(RecordFileTest, compression) {
   }
   ASSERT_TRUE(reader->Close());
 }
+
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordFileTest, compression_in_frames) {
+  std::unique_ptr<RecordFileWriter> writer = RecordFileWriter::CreateInstance(tmpfile_.path);
+  ASSERT_TRUE(writer != nullptr);
+  ASSERT_TRUE(writer->SetCompressionLevel(3));
+  ASSERT_TRUE(writer->SetCompressionThreads(2));
+  AddEventType("cpu-cycles");
+  ASSERT_TRUE(writer->WriteAttrSection(attr_ids_));
+  MmapRecord mmap_record(attr_ids_[0].attr, true, 1, 1, 0x1000, 0x2000, 0x3000,
+                         "mmap_record_example", attr_ids_[0].ids[0]);
+  CommRecord comm_record(attr_ids_[0].attr, 1, 2, "comm_record_example", attr_ids_[0].ids[0], 1000);
+  // Write enough records for several frames.
+  const size_t repeat_count = 20000;
+  for (size_t i = 0; i < repeat_count; i++) {
+    ASSERT_TRUE(writer->WriteRecord(mmap_record));
+    ASSERT_TRUE(writer->WriteRecord(comm_record));
+  }
+  ASSERT_TRUE(writer->FinishWritingDataSection());
+  ASSERT_TRUE(writer->Close());
+
+  // Read records sequentially.
+  std::unique_ptr<RecordFileReader> reader = RecordFileReader::CreateInstance(tmpfile_.path);
+  ASSERT_TRUE(reader != nullptr);
+  std::vector<std::unique_ptr<Record>> records = reader->DataSection();
+  ASSERT_EQ(repeat_count * 2, records.size());
+  for (size_t i = 0; i < repeat_count; i++) {
+    CheckRecordEqual(mmap_record, *records[i * 2]);
+    CheckRecordEqual(comm_record, *records[i * 2 + 1]);
+  }
+
+  // Decompress frames in parallel. Each frame contains whole records.
+  std::vector<CompressedFrame> frames = reader->ReadCompressedFrameIndexFeature();
+  ASSERT_GT(frames.size(), 1u);
+  std::vector<std::vector<char>> frame_data(frames.size());
+  std::vector<char> frame_results(frames.size(), 0);
+  {
+    ThreadPool thread_pool(2);
+    for (size_t i = 0; i < frames.size(); i++) {
+      thread_pool.AddTask([&, i](size_t) {
+        frame_results[i] = reader->DecompressFrame(frames[i], frame_data[i]);
+      });
+    }
+  }
+  size_t count = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    ASSERT_TRUE(frame_results[i]);
+    for (auto& r : ReadRecordsFromBuffer(attr_ids_[0].attr, frame_data[i].data(),
+                                         frame_data[i].size())) {
+      CheckRecordEqual(count % 2 == 0 ? static_cast<Record&>(mmap_record) : comm_record, *r);
+      count++;
+    }
+  }
+  ASSERT_EQ(count, repeat_count * 2);
+  ASSERT_TRUE(reader->Close());
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordFileTest, time_index) {
+  AddEventType("cpu-clock");
+  const perf_event_attr& attr = attr_ids_[0].attr;
+  ASSERT_TRUE(attr.sample_type & PERF_SAMPLE_TIME);
+  const uint64_t id = attr_ids_[0].ids[0];
+  const uint64_t sample_count = 100000;
+  const uint64_t start_time = 50000;
+  const uint64_t end_time = 60000;
+
+  for (size_t compression_threads : {0, 2}) {
+    std::unique_ptr<RecordFileWriter> writer = RecordFileWriter::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(writer != nullptr);
+    if (compression_threads != 0) {
+      ASSERT_TRUE(writer->SetCompressionLevel(1));
+      ASSERT_TRUE(writer->SetCompressionThreads(compression_threads));
+    }
+    ASSERT_TRUE(writer->WriteAttrSection(attr_ids_));
+    for (uint64_t time = 0; time < sample_count; time++) {
+      if (time % 1000 == 0) {
+        CommRecord comm(attr, 1, 1, "comm" + std::to_string(time), id, time);
+        ASSERT_TRUE(writer->WriteRecord(comm));
+      }
+      SampleRecord sample(attr, id, time, 1, 1, time, 0, 1, {}, {}, {}, 0);
+      ASSERT_TRUE(writer->WriteRecord(sample));
+    }
+    ASSERT_TRUE(writer->FinishWritingDataSection());
+    ASSERT_TRUE(writer->Close());
+
+    std::unique_ptr<RecordFileReader> reader = RecordFileReader::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(reader != nullptr);
+    ASSERT_GT(reader->ReadTimeIndexFeature().size(), 1u);
+    ASSERT_TRUE(reader->SetTimeRange(start_time, end_time));
+    size_t sample_read_count = 0;
+    std::set<uint64_t> sample_times;
+    size_t comm_count = 0;
+    ASSERT_TRUE(reader->ReadDataSectionInPlace([&](Record* r) {
+      if (r->type() == PERF_RECORD_SAMPLE) {
+        sample_read_count++;
+        sample_times.insert(r->Timestamp());
+      } else if (r->type() == PERF_RECORD_COMM) {
+        // Non-sample records before the time range are kept.
+        EXPECT_EQ(r->Timestamp(), comm_count * 1000);
+        comm_count++;
+      }
+      return true;
+    }));
+    for (uint64_t time = start_time; time < end_time; time++) {
+      ASSERT_EQ(sample_times.count(time), 1u);
+    }
+    ASSERT_GE(comm_count, end_time / 1000);
+    ASSERT_LT(sample_read_count, sample_count / 2);
+    ASSERT_TRUE(reader->Close());
+  }
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordFileTest, read_data_section_in_place) {
+  AddEventType("cpu-cycles");
+  for (size_t compression_level : {0, 3}) {
+    // Write to a record file.
+    std::unique_ptr<RecordFileWriter> writer = RecordFileWriter::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(writer != nullptr);
+    if (compression_level != 0) {
+      ASSERT_TRUE(writer->SetCompressionLevel(compression_level));
+    }
+    ASSERT_TRUE(writer->WriteAttrSection(attr_ids_));
+    MmapRecord mmap_record(attr_ids_[0].attr, true, 1, 1, 0x1000, 0x2000, 0x3000,
+                           "mmap_record_example", attr_ids_[0].ids[0]);
+    CommRecord comm_record(attr_ids_[0].attr, 1, 2, "comm_record_example", attr_ids_[0].ids[0],
+                           1000);
+    // A record bigger than 64K is split into SPLIT records.
+    std::vector<char> tracing_data(70000, 'a');
+    TracingDataRecord tracing_record(tracing_data);
+    const size_t repeat_count = 100;
+    for (size_t i = 0; i < repeat_count; i++) {
+      ASSERT_TRUE(writer->WriteRecord(mmap_record));
+      ASSERT_TRUE(writer->WriteRecord(comm_record));
+    }
+    ASSERT_TRUE(writer->WriteRecord(tracing_record));
+    ASSERT_TRUE(writer->FinishWritingDataSection());
+    ASSERT_TRUE(writer->Close());
+
+    // Read records in place.
+    std::unique_ptr<RecordFileReader> reader = RecordFileReader::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(reader != nullptr);
+    size_t count = 0;
+    auto callback = [&](Record* r) {
+      if (count < repeat_count * 2) {
+        CheckRecordEqual(count % 2 == 0 ? static_cast<Record&>(mmap_record) : comm_record, *r);
+      } else {
+        EXPECT_EQ(r->type(), tracing_record.type());
+        auto& tracing_r = *static_cast<TracingDataRecord*>(r);
+        EXPECT_EQ(tracing_r.data_size, tracing_data.size());
+        EXPECT_EQ(memcmp(tracing_r.data, tracing_data.data(), tracing_data.size()), 0);
+      }
+      count++;
+      return true;
+    };
+    ASSERT_TRUE(reader->ReadDataSectionInPlace(callback));
+    ASSERT_EQ(count, repeat_count * 2 + 1);
+    ASSERT_TRUE(reader->Close());
+  }
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordFileTest, stack_delta) {
+  AddEventType("cpu-clock");
+  perf_event_attr& attr = attr_ids_[0].attr;
+  attr.sample_type |= PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+  std::vector<std::unique_ptr<Record>> records;
+  std::vector<char> stack(4096, 'a');
+  for (size_t i = 0; i < 10; i++) {
+    stack[i] = static_cast<char>(i);
+    records.emplace_back(new SampleRecord(attr, attr_ids_[0].ids[0], 1, 2, 2, 3, 4, 5, {}, {},
+                                          stack, stack.size()));
+  }
+  // There is no constructor for ExitRecord. So build it from a ForkRecord.
+  ForkRecord fork_record(attr, 2, 2, 2, 2, attr_ids_[0].ids[0]);
+  std::vector<char> exit_binary(fork_record.Binary(), fork_record.Binary() + fork_record.size());
+  reinterpret_cast<perf_event_header*>(exit_binary.data())->type = PERF_RECORD_EXIT;
+  records.emplace_back(ReadRecordFromBuffer(attr, PERF_RECORD_EXIT, exit_binary.data(),
+                                            exit_binary.data() + exit_binary.size()));
+  ASSERT_TRUE(records.back());
+  records.emplace_back(
+      new SampleRecord(attr, attr_ids_[0].ids[0], 1, 2, 2, 3, 4, 5, {}, {}, stack, stack.size()));
+
+  for (size_t compression_level : {0, 3}) {
+    std::unique_ptr<RecordFileWriter> writer = RecordFileWriter::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(writer != nullptr);
+    if (compression_level != 0) {
+      ASSERT_TRUE(writer->SetCompressionLevel(compression_level));
+    }
+    writer->EnableStackDeltaEncoding();
+    ASSERT_TRUE(writer->WriteAttrSection(attr_ids_));
+    for (const auto& r : records) {
+      ASSERT_TRUE(writer->WriteRecord(*r));
+    }
+    ASSERT_TRUE(writer->FinishWritingDataSection());
+    size_t count = 0;
+    ASSERT_TRUE(writer->ReadDataSection([&](const Record* r) {
+      ASSERT_LT(count, records.size());
+      CheckRecordEqual(*records[count++], *r);
+    }));
+    ASSERT_EQ(count, records.size());
+    ASSERT_TRUE(writer->Close());
+
+    std::unique_ptr<RecordFileReader> reader = RecordFileReader::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(reader != nullptr);
+    std::vector<std::unique_ptr<Record>> read_records = reader->DataSection();
+    ASSERT_EQ(read_records.size(), records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+      CheckRecordEqual(*records[i], *read_records[i]);
+    }
+    ASSERT_TRUE(reader->Close());
+
+    reader = RecordFileReader::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(reader != nullptr);
+    count = 0;
+    ASSERT_TRUE(reader->ReadDataSectionInPlace([&](Record* r) {
+      EXPECT_LT(count, records.size());
+      CheckRecordEqual(*records[count++], *r);
+      return count <= records.size();
+    }));
+    ASSERT_EQ(count, records.size());
+    ASSERT_TRUE(reader->Close());
+  }
+}
+
+// @CddTest = 6.1/C-0-2
+TEST_F(RecordFileTest, stack_delta_with_time_index) {
+  AddEventType("cpu-clock");
+  perf_event_attr& attr = attr_ids_[0].attr;
+  attr.sample_type |= PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+  const uint64_t id = attr_ids_[0].ids[0];
+  // Write about 24MB of stack data, so there are at least two time index entries.
+  const uint64_t sample_count = 12000;
+  const size_t stack_size = 2048;
+  auto get_stack = [&](uint64_t time) {
+    std::vector<char> stack(stack_size);
+    for (size_t i = 0; i < stack_size; i++) {
+      stack[i] = static_cast<char>((time + i) % 251);
+    }
+    return stack;
+  };
+  const uint64_t start_time = sample_count - 1000;
+  const uint64_t end_time = sample_count;
+
+  for (size_t compression_level : {0, 1}) {
+    std::unique_ptr<RecordFileWriter> writer = RecordFileWriter::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(writer != nullptr);
+    if (compression_level != 0) {
+      ASSERT_TRUE(writer->SetCompressionLevel(compression_level));
+    }
+    writer->EnableStackDeltaEncoding();
+    ASSERT_TRUE(writer->WriteAttrSection(attr_ids_));
+    for (uint64_t time = 0; time < sample_count; time++) {
+      std::vector<char> stack = get_stack(time);
+      SampleRecord sample(attr, id, time, 1, 1, time, 0, 1, {}, {}, stack, stack.size());
+      ASSERT_TRUE(writer->WriteRecord(sample));
+    }
+    ASSERT_TRUE(writer->FinishWritingDataSection());
+    ASSERT_TRUE(writer->Close());
+
+    std::unique_ptr<RecordFileReader> reader = RecordFileReader::CreateInstance(tmpfile_.path);
+    ASSERT_TRUE(reader != nullptr);
+    // Each time index entry resets stack delta encoding, so entries are added after larger
+    // intervals than without stack delta encoding.
+    size_t entry_count = reader->ReadTimeIndexFeature().size();
+    ASSERT_GT(entry_count, 1u);
+    ASSERT_LT(entry_count, 5u);
+    ASSERT_TRUE(reader->SetTimeRange(start_time, end_time));
+    std::set<uint64_t> sample_times;
+    ASSERT_TRUE(reader->ReadDataSectionInPlace([&](Record* r) {
+      if (r->type() == PERF_RECORD_SAMPLE) {
+        auto sr = static_cast<SampleRecord*>(r);
+        uint64_t time = sr->Timestamp();
+        // Samples after skipped ones still have their whole stacks.
+        std::vector<char> stack = get_stack(time);
+        EXPECT_EQ(sr->stack_user_data.dyn_size, stack.size());
+        EXPECT_EQ(memcmp(sr->stack_user_data.data, stack.data(), stack.size()), 0);
+        sample_times.insert(time);
+      }
+      return true;
+    }));
+    for (uint64_t time = start_time; time < end_time; time++) {
+      ASSERT_EQ(sample_times.count(time), 1u);
+    }
+    ASSERT_LT(sample_times.size(), sample_count / 2);
+    ASSERT_TRUE(reader->Close());
+  }
+}
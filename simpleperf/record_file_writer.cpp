@@ -40,6 +40,16 @@ namespace simpleperf {
 
 using namespace PerfFileFormat;
 
+// Leave space for the header, and keep the record size 8-byte aligned.
+static constexpr size_t kCompressedRecordMaxSize = (1 << 16) - sizeof(perf_event_header) - 8;
+// When compressing in frames, the data section is cut into frames of about this size.
+static constexpr size_t kCompressedFrameSize = kMegabyte;
+// When not compressing, add a time index entry after each interval of the data section.
+static constexpr size_t kTimeIndexInterval = kMegabyte;
+// Each time index entry resets the stack delta encoder, so the next sample of each thread has its
+// whole stack. With stack delta encoding, add time index entries after much larger intervals.
+static constexpr size_t kStackDeltaTimeIndexInterval = 16 * kMegabyte;
+
 std::unique_ptr<RecordFileWriter> RecordFileWriter::CreateInstance(const std::string& filename) {
   // Remove old perf.data to avoid file ownership problems.
   std::string err;
@@ -76,9 +86,24 @@ RecordFileWriter::~RecordFileWriter() {
 
 bool RecordFileWriter::SetCompressionLevel(size_t compression_level) {
   compressor_ = CreateZstdCompressor(compression_level);
+  compression_level_ = compression_level;
   return compressor_ != nullptr;
 }
 
+bool RecordFileWriter::SetCompressionThreads(size_t thread_count) {
+  CHECK(compressor_);
+  CHECK_GT(thread_count, 0u);
+  for (size_t i = 0; i < thread_count; i++) {
+    std::unique_ptr<Compressor> compressor = CreateZstdCompressor(compression_level_);
+    if (!compressor) {
+      return false;
+    }
+    frame_compressors_.emplace_back(std::move(compressor));
+  }
+  compression_thread_pool_.reset(new ThreadPool(thread_count));
+  return true;
+}
+
 bool RecordFileWriter::WriteAttrSection(const EventAttrIds& attr_ids) {
   if (attr_ids.empty()) {
     return false;
@@ -130,8 +155,55 @@ bool RecordFileWriter::WriteAttrSection(const EventAttrIds& attr_ids) {
   return true;
 }
 
+void RecordFileWriter::EnableStackDeltaEncoding() {
+  stack_delta_encoder_.reset(new StackDeltaEncoder);
+}
+
+void RecordFileWriter::EnableFlightRecorder(const EventAttrIds& attr_ids,
+                                            uint64_t max_duration_in_ns, uint64_t max_size) {
+  flight_recorder_.reset(new FlightRecorder(attr_ids, max_duration_in_ns, max_size));
+}
+
 bool RecordFileWriter::WriteRecord(const Record& record) {
+  if (flight_recorder_) {
+    flight_recorder_->AddRecord(record);
+    return true;
+  }
+  uint32_t type = record.type();
+  const char* binary = record.Binary();
+  uint32_t size = record.size();
+  // Update the time index. Without frames, a compressed data section can only be read from the
+  // start. So it has no time index.
+  uint64_t time = record.Timestamp();
+  if (compression_thread_pool_) {
+    if (type != PERF_RECORD_AUXTRACE) {
+      frame_min_time_ = std::min(frame_min_time_, time);
+      frame_max_time_ = std::max(frame_max_time_, time);
+    }
+  } else if (!compressor_) {
+    size_t interval = stack_delta_encoder_ ? kStackDeltaTimeIndexInterval : kTimeIndexInterval;
+    if (time_index_.empty() || data_section_size_ - time_index_.back().data_offset >= interval) {
+      AddTimeIndexEntry(data_section_size_);
+    }
+    AddTimeToIndex(time, time);
+  }
+  if (stack_delta_encoder_) {
+    if (type == PERF_RECORD_SAMPLE) {
+      if (stack_delta_encoder_->Encode(static_cast<const SampleRecord&>(record),
+                                       stack_delta_buf_)) {
+        type = SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE;
+        binary = stack_delta_buf_.data();
+        size = stack_delta_buf_.size();
+      }
+    } else if (type == PERF_RECORD_EXIT) {
+      stack_delta_encoder_->RemoveThread(static_cast<const ExitRecord&>(record).data->tid);
+    }
+  }
   auto write_data = [&](const char* buf, size_t len) {
+    if (compression_thread_pool_) {
+      frame_buf_.insert(frame_buf_.end(), buf, buf + len);
+      return true;
+    }
     if (compressor_) {
       return compressor_->AddInputData(buf, len);
     }
@@ -143,20 +215,20 @@ bool RecordFileWriter::WriteRecord(const Record& record) {
   // Split simpleperf custom records which are > 65535 into a bunch of
   // RECORD_SPLIT records, followed by a RECORD_SPLIT_END record.
   constexpr uint32_t RECORD_SIZE_LIMIT = 65535;
-  if (record.size() <= RECORD_SIZE_LIMIT) {
+  if (size <= RECORD_SIZE_LIMIT) {
     bool result = true;
-    if (record.type() == PERF_RECORD_AUXTRACE) {
+    if (type == PERF_RECORD_AUXTRACE) {
       result = WriteAuxTraceRecord(static_cast<const AuxTraceRecord&>(record));
     } else {
-      result = write_data(record.Binary(), record.size());
+      result = write_data(binary, size);
     }
     if (!result) {
       return false;
     }
   } else {
-    CHECK_GT(record.type(), SIMPLE_PERF_RECORD_TYPE_START);
-    const char* p = record.Binary();
-    uint32_t left_bytes = static_cast<uint32_t>(record.size());
+    CHECK_GT(type, SIMPLE_PERF_RECORD_TYPE_START);
+    const char* p = binary;
+    uint32_t left_bytes = size;
     RecordHeader header;
     header.type = SIMPLE_PERF_RECORD_SPLIT;
     char header_buf[Record::header_size()];
@@ -184,13 +256,128 @@ bool RecordFileWriter::WriteRecord(const Record& record) {
     }
   }
 
+  if (compression_thread_pool_) {
+    // Records are only cut into frames at record boundaries.
+    if (frame_buf_.size() >= kCompressedFrameSize) {
+      return AddCompressedFrameTask();
+    }
+    return true;
+  }
   if (compressor_) {
     return WriteCompressorOutput(false, true);
   }
   return true;
 }
 
+bool RecordFileWriter::AddCompressedFrameTask() {
+  if (frame_buf_.empty()) {
+    return true;
+  }
+  frame_tasks_.emplace_back(new CompressedFrameTask);
+  CompressedFrameTask* task = frame_tasks_.back().get();
+  task->input.swap(frame_buf_);
+  frame_buf_.reserve(kCompressedFrameSize);
+  task->min_time = frame_min_time_;
+  task->max_time = frame_max_time_;
+  task->starts_time_index_entry = frame_starts_time_index_entry_;
+  frame_min_time_ = UINT64_MAX;
+  frame_max_time_ = 0;
+  // Decide whether the next frame starts a time index entry. Records after an entry are encoded
+  // without depending on previous records.
+  frame_input_size_since_time_index_entry_ += task->input.size();
+  frame_starts_time_index_entry_ =
+      !stack_delta_encoder_ ||
+      frame_input_size_since_time_index_entry_ >= kStackDeltaTimeIndexInterval;
+  if (frame_starts_time_index_entry_) {
+    frame_input_size_since_time_index_entry_ = 0;
+    if (stack_delta_encoder_) {
+      stack_delta_encoder_->Reset();
+    }
+  }
+  compression_thread_pool_->AddTask([this, task](size_t thread_index) {
+    Compressor& compressor = *frame_compressors_[thread_index];
+    bool result = compressor.AddInputData(task->input.data(), task->input.size()) &&
+                  compressor.FlushOutputData();
+    if (result) {
+      std::string_view output = compressor.GetOutputData();
+      task->output.assign(output.data(), output.size());
+      compressor.ConsumeOutputData(output.size());
+    }
+    std::lock_guard<std::mutex> lock(frame_mutex_);
+    task->result = result;
+    task->finished = true;
+    frame_cond_.notify_all();
+  });
+  // Limit memory used by frames waiting to be written.
+  return WriteCompressedFrames(compression_thread_pool_->ThreadCount() * 2);
+}
+
+bool RecordFileWriter::WriteCompressedFrames(size_t max_pending_frames) {
+  while (!frame_tasks_.empty()) {
+    CompressedFrameTask& task = *frame_tasks_.front();
+    {
+      std::unique_lock<std::mutex> lock(frame_mutex_);
+      if (!task.finished) {
+        if (frame_tasks_.size() <= max_pending_frames) {
+          break;
+        }
+        frame_cond_.wait(lock, [&]() { return task.finished; });
+      }
+    }
+    if (!task.result) {
+      return false;
+    }
+    CompressedFrame frame;
+    frame.data_offset = data_section_size_;
+    frame.decompressed_size = task.input.size();
+    const char* p = task.output.data();
+    size_t left_size = task.output.size();
+    while (left_size > 0) {
+      size_t size = std::min(left_size, kCompressedRecordMaxSize);
+      if (!WriteCompressRecord(p, size, true)) {
+        return false;
+      }
+      p += size;
+      left_size -= size;
+    }
+    frame.data_size = data_section_size_ - frame.data_offset;
+    compressed_frames_.push_back(frame);
+    if (task.starts_time_index_entry || time_index_.empty()) {
+      AddTimeIndexEntry(frame.data_offset);
+    }
+    AddTimeToIndex(task.min_time, task.max_time);
+    frame_input_size_ += task.input.size();
+    frame_output_size_ += task.output.size();
+    frame_tasks_.pop_front();
+  }
+  return true;
+}
+
+void RecordFileWriter::AddTimeIndexEntry(uint64_t data_offset) {
+  time_index_.emplace_back(TimeIndexEntry{data_offset, time_index_max_time_, UINT64_MAX});
+  // Make records after the entry not depend on previous records.
+  if (stack_delta_encoder_ && !compression_thread_pool_) {
+    stack_delta_encoder_->Reset();
+  }
+}
+
+void RecordFileWriter::AddTimeToIndex(uint64_t min_time, uint64_t max_time) {
+  TimeIndexEntry& entry = time_index_.back();
+  entry.min_time_after = std::min(entry.min_time_after, min_time);
+  time_index_max_time_ = std::max(time_index_max_time_, max_time);
+}
+
 bool RecordFileWriter::WriteAuxTraceRecord(const AuxTraceRecord& r) {
+  if (compression_thread_pool_) {
+    // Keep records before the auxtrace record in front of it.
+    if (!AddCompressedFrameTask() || !WriteCompressedFrames(0)) {
+      return false;
+    }
+    if (time_index_.empty()) {
+      AddTimeIndexEntry(data_section_size_);
+    }
+    AddTimeToIndex(r.Timestamp(), r.Timestamp());
+  }
   if (compressor_) {
     // For auxtrace record:
     // 1. Write PERF_RECORD_AUXTRACE (not compressed)
@@ -219,6 +406,16 @@ bool RecordFileWriter::WriteAuxTraceRecord(const AuxTraceRecord& r) {
 }
 
 bool RecordFileWriter::FinishWritingDataSection() {
+  if (flight_recorder_) {
+    // Write kept records, with the same encoding and compression as records written directly.
+    std::unique_ptr<FlightRecorder> recorder = std::move(flight_recorder_);
+    if (!recorder->ReadRecords([this](const Record& r) { return WriteRecord(r); })) {
+      return false;
+    }
+  }
+  if (compression_thread_pool_ && (!AddCompressedFrameTask() || !WriteCompressedFrames(0))) {
+    return false;
+  }
   if (compressor_) {
     return WriteCompressorOutput(true, true);
   }
@@ -231,15 +428,14 @@ bool RecordFileWriter::WriteCompressorOutput(bool flush, bool data_section) {
   }
   std::string_view output = compressor_->GetOutputData();
   if (!output.empty()) {
-    constexpr size_t COMPRESSED_RECORD_MAX_SIZE = (1 << 16) - sizeof(perf_event_header) - 8;
     const char* p = output.data();
     size_t left_size = output.size();
-    while (left_size >= COMPRESSED_RECORD_MAX_SIZE) {
-      if (!WriteCompressRecord(p, COMPRESSED_RECORD_MAX_SIZE, data_section)) {
+    while (left_size >= kCompressedRecordMaxSize) {
+      if (!WriteCompressRecord(p, kCompressedRecordMaxSize, data_section)) {
         return false;
       }
-      p += COMPRESSED_RECORD_MAX_SIZE;
-      left_size -= COMPRESSED_RECORD_MAX_SIZE;
+      p += kCompressedRecordMaxSize;
+      left_size -= kCompressedRecordMaxSize;
     }
     if (left_size > 0 && flush) {
       if (!WriteCompressRecord(p, left_size, data_section)) {
@@ -292,6 +488,7 @@ bool RecordFileWriter::ReadDataSection(const std::function<void(const Record*)>&
   }
   std::vector<char> record_buf(512);
   std::unique_ptr<Decompressor> decompressor;
+  StackDeltaDecoder stack_delta_decoder;
   uint64_t read_pos = 0;
   while (read_pos < data_section_size_) {
     if (!Read(record_buf.data(), Record::header_size())) {
@@ -320,13 +517,14 @@ bool RecordFileWriter::ReadDataSection(const std::function<void(const Record*)>&
                                       header.size - Record::header_size())) {
         return false;
       }
-      if (!ReadFromDecompressor(*decompressor, callback)) {
+      if (!ReadFromDecompressor(*decompressor, stack_delta_decoder, callback)) {
         return false;
       }
     } else {
-      std::unique_ptr<Record> r = ReadRecordFromBuffer(event_attr_, header.type, record_buf.data(),
-                                                       record_buf.data() + header.size);
-      CHECK(r);
+      std::unique_ptr<Record> r = ParseRecordForRead(record_buf.data(), stack_delta_decoder);
+      if (!r) {
+        return false;
+      }
       if (r->type() == PERF_RECORD_AUXTRACE) {
         auto auxtrace = static_cast<AuxTraceRecord*>(r.get());
         auxtrace->location.file_offset = data_section_offset_ + read_pos;
@@ -343,6 +541,7 @@ bool RecordFileWriter::ReadDataSection(const std::function<void(const Record*)>&
 }
 
 bool RecordFileWriter::ReadFromDecompressor(Decompressor& decompressor,
+                                            StackDeltaDecoder& stack_delta_decoder,
                                             const std::function<void(const Record*)>& callback) {
   std::string_view output = decompressor.GetOutputData();
   char* p = const_cast<char*>(output.data());
@@ -352,8 +551,7 @@ bool RecordFileWriter::ReadFromDecompressor(Decompressor& decompressor,
     if (header->size > left_size) {
       break;
     }
-    std::unique_ptr<Record> r =
-        ReadRecordFromBuffer(event_attr_, header->type, p, p + header->size);
+    std::unique_ptr<Record> r = ParseRecordForRead(p, stack_delta_decoder);
     if (!r) {
       return false;
     }
@@ -365,6 +563,29 @@ bool RecordFileWriter::ReadFromDecompressor(Decompressor& decompressor,
   return true;
 }
 
+std::unique_ptr<Record> RecordFileWriter::ParseRecordForRead(
+    char* p, StackDeltaDecoder& stack_delta_decoder) {
+  RecordHeader header;
+  if (!header.Parse(p)) {
+    return nullptr;
+  }
+  if (header.type == SIMPLE_PERF_RECORD_STACK_DELTA_SAMPLE) {
+    if (!stack_delta_decoder.Decode(p, header.size, stack_delta_buf_)) {
+      return nullptr;
+    }
+    // The record is used only in the callback. So it can refer to stack_delta_buf_.
+    p = stack_delta_buf_.data();
+    if (!header.Parse(p)) {
+      return nullptr;
+    }
+  }
+  std::unique_ptr<Record> r = ReadRecordFromBuffer(event_attr_, header.type, p, p + header.size);
+  if (r && r->type() == PERF_RECORD_EXIT) {
+    stack_delta_decoder.RemoveThread(static_cast<ExitRecord*>(r.get())->data->tid);
+  }
+  return r;
+}
+
 bool RecordFileWriter::GetFilePos(uint64_t* file_pos) {
   off_t offset = ftello(record_fp_);
   if (offset == -1) {
@@ -377,6 +598,14 @@ bool RecordFileWriter::GetFilePos(uint64_t* file_pos) {
 
 bool RecordFileWriter::BeginWriteFeatures(size_t feature_count) {
   feature_section_offset_ = data_section_offset_ + data_section_size_;
+  // The compressed frame index and time index features aren't counted by callers. They are
+  // written here.
+  if (!compressed_frames_.empty()) {
+    feature_count++;
+  }
+  if (time_index_.size() > 1) {
+    feature_count++;
+  }
   feature_count_ = feature_count;
   uint64_t feature_header_size = feature_count * sizeof(SectionDesc);
 
@@ -386,7 +615,29 @@ bool RecordFileWriter::BeginWriteFeatures(size_t feature_count) {
     PLOG(ERROR) << "fseek() failed";
     return false;
   }
-  return Write(zero_data.data(), zero_data.size());
+  if (!Write(zero_data.data(), zero_data.size())) {
+    return false;
+  }
+  return (compressed_frames_.empty() || WriteCompressedFrameIndexFeature()) &&
+         (time_index_.size() <= 1 || WriteTimeIndexFeature());
+}
+
+bool RecordFileWriter::WriteCompressedFrameIndexFeature() {
+  return WriteFeature(FEAT_COMPRESSED_FRAME_INDEX,
+                      reinterpret_cast<const char*>(compressed_frames_.data()),
+                      compressed_frames_.size() * sizeof(CompressedFrame));
+}
+
+bool RecordFileWriter::WriteTimeIndexFeature() {
+  // Change min_time_after from the min timestamp of records to the next entry, to the min
+  // timestamp of all records after the entry.
+  uint64_t min_time = UINT64_MAX;
+  for (auto it = time_index_.rbegin(); it != time_index_.rend(); ++it) {
+    min_time = std::min(min_time, it->min_time_after);
+    it->min_time_after = min_time;
+  }
+  return WriteFeature(FEAT_TIME_INDEX, reinterpret_cast<const char*>(time_index_.data()),
+                      time_index_.size() * sizeof(TimeIndexEntry));
 }
 
 bool RecordFileWriter::WriteBuildIdFeature(const std::vector<BuildIdRecord>& build_id_records) {
@@ -649,6 +900,15 @@ bool RecordFileWriter::EndWriteFeatures() {
   return true;
 }
 
+bool RecordFileWriter::GetCompressionStat(uint64_t* input_size, uint64_t* output_size) const {
+  if (!compressor_) {
+    return false;
+  }
+  *input_size = compressor_->TotalInputSize() + frame_input_size_;
+  *output_size = compressor_->TotalOutputSize() + frame_output_size_;
+  return true;
+}
+
 bool RecordFileWriter::WriteFileHeader() {
   FileHeader header;
   memset(&header, 0, sizeof(header));
@@ -678,6 +938,12 @@ bool RecordFileWriter::Close() {
   CHECK(record_fp_ != nullptr);
   bool result = true;
 
+  // If no feature is written, still write the compressed frame index and time index.
+  if (feature_section_offset_ == 0 && (!compressed_frames_.empty() || time_index_.size() > 1) &&
+      !(BeginWriteFeatures(0) && EndWriteFeatures())) {
+    result = false;
+  }
+
   // Write file header. We gather enough information to write file header only after
   // writing data section and feature section.
   if (!WriteFileHeader()) {
@@ -14,15 +14,21 @@
  * limitations under the License.
  */
 
+#include <deque>
+#include <map>
 #include <memory>
 #include <optional>
 #include <queue>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
+#include "CounterFile.h"
 #include "JITDebugReader.h"
 #include "RecordFilter.h"
 #include "dso.h"
@@ -108,6 +114,65 @@ struct FeatureSection {
   uint32_t data_size;
 };
 
+// Samples returned by GetNextSampleBatch(), stored in columns. Each column has count values.
+// Strings and callchains are stored as indexes in tables returned by GetStringTable() and
+// GetCallChainTable().
+struct SampleBatch {
+  uint32_t count;
+  const uint64_t* time;
+  const uint64_t* period;
+  const uint32_t* pid;
+  const uint32_t* tid;
+  const uint32_t* cpu;
+  const uint32_t* event_name;
+  const uint32_t* thread_name;
+  const uint32_t* callchain;
+};
+
+struct StringTable {
+  uint32_t count;
+  const char* const* strings;
+};
+
+// A frame in callchains. dso_name and symbol_name are indexes in the string table.
+struct FrameEntry {
+  uint64_t vaddr_in_file;
+  uint32_t dso_name;
+  uint32_t symbol_name;
+};
+
+struct FrameTable {
+  uint32_t count;
+  const FrameEntry* frames;
+};
+
+// Callchain i has frames[offsets[i]] to frames[offsets[i + 1] - 1], from the sampled frame to the
+// root. Values in frames are indexes in the frame table.
+struct CallChainTable {
+  uint32_t count;
+  const uint32_t* offsets;
+  const uint32_t* frames;
+};
+
+// A counter of an event on a thread and cpu in an interval, read from a file generated by
+// `simpleperf stat --binary-output`. event_index is an index in GetCounterEventNames().
+struct StatCounter {
+  uint32_t event_index;
+  int32_t tid;
+  int32_t cpu;
+  uint64_t value;
+  uint64_t time_enabled;
+  uint64_t time_running;
+};
+
+struct StatInterval {
+  uint64_t time_in_ns;
+  uint32_t counter_count;
+  // Set when there are no more intervals. Then other fields are unused.
+  uint32_t eof;
+  const StatCounter* counters;
+};
+
 }  // extern "C"
 
 namespace simpleperf {
@@ -199,16 +264,26 @@ class ReportLib {
 
   bool SetKallsymsFile(const char* kallsyms_file);
 
-  void ShowIpForUnknownSymbol() { thread_tree_.ShowIpForUnknownSymbol(); }
+  // Options changing symbolized callchains invalidate callchain_cache_.
+  void ShowIpForUnknownSymbol() {
+    thread_tree_.ShowIpForUnknownSymbol();
+    callchain_options_version_++;
+  }
   void ShowArtFrames(bool show) {
     bool remove_art_frame = !show;
     callchain_report_builder_.SetRemoveArtFrame(remove_art_frame);
+    callchain_options_version_++;
   }
   bool RemoveMethod(const char* method_name_regex) {
+    callchain_options_version_++;
     return callchain_report_builder_.RemoveMethod(method_name_regex);
   }
-  void MergeJavaMethods(bool merge) { callchain_report_builder_.SetConvertJITFrame(merge); }
+  void MergeJavaMethods(bool merge) {
+    callchain_report_builder_.SetConvertJITFrame(merge);
+    callchain_options_version_++;
+  }
   bool AddProguardMappingFile(const char* mapping_file) {
+    callchain_options_version_++;
     return callchain_report_builder_.AddProguardMappingFile(mapping_file);
   }
   const char* GetSupportedTraceOffCpuModes();
@@ -220,6 +295,7 @@ class ReportLib {
   Event* GetEventOfCurrentSample() { return &current_event_; }
   SymbolEntry* GetSymbolOfCurrentSample() { return current_symbol_; }
   CallChain* GetCallChainOfCurrentSample() { return &current_callchain_; }
+  uint64_t GetCallChainIdOfCurrentSample() { return current_callchain_id_; }
   EventCountersView* GetEventCountersOfCurrentSample() {
     event_counters_view_.nr = event_counters_.size();
     event_counters_view_.event_counter = event_counters_.data();
@@ -234,18 +310,47 @@ class ReportLib {
   const char* GetBuildIdForPath(const char* path);
   FeatureSection* GetFeatureSection(const char* feature_name);
 
+  SampleBatch* GetNextSampleBatch(uint32_t max_count);
+  StringTable* GetStringTable() {
+    string_table_.count = string_ptrs_.size();
+    string_table_.strings = string_ptrs_.data();
+    return &string_table_;
+  }
+  FrameTable* GetFrameTable() {
+    frame_table_.count = frames_.size();
+    frame_table_.frames = frames_.data();
+    return &frame_table_;
+  }
+  CallChainTable* GetCallChainTable() {
+    callchain_table_.count = callchain_offsets_.size() - 1;
+    callchain_table_.offsets = callchain_offsets_.data();
+    callchain_table_.frames = callchain_frames_.data();
+    return &callchain_table_;
+  }
+  bool ExportSamples(const char* path);
+
+  bool SetCounterFile(const char* counter_file);
+  StringTable* GetCounterEventNames();
+  StatInterval* GetNextStatInterval();
+
  private:
   std::unique_ptr<SampleRecord> GetNextSampleRecord();
   void ProcessSampleRecord(std::unique_ptr<Record> r);
   void ProcessSwitchRecord(std::unique_ptr<Record> r);
   void AddSampleRecordToQueue(SampleRecord* r);
   bool SetCurrentSample(std::unique_ptr<SampleRecord> sample_record);
+  struct CachedCallChain;
+  CachedCallChain& GetCachedCallChain(const SampleRecord& r);
   void SetEventCounters(const SampleRecord& r);
   const EventInfo& FindEvent(const SampleRecord& r);
   void CreateEvents();
 
   bool OpenRecordFileIfNecessary();
-  Mapping* AddMapping(const MapEntry& map);
+  Mapping* AddMapping(CachedCallChain& callchain, const MapEntry& map);
+  void AddCurrentSampleToBatch();
+  uint32_t InternString(std::string_view s);
+  uint32_t InternFrame(const SymbolEntry& symbol);
+  uint32_t InternCallChain(const std::vector<uint32_t>& frames);
 
   std::unique_ptr<android::base::ScopedLogSeverity> log_severity_;
   std::string record_filename_;
@@ -257,11 +362,54 @@ class ReportLib {
   Event current_event_;
   SymbolEntry* current_symbol_;
   CallChain current_callchain_;
+  uint64_t current_callchain_id_ = 0;
   std::vector<EventCounter> event_counters_;
   EventCountersView event_counters_view_;
   const char* current_tracing_data_;
-  std::vector<std::unique_ptr<Mapping>> current_mappings_;
-  std::vector<CallChainEntry> callchain_entries_;
+
+  // Most samples share a small set of callchains. So symbolized callchains are cached, keyed by
+  // the ips, the versions of the maps used to symbolize them and the version of the options.
+  struct CallChainKey {
+    uint64_t options_version;
+    const MapSet* maps;
+    uint64_t maps_version;
+    uint64_t kernel_maps_version;
+    size_t kernel_ip_count;
+    std::vector<uint64_t> ips;
+
+    bool operator==(const CallChainKey& other) const {
+      return options_version == other.options_version && maps == other.maps &&
+             maps_version == other.maps_version &&
+             kernel_maps_version == other.kernel_maps_version &&
+             kernel_ip_count == other.kernel_ip_count && ips == other.ips;
+    }
+  };
+  struct CallChainKeyHash {
+    size_t operator()(const CallChainKey& key) const {
+      size_t seed = 0;
+      HashCombine(seed, key.options_version);
+      HashCombine(seed, key.maps);
+      HashCombine(seed, key.maps_version);
+      HashCombine(seed, key.kernel_maps_version);
+      for (uint64_t ip : key.ips) {
+        HashCombine(seed, ip);
+      }
+      return seed;
+    }
+  };
+  struct CachedCallChain {
+    // Unique in a ReportLib instance, even after the cache is cleared.
+    uint64_t id;
+    // Used to detect a MapSet freed and reallocated at the same address.
+    std::weak_ptr<MapSet> maps;
+    // Entry 0 is the sampled frame. Empty if the callchain is removed by RemoveMethod().
+    std::vector<CallChainEntry> entries;
+    std::vector<std::unique_ptr<Mapping>> mappings;
+  };
+  std::unordered_map<CallChainKey, CachedCallChain, CallChainKeyHash> callchain_cache_;
+  uint64_t next_callchain_id_ = 1;
+  uint64_t callchain_options_version_ = 0;
+  CachedCallChain* current_cached_callchain_ = nullptr;
   std::string build_id_string_;
   std::vector<EventInfo> events_;
   TraceOffCpuData trace_offcpu_;
@@ -271,6 +419,41 @@ class ReportLib {
   ThreadReportBuilder thread_report_builder_;
   std::unique_ptr<Tracing> tracing_;
   RecordFilter record_filter_;
+
+  // Used by GetNextSampleBatch().
+  struct SampleColumns {
+    std::vector<uint64_t> time;
+    std::vector<uint64_t> period;
+    std::vector<uint32_t> pid;
+    std::vector<uint32_t> tid;
+    std::vector<uint32_t> cpu;
+    std::vector<uint32_t> event_name;
+    std::vector<uint32_t> thread_name;
+    std::vector<uint32_t> callchain;
+  } sample_columns_;
+  SampleBatch sample_batch_;
+  std::deque<std::string> strings_;
+  std::vector<const char*> string_ptrs_;
+  std::unordered_map<std::string_view, uint32_t> string_map_;
+  StringTable string_table_;
+  std::vector<FrameEntry> frames_;
+  std::map<std::tuple<uint64_t, uint32_t, uint32_t>, uint32_t> frame_map_;
+  FrameTable frame_table_;
+  std::vector<uint32_t> callchain_offsets_{0};
+  std::vector<uint32_t> callchain_frames_;
+  std::unordered_map<std::string, uint32_t> callchain_map_;
+  // Map from callchain ids to indexes in the callchain table.
+  std::unordered_map<uint64_t, uint32_t> callchain_index_map_;
+  CallChainTable callchain_table_;
+  std::vector<uint32_t> tmp_frames_;
+
+  // Used to read files generated by `simpleperf stat --binary-output`.
+  std::unique_ptr<CounterFileReader> counter_file_reader_;
+  std::vector<const char*> counter_event_names_;
+  StringTable counter_event_name_table_;
+  CounterInterval counter_interval_;
+  std::vector<StatCounter> stat_counters_;
+  StatInterval stat_interval_;
 };
 
 bool ReportLib::SetLogSeverity(const char* log_level) {
@@ -376,6 +559,9 @@ bool ReportLib::OpenRecordFileIfNecessary() {
       LOG(ERROR) << "Recording file " << record_filename_ << " doesn't match the clock of filter.";
       return false;
     }
+    if (auto time_range = record_filter_.GetTimeRange(); time_range) {
+      record_file_reader_->SetTimeRange(time_range->first, time_range->second);
+    }
   }
   return true;
 }
@@ -494,8 +680,6 @@ void ReportLib::AddSampleRecordToQueue(SampleRecord* r) {
 
 bool ReportLib::SetCurrentSample(std::unique_ptr<SampleRecord> sample_record) {
   const SampleRecord& r = *sample_record;
-  current_mappings_.clear();
-  callchain_entries_.clear();
   current_sample_.ip = r.ip_data.ip;
   current_thread_ = thread_tree_.FindThreadOrNew(r.tid_data.pid, r.tid_data.tid);
   ThreadReport thread_report = thread_report_builder_.Build(*current_thread_);
@@ -507,18 +691,58 @@ bool ReportLib::SetCurrentSample(std::unique_ptr<SampleRecord> sample_record) {
   current_sample_.cpu = r.cpu_data.cpu;
   current_sample_.period = r.period_data.period;
 
-  size_t kernel_ip_count;
-  std::vector<uint64_t> ips = r.GetCallChain(&kernel_ip_count);
-  std::vector<CallChainReportEntry> report_entries =
-      callchain_report_builder_.Build(current_thread_, ips, kernel_ip_count);
-  if (report_entries.empty()) {
+  CachedCallChain& callchain = GetCachedCallChain(r);
+  if (callchain.entries.empty()) {
     // Skip samples with callchain fully removed by RemoveMethod().
     return false;
   }
+  current_cached_callchain_ = &callchain;
+  current_callchain_id_ = callchain.id;
+  current_sample_.ip = callchain.entries[0].ip;
+  current_symbol_ = &(callchain.entries[0].symbol);
+  current_callchain_.nr = callchain.entries.size() - 1;
+  current_callchain_.entries = &callchain.entries[1];
+  const EventInfo& event = FindEvent(r);
+  current_event_.name = event.name.c_str();
+  current_event_.tracing_data_format = event.tracing_info.data_format;
+  if (current_event_.tracing_data_format.size > 0u && (r.sample_type & PERF_SAMPLE_RAW)) {
+    CHECK_GE(r.raw_data.size, current_event_.tracing_data_format.size);
+    current_tracing_data_ = r.raw_data.data;
+  } else {
+    current_tracing_data_ = nullptr;
+  }
+  SetEventCounters(r);
+  return true;
+}
 
-  for (const auto& report_entry : report_entries) {
-    callchain_entries_.resize(callchain_entries_.size() + 1);
-    CallChainEntry& entry = callchain_entries_.back();
+ReportLib::CachedCallChain& ReportLib::GetCachedCallChain(const SampleRecord& r) {
+  // Limit the memory used by the cache. Callchain ids aren't reused after clearing the cache.
+  static constexpr size_t kMaxCachedCallChains = 1 << 17;
+
+  CallChainKey key;
+  key.ips = r.GetCallChain(&key.kernel_ip_count);
+  key.options_version = callchain_options_version_;
+  key.maps = current_thread_->maps.get();
+  key.maps_version = current_thread_->maps->version;
+  key.kernel_maps_version = thread_tree_.GetKernelMaps().version;
+  if (auto it = callchain_cache_.find(key); it != callchain_cache_.end()) {
+    if (it->second.maps.lock() == current_thread_->maps) {
+      return it->second;
+    }
+    callchain_cache_.erase(it);
+  }
+  if (callchain_cache_.size() >= kMaxCachedCallChains) {
+    callchain_cache_.clear();
+  }
+  std::vector<CallChainReportEntry> report_entries =
+      callchain_report_builder_.Build(current_thread_, key.ips, key.kernel_ip_count);
+  CachedCallChain& callchain = callchain_cache_[std::move(key)];
+  callchain.id = next_callchain_id_++;
+  callchain.maps = current_thread_->maps;
+  callchain.entries.resize(report_entries.size());
+  for (size_t i = 0; i < report_entries.size(); i++) {
+    const CallChainReportEntry& report_entry = report_entries[i];
+    CallChainEntry& entry = callchain.entries[i];
     entry.ip = report_entry.ip;
     if (report_entry.dso_name != nullptr) {
       entry.symbol.dso_name = report_entry.dso_name;
@@ -529,23 +753,9 @@ bool ReportLib::SetCurrentSample(std::unique_ptr<SampleRecord> sample_record) {
     entry.symbol.symbol_name = report_entry.symbol->DemangledName();
     entry.symbol.symbol_addr = report_entry.symbol->addr;
     entry.symbol.symbol_len = report_entry.symbol->len;
-    entry.symbol.mapping = AddMapping(*report_entry.map);
-  }
-  current_sample_.ip = callchain_entries_[0].ip;
-  current_symbol_ = &(callchain_entries_[0].symbol);
-  current_callchain_.nr = callchain_entries_.size() - 1;
-  current_callchain_.entries = &callchain_entries_[1];
-  const EventInfo& event = FindEvent(r);
-  current_event_.name = event.name.c_str();
-  current_event_.tracing_data_format = event.tracing_info.data_format;
-  if (current_event_.tracing_data_format.size > 0u && (r.sample_type & PERF_SAMPLE_RAW)) {
-    CHECK_GE(r.raw_data.size, current_event_.tracing_data_format.size);
-    current_tracing_data_ = r.raw_data.data;
-  } else {
-    current_tracing_data_ = nullptr;
+    entry.symbol.mapping = AddMapping(callchain, *report_entry.map);
   }
-  SetEventCounters(r);
-  return true;
+  return callchain;
 }
 
 void ReportLib::SetEventCounters(const SampleRecord& r) {
@@ -618,9 +828,9 @@ void ReportLib::CreateEvents() {
   }
 }
 
-Mapping* ReportLib::AddMapping(const MapEntry& map) {
-  current_mappings_.emplace_back(std::unique_ptr<Mapping>(new Mapping));
-  Mapping* mapping = current_mappings_.back().get();
+Mapping* ReportLib::AddMapping(CachedCallChain& callchain, const MapEntry& map) {
+  callchain.mappings.emplace_back(std::unique_ptr<Mapping>(new Mapping));
+  Mapping* mapping = callchain.mappings.back().get();
   mapping->start = map.start_addr;
   mapping->end = map.start_addr + map.len;
   mapping->pgoff = map.pgoff;
@@ -654,6 +864,232 @@ FeatureSection* ReportLib::GetFeatureSection(const char* feature_name) {
   return &feature_section_;
 }
 
+SampleBatch* ReportLib::GetNextSampleBatch(uint32_t max_count) {
+  if (!OpenRecordFileIfNecessary()) {
+    return nullptr;
+  }
+  SampleColumns& c = sample_columns_;
+  for (auto* column : {&c.pid, &c.tid, &c.cpu, &c.event_name, &c.thread_name, &c.callchain}) {
+    column->clear();
+  }
+  c.time.clear();
+  c.period.clear();
+  while (c.time.size() < max_count) {
+    std::unique_ptr<SampleRecord> r = GetNextSampleRecord();
+    if (!r) {
+      break;
+    }
+    if (SetCurrentSample(std::move(r))) {
+      AddCurrentSampleToBatch();
+    }
+  }
+  sample_batch_.count = c.time.size();
+  sample_batch_.time = c.time.data();
+  sample_batch_.period = c.period.data();
+  sample_batch_.pid = c.pid.data();
+  sample_batch_.tid = c.tid.data();
+  sample_batch_.cpu = c.cpu.data();
+  sample_batch_.event_name = c.event_name.data();
+  sample_batch_.thread_name = c.thread_name.data();
+  sample_batch_.callchain = c.callchain.data();
+  return &sample_batch_;
+}
+
+void ReportLib::AddCurrentSampleToBatch() {
+  SampleColumns& c = sample_columns_;
+  c.time.push_back(current_sample_.time);
+  c.period.push_back(current_sample_.period);
+  c.pid.push_back(current_sample_.pid);
+  c.tid.push_back(current_sample_.tid);
+  c.cpu.push_back(current_sample_.cpu);
+  c.event_name.push_back(InternString(current_event_.name));
+  c.thread_name.push_back(InternString(current_sample_.thread_comm));
+  auto [it, inserted] = callchain_index_map_.try_emplace(current_callchain_id_, 0);
+  if (inserted) {
+    tmp_frames_.clear();
+    for (const CallChainEntry& entry : current_cached_callchain_->entries) {
+      tmp_frames_.push_back(InternFrame(entry.symbol));
+    }
+    it->second = InternCallChain(tmp_frames_);
+  }
+  c.callchain.push_back(it->second);
+}
+
+uint32_t ReportLib::InternString(std::string_view s) {
+  if (auto it = string_map_.find(s); it != string_map_.end()) {
+    return it->second;
+  }
+  uint32_t index = strings_.size();
+  // Strings in a deque aren't moved when adding more strings.
+  const std::string& stored = strings_.emplace_back(s);
+  string_ptrs_.push_back(stored.c_str());
+  string_map_.emplace(stored, index);
+  return index;
+}
+
+uint32_t ReportLib::InternFrame(const SymbolEntry& symbol) {
+  auto key = std::make_tuple(symbol.vaddr_in_file, InternString(symbol.dso_name),
+                             InternString(symbol.symbol_name));
+  auto [it, inserted] = frame_map_.try_emplace(key, frames_.size());
+  if (inserted) {
+    frames_.push_back(FrameEntry{symbol.vaddr_in_file, std::get<1>(key), std::get<2>(key)});
+  }
+  return it->second;
+}
+
+uint32_t ReportLib::InternCallChain(const std::vector<uint32_t>& frames) {
+  std::string key(reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(uint32_t));
+  auto [it, inserted] = callchain_map_.try_emplace(std::move(key), callchain_offsets_.size() - 1);
+  if (inserted) {
+    callchain_frames_.insert(callchain_frames_.end(), frames.begin(), frames.end());
+    callchain_offsets_.push_back(callchain_frames_.size());
+  }
+  return it->second;
+}
+
+// The file written by ExportSamples() has below sections, each starting with a uint32_t tag and a
+// uint32_t count. All values are little endian, and each section is padded to 8 bytes.
+//   header: tag 'S' 'P' 'C' 'L', count = version (1)
+//   sample block (tag 1): count samples, stored in columns in the order of SampleBatch fields:
+//     uint64_t time[count], uint64_t period[count], uint32_t pid[count], ...
+//   string table (tag 2): count strings, each stored as uint32_t size, char data[size]
+//   frame table (tag 3): FrameEntry frames[count]
+//   callchain table (tag 4): uint32_t offsets[count + 1], uint32_t frames[offsets[count]]
+//   end (tag 0, count 0)
+// Sample blocks come first. The tables are written after all samples.
+bool ReportLib::ExportSamples(const char* path) {
+  constexpr uint32_t kVersion = 1;
+  constexpr uint32_t kSampleBlockSize = 65536;
+  enum : uint32_t {
+    kTagEnd = 0,
+    kTagSampleBlock = 1,
+    kTagStringTable = 2,
+    kTagFrameTable = 3,
+    kTagCallChainTable = 4,
+  };
+
+  std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(path, "wb"), fclose);
+  if (!fp) {
+    PLOG(ERROR) << "failed to open " << path;
+    return false;
+  }
+  uint64_t offset = 0;
+  auto write = [&](const void* data, size_t size) {
+    if (size > 0 && fwrite(data, size, 1, fp.get()) != 1) {
+      PLOG(ERROR) << "failed to write " << path;
+      return false;
+    }
+    offset += size;
+    return true;
+  };
+  auto write_section_header = [&](uint32_t tag, uint32_t count) {
+    uint32_t data[2] = {tag, count};
+    return write(data, sizeof(data));
+  };
+  auto write_padding = [&]() {
+    static const char zeros[8] = {};
+    return write(zeros, Align(offset, 8) - offset);
+  };
+  auto write_column = [&](const auto* values, uint32_t count) {
+    return write(values, sizeof(values[0]) * count);
+  };
+
+  constexpr uint32_t kMagic = 'S' | ('P' << 8) | ('C' << 16) | ('L' << 24);
+  if (!write_section_header(kMagic, kVersion)) {
+    return false;
+  }
+  while (true) {
+    SampleBatch* batch = GetNextSampleBatch(kSampleBlockSize);
+    if (batch == nullptr) {
+      return false;
+    }
+    if (batch->count == 0) {
+      break;
+    }
+    uint32_t n = batch->count;
+    if (!write_section_header(kTagSampleBlock, n) || !write_column(batch->time, n) ||
+        !write_column(batch->period, n) || !write_column(batch->pid, n) ||
+        !write_column(batch->tid, n) || !write_column(batch->cpu, n) ||
+        !write_column(batch->event_name, n) || !write_column(batch->thread_name, n) ||
+        !write_column(batch->callchain, n) || !write_padding()) {
+      return false;
+    }
+  }
+  if (!write_section_header(kTagStringTable, strings_.size())) {
+    return false;
+  }
+  for (const std::string& s : strings_) {
+    uint32_t size = s.size();
+    if (!write(&size, sizeof(size)) || !write(s.data(), size)) {
+      return false;
+    }
+  }
+  uint32_t callchain_count = callchain_offsets_.size() - 1;
+  if (!write_padding() || !write_section_header(kTagFrameTable, frames_.size()) ||
+      !write_column(frames_.data(), frames_.size()) ||
+      !write_section_header(kTagCallChainTable, callchain_count) ||
+      !write_column(callchain_offsets_.data(), callchain_offsets_.size()) ||
+      !write_column(callchain_frames_.data(), callchain_frames_.size()) || !write_padding() ||
+      !write_section_header(kTagEnd, 0)) {
+    return false;
+  }
+  if (fflush(fp.get()) != 0) {
+    PLOG(ERROR) << "failed to write " << path;
+    return false;
+  }
+  return true;
+}
+
+bool ReportLib::SetCounterFile(const char* counter_file) {
+  counter_file_reader_ = CounterFileReader::Open(counter_file);
+  if (!counter_file_reader_) {
+    return false;
+  }
+  counter_event_names_.clear();
+  for (const std::string& name : counter_file_reader_->EventNames()) {
+    counter_event_names_.push_back(name.c_str());
+  }
+  return true;
+}
+
+StringTable* ReportLib::GetCounterEventNames() {
+  counter_event_name_table_.count = counter_event_names_.size();
+  counter_event_name_table_.strings = counter_event_names_.data();
+  return &counter_event_name_table_;
+}
+
+StatInterval* ReportLib::GetNextStatInterval() {
+  if (!counter_file_reader_) {
+    LOG(ERROR) << "counter file isn't set";
+    return nullptr;
+  }
+  bool eof;
+  if (!counter_file_reader_->ReadInterval(&counter_interval_, &eof)) {
+    return nullptr;
+  }
+  if (eof) {
+    stat_interval_ = {};
+    stat_interval_.eof = 1;
+    return &stat_interval_;
+  }
+  stat_counters_.resize(counter_interval_.counters.size());
+  for (size_t i = 0; i < stat_counters_.size(); i++) {
+    const CounterFileEntry& entry = counter_interval_.counters[i];
+    StatCounter& counter = stat_counters_[i];
+    counter.event_index = entry.event_index;
+    counter.tid = entry.tid;
+    counter.cpu = entry.cpu;
+    counter.value = entry.value;
+    counter.time_enabled = entry.time_enabled;
+    counter.time_running = entry.time_running;
+  }
+  stat_interval_.time_in_ns = counter_interval_.time_in_ns;
+  stat_interval_.counter_count = stat_counters_.size();
+  stat_interval_.eof = 0;
+  stat_interval_.counters = stat_counters_.data();
+  return &stat_interval_;
+}
+
 }  // namespace simpleperf
 
 using ReportLib = simpleperf::ReportLib;
@@ -688,12 +1124,30 @@ Sample* GetNextSample(ReportLib* report_lib) EXPORT;
 Event* GetEventOfCurrentSample(ReportLib* report_lib) EXPORT;
 SymbolEntry* GetSymbolOfCurrentSample(ReportLib* report_lib) EXPORT;
 CallChain* GetCallChainOfCurrentSample(ReportLib* report_lib) EXPORT;
+// Samples with the same callchain id have the same symbolized callchain.
+uint64_t GetCallChainIdOfCurrentSample(ReportLib* report_lib) EXPORT;
 EventCountersView* GetEventCountersOfCurrentSample(ReportLib* report_lib) EXPORT;
 const char* GetTracingDataOfCurrentSample(ReportLib* report_lib) EXPORT;
 const char* GetProcessNameOfCurrentSample(ReportLib* report_lib) EXPORT;
 
 const char* GetBuildIdForPath(ReportLib* report_lib, const char* path) EXPORT;
 FeatureSection* GetFeatureSection(ReportLib* report_lib, const char* feature_name) EXPORT;
+
+// Read up to max_count samples. Return a batch with count = 0 when there are no more samples.
+// The batch and tables are valid until the next call of GetNextSampleBatch().
+SampleBatch* GetNextSampleBatch(ReportLib* report_lib, uint32_t max_count) EXPORT;
+StringTable* GetStringTable(ReportLib* report_lib) EXPORT;
+FrameTable* GetFrameTable(ReportLib* report_lib) EXPORT;
+CallChainTable* GetCallChainTable(ReportLib* report_lib) EXPORT;
+// Write all samples in a columnar binary file, described in ReportLib::ExportSamples().
+bool ExportSamples(ReportLib* report_lib, const char* path) EXPORT;
+
+// Read counters from a file generated by `simpleperf stat --binary-output`. It is independent of
+// the record file. GetNextStatInterval() returns nullptr on error, and an interval with eof set
+// when there are no more intervals.
+bool SetCounterFile(ReportLib* report_lib, const char* counter_file) EXPORT;
+StringTable* GetCounterEventNames(ReportLib* report_lib) EXPORT;
+StatInterval* GetNextStatInterval(ReportLib* report_lib) EXPORT;
 }
 
 // Exported methods working with a client created instance
@@ -774,6 +1228,10 @@ CallChain* GetCallChainOfCurrentSample(ReportLib* report_lib) {
   return report_lib->GetCallChainOfCurrentSample();
 }
 
+uint64_t GetCallChainIdOfCurrentSample(ReportLib* report_lib) {
+  return report_lib->GetCallChainIdOfCurrentSample();
+}
+
 EventCountersView* GetEventCountersOfCurrentSample(ReportLib* report_lib) {
   return report_lib->GetEventCountersOfCurrentSample();
 }
@@ -793,3 +1251,35 @@ const char* GetBuildIdForPath(ReportLib* report_lib, const char* path) {
 FeatureSection* GetFeatureSection(ReportLib* report_lib, const char* feature_name) {
   return report_lib->GetFeatureSection(feature_name);
 }
+
+SampleBatch* GetNextSampleBatch(ReportLib* report_lib, uint32_t max_count) {
+  return report_lib->GetNextSampleBatch(max_count);
+}
+
+StringTable* GetStringTable(ReportLib* report_lib) {
+  return report_lib->GetStringTable();
+}
+
+FrameTable* GetFrameTable(ReportLib* report_lib) {
+  return report_lib->GetFrameTable();
+}
+
+CallChainTable* GetCallChainTable(ReportLib* report_lib) {
+  return report_lib->GetCallChainTable();
+}
+
+bool ExportSamples(ReportLib* report_lib, const char* path) {
+  return report_lib->ExportSamples(path);
+}
+
+bool SetCounterFile(ReportLib* report_lib, const char* counter_file) {
+  return report_lib->SetCounterFile(counter_file);
+}
+
+StringTable* GetCounterEventNames(ReportLib* report_lib) {
+  return report_lib->GetCounterEventNames();
+}
+
+StatInterval* GetNextStatInterval(ReportLib* report_lib) {
+  return report_lib->GetNextStatInterval();
+}
@@ -17,7 +17,10 @@
 #ifndef SIMPLE_PERF_SAMPLE_TREE_H_
 #define SIMPLE_PERF_SAMPLE_TREE_H_
 
+#include <algorithm>
+#include <set>
 #include <unordered_map>
+#include <vector>
 
 #include "OfflineUnwinder.h"
 #include "SampleComparator.h"
@@ -26,9 +29,126 @@
 #include "perf_regs.h"
 #include "record.h"
 #include "thread_tree.h"
+#include "utils.h"
 
 namespace simpleperf {
 
+// SampleSet keeps samples that are different from each other according to a SampleComparator.
+// If the comparator can hash samples, they are kept in an open addressing hash table, which avoids
+// running the compare functions O(log n) times for each lookup. Otherwise, they are kept in an
+// ordered set.
+template <typename EntryT>
+class SampleSet {
+ public:
+  explicit SampleSet(const SampleComparator<EntryT>& comparator)
+      : comparator_(comparator), use_hash_(comparator.CanHash()), set_(comparator) {}
+
+  size_t size() const { return use_hash_ ? size_ : set_.size(); }
+
+  // Return the sample in the set which is the same as the given sample, or nullptr.
+  EntryT* Find(const EntryT* sample) const {
+    if (!use_hash_) {
+      auto it = set_.find(const_cast<EntryT*>(sample));
+      return it != set_.end() ? *it : nullptr;
+    }
+    if (size_ == 0) {
+      return nullptr;
+    }
+    size_t hash = comparator_.Hash(sample);
+    for (size_t i = hash & mask_;; i = (i + 1) & mask_) {
+      const Slot& slot = slots_[i];
+      if (slot.sample == nullptr) {
+        return nullptr;
+      }
+      if (slot.hash == hash && comparator_.IsSameSample(slot.sample, sample)) {
+        return slot.sample;
+      }
+    }
+  }
+
+  // Insert a sample not in the set.
+  void Insert(EntryT* sample) {
+    if (!use_hash_) {
+      set_.insert(sample);
+      return;
+    }
+    // Keep the load factor <= 0.5.
+    if ((size_ + 1) * 2 > slots_.size()) {
+      Rehash(std::max<size_t>(slots_.size() * 2, 64));
+    }
+    InsertSlot(Slot{comparator_.Hash(sample), sample});
+    size_++;
+  }
+
+  // Call the callback for each sample, in no particular order.
+  template <typename Callback>
+  void ForEach(Callback callback) const {
+    if (!use_hash_) {
+      for (EntryT* sample : set_) {
+        callback(sample);
+      }
+      return;
+    }
+    for (const Slot& slot : slots_) {
+      if (slot.sample != nullptr) {
+        callback(slot.sample);
+      }
+    }
+  }
+
+  // Return samples sorted by the comparator.
+  std::vector<EntryT*> GetSortedSamples() const {
+    std::vector<EntryT*> result;
+    result.reserve(size());
+    ForEach([&](EntryT* sample) { result.push_back(sample); });
+    if (use_hash_) {
+      std::sort(result.begin(), result.end(), comparator_);
+    }
+    return result;
+  }
+
+  void clear() {
+    set_.clear();
+    slots_.clear();
+    size_ = 0;
+    mask_ = 0;
+  }
+
+ private:
+  struct Slot {
+    size_t hash;
+    EntryT* sample;
+  };
+
+  void Rehash(size_t slot_count) {
+    std::vector<Slot> old_slots(slot_count, Slot{0, nullptr});
+    old_slots.swap(slots_);
+    mask_ = slot_count - 1;
+    for (const Slot& slot : old_slots) {
+      if (slot.sample != nullptr) {
+        InsertSlot(slot);
+      }
+    }
+  }
+
+  void InsertSlot(const Slot& slot) {
+    size_t i = slot.hash & mask_;
+    while (slots_[i].sample != nullptr) {
+      i = (i + 1) & mask_;
+    }
+    slots_[i] = slot;
+  }
+
+  const SampleComparator<EntryT> comparator_;
+  const bool use_hash_;
+  // Used when use_hash_ is true. The size of slots_ is a power of two.
+  std::vector<Slot> slots_;
+  size_t size_ = 0;
+  size_t mask_ = 0;
+  // Used when use_hash_ is false.
+  std::set<EntryT*, SampleComparator<EntryT>> set_;
+};
+
 // A SampleTree is a collection of samples. A profiling report is mainly about
 // constructing a SampleTree and display it. There are three steps involved:
 // build the tree, sort the tree, and display it. For example, if we want to
@@ -54,6 +174,8 @@ namespace simpleperf {
 
 template <typename EntryT, typename AccumulateInfoT>
 class SampleTreeBuilder {
+  static constexpr size_t kAllocatorUnitSize = 64 * kKilobyte;
+
  public:
   explicit SampleTreeBuilder(const SampleComparator<EntryT>& comparator)
       : sample_set_(comparator),
@@ -64,7 +186,7 @@ class SampleTreeBuilder {
         build_callchain_(false),
         use_caller_as_callchain_root_(false) {}
 
-  virtual ~SampleTreeBuilder() {}
+  virtual ~SampleTreeBuilder() { DestroySamples(); }
 
   void SetBranchSampleOption(bool use_branch_address) { use_branch_address_ = use_branch_address; }
 
@@ -172,14 +294,22 @@ class SampleTreeBuilder {
     }
   }
 
-  std::vector<EntryT*> GetSamples() const {
-    std::vector<EntryT*> result;
-    for (auto& entry : sample_set_) {
-      result.push_back(entry);
+  // Move samples from another builder using the same comparator. It is used to merge sample trees
+  // built in parallel, and doesn't support callchains.
+  void MergeSamplesFrom(SampleTreeBuilder& other) {
+    for (EntryT* sample : other.sample_storage_) {
+      if (other.sample_set_.Find(sample) == sample) {
+        InsertSample(std::move(*sample));
+      }
     }
-    return result;
+    other.sample_set_.clear();
+    other.filtered_sample_set_.clear();
+    other.DestroySamples();
+    other.allocator_.Clear();
   }
 
+  std::vector<EntryT*> GetSamples() const { return sample_set_.GetSortedSamples(); }
+
  protected:
   virtual EntryT* CreateSample(const SampleRecord& r, bool in_kernel,
                                AccumulateInfoT* acc_info) = 0;
@@ -196,46 +326,34 @@ class SampleTreeBuilder {
 
   virtual void MergeSample(EntryT* sample1, EntryT* sample2) = 0;
 
-  EntryT* InsertSample(std::unique_ptr<EntryT> sample) {
-    if (sample == nullptr) {
-      return nullptr;
-    }
-    if (!FilterSample(sample.get())) {
+  // Insert a sample built on the stack. It is moved into the builder only if it doesn't match
+  // an existing sample, so merged samples don't cost any allocation.
+  EntryT* InsertSample(EntryT&& sample) {
+    if (!FilterSample(&sample)) {
       // Store in filtered_sample_set_ for use in other EntryT's callchain.
-      auto it = filtered_sample_set_.find(sample.get());
-      if (it != filtered_sample_set_.end()) {
-        return *it;
+      if (EntryT* result = filtered_sample_set_.Find(&sample); result != nullptr) {
+        return result;
       }
-      EntryT* result = sample.get();
-      filtered_sample_set_.insert(sample.get());
-      sample_storage_.push_back(std::move(sample));
+      EntryT* result = StoreSample(std::move(sample));
+      filtered_sample_set_.Insert(result);
       return result;
     }
-    UpdateSummary(sample.get());
-    EntryT* result;
-    auto it = sample_set_.find(sample.get());
-    if (it == sample_set_.end()) {
-      result = sample.get();
-      sample_set_.insert(sample.get());
-      sample_storage_.push_back(std::move(sample));
+    UpdateSummary(&sample);
+    EntryT* result = sample_set_.Find(&sample);
+    if (result == nullptr) {
+      result = StoreSample(std::move(sample));
+      sample_set_.Insert(result);
     } else {
-      result = *it;
-      MergeSample(*it, sample.get());
+      MergeSample(result, &sample);
     }
     return result;
   }
 
-  EntryT* InsertCallChainSample(std::unique_ptr<EntryT> sample,
-                                const std::vector<EntryT*>& callchain) {
-    if (sample == nullptr) {
-      return nullptr;
-    }
-    auto it = sample_set_.find(sample.get());
-    if (it != sample_set_.end()) {
-      EntryT* sample = *it;
+  EntryT* InsertCallChainSample(EntryT&& sample, const std::vector<EntryT*>& callchain) {
+    if (EntryT* existing = sample_set_.Find(&sample); existing != nullptr) {
       // Process only once for recursive function call.
-      if (std::find(callchain.begin(), callchain.end(), sample) != callchain.end()) {
-        return sample;
+      if (std::find(callchain.begin(), callchain.end(), existing) != callchain.end()) {
+        return existing;
       }
     }
     return InsertSample(std::move(sample));
@@ -244,26 +362,40 @@ class SampleTreeBuilder {
   void InsertCallChainForSample(EntryT* sample, const std::vector<EntryT*>& callchain,
                                 const AccumulateInfoT& acc_info) {
     uint64_t period = GetPeriodForCallChain(acc_info);
-    sample->callchain.AddCallChain(callchain, period, [&](const EntryT* s1, const EntryT* s2) {
-      return sample_comparator_.IsSameSample(s1, s2);
-    });
+    sample->callchain.AddCallChain(callchain, period, &allocator_,
+                                   [&](const EntryT* s1, const EntryT* s2) {
+                                     return sample_comparator_.IsSameSample(s1, s2);
+                                   });
   }
 
   void AddCallChainDuplicateInfo() {
     if (build_callchain_) {
-      for (EntryT* sample : sample_set_) {
+      sample_set_.ForEach([&](EntryT* sample) {
         auto it = callchain_parent_map_.find(sample);
         if (it != callchain_parent_map_.end() && !it->second.has_multiple_parents) {
           sample->callchain.duplicated = true;
         }
-      }
+      });
     }
   }
 
-  std::set<EntryT*, SampleComparator<EntryT>> sample_set_;
+  SampleSet<EntryT> sample_set_;
   bool accumulate_callchain_;
 
  private:
+  EntryT* StoreSample(EntryT&& sample) {
+    EntryT* result = allocator_.New<EntryT>(std::move(sample));
+    sample_storage_.push_back(result);
+    return result;
+  }
+
+  void DestroySamples() {
+    for (EntryT* sample : sample_storage_) {
+      sample->~EntryT();
+    }
+    sample_storage_.clear();
+  }
+
   void UpdateCallChainParentInfo(EntryT* sample, EntryT* parent) {
     if (parent == nullptr) {
       return;
@@ -282,8 +414,11 @@ class SampleTreeBuilder {
   const SampleComparator<EntryT> sample_comparator_;
   // If a Sample/CallChainSample is filtered out, it is stored in filtered_sample_set_,
   // and only used in other EntryT's callchain.
-  std::set<EntryT*, SampleComparator<EntryT>> filtered_sample_set_;
-  std::vector<std::unique_ptr<EntryT>> sample_storage_;
+  SampleSet<EntryT> filtered_sample_set_;
+  // Samples and their callchain nodes are allocated from allocator_, to avoid allocating and
+  // freeing them one by one.
+  OneTimeFreeAllocator allocator_{kAllocatorUnitSize};
+  std::vector<EntryT*> sample_storage_;
 
   struct CallChainParentInfo {
     EntryT* parent;
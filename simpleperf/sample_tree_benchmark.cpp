@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <libgen.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include "dso.h"
+#include "record_file.h"
+#include "sample_tree.h"
+#include "thread_tree.h"
+
+using namespace simpleperf;
+
+namespace {
+
+std::string testdata_dir;
+
+struct BenchSampleEntry {
+  pid_t pid;
+  pid_t tid;
+  const char* thread_comm;
+  const MapEntry* map;
+  const Symbol* symbol;
+  uint64_t vaddr_in_file;
+  uint64_t period;
+  uint64_t sample_count;
+
+  BenchSampleEntry(const ThreadEntry* thread, const MapEntry* map, const Symbol* symbol,
+                   uint64_t vaddr_in_file, uint64_t period)
+      : pid(thread->pid),
+        tid(thread->tid),
+        thread_comm(thread->comm),
+        map(map),
+        symbol(symbol),
+        vaddr_in_file(vaddr_in_file),
+        period(period),
+        sample_count(1) {}
+};
+
+BUILD_COMPARE_VALUE_FUNCTION(CompareVaddrInFile, vaddr_in_file);
+BUILD_HASH_VALUE_FUNCTION(HashVaddrInFile, vaddr_in_file);
+
+class BenchSampleTreeBuilder : public SampleTreeBuilder<BenchSampleEntry, int> {
+ public:
+  explicit BenchSampleTreeBuilder(const SampleComparator<BenchSampleEntry>& comparator)
+      : SampleTreeBuilder(comparator) {}
+
+  void AddSample(const BenchSampleEntry& sample) {
+    InsertSample(BenchSampleEntry(sample));
+  }
+
+ protected:
+  BenchSampleEntry* CreateSample(const SampleRecord&, bool, int*) override { return nullptr; }
+  BenchSampleEntry* CreateBranchSample(const SampleRecord&, const BranchStackItemType&) override {
+    return nullptr;
+  }
+  BenchSampleEntry* CreateCallChainSample(const ThreadEntry*, const BenchSampleEntry*, uint64_t,
+                                          bool, const std::vector<BenchSampleEntry*>&,
+                                          const int&) override {
+    return nullptr;
+  }
+  const ThreadEntry* GetThreadOfSample(BenchSampleEntry*) override { return nullptr; }
+  uint64_t GetPeriodForCallChain(const int&) override { return 0; }
+  void MergeSample(BenchSampleEntry* sample1, BenchSampleEntry* sample2) override {
+    sample1->period += sample2->period;
+    sample1->sample_count += sample2->sample_count;
+  }
+};
+
+// Samples read from a record file, with symbols resolved.
+struct RecordFileSamples {
+  ThreadTree thread_tree;
+  std::vector<BenchSampleEntry> samples;
+};
+
+const RecordFileSamples& GetSamples(const std::string& filename) {
+  static std::map<std::string, std::unique_ptr<RecordFileSamples>> cache;
+  std::unique_ptr<RecordFileSamples>& data = cache[filename];
+  if (data) {
+    return *data;
+  }
+  data.reset(new RecordFileSamples);
+  auto reader = RecordFileReader::CreateInstance(testdata_dir + filename);
+  CHECK(reader) << "failed to read " << testdata_dir + filename;
+  ThreadTree& thread_tree = data->thread_tree;
+  thread_tree.ShowIpForUnknownSymbol();
+  CHECK(reader->LoadBuildIdAndFileFeatures(thread_tree));
+  auto callback = [&](Record* record) {
+    thread_tree.Update(*record);
+    if (record->type() == PERF_RECORD_SAMPLE) {
+      auto r = static_cast<SampleRecord*>(record);
+      const ThreadEntry* thread = thread_tree.FindThreadOrNew(r->tid_data.pid, r->tid_data.tid);
+      const MapEntry* map = thread_tree.FindMap(thread, r->ip_data.ip, r->InKernel());
+      uint64_t vaddr_in_file;
+      const Symbol* symbol = thread_tree.FindSymbol(map, r->ip_data.ip, &vaddr_in_file);
+      data->samples.emplace_back(thread, map, symbol, vaddr_in_file, r->period_data.period);
+    }
+    return true;
+  };
+  CHECK(reader->ReadDataSectionInPlace(callback));
+  return *data;
+}
+
+const char* kRecordFiles[] = {
+    "perf.data",
+    "perf_g_fp.data",
+    "perf_with_symbols.data",
+};
+
+// Use the default sort keys of the report command: comm,pid,tid,dso,symbol.
+// If by_vaddr is true, also sort by vaddr_in_file, which generates many more report entries.
+SampleComparator<BenchSampleEntry> BuildComparator(bool use_hash, bool by_vaddr) {
+  SampleComparator<BenchSampleEntry> comparator;
+  comparator.AddCompareFunction(CompareComm, use_hash ? HashComm<BenchSampleEntry> : nullptr);
+  comparator.AddCompareFunction(ComparePid, use_hash ? HashPid<BenchSampleEntry> : nullptr);
+  comparator.AddCompareFunction(CompareTid, use_hash ? HashTid<BenchSampleEntry> : nullptr);
+  comparator.AddCompareFunction(CompareDso, use_hash ? HashDso<BenchSampleEntry> : nullptr);
+  comparator.AddCompareFunction(CompareSymbol, use_hash ? HashSymbol<BenchSampleEntry> : nullptr);
+  if (by_vaddr) {
+    comparator.AddCompareFunction(CompareVaddrInFile,
+                                  use_hash ? HashVaddrInFile<BenchSampleEntry> : nullptr);
+  }
+  return comparator;
+}
+
+// Arguments: index of the record file, use hash or not, sort by vaddr_in_file or not.
+void BM_AggregateSamples(benchmark::State& state) {
+  const std::string filename = kRecordFiles[state.range(0)];
+  const bool use_hash = state.range(1) != 0;
+  const bool by_vaddr = state.range(2) != 0;
+  const RecordFileSamples& data = GetSamples(filename);
+  SampleComparator<BenchSampleEntry> comparator = BuildComparator(use_hash, by_vaddr);
+  // Record files in testdata are small. Repeat samples to make the run time measurable.
+  const size_t repeat = 100;
+  size_t entries = 0;
+  for (auto _ : state) {
+    BenchSampleTreeBuilder builder(comparator);
+    for (size_t i = 0; i < repeat; i++) {
+      for (const BenchSampleEntry& sample : data.samples) {
+        builder.AddSample(sample);
+      }
+    }
+    std::vector<BenchSampleEntry*> samples = builder.GetSamples();
+    entries = samples.size();
+    benchmark::DoNotOptimize(samples.data());
+  }
+  state.SetLabel(filename + (use_hash ? " hash" : " ordered_set"));
+  state.counters["entries"] = entries;
+  state.SetItemsProcessed(state.iterations() * data.samples.size() * repeat);
+}
+
+BENCHMARK(BM_AggregateSamples)
+    ->ArgNames({"file", "hash", "vaddr"})
+    ->ArgsProduct({{0, 1, 2}, {0, 1}, {0, 1}});
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  android::base::InitLogging(argv, android::base::StderrLogger);
+  android::base::SetMinimumLogSeverity(android::base::ERROR);
+  testdata_dir = std::string(dirname(argv[0])) + "/testdata/";
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      testdata_dir = std::string(argv[i + 1]) + "/";
+      i++;
+    }
+  }
+  Dso::SetSymFsDir(testdata_dir);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -45,28 +45,32 @@ BUILD_COMPARE_VALUE_FUNCTION(TestComparePid, pid);
 BUILD_COMPARE_VALUE_FUNCTION(TestCompareTid, tid);
 BUILD_COMPARE_STRING_FUNCTION(TestCompareDsoName, dso_name.c_str());
 BUILD_COMPARE_VALUE_FUNCTION(TestCompareMapStartAddr, map_start_addr);
+BUILD_HASH_VALUE_FUNCTION(TestHashPid, pid);
+BUILD_HASH_VALUE_FUNCTION(TestHashTid, tid);
+BUILD_HASH_STRING_FUNCTION(TestHashDsoName, dso_name);
+BUILD_HASH_VALUE_FUNCTION(TestHashMapStartAddr, map_start_addr);
 
 class TestSampleComparator : public SampleComparator<SampleEntry> {
  public:
-  TestSampleComparator() {
-    AddCompareFunction(TestComparePid);
-    AddCompareFunction(TestCompareTid);
-    AddCompareFunction(CompareComm);
-    AddCompareFunction(TestCompareDsoName);
-    AddCompareFunction(TestCompareMapStartAddr);
+  explicit TestSampleComparator(bool use_hash = false) {
+    AddCompareFunction(TestComparePid, use_hash ? TestHashPid<SampleEntry> : nullptr);
+    AddCompareFunction(TestCompareTid, use_hash ? TestHashTid<SampleEntry> : nullptr);
+    AddCompareFunction(CompareComm, use_hash ? HashComm<SampleEntry> : nullptr);
+    AddCompareFunction(TestCompareDsoName, use_hash ? TestHashDsoName<SampleEntry> : nullptr);
+    AddCompareFunction(TestCompareMapStartAddr,
+                       use_hash ? TestHashMapStartAddr<SampleEntry> : nullptr);
   }
 };
 
 class TestSampleTreeBuilder : public SampleTreeBuilder<SampleEntry, int> {
  public:
-  explicit TestSampleTreeBuilder(ThreadTree* thread_tree)
-      : SampleTreeBuilder(TestSampleComparator()), thread_tree_(thread_tree) {}
+  explicit TestSampleTreeBuilder(ThreadTree* thread_tree, bool use_hash = false)
+      : SampleTreeBuilder(TestSampleComparator(use_hash)), thread_tree_(thread_tree) {}
 
   void AddSample(int pid, int tid, uint64_t ip, bool in_kernel) {
     const ThreadEntry* thread = thread_tree_->FindThreadOrNew(pid, tid);
     const MapEntry* map = thread_tree_->FindMap(thread, ip, in_kernel);
-    InsertSample(std::unique_ptr<SampleEntry>(
-        new SampleEntry(pid, tid, thread->comm, map->dso->Path(), map->start_addr)));
+    InsertSample(SampleEntry(pid, tid, thread->comm, map->dso->Path(), map->start_addr));
   }
 
  protected:
@@ -240,3 +244,68 @@ TEST(thread_tree, symbol_ULLONG_MAX) {
   thread_tree.ShowIpForUnknownSymbol();
   ASSERT_TRUE(thread_tree.FindKernelSymbol(ULLONG_MAX) != nullptr);
 }
+
+// @CddTest = 6.1/C-0-2
+TEST(sample_tree, hash_sample_set) {
+  ThreadTree thread_tree;
+  TestSampleTreeBuilder ordered_builder(&thread_tree, false);
+  TestSampleTreeBuilder hash_builder(&thread_tree, true);
+  for (int pid = 1; pid <= 10; pid++) {
+    thread_tree.SetThreadName(pid, pid, "thread" + std::to_string(pid));
+    for (uint64_t i = 0; i < 20; i++) {
+      thread_tree.AddThreadMap(pid, pid, i * 0x1000, 0x1000, 0, "map" + std::to_string(i % 7));
+    }
+  }
+  // Add enough samples to grow the hash table a few times.
+  for (uint64_t i = 0; i < 10000; i++) {
+    int pid = static_cast<int>(i % 10) + 1;
+    uint64_t ip = (i * 7919) % (20 * 0x1000);
+    bool in_kernel = i % 13 == 0;
+    ordered_builder.AddSample(pid, pid, ip, in_kernel);
+    hash_builder.AddSample(pid, pid, ip, in_kernel);
+  }
+  std::vector<SampleEntry*> ordered_samples = ordered_builder.GetSamples();
+  std::vector<SampleEntry> expected_samples;
+  for (SampleEntry* sample : ordered_samples) {
+    expected_samples.push_back(*sample);
+  }
+  ASSERT_GT(expected_samples.size(), 100u);
+  CheckSamples(hash_builder.GetSamples(), expected_samples);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(sample_tree, callchain_root) {
+  std::vector<SampleEntry> entries;
+  for (int i = 0; i < 4; i++) {
+    entries.emplace_back(i, i, "comm", "dso", 0);
+  }
+  SampleEntry* a = &entries[0];
+  SampleEntry* b = &entries[1];
+  SampleEntry* c = &entries[2];
+  SampleEntry* d = &entries[3];
+  auto is_same_sample = [](const SampleEntry* s1, const SampleEntry* s2) { return s1 == s2; };
+  OneTimeFreeAllocator allocator;
+  CallChainRoot<SampleEntry> root;
+  root.AddCallChain({a, b, c}, 1, &allocator, is_same_sample);
+  // Split node (a, b, c) into (a, b) -> (c) and (a, b) -> (d).
+  root.AddCallChain({a, b, d}, 2, &allocator, is_same_sample);
+  root.AddCallChain({a, b, d}, 2, &allocator, is_same_sample);
+  root.AddCallChain({b}, 1, &allocator, is_same_sample);
+  root.SortByPeriod();
+
+  ASSERT_EQ(root.children_period, 6u);
+  ASSERT_EQ(root.children.size(), 2u);
+  auto* node = root.children[0];
+  ASSERT_EQ(node->chain.size(), 2u);
+  ASSERT_EQ(node->chain[0], a);
+  ASSERT_EQ(node->chain[1], b);
+  ASSERT_EQ(node->period, 0u);
+  ASSERT_EQ(node->children_period, 5u);
+  ASSERT_EQ(node->children.size(), 2u);
+  ASSERT_EQ(node->children[0]->chain[0], d);
+  ASSERT_EQ(node->children[0]->period, 4u);
+  ASSERT_EQ(node->children[1]->chain[0], c);
+  ASSERT_EQ(node->children[1]->period, 1u);
+  ASSERT_EQ(root.children[1]->chain[0], b);
+  ASSERT_EQ(root.children[1]->period, 1u);
+}
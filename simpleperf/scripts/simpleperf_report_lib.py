@@ -258,6 +258,73 @@ class FeatureSectionStructure(ct.Structure):
                 ('data_size', ct.c_uint32)]
 
 
+class SampleBatchStructure(ct.Structure):
+    """ Samples read by GetNextSampleBatch(), stored in columns. Each column has count values.
+        event_name and thread_name are indexes in the string table.
+        callchain is an index in the callchain table.
+    """
+    _fields_ = [('count', ct.c_uint32),
+                ('time', ct.POINTER(ct.c_uint64)),
+                ('period', ct.POINTER(ct.c_uint64)),
+                ('pid', ct.POINTER(ct.c_uint32)),
+                ('tid', ct.POINTER(ct.c_uint32)),
+                ('cpu', ct.POINTER(ct.c_uint32)),
+                ('event_name', ct.POINTER(ct.c_uint32)),
+                ('thread_name', ct.POINTER(ct.c_uint32)),
+                ('callchain', ct.POINTER(ct.c_uint32))]
+
+
+class StringTableStructure(ct.Structure):
+    _fields_ = [('count', ct.c_uint32),
+                ('strings', ct.POINTER(ct.c_char_p))]
+
+
+class FrameEntryStructure(ct.Structure):
+    """ A frame in callchains. dso_name and symbol_name are indexes in the string table. """
+    _fields_ = [('vaddr_in_file', ct.c_uint64),
+                ('dso_name', ct.c_uint32),
+                ('symbol_name', ct.c_uint32)]
+
+
+class FrameTableStructure(ct.Structure):
+    _fields_ = [('count', ct.c_uint32),
+                ('frames', ct.POINTER(FrameEntryStructure))]
+
+
+class CallChainTableStructure(ct.Structure):
+    """ Callchain i has frames[offsets[i]:offsets[i + 1]], from the sampled frame to the root.
+        Values in frames are indexes in the frame table.
+    """
+    _fields_ = [('count', ct.c_uint32),
+                ('offsets', ct.POINTER(ct.c_uint32)),
+                ('frames', ct.POINTER(ct.c_uint32))]
+
+
+class StatCounterStructure(ct.Structure):
+    """ A counter of an event on a thread and cpu in an interval, read from a file generated by
+        `simpleperf stat --binary-output`.
+        event_index: an index in the list returned by GetCounterEventNames().
+        value, time_enabled, time_running: deltas from the previous interval.
+    """
+    _fields_ = [('event_index', ct.c_uint32),
+                ('tid', ct.c_int32),
+                ('cpu', ct.c_int32),
+                ('value', ct.c_uint64),
+                ('time_enabled', ct.c_uint64),
+                ('time_running', ct.c_uint64)]
+
+
+class StatIntervalStructure(ct.Structure):
+    """ Counters in an interval.
+        time_in_ns: time since stat starts.
+        eof: set when there are no more intervals.
+    """
+    _fields_ = [('time_in_ns', ct.c_uint64),
+                ('counter_count', ct.c_uint32),
+                ('eof', ct.c_uint32),
+                ('counters', ct.POINTER(StatCounterStructure))]
+
+
 class ReportLibStructure(ct.Structure):
     _fields_ = []
 
@@ -319,6 +386,8 @@ class ReportLib(object):
         self._GetSymbolOfCurrentSampleFunc.restype = ct.POINTER(SymbolStruct)
         self._GetCallChainOfCurrentSampleFunc = self._lib.GetCallChainOfCurrentSample
         self._GetCallChainOfCurrentSampleFunc.restype = ct.POINTER(CallChainStructure)
+        self._GetCallChainIdOfCurrentSampleFunc = self._lib.GetCallChainIdOfCurrentSample
+        self._GetCallChainIdOfCurrentSampleFunc.restype = ct.c_uint64
         self._GetEventCountersOfCurrentSampleFunc = self._lib.GetEventCountersOfCurrentSample
         self._GetEventCountersOfCurrentSampleFunc.restype = ct.POINTER(EventCountersViewStructure)
         self._GetTracingDataOfCurrentSampleFunc = self._lib.GetTracingDataOfCurrentSample
@@ -329,6 +398,22 @@ class ReportLib(object):
         self._GetBuildIdForPathFunc.restype = ct.c_char_p
         self._GetFeatureSection = self._lib.GetFeatureSection
         self._GetFeatureSection.restype = ct.POINTER(FeatureSectionStructure)
+        self._GetNextSampleBatchFunc = self._lib.GetNextSampleBatch
+        self._GetNextSampleBatchFunc.restype = ct.POINTER(SampleBatchStructure)
+        self._GetStringTableFunc = self._lib.GetStringTable
+        self._GetStringTableFunc.restype = ct.POINTER(StringTableStructure)
+        self._GetFrameTableFunc = self._lib.GetFrameTable
+        self._GetFrameTableFunc.restype = ct.POINTER(FrameTableStructure)
+        self._GetCallChainTableFunc = self._lib.GetCallChainTable
+        self._GetCallChainTableFunc.restype = ct.POINTER(CallChainTableStructure)
+        self._ExportSamplesFunc = self._lib.ExportSamples
+        self._ExportSamplesFunc.restype = ct.c_bool
+        self._SetCounterFileFunc = self._lib.SetCounterFile
+        self._SetCounterFileFunc.restype = ct.c_bool
+        self._GetCounterEventNamesFunc = self._lib.GetCounterEventNames
+        self._GetCounterEventNamesFunc.restype = ct.POINTER(StringTableStructure)
+        self._GetNextStatIntervalFunc = self._lib.GetNextStatInterval
+        self._GetNextStatIntervalFunc.restype = ct.POINTER(StatIntervalStructure)
         self._instance = self._CreateReportLibFunc()
         assert not _is_null(self._instance)
 
@@ -486,6 +571,12 @@ class ReportLib(object):
         assert not _is_null(callchain)
         return callchain[0]
 
+    def GetCallChainIdOfCurrentSample(self) -> int:
+        """ Return an id of the callchain of the current sample. Samples with the same id have
+            the same symbolized callchain. So callers can use it to cache results for callchains.
+        """
+        return self._GetCallChainIdOfCurrentSampleFunc(self.getInstance())
+
     def GetEventCountersOfCurrentSample(self) -> EventCountersViewStructure:
         event_counters = self._GetEventCountersOfCurrentSampleFunc(self.getInstance())
         assert not _is_null(event_counters)
@@ -505,6 +596,51 @@ class ReportLib(object):
     def GetProcessNameOfCurrentSample(self) -> str:
         return _char_pt_to_str(self._GetProcessNameOfCurrentSampleFunc(self.getInstance()))
 
+    def GetNextSampleBatch(self, max_count: int = 4096) -> SampleBatchStructure:
+        """ Read up to max_count samples in columns. If no more samples, return a batch with
+            count = 0. The batch and tables are valid until the next call of GetNextSampleBatch().
+        """
+        batch = self._GetNextSampleBatchFunc(self.getInstance(), ct.c_uint32(max_count))
+        _check(not _is_null(batch), 'Failed to call GetNextSampleBatch()')
+        self.current_sample = None
+        return batch[0]
+
+    def GetStringTable(self) -> List[str]:
+        table = self._GetStringTableFunc(self.getInstance())[0]
+        return [_char_pt_to_str(table.strings[i]) for i in range(table.count)]
+
+    def GetFrameTable(self) -> FrameTableStructure:
+        return self._GetFrameTableFunc(self.getInstance())[0]
+
+    def GetCallChainTable(self) -> CallChainTableStructure:
+        return self._GetCallChainTableFunc(self.getInstance())[0]
+
+    def ExportSamples(self, path: Union[str, Path]):
+        """ Write all samples to a columnar binary file. The format is described in
+            ReportLib::ExportSamples() in report_lib_interface.cpp.
+        """
+        res: bool = self._ExportSamplesFunc(self.getInstance(), _char_pt(str(path)))
+        _check(res, f'Failed to call ExportSamples({path})')
+
+    def SetCounterFile(self, counter_file: Union[str, Path]):
+        """ Read counters from a file generated by `simpleperf stat --binary-output`. """
+        res: bool = self._SetCounterFileFunc(self.getInstance(), _char_pt(str(counter_file)))
+        _check(res, f'Failed to call SetCounterFile({counter_file})')
+
+    def GetCounterEventNames(self) -> List[str]:
+        table = self._GetCounterEventNamesFunc(self.getInstance())[0]
+        return [_char_pt_to_str(table.strings[i]) for i in range(table.count)]
+
+    def GetNextStatInterval(self) -> Optional[StatIntervalStructure]:
+        """ Return counters in the next interval. If no more intervals, return None.
+            Raise RuntimeError if the counter file is broken.
+        """
+        interval = self._GetNextStatIntervalFunc(self.getInstance())
+        _check(not _is_null(interval), 'Failed to call GetNextStatInterval()')
+        if interval[0].eof:
+            return None
+        return interval[0]
+
     def GetBuildIdForPath(self, path: str) -> str:
         build_id = self._GetBuildIdForPathFunc(self.getInstance(), _char_pt(path))
         assert not _is_null(build_id)
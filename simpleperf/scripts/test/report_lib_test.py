@@ -17,12 +17,13 @@
 import os
 from pathlib import Path
 import shutil
+import struct
 import subprocess
 import tempfile
 from typing import Dict, List, Optional, Set
 
 from simpleperf_report_lib import ReportLib, ProtoFileReportLib
-from simpleperf_utils import get_host_binary_path, ReadElf
+from simpleperf_utils import bytes_to_str, get_host_binary_path, ReadElf
 from . test_utils import TestBase, TestHelper
 
 
@@ -407,6 +408,178 @@ class TestReportLib(TestBase):
             process_name = self.report_lib.GetProcessNameOfCurrentSample()
             self.assertEqual(process_name, expected_process_name)
 
+    def test_callchain_id(self):
+        self.report_lib.SetRecordFile(TestHelper.testdata_path('perf_display_bitmaps.data'))
+        callchains = {}
+        sample_count = 0
+        while self.report_lib.GetNextSample():
+            sample_count += 1
+            symbols = [self.report_lib.GetSymbolOfCurrentSample()]
+            callchain = self.report_lib.GetCallChainOfCurrentSample()
+            symbols += [callchain.entries[i].symbol for i in range(callchain.nr)]
+            frames = [(s.dso_name, s.symbol_name, s.vaddr_in_file) for s in symbols]
+            callchain_id = self.report_lib.GetCallChainIdOfCurrentSample()
+            if callchain_id in callchains:
+                self.assertEqual(callchains[callchain_id], frames)
+            else:
+                callchains[callchain_id] = frames
+        self.assertLess(len(callchains), sample_count)
+
+    def get_samples_one_by_one(self):
+        samples = []
+        while self.report_lib.GetNextSample():
+            sample = self.report_lib.GetCurrentSample()
+            symbols = [self.report_lib.GetSymbolOfCurrentSample()]
+            callchain = self.report_lib.GetCallChainOfCurrentSample()
+            symbols += [callchain.entries[i].symbol for i in range(callchain.nr)]
+            frames = [(s.dso_name, s.symbol_name, s.vaddr_in_file) for s in symbols]
+            samples.append((sample.time, sample.period, sample.tid, sample.cpu,
+                            self.report_lib.GetEventOfCurrentSample().name,
+                            sample.thread_comm, frames))
+        return samples
+
+    def test_get_next_sample_batch(self):
+        def get_samples_in_batch():
+            samples = []
+            while True:
+                batch = self.report_lib.GetNextSampleBatch(100)
+                if batch.count == 0:
+                    break
+                strings = self.report_lib.GetStringTable()
+                frame_table = self.report_lib.GetFrameTable()
+                callchain_table = self.report_lib.GetCallChainTable()
+                for i in range(batch.count):
+                    callchain = batch.callchain[i]
+                    frames = []
+                    start = callchain_table.offsets[callchain]
+                    end = callchain_table.offsets[callchain + 1]
+                    for j in range(start, end):
+                        frame = frame_table.frames[callchain_table.frames[j]]
+                        frames.append((strings[frame.dso_name], strings[frame.symbol_name],
+                                       frame.vaddr_in_file))
+                    samples.append((batch.time[i], batch.period[i], batch.tid[i], batch.cpu[i],
+                                    strings[batch.event_name[i]], strings[batch.thread_name[i]],
+                                    frames))
+            return samples
+
+        record_file = TestHelper.testdata_path('perf_display_bitmaps.data')
+        self.report_lib.SetRecordFile(record_file)
+        expected_samples = self.get_samples_one_by_one()
+        self.report_lib.Close()
+        self.report_lib = ReportLib()
+        self.report_lib.SetRecordFile(record_file)
+        samples = get_samples_in_batch()
+        self.assertGreater(len(samples), 100)
+        self.assertEqual(samples, expected_samples)
+
+    def test_read_counter_file(self):
+        counter_file = self.test_dir / 'counters.bin'
+        with counter_file.open('wb') as f:
+            f.write(b'SPCOUNTS' + struct.pack('<II', 1, 2))
+            names = b''
+            for name in [b'cpu-cycles', b'instructions:u']:
+                names += struct.pack('<I', len(name)) + name
+            names += bytes(-len(names) % 8)
+            f.write(names)
+            for time_in_ns in [1000, 2000]:
+                f.write(struct.pack('<QII', time_in_ns, 2, 0))
+                f.write(struct.pack('<IiiIQQQ', 0, 10, 1, 0, time_in_ns, 5, 4))
+                f.write(struct.pack('<IiiIQQQ', 1, 10, 2, 0, time_in_ns // 2, 5, 5))
+        self.report_lib.SetCounterFile(counter_file)
+        self.assertEqual(self.report_lib.GetCounterEventNames(), ['cpu-cycles', 'instructions:u'])
+        intervals = []
+        while True:
+            interval = self.report_lib.GetNextStatInterval()
+            if interval is None:
+                break
+            counters = []
+            for i in range(interval.counter_count):
+                c = interval.counters[i]
+                counters.append((c.event_index, c.tid, c.cpu, c.value,
+                                 c.time_enabled, c.time_running))
+            intervals.append((interval.time_in_ns, counters))
+        self.assertEqual(intervals, [
+            (1000, [(0, 10, 1, 1000, 5, 4), (1, 10, 2, 500, 5, 5)]),
+            (2000, [(0, 10, 1, 2000, 5, 4), (1, 10, 2, 1000, 5, 5)]),
+        ])
+
+    def test_read_truncated_counter_file(self):
+        counter_file = self.test_dir / 'counters.bin'
+        with counter_file.open('wb') as f:
+            name = b'cpu-cycles'
+            names = struct.pack('<I', len(name)) + name
+            f.write(b'SPCOUNTS' + struct.pack('<II', 1, 1) + names + bytes(-len(names) % 8))
+            f.write(struct.pack('<QII', 1000, 2, 0))
+            f.write(struct.pack('<IiiIQQQ', 0, 10, 1, 0, 1000, 5, 4))
+        self.report_lib.SetCounterFile(counter_file)
+        with self.assertRaises(RuntimeError):
+            self.report_lib.GetNextStatInterval()
+
+    def test_export_samples(self):
+        record_file = TestHelper.testdata_path('perf_display_bitmaps.data')
+        self.report_lib.SetRecordFile(record_file)
+        expected_samples = self.get_samples_one_by_one()
+        self.report_lib.Close()
+        self.report_lib = ReportLib()
+        self.report_lib.SetRecordFile(record_file)
+        export_file = self.test_dir / 'samples.bin'
+        self.report_lib.ExportSamples(export_file)
+        data = export_file.read_bytes()
+        self.assertEqual(data[:4], b'SPCL')
+        self.assertEqual(struct.unpack('<I', data[4:8])[0], 1)
+
+        # Parse sections in the format described in ReportLib::ExportSamples().
+        offset = 8
+
+        def read(fmt: str) -> List[int]:
+            nonlocal offset
+            values = struct.unpack_from('<' + fmt, data, offset)
+            offset += struct.calcsize('<' + fmt)
+            return list(values)
+
+        sample_rows = []
+        strings = []
+        frame_table = []
+        callchain_offsets = []
+        callchain_frames = []
+        while True:
+            tag, count = read('2I')
+            if tag == 0:
+                self.assertEqual(count, 0)
+                break
+            if tag == 1:
+                columns = [read(f'{count}Q'), read(f'{count}Q')]
+                columns += [read(f'{count}I') for _ in range(6)]
+                sample_rows += zip(*columns)
+            elif tag == 2:
+                for _ in range(count):
+                    size = read('I')[0]
+                    strings.append(bytes_to_str(data[offset:offset + size]))
+                    offset += size
+            elif tag == 3:
+                frame_table += [read('QII') for _ in range(count)]
+            elif tag == 4:
+                callchain_offsets = read(f'{count + 1}I')
+                callchain_frames = read(f'{callchain_offsets[-1]}I')
+            else:
+                self.fail(f'unknown tag {tag}')
+            # Each section is padded to 8 bytes.
+            offset = (offset + 7) & ~7
+        self.assertEqual(offset, len(data))
+
+        samples = []
+        for time, period, _, tid, cpu, event_name, thread_name, callchain in sample_rows:
+            start = callchain_offsets[callchain]
+            end = callchain_offsets[callchain + 1]
+            frames = []
+            for frame_id in callchain_frames[start:end]:
+                vaddr_in_file, dso_name, symbol_name = frame_table[frame_id]
+                frames.append((strings[dso_name], strings[symbol_name], vaddr_in_file))
+            samples.append((time, period, tid, cpu, strings[event_name], strings[thread_name],
+                            frames))
+        self.assertGreater(len(samples), 100)
+        self.assertEqual(samples, expected_samples)
+
 
 class TestProtoFileReportLib(TestBase):
     def test_smoke(self):
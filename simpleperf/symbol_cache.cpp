@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "symbol_cache.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <string_view>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+
+#include "read_elf.h"
+#include "utils.h"
+
+namespace simpleperf {
+
+namespace {
+
+constexpr char kSymbolCacheMagic[8] = {'S', 'P', 'S', 'Y', 'M', 'C', 'C', 'H'};
+constexpr uint32_t kSymbolCacheVersion = 1;
+constexpr const char* kSymbolCacheFileSuffix = ".symcache";
+constexpr const char* kBuildIdCacheFileName = "build_id_cache";
+// Limit the cache file size, in case of recording many short lived files.
+constexpr size_t kMaxBuildIdCacheEntries = 100000;
+
+struct SymbolCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t symbol_count;
+  unsigned char build_id[BUILD_ID_SIZE];
+  uint32_t reserved;
+  uint64_t string_pool_size;
+};
+
+struct SymbolCacheEntry {
+  uint64_t addr;
+  uint64_t len;
+  // Offsets in the string pool.
+  uint32_t name;
+  uint32_t demangled_name;
+};
+
+static_assert(sizeof(SymbolCacheHeader) == 48);
+static_assert(sizeof(SymbolCacheHeader) % alignof(SymbolCacheEntry) == 0);
+static_assert(sizeof(SymbolCacheEntry) == 24);
+
+}  // namespace
+
+namespace fs = std::filesystem;
+
+// Write data to a uniquely named temporary file in the same dir, and rename it to path. So other
+// threads and processes writing the same path don't interfere, and readers never see a partial
+// file.
+static bool WriteFileAtomically(const std::string& path,
+                                const std::vector<std::string_view>& data) {
+  TemporaryFile tmp_file(fs::path(path).parent_path().string());
+  if (tmp_file.fd == -1) {
+    PLOG(WARNING) << "failed to create a temporary file for " << path;
+    return false;
+  }
+  for (std::string_view part : data) {
+    if (!android::base::WriteFully(tmp_file.fd, part.data(), part.size())) {
+      PLOG(WARNING) << "failed to write " << tmp_file.path;
+      return false;
+    }
+  }
+#if !defined(_WIN32)
+  // TemporaryFile creates files only accessible by the owner.
+  fchmod(tmp_file.fd, 0644);
+#endif
+  close(tmp_file.release());
+  std::error_code ec;
+  fs::rename(tmp_file.path, path, ec);
+  if (ec) {
+    LOG(WARNING) << "failed to rename " << tmp_file.path << " to " << path << ": " << ec.message();
+    return false;
+  }
+  tmp_file.DoNotRemove();
+  return true;
+}
+
+SymbolCache::SymbolCache(const std::string& dir, uint64_t max_size)
+    : dir_(dir), max_size_(max_size) {}
+
+std::string SymbolCache::GetCacheFilePath(const BuildId& build_id) const {
+  return dir_ + OS_PATH_SEPARATOR + build_id.ToString() + kSymbolCacheFileSuffix;
+}
+
+bool SymbolCache::Load(const BuildId& build_id, std::vector<Entry>* symbols) {
+  std::string path = GetCacheFilePath(build_id);
+  android::base::unique_fd fd = FileHelper::OpenReadOnly(path);
+  if (fd == -1) {
+    return false;
+  }
+  auto remove_invalid_file = [&]() {
+    LOG(DEBUG) << "remove invalid symbol cache file " << path;
+    std::error_code ec;
+    fs::remove(path, ec);
+    return false;
+  };
+  uint64_t file_size = GetFileSize(path);
+  if (file_size < sizeof(SymbolCacheHeader) ||
+      file_size > std::numeric_limits<size_t>::max()) {
+    return remove_invalid_file();
+  }
+  std::unique_ptr<android::base::MappedFile> map =
+      android::base::MappedFile::FromFd(fd, 0, file_size, PROT_READ);
+  if (!map) {
+    PLOG(DEBUG) << "failed to map " << path;
+    return false;
+  }
+  const char* data = map->data();
+  SymbolCacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, kSymbolCacheMagic, sizeof(kSymbolCacheMagic)) != 0 ||
+      header.version != kSymbolCacheVersion) {
+    return remove_invalid_file();
+  }
+  // The file name is only a hint. Check the build id in the file, in case the file is renamed.
+  if (BuildId(header.build_id, BUILD_ID_SIZE) != build_id) {
+    return remove_invalid_file();
+  }
+  uint64_t entries_size = static_cast<uint64_t>(header.symbol_count) * sizeof(SymbolCacheEntry);
+  if (header.string_pool_size == 0 ||
+      sizeof(header) + entries_size + header.string_pool_size != file_size ||
+      data[file_size - 1] != '\0') {
+    return remove_invalid_file();
+  }
+  auto entries = reinterpret_cast<const SymbolCacheEntry*>(data + sizeof(header));
+  const char* string_pool = data + sizeof(header) + entries_size;
+  std::vector<Entry> result;
+  result.reserve(header.symbol_count);
+  for (uint32_t i = 0; i < header.symbol_count; i++) {
+    const SymbolCacheEntry& entry = entries[i];
+    if (entry.name >= header.string_pool_size || entry.demangled_name >= header.string_pool_size) {
+      return remove_invalid_file();
+    }
+    result.push_back(Entry{entry.addr, entry.len, string_pool + entry.name,
+                           string_pool + entry.demangled_name});
+  }
+  {
+    std::lock_guard<std::mutex> lock(mapped_files_mutex_);
+    mapped_files_.push_back(std::move(map));
+  }
+  // Update modification time, so recently used files are kept in RemoveOldFiles().
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  *symbols = std::move(result);
+  return true;
+}
+
+bool SymbolCache::Store(const BuildId& build_id, const std::vector<Entry>& symbols) {
+  if (symbols.size() > std::numeric_limits<uint32_t>::max()) {
+    return false;
+  }
+  std::string string_pool;
+  std::vector<SymbolCacheEntry> entries;
+  entries.reserve(symbols.size());
+  auto add_string = [&](const char* s) {
+    uint64_t offset = string_pool.size();
+    string_pool.append(s);
+    string_pool.push_back('\0');
+    return offset;
+  };
+  for (const Entry& symbol : symbols) {
+    uint64_t name = add_string(symbol.name);
+    uint64_t demangled_name = name;
+    if (strcmp(symbol.name, symbol.demangled_name) != 0) {
+      demangled_name = add_string(symbol.demangled_name);
+    }
+    if (demangled_name > std::numeric_limits<uint32_t>::max()) {
+      return false;
+    }
+    entries.push_back(SymbolCacheEntry{symbol.addr, symbol.len, static_cast<uint32_t>(name),
+                                       static_cast<uint32_t>(demangled_name)});
+  }
+  if (string_pool.empty()) {
+    string_pool.push_back('\0');
+  }
+  SymbolCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kSymbolCacheMagic, sizeof(kSymbolCacheMagic));
+  header.version = kSymbolCacheVersion;
+  header.symbol_count = static_cast<uint32_t>(entries.size());
+  memcpy(header.build_id, build_id.Data(), BUILD_ID_SIZE);
+  header.string_pool_size = string_pool.size();
+
+  std::error_code ec;
+  if (!fs::is_directory(dir_, ec) && !fs::create_directories(dir_, ec)) {
+    LOG(WARNING) << "failed to create symbol cache dir " << dir_ << ": " << ec.message();
+    return false;
+  }
+  std::string_view header_data(reinterpret_cast<const char*>(&header), sizeof(header));
+  std::string_view entries_data(reinterpret_cast<const char*>(entries.data()),
+                                sizeof(SymbolCacheEntry) * entries.size());
+  if (!WriteFileAtomically(GetCacheFilePath(build_id),
+                           {header_data, entries_data, string_pool})) {
+    return false;
+  }
+  // Scanning the dir is much slower than storing a small file. So don't check the size limit
+  // in every Store().
+  std::lock_guard<std::mutex> lock(remove_old_files_mutex_);
+  stored_size_since_check_ += header_data.size() + entries_data.size() + string_pool.size();
+  if (!old_files_checked_ || stored_size_since_check_ > max_size_ / 8) {
+    RemoveOldFiles();
+    old_files_checked_ = true;
+    stored_size_since_check_ = 0;
+  }
+  return true;
+}
+
+void SymbolCache::RemoveOldFiles() {
+  struct CacheFile {
+    fs::path path;
+    uint64_t size;
+    fs::file_time_type time;
+  };
+  std::vector<CacheFile> files;
+  uint64_t total_size = 0;
+  std::error_code ec;
+  for (const fs::directory_entry& entry : fs::directory_iterator(dir_, ec)) {
+    if (!entry.is_regular_file(ec) ||
+        !android::base::EndsWith(entry.path().filename().string(), kSymbolCacheFileSuffix)) {
+      continue;
+    }
+    CacheFile file{entry.path(), entry.file_size(ec), entry.last_write_time(ec)};
+    if (!ec) {
+      total_size += file.size;
+      files.push_back(std::move(file));
+    }
+  }
+  if (total_size <= max_size_) {
+    return;
+  }
+  std::sort(files.begin(), files.end(),
+            [](const CacheFile& f1, const CacheFile& f2) { return f1.time < f2.time; });
+  for (const CacheFile& file : files) {
+    if (total_size <= max_size_) {
+      break;
+    }
+    LOG(DEBUG) << "remove old symbol cache file " << file.path.string();
+    if (fs::remove(file.path, ec)) {
+      total_size -= file.size;
+    }
+  }
+}
+
+BuildIdCache::BuildIdCache(const std::string& dir)
+    : file_path_(dir + OS_PATH_SEPARATOR + kBuildIdCacheFileName) {
+  Load();
+}
+
+BuildIdCache::~BuildIdCache() {
+  Save();
+}
+
+void BuildIdCache::Load() {
+  std::string content;
+  if (!android::base::ReadFileToString(file_path_, &content)) {
+    return;
+  }
+  for (const std::string& line : android::base::Split(content, "\n")) {
+    char build_id[BUILD_ID_SIZE * 2 + 1];
+    FileKey key;
+    int path_pos = 0;
+    if (sscanf(line.c_str(), "%40s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %n", build_id,
+               &key.dev, &key.inode, &key.size, &key.mtime_ns, &path_pos) != 5 ||
+        path_pos == 0 || static_cast<size_t>(path_pos) >= line.size()) {
+      continue;
+    }
+    if (entries_.size() >= kMaxBuildIdCacheEntries) {
+      break;
+    }
+    // Keep entries already checked or added by this process.
+    BuildId id = strcmp(build_id, "-") == 0 ? BuildId() : BuildId(build_id);
+    entries_.try_emplace(line.substr(path_pos), CacheEntry{key, id});
+  }
+}
+
+bool BuildIdCache::GetBuildId(const std::string& path, BuildId* build_id) {
+  auto read_build_id = [&]() {
+    ElfStatus status;
+    auto elf = ElfFile::Open(path, &status);
+    return elf && elf->GetBuildId(build_id) == ElfStatus::NO_ERROR;
+  };
+  struct stat st;
+  std::error_code ec;
+  fs::file_time_type mtime;
+  if (path.find('\n') != std::string::npos || stat(path.c_str(), &st) != 0 ||
+      !S_ISREG(st.st_mode) || (mtime = fs::last_write_time(path, ec), ec)) {
+    // Not a file we can check, like an embedded file in an apk.
+    return read_build_id();
+  }
+  auto mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch());
+  FileKey key{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+              static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(mtime_ns.count())};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = entries_.find(path); it != entries_.end() && it->second.key == key) {
+      *build_id = it->second.build_id;
+      return !build_id->IsEmpty();
+    }
+  }
+  bool result = read_build_id();
+  if (!result) {
+    *build_id = BuildId();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.size() < kMaxBuildIdCacheEntries || entries_.count(path) != 0) {
+    entries_[path] = CacheEntry{key, *build_id};
+    changed_ = true;
+  }
+  return result;
+}
+
+bool BuildIdCache::Save() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!changed_) {
+    return true;
+  }
+  // Other processes may have saved entries since we loaded the file. Merge them, so they aren't
+  // lost when we replace the file.
+  Load();
+  std::string content;
+  for (const auto& [path, entry] : entries_) {
+    const FileKey& key = entry.key;
+    content += android::base::StringPrintf(
+        "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %s\n",
+        entry.build_id.IsEmpty() ? "-" : entry.build_id.ToString().substr(2).c_str(), key.dev,
+        key.inode, key.size, key.mtime_ns, path.c_str());
+  }
+  std::error_code ec;
+  std::string dir = fs::path(file_path_).parent_path().string();
+  if (!fs::is_directory(dir, ec) && !fs::create_directories(dir, ec)) {
+    LOG(WARNING) << "failed to create symbol cache dir " << dir << ": " << ec.message();
+    return false;
+  }
+  if (!WriteFileAtomically(file_path_, {content})) {
+    return false;
+  }
+  changed_ = false;
+  return true;
+}
+
+}  // namespace simpleperf
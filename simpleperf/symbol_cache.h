@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIMPLE_PERF_SYMBOL_CACHE_H_
+#define SIMPLE_PERF_SYMBOL_CACHE_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/mapped_file.h>
+
+#include "build_id.h"
+
+namespace simpleperf {
+
+// SymbolCache stores symbol tables of ELF files in a directory, with one file for each build id.
+// So reporting profiles using the same binaries again doesn't need to parse ELF files, sort
+// symbols or demangle symbol names.
+//
+// A cache file is mapped into memory when loaded. Symbol names returned by Load() point into the
+// mapped file, which stays mapped as long as the SymbolCache object.
+//
+// The cache file format is:
+//   SymbolCacheHeader
+//   SymbolCacheEntry entries[symbol_count], sorted by addr
+//   char string_pool[string_pool_size], containing null terminated names
+class SymbolCache {
+ public:
+  struct Entry {
+    uint64_t addr;
+    uint64_t len;
+    const char* name;
+    const char* demangled_name;
+  };
+
+  // max_size limits the total size of cache files in dir. When exceeded, least recently used
+  // cache files are removed. The limit is checked in the first Store(), and again after storing
+  // max_size / 8 bytes.
+  SymbolCache(const std::string& dir, uint64_t max_size);
+
+  // Return false if there is no valid cache file for the build id.
+  bool Load(const BuildId& build_id, std::vector<Entry>* symbols);
+  // Symbols should be sorted by addr. It can be called in multiple threads.
+  bool Store(const BuildId& build_id, const std::vector<Entry>& symbols);
+
+  std::string GetCacheFilePath(const BuildId& build_id) const;
+
+ private:
+  void RemoveOldFiles();
+
+  const std::string dir_;
+  const uint64_t max_size_;
+  // Load() can be called in multiple threads by Dso::PrefetchSymbols().
+  std::mutex mapped_files_mutex_;
+  std::vector<std::unique_ptr<android::base::MappedFile>> mapped_files_;
+  std::mutex remove_old_files_mutex_;
+  bool old_files_checked_ = false;
+  uint64_t stored_size_since_check_ = 0;
+};
+
+// BuildIdCache stores build ids of ELF files in a file in the symbol cache dir. Entries are keyed
+// by file paths, and checked by device, inode, size and modification time of the files. So getting
+// build ids of unchanged files, like when recording repeatedly on a device, doesn't open them.
+//
+// Each line of the cache file is:
+//   <build_id or -> <dev> <inode> <size> <mtime_in_ns> <path>
+//
+// Save() merges entries saved by other processes since loading. But if two processes save at the
+// same time, entries only added by one of them can still be lost.
+class BuildIdCache {
+ public:
+  explicit BuildIdCache(const std::string& dir);
+  // Save the cache file if changed.
+  ~BuildIdCache();
+
+  // Return false if the file isn't an ELF file with a build id.
+  bool GetBuildId(const std::string& path, BuildId* build_id);
+  bool Save();
+
+ private:
+  struct FileKey {
+    uint64_t dev;
+    uint64_t inode;
+    uint64_t size;
+    uint64_t mtime_ns;
+
+    bool operator==(const FileKey& other) const {
+      return dev == other.dev && inode == other.inode && size == other.size &&
+             mtime_ns == other.mtime_ns;
+    }
+  };
+  struct CacheEntry {
+    FileKey key;
+    // Empty for files without build ids.
+    BuildId build_id;
+  };
+
+  // Add entries in the cache file which aren't in entries_.
+  void Load();
+
+  const std::string file_path_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, CacheEntry> entries_;
+  bool changed_ = false;
+};
+
+}  // namespace simpleperf
+
+#endif  // SIMPLE_PERF_SYMBOL_CACHE_H_
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "symbol_cache.h"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <android-base/file.h>
+
+#include "get_test_data.h"
+#include "utils.h"
+
+using namespace simpleperf;
+
+static const BuildId kBuildId1("0b12a384a9f4a3f3659b7171ca615dbec3a81f71");
+static const BuildId kBuildId2("1b12a384a9f4a3f3659b7171ca615dbec3a81f71");
+
+static std::vector<SymbolCache::Entry> GetTestSymbols() {
+  return {
+      {0x1000, 0x10, "main", "main"},
+      {0x1010, 0x20, "_Z3fooi", "foo(int)"},
+      {0x1030, 0x30, "_Z3bari", "bar(int)"},
+  };
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(SymbolCache, store_and_load) {
+  TemporaryDir tmpdir;
+  SymbolCache cache(tmpdir.path, kMegabyte);
+  std::vector<SymbolCache::Entry> symbols;
+  ASSERT_FALSE(cache.Load(kBuildId1, &symbols));
+  std::vector<SymbolCache::Entry> expected = GetTestSymbols();
+  ASSERT_TRUE(cache.Store(kBuildId1, expected));
+  ASSERT_TRUE(cache.Load(kBuildId1, &symbols));
+  ASSERT_EQ(symbols.size(), expected.size());
+  for (size_t i = 0; i < symbols.size(); i++) {
+    ASSERT_EQ(symbols[i].addr, expected[i].addr);
+    ASSERT_EQ(symbols[i].len, expected[i].len);
+    ASSERT_STREQ(symbols[i].name, expected[i].name);
+    ASSERT_STREQ(symbols[i].demangled_name, expected[i].demangled_name);
+  }
+  ASSERT_FALSE(cache.Load(kBuildId2, &symbols));
+
+  // An empty symbol table can also be cached.
+  ASSERT_TRUE(cache.Store(kBuildId2, {}));
+  ASSERT_TRUE(cache.Load(kBuildId2, &symbols));
+  ASSERT_TRUE(symbols.empty());
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(SymbolCache, store_in_multiple_threads) {
+  TemporaryDir tmpdir;
+  SymbolCache cache(tmpdir.path, kMegabyte);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 4; i++) {
+    threads.emplace_back([&]() {
+      for (size_t j = 0; j < 10; j++) {
+        ASSERT_TRUE(cache.Store(kBuildId1, GetTestSymbols()));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::vector<SymbolCache::Entry> symbols;
+  ASSERT_TRUE(cache.Load(kBuildId1, &symbols));
+  ASSERT_EQ(symbols.size(), GetTestSymbols().size());
+  // No temporary files are left.
+  ASSERT_EQ(GetEntriesInDir(tmpdir.path).size(), 1u);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(SymbolCache, remove_invalid_files) {
+  TemporaryDir tmpdir;
+  SymbolCache cache(tmpdir.path, kMegabyte);
+  ASSERT_TRUE(cache.Store(kBuildId1, GetTestSymbols()));
+  std::string path1 = cache.GetCacheFilePath(kBuildId1);
+  std::string path2 = cache.GetCacheFilePath(kBuildId2);
+
+  // Build id mismatch.
+  ASSERT_EQ(rename(path1.c_str(), path2.c_str()), 0);
+  std::vector<SymbolCache::Entry> symbols;
+  ASSERT_FALSE(cache.Load(kBuildId2, &symbols));
+  ASSERT_FALSE(IsRegularFile(path2));
+
+  // Truncated file.
+  ASSERT_TRUE(cache.Store(kBuildId1, GetTestSymbols()));
+  std::string data;
+  ASSERT_TRUE(android::base::ReadFileToString(path1, &data));
+  ASSERT_TRUE(android::base::WriteStringToFile(data.substr(0, data.size() - 1), path1));
+  ASSERT_FALSE(cache.Load(kBuildId1, &symbols));
+  ASSERT_FALSE(IsRegularFile(path1));
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(SymbolCache, remove_old_files) {
+  TemporaryDir tmpdir;
+  // With max size 0, no file is kept.
+  SymbolCache empty_cache(tmpdir.path, 0);
+  ASSERT_TRUE(empty_cache.Store(kBuildId1, GetTestSymbols()));
+  ASSERT_FALSE(IsRegularFile(empty_cache.GetCacheFilePath(kBuildId1)));
+
+  SymbolCache cache(tmpdir.path, kMegabyte);
+  ASSERT_TRUE(cache.Store(kBuildId1, GetTestSymbols()));
+  uint64_t file_size = GetFileSize(cache.GetCacheFilePath(kBuildId1));
+  ASSERT_GT(file_size, 0u);
+
+  // Keep at most one file.
+  SymbolCache small_cache(tmpdir.path, file_size + 1);
+  ASSERT_TRUE(small_cache.Store(kBuildId2, GetTestSymbols()));
+  ASSERT_EQ(IsRegularFile(small_cache.GetCacheFilePath(kBuildId1)) +
+                IsRegularFile(small_cache.GetCacheFilePath(kBuildId2)),
+            1);
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(BuildIdCache, get_build_id) {
+  TemporaryDir tmpdir;
+  std::string elf_path = std::string(tmpdir.path) + "/elf";
+  std::string elf_data;
+  ASSERT_TRUE(android::base::ReadFileToString(GetTestData(ELF_FILE), &elf_data));
+  ASSERT_TRUE(android::base::WriteStringToFile(elf_data, elf_path));
+  std::string text_path = std::string(tmpdir.path) + "/text";
+  ASSERT_TRUE(android::base::WriteStringToFile("not an elf file", text_path));
+
+  BuildId build_id;
+  {
+    BuildIdCache cache(tmpdir.path);
+    ASSERT_TRUE(cache.GetBuildId(elf_path, &build_id));
+    ASSERT_EQ(build_id, BuildId(ELF_FILE_BUILD_ID));
+    ASSERT_FALSE(cache.GetBuildId(text_path, &build_id));
+    ASSERT_FALSE(cache.GetBuildId(std::string(tmpdir.path) + "/not_exist", &build_id));
+  }
+  std::string content;
+  ASSERT_TRUE(android::base::ReadFileToString(std::string(tmpdir.path) + "/build_id_cache",
+                                              &content));
+  ASSERT_NE(content.find(elf_path), std::string::npos);
+  ASSERT_NE(content.find(text_path), std::string::npos);
+
+  // Entries are loaded in a new cache, and checked against changed files.
+  BuildIdCache cache(tmpdir.path);
+  ASSERT_TRUE(cache.GetBuildId(elf_path, &build_id));
+  ASSERT_EQ(build_id, BuildId(ELF_FILE_BUILD_ID));
+  ASSERT_TRUE(android::base::WriteStringToFile("not an elf file any more", elf_path));
+  ASSERT_FALSE(cache.GetBuildId(elf_path, &build_id));
+  ASSERT_TRUE(android::base::WriteStringToFile(elf_data, text_path));
+  ASSERT_TRUE(cache.GetBuildId(text_path, &build_id));
+  ASSERT_EQ(build_id, BuildId(ELF_FILE_BUILD_ID));
+}
+
+// @CddTest = 6.1/C-0-2
+TEST(BuildIdCache, merge_entries_saved_by_others) {
+  TemporaryDir tmpdir;
+  std::string elf_data;
+  ASSERT_TRUE(android::base::ReadFileToString(GetTestData(ELF_FILE), &elf_data));
+  std::string elf_path1 = std::string(tmpdir.path) + "/elf1";
+  std::string elf_path2 = std::string(tmpdir.path) + "/elf2";
+  ASSERT_TRUE(android::base::WriteStringToFile(elf_data, elf_path1));
+  ASSERT_TRUE(android::base::WriteStringToFile(elf_data, elf_path2));
+
+  // Like two record processes running at the same time, each adding a different file.
+  BuildIdCache cache1(tmpdir.path);
+  BuildIdCache cache2(tmpdir.path);
+  BuildId build_id;
+  ASSERT_TRUE(cache1.GetBuildId(elf_path1, &build_id));
+  ASSERT_TRUE(cache2.GetBuildId(elf_path2, &build_id));
+  ASSERT_TRUE(cache1.Save());
+  ASSERT_TRUE(cache2.Save());
+
+  std::string content;
+  ASSERT_TRUE(android::base::ReadFileToString(std::string(tmpdir.path) + "/build_id_cache",
+                                              &content));
+  ASSERT_NE(content.find(elf_path1), std::string::npos);
+  ASSERT_NE(content.find(elf_path2), std::string::npos);
+}
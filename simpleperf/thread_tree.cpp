@@ -18,6 +18,7 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <limits>
 
 #include <android-base/logging.h>
@@ -27,6 +28,7 @@
 #include "perf_event.h"
 #include "record.h"
 #include "record_file.h"
+#include "ThreadPool.h"
 #include "utils.h"
 
 namespace simpleperf {
@@ -387,6 +389,24 @@ void ThreadTree::AddDexFileOffset(const std::string& file_path, uint64_t dex_fil
   dso->AddDexFileOffset(dex_file_offset);
 }
 
+void ThreadTree::PrefetchSymbols(size_t thread_count) {
+  std::vector<Dso*> dsos;
+  for (auto& p : user_dso_tree_) {
+    if (p.second->type() == DSO_ELF_FILE) {
+      dsos.push_back(p.second.get());
+    }
+  }
+  if (thread_count <= 1 || dsos.size() <= 1) {
+    // Symbols are loaded lazily when needed.
+    return;
+  }
+  ThreadPool pool(std::min(thread_count, dsos.size()));
+  for (Dso* dso : dsos) {
+    pool.AddTask([dso](size_t) { dso->PrefetchSymbols(); });
+  }
+  pool.Wait();
+}
+
 void ThreadTree::Update(const Record& record) {
   if (record.type() == PERF_RECORD_MMAP) {
     const MmapRecord& r = *static_cast<const MmapRecord*>(&record);
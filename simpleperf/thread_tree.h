@@ -135,6 +135,9 @@ class ThreadTree {
   void ClearThreadAndMap();
   bool AddDsoInfo(FileFeature& file);
   void AddDexFileOffset(const std::string& file_path, uint64_t dex_file_offset);
+  // Load symbols of user space ELF files in parallel, using thread_count threads. It is called
+  // after adding dsos in the file feature section, and before looking for any symbols.
+  void PrefetchSymbols(size_t thread_count);
 
   // Update thread tree with information provided by record.
   void Update(const Record& record);
@@ -18,6 +18,7 @@
 
 #include <gtest/gtest.h>
 
+#include "get_test_data.h"
 #include "read_symbol_map.h"
 
 using namespace simpleperf;
@@ -157,3 +158,27 @@ TEST_F(ThreadTreeTest, invalid_fork) {
   // pid != tid && pid != ppid
   ASSERT_FALSE(thread_tree_.ForkThread(1, 2, 3, 1));
 }
+
+// @CddTest = 6.1/C-0-2
+TEST_F(ThreadTreeTest, prefetch_symbols) {
+  std::vector<std::string> files = {GetTestData(ELF_FILE), GetTestData("libc.so"),
+                                    GetTestData("elf_with_mini_debug_info")};
+  std::vector<Dso*> dsos;
+  for (const std::string& file : files) {
+    dsos.push_back(thread_tree_.FindUserDsoOrNew(file));
+  }
+  thread_tree_.PrefetchSymbols(4);
+  for (size_t i = 0; i < files.size(); i++) {
+    std::unique_ptr<Dso> expected_dso = Dso::CreateDso(DSO_ELF_FILE, files[i]);
+    expected_dso->LoadSymbols();
+    const std::vector<Symbol>& expected = expected_dso->GetSymbols();
+    ASSERT_FALSE(expected.empty());
+    dsos[i]->LoadSymbols();
+    const std::vector<Symbol>& symbols = dsos[i]->GetSymbols();
+    ASSERT_EQ(symbols.size(), expected.size());
+    for (size_t j = 0; j < symbols.size(); j++) {
+      ASSERT_EQ(symbols[j].addr, expected[j].addr);
+      ASSERT_STREQ(symbols[j].Name(), expected[j].Name());
+    }
+  }
+}
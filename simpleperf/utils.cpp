@@ -27,6 +27,7 @@
 
 #include <algorithm>
 #include <map>
+#include <mutex>
 #include <string>
 
 #include <android-base/file.h>
@@ -74,6 +75,19 @@ const char* OneTimeFreeAllocator::AllocateString(std::string_view s) {
   return result;
 }
 
+void* OneTimeFreeAllocator::Allocate(size_t size, size_t align) {
+  char* p = reinterpret_cast<char*>(Align(reinterpret_cast<uintptr_t>(cur_), align));
+  if (cur_ == nullptr || p + size > end_) {
+    size_t alloc_size = std::max(size + align, unit_size_);
+    char* block = new char[alloc_size];
+    v_.push_back(block);
+    end_ = block + alloc_size;
+    p = reinterpret_cast<char*>(Align(reinterpret_cast<uintptr_t>(block), align));
+  }
+  cur_ = p + size;
+  return p;
+}
+
 android::base::unique_fd FileHelper::OpenReadOnly(const std::string& filename) {
   int fd = TEMP_FAILURE_RETRY(open(filename.c_str(), O_RDONLY | O_BINARY));
   return android::base::unique_fd(fd);
@@ -274,8 +288,12 @@ bool XzDecompress(const std::string& compressed_data, std::string* decompressed_
   alloc.Alloc = xz_alloc;
   alloc.Free = xz_free;
   XzUnpacker_Construct(&state, &alloc);
-  CrcGenerateTable();
-  Crc64GenerateTable();
+  // The tables are global, and XzDecompress() can be called in multiple threads.
+  static std::once_flag crc_table_once;
+  std::call_once(crc_table_once, []() {
+    CrcGenerateTable();
+    Crc64GenerateTable();
+  });
   size_t src_offset = 0;
   size_t dst_offset = 0;
   std::string dst(compressed_data.size(), ' ');
@@ -23,9 +23,11 @@
 
 #include <fstream>
 #include <functional>
+#include <new>
 #include <optional>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -68,6 +70,14 @@ class OneTimeFreeAllocator {
 
   void Clear();
   const char* AllocateString(std::string_view s);
+  void* Allocate(size_t size, size_t align = alignof(max_align_t));
+
+  // Construct an object in the allocated memory. The object's destructor isn't called when the
+  // memory is freed, so the owner should call it if needed.
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
 
  private:
   const size_t unit_size_;
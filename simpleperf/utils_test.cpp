@@ -119,3 +119,20 @@ TEST(utils, ReadableCount) {
   ASSERT_EQ(ReadableCount(1000), "1,000");
   ASSERT_EQ(ReadableCount(123456789), "123,456,789");
 }
+
+// @CddTest = 6.1/C-0-2
+TEST(utils, OneTimeFreeAllocator) {
+  OneTimeFreeAllocator allocator(64);
+  // Small allocations are aligned and share blocks.
+  char* p1 = static_cast<char*>(allocator.Allocate(3, 1));
+  uint64_t* p2 = static_cast<uint64_t*>(allocator.Allocate(sizeof(uint64_t), alignof(uint64_t)));
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(p2) % alignof(uint64_t), 0u);
+  ASSERT_LT(reinterpret_cast<char*>(p2) - p1, 64);
+  // An allocation larger than the unit size gets its own block.
+  char* p3 = static_cast<char*>(allocator.Allocate(1000));
+  memset(p3, 0, 1000);
+
+  std::string* s = allocator.New<std::string>("hello");
+  ASSERT_EQ(*s, "hello");
+  s->~basic_string();
+}